@@ -0,0 +1,34 @@
+-- KEYS[1]: resource key
+-- ARGV[1]: node_id, ARGV[2]: resource limit
+-- ARGV[3]: units to reserve for the node or negative value to return them
+--
+-- returns reserved/returned units
+
+local key = KEYS[1]
+local node_id = ARGV[1]
+local limit = tonumber(ARGV[2])
+local amount = tonumber(ARGV[3])
+
+if amount < 0 then
+  -- node counter could be reset by invalidation
+  local current = tonumber(redis.call('HGET', key, node_id) or 0)
+  if current + amount < 0 then
+    amount = -current
+  end
+  if amount ~= 0 then
+    redis.call('HINCRBY', key, node_id, amount)
+  end
+  return amount
+end
+
+local total = 0
+for _, v in ipairs(redis.call('HVALS', key)) do
+  total = total + tonumber(v)
+end
+
+if total + amount > limit then
+  return 0
+end
+
+redis.call('HINCRBY', key, node_id, amount)
+return amount
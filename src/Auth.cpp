@@ -6,7 +6,10 @@
 #include "AmUtils.h"
 #include "AmJwt.h"
 #include "cfg/yeti_opts.h"
+#include "db/DbHelpers.h"
 
+#include <algorithm>
+#include <limits>
 #include <unistd.h>
 #include <botan/x509_key.h>
 
@@ -41,39 +44,11 @@ inline string find_attribute(const string &name, const string &header)
     return "";
 }
 
-void Auth::CredentialsContainer::add(const AmArg &data)
-{
-    auth_id_type id = data["id"].asInt();
-
-    if (data.hasMember("username") && data.hasMember("password")) {
-        string username = data["username"].asCStr();
-        if (!username.empty()) {
-            by_user.emplace(username, cred(id, username, data["password"].asCStr()));
-        }
-    }
-
-    if (data.hasMember("allow_jwt_auth")) {
-        auto &a = data["allow_jwt_auth"];
-        if ((isArgBool(a) && a.asBool())) {
-            allowed_jwt_auth.emplace(id);
-            if (data.hasMember("jwt_gid")) {
-                by_gid.emplace(data["jwt_gid"].asCStr(), id);
-            }
-        }
-    }
-}
-
-void Auth::CredentialsContainer::swap(CredentialsContainer &rhs)
-{
-    by_user.swap(rhs.by_user);
-    by_gid.swap(rhs.by_gid);
-    allowed_jwt_auth.swap(rhs.allowed_jwt_auth);
-}
-
 Auth::Auth(GatewaysCacheALeg &gateways_cache_aleg)
     : uac_auth(nullptr)
     , skip_logging_invite_challenge(false)
     , skip_logging_invite_success(false)
+    , credentials_snapshot(std::make_shared<const CredentialsSnapshot>())
     , gateways_cache_aleg(gateways_cache_aleg)
 {
 }
@@ -114,6 +89,9 @@ int Auth::auth_configure(cfg_t *cfg)
         }
     }
 
+    jwt_auth_cache.configure(cfg_getint(cfg, opt_name_auth_jwt_cache_size),
+                             cfg_getint(cfg, opt_name_auth_jwt_cache_max_ttl));
+
     DBG("auth_init: configured to use realms: %s, skip_logging_invite_success: %s, skip_logging_invite_challenge: %s",
         realms.print().c_str(), skip_logging_invite_success ? "true" : "false",
         skip_logging_invite_challenge ? "true" : "false");
@@ -137,21 +115,56 @@ int Auth::auth_init()
     return 0;
 }
 
+void Auth::publish_credentials()
+{
+    credentials_snapshot.store(std::make_shared<const CredentialsSnapshot>(*get_credentials(), credentials),
+                               std::memory_order_release);
+    credentials.dirty.reset();
+    jwt_auth_cache.clear();
+}
+
 void Auth::reload_credentials(const AmArg &data)
 {
     CredentialsContainer c;
 
-    AmLock l(credentials_mutex);
-
     if (isArgArray(data)) {
         for (size_t i = 0; i < data.size(); i++)
             c.add(data[i]);
     }
 
-    DBG("loaded credentials list. by_user:%zd, by_gid:%zd, allowed_jwt_auth:%d", c.by_user.size(), c.by_gid.size(),
-        c.allowed_jwt_auth.size());
+    DBG("loaded credentials list. by_user:%zd, by_gid:%zd, allowed_jwt_auth:%zd", c.creds_count(), c.gids_count(),
+        c.allowed_jwt_auth_count());
+
+    AmLock l(credentials_update_mutex);
 
     credentials.swap(c);
+    publish_credentials();
+}
+
+void Auth::apply_credentials_delta(const AmArg &data)
+{
+    if (!isArgArray(data))
+        return;
+
+    std::set<auth_id_type> changed;
+
+    AmLock l(credentials_update_mutex);
+
+    for (size_t i = 0; i < data.size(); i++) {
+        const AmArg &row = data[i];
+
+        auth_id_type id = row["id"].asInt();
+        if (changed.emplace(id).second)
+            credentials.remove(id);
+
+        if (!DbAmArg_hash_get_bool(row, "deleted"))
+            credentials.add(row);
+    }
+
+    publish_credentials();
+
+    DBG("applied credentials delta for %zd ids. by_user:%zd, by_gid:%zd, allowed_jwt_auth:%zd", changed.size(),
+        credentials.creds_count(), credentials.gids_count(), credentials.allowed_jwt_auth_count());
 }
 
 std::optional<Auth::auth_id_type> Auth::check_jwt_auth(const string &auth_hdr)
@@ -167,6 +180,19 @@ std::optional<Auth::auth_id_type> Auth::check_jwt_auth(const string &auth_hdr)
     // JWT authorization
     auto jwt_value = std::string_view(auth_hdr).substr(scheme_pos + 7);
 
+    /* generation is taken before the credentials and secrets are used for the verification
+     * to discard the result if they are reloaded meanwhile */
+    std::optional<JwtAuthCache::key_type> cache_key;
+    uint64_t                              cache_generation = 0;
+    if (jwt_auth_cache.enabled()) {
+        cache_generation = jwt_auth_cache.get_generation();
+        cache_key        = JwtAuthCache::make_key(jwt_value);
+        if (auto id = jwt_auth_cache.get(cache_key.value(), time(0)); id) {
+            DBG("JWT auth cache hit. id: %d", id.value());
+            return id;
+        }
+    }
+
     AmJwt jwt;
     if (!jwt.parse(jwt_value)) {
         DBG("failed to parse JWT: %s", jwt_value.data());
@@ -177,13 +203,15 @@ std::optional<Auth::auth_id_type> Auth::check_jwt_auth(const string &auth_hdr)
     const auto &jwt_data = jwt.get_payload();
     DBG("jwt payload: %s", jwt_data.print().data());
 
+    // tokens without 'exp' claim are cached up to the cache max ttl
+    time_t exp = std::numeric_limits<time_t>::max();
     if (jwt_data.hasMember("exp")) {
         auto &exp_arg = jwt_data["exp"];
 
         if (!exp_arg.isNumber())
             return -JWT_DATA_ERROR;
 
-        auto exp = exp_arg.asNumber<time_t>();
+        exp = exp_arg.asNumber<time_t>();
         if (time(0) > exp) {
             DBG("JWT is expired. exp:%li", exp);
             return -JWT_EXPIRED_ERROR;
@@ -213,9 +241,8 @@ std::optional<Auth::auth_id_type> Auth::check_jwt_auth(const string &auth_hdr)
         if (!isArgCStr(gid))
             return -JWT_DATA_ERROR;
 
-        AmLock l(credentials_mutex);
-        if (auto it = credentials.by_gid.find(gid.asCStr()); it != credentials.by_gid.end()) {
-            id = it->second;
+        if (auto gid_id = get_credentials()->find_gid(gid.asCStr()); gid_id) {
+            id = gid_id.value();
         } else {
             DBG("no matches for JWT gid: %s", gid.asCStr());
             return -JWT_AUTH_ERROR;
@@ -228,8 +255,7 @@ std::optional<Auth::auth_id_type> Auth::check_jwt_auth(const string &auth_hdr)
         id = id_arg.asNumber<auth_id_type>();
         DBG("JWT id: %d", id);
 
-        AmLock l(credentials_mutex);
-        if (!credentials.allowed_jwt_auth.contains(id)) {
+        if (!get_credentials()->is_jwt_auth_allowed(id)) {
             DBG("JWT auth is not allowed for: %d", id);
             return -JWT_AUTH_ERROR;
         }
@@ -256,13 +282,16 @@ std::optional<Auth::auth_id_type> Auth::check_jwt_auth(const string &auth_hdr)
         }
     }
 
+    if (cache_key)
+        jwt_auth_cache.put(cache_key.value(), id, exp, cache_generation);
+
     return id;
 }
 
-Auth::auth_id_type Auth::check_request_auth(const AmSipRequest &req, const OriginationPreAuth::Reply &ip_auth_data,
-                                            AmArg &ret)
+Auth::auth_id_type Auth::check_request_auth(const AmSipRequest &req, const SipHeadersIndex &hdrs_index,
+                                            const OriginationPreAuth::Reply &ip_auth_data, AmArg &ret)
 {
-    string auth_hdr = getHeader(req.hdrs, SIP_HDR_AUTHORIZATION);
+    string auth_hdr = hdrs_index.get(SIP_HDR_AUTHORIZATION);
     if (auth_hdr.empty()) {
         // no auth header. just continue
         return NO_AUTH;
@@ -295,25 +324,16 @@ Auth::auth_id_type Auth::check_request_auth(const AmSipRequest &req, const Origi
     return user_to_auth_id;
 #endif
 
-    credentials_mutex.lock();
-
-    auto range = credentials.by_user.equal_range(username);
-    if (range.first == credentials.by_user.end()) {
-        credentials_mutex.unlock();
+    // snapshot keeps the found credentials alive during the matching
+    auto snapshot = get_credentials();
+    auto creds    = snapshot->find_user(username);
+    if (creds.empty()) {
         DBG("no credentials for username '%s'", username.c_str());
         ret = "no credentials for username";
         return -NO_CREDENTIALS;
     }
 
-    size_t            creds_count = std::distance(range.first, range.second);
-    std::vector<cred> creds;
-    creds.reserve(creds_count);
-    for (auto it = range.first; it != range.second; ++it)
-        creds.push_back(it->second);
-
-    credentials_mutex.unlock();
-
-    DBG("there are %zd credentials for username '%s'. iterate over them", creds_count, username.c_str());
+    DBG("there are %zd credentials for username '%s'. iterate over them", creds.size(), username.c_str());
 
     AmArg args;
     args.push((AmObject *)&req);
@@ -330,9 +350,10 @@ Auth::auth_id_type Auth::check_request_auth(const AmSipRequest &req, const Origi
     for (const auto &c : creds) {
         ret.clear();
 
-        DBG("match against %d/%s/%s", c.id, c.username.c_str(), c.password.c_str());
+        DBG("match against %d/%.*s/%.*s", c.id, static_cast<int>(c.username.size()), c.username.data(),
+            static_cast<int>(c.password.size()), c.password.data());
 
-        args[3] = c.password;
+        args[3] = string(c.password);
         uac_auth->invoke("checkAuth", args, ret);
 
         int reply_code = ret[0].asInt();
@@ -367,27 +388,30 @@ void Auth::auth_info(AmArg &ret)
 {
     ret.assertStruct();
 
-    AmLock l(credentials_mutex);
+    auto snapshot = get_credentials();
 
     auto &by_user_arg = ret["users"];
     by_user_arg.assertArray();
-    for (const auto &[user, c] : credentials.by_user) {
+    snapshot->for_each_cred([&by_user_arg](const CredentialsSnapshot::cred &c) {
         by_user_arg.push({
-            {   "id",       c.id },
-            { "user",       user },
-            {  "pwd", c.password }
+            {   "id",               c.id },
+            { "user", string(c.username) },
+            {  "pwd", string(c.password) }
         });
-    }
+    });
 
     auto &by_gid_arg = ret["jwt_gid"];
     by_gid_arg.assertStruct();
-    for (const auto &[gid, id] : credentials.by_gid) {
-        by_gid_arg[gid] = id;
-    }
+    snapshot->for_each_gid(
+        [&by_gid_arg](const CredentialsSnapshot::gid_entry &g) { by_gid_arg[string(g.key)] = g.id; });
+
+    std::vector<auth_id_type> allowed_jwt_auth;
+    snapshot->for_each_allowed_jwt_auth([&allowed_jwt_auth](auth_id_type id) { allowed_jwt_auth.push_back(id); });
+    std::sort(allowed_jwt_auth.begin(), allowed_jwt_auth.end());
 
     auto &allow_jwt_auth_arg = ret["allow_jwt_auth"];
     allow_jwt_auth_arg.assertArray();
-    for (auto id : credentials.allowed_jwt_auth)
+    for (auto id : allowed_jwt_auth)
         allow_jwt_auth_arg.push(id);
 }
 
@@ -395,29 +419,19 @@ void Auth::auth_info_by_user(const string &username, AmArg &ret)
 {
     ret.assertArray();
 
-    credentials_mutex.lock();
-
-    auto range = credentials.by_user.equal_range(username);
-    if (range.first == credentials.by_user.end()) {
-        credentials_mutex.unlock();
+    auto snapshot = get_credentials();
+    auto creds    = snapshot->find_user(username);
+    if (creds.empty()) {
         DBG("no credentials for username '%s'", username.c_str());
         return;
     }
 
-    size_t            creds_count = std::distance(range.first, range.second);
-    std::vector<cred> creds;
-    creds.reserve(creds_count);
-    for (auto it = range.first; it != range.second; ++it)
-        creds.push_back(it->second);
-
-    credentials_mutex.unlock();
-
     for (const auto &c : creds) {
         ret.push(AmArg());
         AmArg &a  = ret.back();
         a["id"]   = c.id;
-        a["user"] = c.username;
-        a["pwd"]  = c.password;
+        a["user"] = string(c.username);
+        a["pwd"]  = string(c.password);
     }
 }
 
@@ -425,31 +439,30 @@ void Auth::auth_info_by_id(auth_id_type id, AmArg &ret)
 {
     ret.assertStruct();
 
-    AmLock l(credentials_mutex);
+    auto snapshot = get_credentials();
 
     auto &by_user_arg = ret["users"];
     by_user_arg.assertArray();
-    for (const auto &[user, c] : credentials.by_user) {
+    snapshot->for_each_cred([id, &by_user_arg](const CredentialsSnapshot::cred &c) {
         if (c.id != id)
-            continue;
+            return;
         by_user_arg.push({
-            {   "id",       c.id },
-            { "user",       user },
-            {  "pwd", c.password }
+            {   "id",               c.id },
+            { "user", string(c.username) },
+            {  "pwd", string(c.password) }
         });
-    }
+    });
 
 
     auto &by_gid_arg = ret["jwt_gid"];
     by_gid_arg.assertStruct();
-    for (const auto &[gid, auth_id] : credentials.by_gid) {
-        if (id != auth_id)
-            continue;
-        by_gid_arg[gid] = id;
-    }
+    snapshot->for_each_gid([id, &by_gid_arg](const CredentialsSnapshot::gid_entry &g) {
+        if (id == g.id)
+            by_gid_arg[string(g.key)] = id;
+    });
 
     auto &allow_jwt_auth_arg = ret["allow_jwt_auth"];
     allow_jwt_auth_arg.assertArray();
-    if (credentials.allowed_jwt_auth.contains(id))
+    if (snapshot->is_jwt_auth_allowed(id))
         allow_jwt_auth_arg.push(id);
 }
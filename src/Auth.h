@@ -5,8 +5,10 @@
 #include "AmThread.h"
 #include "OriginationPreAuth.h"
 #include "GatewaysCache.h"
+#include "AuthCredentials.h"
+#include "JwtAuthCache.h"
 
-#include <unordered_map>
+#include <atomic>
 #include <optional>
 
 #include <confuse.h>
@@ -30,7 +32,7 @@ class Auth {
         UAC_AUTH_ERROR = 10
     };
 
-    using auth_id_type = int;
+    using auth_id_type = CredentialsContainer::auth_id_type;
 
   private:
     AmDynInvoke                       *uac_auth;
@@ -39,32 +41,20 @@ class Auth {
     bool                               skip_logging_invite_challenge;
     bool                               skip_logging_invite_success;
     std::unique_ptr<Botan::Public_Key> jwt_public_key;
+    JwtAuthCache                       jwt_auth_cache;
 
-    struct cred {
-        auth_id_type id;
-        std::string  username;
-        std::string  password;
-        cred(int id, std::string username, std::string password)
-            : id(id)
-            , username(username)
-            , password(password)
-        {
-        }
-    };
-
-    struct CredentialsContainer {
-        std::unordered_multimap<std::string, struct cred> by_user;
-        std::unordered_map<std::string, auth_id_type>     by_gid;
-        std::set<auth_id_type>                            allowed_jwt_auth;
-
-        void add(const AmArg &data);
-        void swap(CredentialsContainer &rhs);
-    } credentials;
-    AmMutex credentials_mutex;
+    /* credentials_update_mutex serializes reloads of the credentials container.
+     * lookups use immutable snapshot built on each change and do not take locks */
+    CredentialsContainer                credentials;
+    AmMutex                             credentials_update_mutex;
+    std::atomic<CredentialsSnapshotPtr> credentials_snapshot;
 
     GatewaysCacheALeg          &gateways_cache_aleg;
     std::optional<auth_id_type> check_jwt_auth(const string &auth_hdr);
 
+    CredentialsSnapshotPtr get_credentials() const { return credentials_snapshot.load(std::memory_order_acquire); }
+    void                   publish_credentials();
+
   protected:
     int auth_configure(cfg_t *cfg);
     int auth_init();
@@ -79,16 +69,23 @@ class Auth {
     void auth_info_by_id(auth_id_type id, AmArg &ret);
 
     void reload_credentials(const AmArg &data);
+    /* rows of the changed ids replace all their credentials.
+     * id with the single row with 'deleted' flag is removed */
+    void apply_credentials_delta(const AmArg &data);
+    /* must be called when the HS256 secrets are changed */
+    void clear_jwt_auth_cache() { jwt_auth_cache.clear(); }
 
     /**
      * @brief check_request_auth
      * checks auth if Authorization header is present
      * @param req INVITE request
+     * @param hdrs_index index of the req headers
      * @return >0 (auth_id) if succ authenticiated,
      *         =0 to continue (no Authorization header)
      *         <0 on error
      */
-    auth_id_type check_request_auth(const AmSipRequest &req, const OriginationPreAuth::Reply &ip_auth_data, AmArg &ret);
+    auth_id_type check_request_auth(const AmSipRequest &req, const SipHeadersIndex &hdrs_index,
+                                    const OriginationPreAuth::Reply &ip_auth_data, AmArg &ret);
 
     bool is_skip_logging_invite_challenge() { return skip_logging_invite_challenge; }
     bool is_skip_logging_invite_success() { return skip_logging_invite_success; }
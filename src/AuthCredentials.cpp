@@ -0,0 +1,222 @@
+#include "AuthCredentials.h"
+
+#include <algorithm>
+
+void CredentialsContainer::add(const AmArg &data)
+{
+    auth_id_type id = data["id"].asInt();
+
+    if (data.hasMember("username") && data.hasMember("password")) {
+        string username = data["username"].asCStr();
+        if (!username.empty()) {
+            auto n = shard_of(username);
+            shards[n].by_user.emplace(username, cred(id, username, data["password"].asCStr()));
+            dirty.set(n);
+            by_id[id].usernames.emplace_back(username);
+        }
+    }
+
+    if (data.hasMember("allow_jwt_auth")) {
+        auto &a = data["allow_jwt_auth"];
+        if ((isArgBool(a) && a.asBool())) {
+            auto n = shard_of(id);
+            shards[n].allowed_jwt_auth.emplace(id);
+            dirty.set(n);
+            if (data.hasMember("jwt_gid")) {
+                string gid = data["jwt_gid"].asCStr();
+                n          = shard_of(gid);
+                if (shards[n].by_gid.emplace(gid, id).second) {
+                    dirty.set(n);
+                    by_id[id].gids.emplace_back(std::move(gid));
+                }
+            }
+        }
+    }
+}
+
+void CredentialsContainer::remove(auth_id_type id)
+{
+    auto n = shard_of(id);
+    if (shards[n].allowed_jwt_auth.erase(id))
+        dirty.set(n);
+
+    auto it = by_id.find(id);
+    if (it == by_id.end())
+        return;
+
+    for (const auto &username : it->second.usernames) {
+        n                 = shard_of(username);
+        auto &by_user     = shards[n].by_user;
+        auto [begin, end] = by_user.equal_range(username);
+        for (auto user_it = begin; user_it != end;) {
+            if (user_it->second.id == id)
+                user_it = by_user.erase(user_it);
+            else
+                ++user_it;
+        }
+        dirty.set(n);
+    }
+
+    for (const auto &gid : it->second.gids) {
+        n = shard_of(gid);
+        shards[n].by_gid.erase(gid);
+        dirty.set(n);
+    }
+
+    by_id.erase(it);
+}
+
+void CredentialsContainer::swap(CredentialsContainer &rhs)
+{
+    shards.swap(rhs.shards);
+    by_id.swap(rhs.by_id);
+    dirty.set();
+    rhs.dirty.set();
+}
+
+size_t CredentialsContainer::creds_count() const
+{
+    size_t count = 0;
+    for (const auto &s : shards)
+        count += s.by_user.size();
+    return count;
+}
+
+size_t CredentialsContainer::gids_count() const
+{
+    size_t count = 0;
+    for (const auto &s : shards)
+        count += s.by_gid.size();
+    return count;
+}
+
+size_t CredentialsContainer::allowed_jwt_auth_count() const
+{
+    size_t count = 0;
+    for (const auto &s : shards)
+        count += s.allowed_jwt_auth.size();
+    return count;
+}
+
+CredentialsSnapshot::shard::shard(const CredentialsContainer::shard &c)
+{
+    /* offsets are collected first because string_view
+     * can point to the pool only after it stops growing */
+    struct interned {
+        size_t offset;
+        size_t len;
+    };
+    std::unordered_map<std::string_view, interned> interned_strings;
+
+    auto intern = [this, &interned_strings](const std::string &s) -> interned {
+        auto [it, inserted] = interned_strings.try_emplace(s, interned{ pool.size(), s.size() });
+        if (inserted)
+            pool.append(s);
+        return it->second;
+    };
+    auto view = [this](const interned &i) { return std::string_view(pool.data() + i.offset, i.len); };
+
+    struct interned_cred {
+        auth_id_type id;
+        interned     username;
+        interned     password;
+    };
+    std::vector<interned_cred> tmp_creds;
+    tmp_creds.reserve(c.by_user.size());
+    for (const auto &[username, cr] : c.by_user)
+        tmp_creds.emplace_back(interned_cred{ cr.id, intern(username), intern(cr.password) });
+
+    std::vector<std::pair<interned, auth_id_type>> tmp_gids;
+    tmp_gids.reserve(c.by_gid.size());
+    for (const auto &[gid, id] : c.by_gid)
+        tmp_gids.emplace_back(intern(gid), id);
+
+    pool.shrink_to_fit();
+
+    // equal usernames are interned once, so grouping by the offset is enough
+    std::stable_sort(tmp_creds.begin(), tmp_creds.end(), [](const interned_cred &lhs, const interned_cred &rhs) {
+        return lhs.username.offset < rhs.username.offset;
+    });
+
+    creds.reserve(tmp_creds.size());
+    for (const auto &cr : tmp_creds) {
+        auto username = view(cr.username);
+        if (users.empty() || users.back().key.data() != username.data())
+            users.emplace_back(user_entry{ username, static_cast<uint32_t>(creds.size()), 0 });
+        users.back().count++;
+        creds.emplace_back(cred{ cr.id, username, view(cr.password) });
+    }
+
+    gids.reserve(tmp_gids.size());
+    for (const auto &[gid, id] : tmp_gids)
+        gids.emplace_back(gid_entry{ view(gid), id });
+
+    allowed_jwt_auth.assign(c.allowed_jwt_auth.begin(), c.allowed_jwt_auth.end());
+
+    users_index.build(users);
+    gids_index.build(gids);
+}
+
+CredentialsSnapshot::CredentialsSnapshot(const CredentialsContainer &c)
+{
+    for (size_t n = 0; n < shards.size(); n++)
+        shards[n] = std::make_shared<const shard>(c.shards[n]);
+}
+
+CredentialsSnapshot::CredentialsSnapshot(const CredentialsSnapshot &prev, const CredentialsContainer &c)
+{
+    for (size_t n = 0; n < shards.size(); n++) {
+        if (c.dirty.test(n) || !prev.shards[n])
+            shards[n] = std::make_shared<const shard>(c.shards[n]);
+        else
+            shards[n] = prev.shards[n];
+    }
+}
+
+std::span<const CredentialsSnapshot::cred> CredentialsSnapshot::find_user(std::string_view username) const
+{
+    const auto &s = shards[CredentialsContainer::shard_of(username)];
+    if (!s)
+        return {};
+    if (auto e = s->users_index.find(s->users, username); e)
+        return std::span<const cred>(s->creds.data() + e->first, e->count);
+    return {};
+}
+
+std::optional<CredentialsSnapshot::auth_id_type> CredentialsSnapshot::find_gid(std::string_view gid) const
+{
+    const auto &s = shards[CredentialsContainer::shard_of(gid)];
+    if (!s)
+        return std::nullopt;
+    if (auto e = s->gids_index.find(s->gids, gid); e)
+        return e->id;
+    return std::nullopt;
+}
+
+bool CredentialsSnapshot::is_jwt_auth_allowed(auth_id_type id) const
+{
+    const auto &s = shards[CredentialsContainer::shard_of(id)];
+    if (!s)
+        return false;
+    return std::binary_search(s->allowed_jwt_auth.begin(), s->allowed_jwt_auth.end(), id);
+}
+
+size_t CredentialsSnapshot::get_users_count() const
+{
+    size_t count = 0;
+    for (const auto &s : shards) {
+        if (s)
+            count += s->users.size();
+    }
+    return count;
+}
+
+size_t CredentialsSnapshot::get_shared_shards_count(const CredentialsSnapshot &other) const
+{
+    size_t count = 0;
+    for (size_t n = 0; n < shards.size(); n++) {
+        if (shards[n] && shards[n] == other.shards[n])
+            count++;
+    }
+    return count;
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "AmArg.h"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* credentials are split into the shards by the username, jwt gid and id.
+ * CredentialsSnapshot rebuilds only the shards changed since the previous snapshot */
+#define CREDENTIALS_SHARDS_BITS  6
+#define CREDENTIALS_SHARDS_COUNT (1 << CREDENTIALS_SHARDS_BITS)
+
+/* mutable credentials storage. used on the reload side only
+ * to apply delta changes and to build CredentialsSnapshot */
+struct CredentialsContainer {
+    using auth_id_type = int;
+
+    struct cred {
+        auth_id_type id;
+        std::string  username;
+        std::string  password;
+        cred(int id, std::string username, std::string password)
+            : id(id)
+            , username(username)
+            , password(password)
+        {
+        }
+    };
+
+    struct id_keys {
+        std::vector<std::string> usernames;
+        std::vector<std::string> gids;
+    };
+
+    struct shard {
+        std::unordered_multimap<std::string, struct cred> by_user;
+        std::unordered_map<std::string, auth_id_type>     by_gid;
+        std::set<auth_id_type>                            allowed_jwt_auth;
+    };
+
+    std::array<shard, CREDENTIALS_SHARDS_COUNT> shards;
+    std::unordered_map<auth_id_type, id_keys>   by_id; // to remove entries on delta reload
+    std::bitset<CREDENTIALS_SHARDS_COUNT>       dirty; // shards changed since the last snapshot
+
+    // high bits of the hash. low ones are used by the snapshot indexes
+    static size_t shard_of(std::string_view key)
+    {
+        return std::hash<std::string_view>{}(key) >> (std::numeric_limits<size_t>::digits - CREDENTIALS_SHARDS_BITS);
+    }
+    static size_t shard_of(auth_id_type id) { return static_cast<size_t>(id) % CREDENTIALS_SHARDS_COUNT; }
+
+    void add(const AmArg &data);
+    void remove(auth_id_type id);
+    /* marks all shards dirty */
+    void swap(CredentialsContainer &rhs);
+
+    size_t creds_count() const;
+    size_t gids_count() const;
+    size_t allowed_jwt_auth_count() const;
+};
+
+/* immutable credentials lookup tables shared with the auth readers.
+ * unchanged shards are shared with the previous snapshot.
+ * strings of the shard are interned into the single pool and referenced by string_view.
+ * usernames and jwt gids are indexed by the flat open addressing tables with linear probing.
+ * credentials with the same username are stored contiguously */
+class CredentialsSnapshot {
+  public:
+    using auth_id_type = CredentialsContainer::auth_id_type;
+
+    struct cred {
+        auth_id_type     id;
+        std::string_view username;
+        std::string_view password;
+    };
+
+    struct user_entry {
+        std::string_view key;
+        uint32_t         first;
+        uint32_t         count;
+    };
+
+    struct gid_entry {
+        std::string_view key;
+        auth_id_type     id;
+    };
+
+  private:
+    template <typename Entry> class FlatIndex {
+        struct slot {
+            size_t   hash;
+            uint32_t pos; // 1-based position in the entries vector. 0 for the empty slot
+        };
+        std::vector<slot> slots;
+        size_t            mask;
+
+      public:
+        FlatIndex()
+            : mask(0)
+        {
+        }
+
+        // load factor is kept not greater than 0.5
+        void build(const std::vector<Entry> &entries)
+        {
+            size_t capacity = 8;
+            while (capacity < entries.size() * 2)
+                capacity <<= 1;
+
+            slots.assign(capacity, slot{ 0, 0 });
+            mask = capacity - 1;
+
+            for (uint32_t i = 0; i < entries.size(); i++) {
+                size_t h = std::hash<std::string_view>{}(entries[i].key);
+                size_t n = h & mask;
+                while (slots[n].pos)
+                    n = (n + 1) & mask;
+                slots[n] = slot{ h, i + 1 };
+            }
+        }
+
+        const Entry *find(const std::vector<Entry> &entries, std::string_view key) const
+        {
+            if (slots.empty())
+                return nullptr;
+
+            size_t h = std::hash<std::string_view>{}(key);
+            for (size_t n = h & mask; slots[n].pos; n = (n + 1) & mask) {
+                const auto &s = slots[n];
+                if (s.hash == h && entries[s.pos - 1].key == key)
+                    return &entries[s.pos - 1];
+            }
+            return nullptr;
+        }
+    };
+
+    struct shard {
+        std::string               pool;
+        std::vector<cred>         creds;
+        std::vector<user_entry>   users;
+        std::vector<gid_entry>    gids;
+        std::vector<auth_id_type> allowed_jwt_auth; // sorted
+        FlatIndex<user_entry>     users_index;
+        FlatIndex<gid_entry>      gids_index;
+
+        shard(const CredentialsContainer::shard &c);
+
+        shard(const shard &)            = delete;
+        shard &operator=(const shard &) = delete;
+    };
+
+    std::array<std::shared_ptr<const shard>, CREDENTIALS_SHARDS_COUNT> shards;
+
+  public:
+    CredentialsSnapshot() = default;
+    CredentialsSnapshot(const CredentialsContainer &c);
+    /* rebuilds the dirty shards of the container. other shards are shared with prev */
+    CredentialsSnapshot(const CredentialsSnapshot &prev, const CredentialsContainer &c);
+
+    CredentialsSnapshot(const CredentialsSnapshot &)            = delete;
+    CredentialsSnapshot &operator=(const CredentialsSnapshot &) = delete;
+
+    std::span<const cred>       find_user(std::string_view username) const;
+    std::optional<auth_id_type> find_gid(std::string_view gid) const;
+    bool                        is_jwt_auth_allowed(auth_id_type id) const;
+
+    template <typename F> void for_each_cred(F f) const
+    {
+        for (const auto &s : shards) {
+            if (!s)
+                continue;
+            for (const auto &c : s->creds)
+                f(c);
+        }
+    }
+    template <typename F> void for_each_gid(F f) const
+    {
+        for (const auto &s : shards) {
+            if (!s)
+                continue;
+            for (const auto &g : s->gids)
+                f(g);
+        }
+    }
+    template <typename F> void for_each_allowed_jwt_auth(F f) const
+    {
+        for (const auto &s : shards) {
+            if (!s)
+                continue;
+            for (auto id : s->allowed_jwt_auth)
+                f(id);
+        }
+    }
+
+    size_t get_users_count() const;
+    /* count of the shards shared with other snapshot */
+    size_t get_shared_shards_count(const CredentialsSnapshot &other) const;
+};
+
+using CredentialsSnapshotPtr = std::shared_ptr<const CredentialsSnapshot>;
@@ -195,7 +195,7 @@ ResourceList &CallCtx::getCurrentResourceList()
     return (*current_profile).rl;
 }
 
-string &CallCtx::getResourceHandler(SqlCallProfile &profile, bool a_leg)
+ResourceHandler &CallCtx::getResourceHandler(SqlCallProfile &profile, bool a_leg)
 {
     return profile.legab_res_mode_enabled ? (a_leg ? lega_resource_handler : profile.resource_handler)
                                           : profile.resource_handler;
@@ -226,6 +226,7 @@ CallCtx::CallCtx(SqlRouter &router)
     , ringing_timeout(false)
     , ringing_sent(false)
     , transfer_intermediate_state(false)
+    , lega_resource_handler(0)
     , router(router)
 {
     current_profile = profiles.end();
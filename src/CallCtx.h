@@ -51,7 +51,7 @@ struct CallCtx {
 
     AmSdp bleg_initial_offer;
 
-    string lega_resource_handler;
+    ResourceHandler lega_resource_handler;
 
     SqlRouter &router;
 
@@ -76,5 +76,5 @@ struct CallCtx {
     ResourceList &getCurrentResourceList();
     int           getOverrideId(bool aleg = true);
 
-    string &getResourceHandler(SqlCallProfile &profile, bool a_leg = false);
+    ResourceHandler &getResourceHandler(SqlCallProfile &profile, bool a_leg = false);
 };
@@ -1,7 +1,18 @@
 #include "CallProfilesCache.h"
+#include "SqlCallProfile.h"
 #include "yeti.h"
 #include "jsonArg.h"
 
+CallProfilesCache::CallProfilesCache()
+    : overlaid_profiles(stat_group(Counter, MOD_NAME, "callprofiles_overlaid")
+                            .setHelp("call profiles completed over the materialized cached profile")
+                            .addAtomicCounter())
+    , merged_profiles(stat_group(Counter, MOD_NAME, "callprofiles_merged")
+                          .setHelp("call profiles read from the tuple merged with the cached data")
+                          .addAtomicCounter())
+{
+}
+
 void CallProfilesCache::merge_cached_profile_data(AmArg &profile_data, const AmArg &cached_data)
 {
     for (const auto &it : *cached_data.asStruct()) {
@@ -10,10 +21,35 @@ void CallProfilesCache::merge_cached_profile_data(AmArg &profile_data, const AmA
     }
 }
 
-void CallProfilesCache::load_callprofiles(const PGResponse &e)
+std::shared_ptr<const SqlCallProfile> CallProfilesCache::materialize(const AmArg &data, const DynFieldsT &df,
+                                                                     const std::string &lega_gw_cache_key,
+                                                                     const std::string &legb_gw_cache_key)
 {
-    int                                    common_profile_idx = -1;
-    std::unordered_map<std::string, AmArg> new_cache;
+    // radius placeholders are built from the whole merged tuple
+    if (Yeti::instance().config.use_radius)
+        return nullptr;
+
+    auto profile = std::make_shared<SqlCallProfile>();
+    try {
+        if (!profile->readFromTuple(data, std::string(), df, lega_gw_cache_key, legb_gw_cache_key))
+            return nullptr;
+    } catch (...) {
+        // will be reported on the per-call reading
+        return nullptr;
+    }
+
+    // refusing profiles skip the most of the fields
+    if (profile->disconnect_code_id != 0)
+        return nullptr;
+
+    return profile;
+}
+
+void CallProfilesCache::load_callprofiles(const PGResponse &e, const DynFieldsT &df,
+                                          const std::string &lega_gw_cache_key, const std::string &legb_gw_cache_key)
+{
+    int                                             common_profile_idx = -1;
+    std::unordered_map<std::string, cached_profile> new_cache;
 
     for (size_t i = 0; i < e.result.size(); i++) {
         const AmArg &a = e.result.get(i);
@@ -49,18 +85,29 @@ void CallProfilesCache::load_callprofiles(const PGResponse &e)
             continue;
         }
 
-        new_cache.emplace(cache_id_str, a);
+        new_cache.emplace(cache_id_str, cached_profile{ a, nullptr });
+    }
+
+    AmArg                                 new_common_profile_data;
+    std::shared_ptr<const SqlCallProfile> new_common_profile;
+    if (common_profile_idx >= 0) {
+        new_common_profile_data = e.result.get(common_profile_idx);
+        new_common_profile = materialize(new_common_profile_data, df, lega_gw_cache_key, legb_gw_cache_key);
+    }
+
+    // pre-parse cached profiles once instead of the merging and reading for every call
+    for (auto &it : new_cache) {
+        AmArg merged(it.second.data);
+        if (!new_common_profile_data.is<AmArg::Undef>())
+            merge_cached_profile_data(merged, new_common_profile_data);
+        it.second.profile = materialize(merged, df, lega_gw_cache_key, legb_gw_cache_key);
     }
 
     AmLock l(cache_mutex);
 
     cache.swap(new_cache);
-
-    if (common_profile_idx >= 0) {
-        common_profile_data = e.result.get(common_profile_idx);
-    } else {
-        common_profile_data.clear();
-    }
+    common_profile_data = new_common_profile_data;
+    common_profile.swap(new_common_profile);
 }
 
 bool CallProfilesCache::complete_profile(AmArg &profile_data)
@@ -91,7 +138,7 @@ bool CallProfilesCache::complete_profile(AmArg &profile_data)
             return false;
         }
 
-        merge_cached_profile_data(profile_data, it->second);
+        merge_cached_profile_data(profile_data, it->second.data);
     }
 
     if (!common_profile_data.is<AmArg::Undef>()) {
@@ -100,3 +147,24 @@ bool CallProfilesCache::complete_profile(AmArg &profile_data)
 
     return true;
 }
+
+std::shared_ptr<const SqlCallProfile> CallProfilesCache::get_profile(const AmArg &profile_data)
+{
+    if (!profile_data.hasMember("cache_id")) {
+        AmLock l(cache_mutex);
+        return common_profile;
+    }
+
+    const auto &cache_id = profile_data["cache_id"];
+
+    AmLock l(cache_mutex);
+
+    if (!cache_id.is<AmArg::CStr>())
+        return common_profile;
+
+    const auto it = cache.find(cache_id.asCStr());
+    if (it == cache.end())
+        return nullptr;
+
+    return it->second.profile;
+}
@@ -2,21 +2,51 @@
 
 #include <AmArg.h>
 #include <AmThread.h>
+#include <AmStatistics.h>
 #include <ampi/PostgreSqlAPI.h>
 
+#include "db/DbTypes.h"
+
 #include <unordered_map>
+#include <memory>
+
+struct SqlCallProfile;
 
 class CallProfilesCache {
   private:
-    std::unordered_map<std::string, AmArg> cache;
-    AmMutex                                cache_mutex;
+    struct cached_profile {
+        AmArg data;
+        // typed profile read from the data merged with the common profile
+        std::shared_ptr<const SqlCallProfile> profile;
+    };
+
+    std::unordered_map<std::string, cached_profile> cache;
+    AmMutex                                         cache_mutex;
+
+    AmArg                                 common_profile_data;
+    std::shared_ptr<const SqlCallProfile> common_profile;
 
-    AmArg common_profile_data;
+    AtomicCounter &overlaid_profiles;
+    AtomicCounter &merged_profiles;
 
     static void merge_cached_profile_data(AmArg &profile_data, const AmArg &cached_data);
 
+    static std::shared_ptr<const SqlCallProfile> materialize(const AmArg &data, const DynFieldsT &df,
+                                                             const std::string &lega_gw_cache_key,
+                                                             const std::string &legb_gw_cache_key);
+
   public:
-    void load_callprofiles(const PGResponse &e);
+    CallProfilesCache();
+
+    void load_callprofiles(const PGResponse &e, const DynFieldsT &df, const std::string &lega_gw_cache_key,
+                           const std::string &legb_gw_cache_key);
 
     bool complete_profile(AmArg &profile_Data);
+
+    /* materialized profile for the cached data referenced by the per-call profile_data.
+     * nullptr if there is no one and complete_profile() + readFromTuple() must be used */
+    std::shared_ptr<const SqlCallProfile> get_profile(const AmArg &profile_data);
+
+    void inc_overlaid() { overlaid_profiles.inc(); }
+    void inc_merged() { merged_profiles.inc(); }
 };
@@ -0,0 +1,22 @@
+#include "CallSetupStats.h"
+
+#define CALL_SETUP_STAGE_HISTOGRAM MOD_NAME "_call_setup_stage_duration_usec"
+
+static const char *stage_names[CallSetupStats::STAGES_COUNT] = {
+    "pre_auth",     "auth",            "getprofile",     "complete_profile",
+    "read_profile", "resources_check", "sdp_processing", "first_bleg_invite",
+};
+
+CallSetupStats::CallSetupStats()
+{
+    auto &h = LatencyHistograms::instance();
+    for (int i = 0; i < STAGES_COUNT; i++)
+        stages[i] = &h.add(CALL_SETUP_STAGE_HISTOGRAM, { { "stage", stage_names[i] } });
+    h.setHelp(CALL_SETUP_STAGE_HISTOGRAM, "initial INVITE processing stages duration in microseconds");
+}
+
+CallSetupStats &CallSetupStats::instance()
+{
+    static CallSetupStats *_instance = new CallSetupStats();
+    return *_instance;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <sys/time.h>
+
+/* initial INVITE processing stages latency histograms.
+ * exported as yeti_call_setup_stage_duration_usec{stage="<name>"} */
+class CallSetupStats {
+  public:
+    enum stage_t {
+        PRE_AUTH = 0,      // origination IP pre auth
+        AUTH,              // request auth (ip/digest/jwt)
+        GETPROFILE,        // getprofile DB round trip
+        COMPLETE_PROFILE,  // CallProfilesCache::complete_profile
+        READ_PROFILE,      // SqlCallProfile::readFromTuple
+        RESOURCES_CHECK,   // throttling and resources check/grab for all attempts
+        SDP_PROCESSING,    // initial SDP offer processing and filtering
+        FIRST_BLEG_INVITE, // from the INVITE receiving to the first B-leg INVITE
+        STAGES_COUNT
+    };
+
+  private:
+    LatencyHistogram *stages[STAGES_COUNT];
+
+    CallSetupStats();
+
+  public:
+    static CallSetupStats &instance();
+
+    LatencyHistogram &operator[](stage_t stage) { return *stages[stage]; }
+
+    void add(stage_t stage, const LatencyHistogram::clock::time_point &start) { stages[stage]->add(start); }
+    void add(stage_t stage, const struct timeval &start) { stages[stage]->add(start); }
+};
@@ -1,35 +1,159 @@
 #include "GatewayStats.h"
 
-void GatewayStats::cleanup_obsolete_time_slots(int now)
+#include <algorithm>
+
+#define SLOT_COUNTER_MAX 0xffff
+
+static inline uint64_t slot_pack(int time, uint64_t failed, uint64_t success)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(time)) << 32) | (failed << 16) | success;
+}
+
+static inline int slot_time(uint64_t v)
+{
+    return static_cast<int>(static_cast<uint32_t>(v >> 32));
+}
+
+static inline int slot_failed(uint64_t v)
+{
+    return static_cast<int>((v >> 16) & SLOT_COUNTER_MAX);
+}
+
+static inline int slot_success(uint64_t v)
 {
-    auto window_start = now - window_size;
-    for (auto it = time_slots.begin(); it != time_slots.end() && it->first < window_start;) {
-        global.failed_replies -= it->second.failed_replies;
-        global.success_replies -= it->second.success_replies;
-        it = time_slots.erase(it);
+    return static_cast<int>(v & SLOT_COUNTER_MAX);
+}
+
+GatewayStats::GatewayStats(int window_size_seconds)
+    : window_size(std::max(window_size_seconds, 1))
+    , last_time(0)
+    , failed_replies(0)
+    , success_replies(0)
+{
+    time_slots.reset(new std::atomic<uint64_t>[window_size]);
+    for (int i = 0; i < window_size; i++)
+        time_slots[i].store(0, std::memory_order_relaxed);
+}
+
+GatewayStats::GatewayStats(int window_size_seconds, const GatewayStats &src)
+    : GatewayStats(window_size_seconds)
+{
+    int now = src.last_time.load(std::memory_order_relaxed);
+    last_time.store(now, std::memory_order_relaxed);
+
+    // distinct seconds within the new window never share the slot
+    for (int i = 0; i < src.window_size; i++) {
+        auto v = src.time_slots[i].load(std::memory_order_relaxed);
+        auto t = slot_time(v);
+        if (t <= now - window_size || t > now)
+            continue;
+        time_slots[slot_index(t)].store(v, std::memory_order_relaxed);
+        failed_replies.fetch_add(slot_failed(v), std::memory_order_relaxed);
+        success_replies.fetch_add(slot_success(v), std::memory_order_relaxed);
     }
+
+    throttled_requests          = src.throttled_requests.load(std::memory_order_relaxed);
+    throttled_requests_randomly = src.throttled_requests_randomly.load(std::memory_order_relaxed);
+    checked_requests            = src.checked_requests.load(std::memory_order_relaxed);
 }
 
-void GatewayStats::add_failed_reply(int now)
+void GatewayStats::expire_slot(int idx, int window_start)
+{
+    auto    &slot = time_slots[idx];
+    uint64_t v    = slot.load(std::memory_order_relaxed);
+
+    do {
+        if (slot_time(v) > window_start || (!slot_failed(v) && !slot_success(v)))
+            return;
+    } while (!slot.compare_exchange_weak(v, slot_pack(slot_time(v), 0, 0), std::memory_order_relaxed));
+
+    failed_replies.fetch_sub(slot_failed(v), std::memory_order_relaxed);
+    success_replies.fetch_sub(slot_success(v), std::memory_order_relaxed);
+}
+
+void GatewayStats::update_time(int now)
+{
+    int t = last_time.load(std::memory_order_relaxed);
+    do {
+        if (now <= t)
+            return;
+    } while (!last_time.compare_exchange_weak(t, now, std::memory_order_relaxed));
+
+    /* window moved from (t - window_size, t] to (now - window_size, now].
+     * expire slots of the seconds left behind. amortized O(1) per second */
+    int window_start = now - window_size;
+    int expired      = std::min(now - t, window_size);
+    for (int i = 0; i < expired; i++)
+        expire_slot(slot_index(window_start - i), window_start);
+}
+
+void GatewayStats::add_reply(int now, bool failed)
 {
-    auto it = time_slots.find(now);
-    if (it == time_slots.end()) {
-        time_slots.try_emplace(now, 1, 0);
-    } else {
-        it->second.failed_replies += 1;
+    update_time(now);
+
+    auto    &slot = time_slots[slot_index(now)];
+    uint64_t v    = slot.load(std::memory_order_relaxed);
+    uint64_t new_v;
+
+    if (now <= last_time.load(std::memory_order_relaxed) - window_size)
+        return; // reply is out of the window
+
+    do {
+        auto t = slot_time(v);
+        if (t == now) {
+            if ((failed ? slot_failed(v) : slot_success(v)) == SLOT_COUNTER_MAX)
+                return; // saturated
+            new_v = v + (failed ? (1ULL << 16) : 1ULL);
+        } else if (t < now) {
+            // recycle obsolete slot
+            new_v = slot_pack(now, failed ? 1 : 0, failed ? 0 : 1);
+        } else {
+            // slot is already reused for the newer second. reply is out of the window
+            return;
+        }
+    } while (!slot.compare_exchange_weak(v, new_v, std::memory_order_relaxed));
+
+    if (slot_time(v) != now) {
+        // counters of the recycled slot are not expired yet
+        failed_replies.fetch_sub(slot_failed(v), std::memory_order_relaxed);
+        success_replies.fetch_sub(slot_success(v), std::memory_order_relaxed);
     }
-    global.failed_replies += 1;
-    cleanup_obsolete_time_slots(now);
+
+    if (failed)
+        failed_replies.fetch_add(1, std::memory_order_relaxed);
+    else
+        success_replies.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GatewayStats::add_failed_reply(int now)
+{
+    add_reply(now, true);
 }
 
 void GatewayStats::add_success_reply(int now)
 {
-    auto it = time_slots.find(now);
-    if (it == time_slots.end()) {
-        time_slots.try_emplace(now, 0, 1);
-    } else {
-        it->second.success_replies += 1;
+    add_reply(now, false);
+}
+
+GatewayStats::Stats GatewayStats::get_window_stats() const
+{
+    return { std::max(failed_replies.load(std::memory_order_relaxed), 0),
+             std::max(success_replies.load(std::memory_order_relaxed), 0) };
+}
+
+std::optional<int> GatewayStats::get_oldest_time_slot() const
+{
+    std::optional<int> ret;
+    int                now = last_time.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < window_size; i++) {
+        auto v = time_slots[i].load(std::memory_order_relaxed);
+        auto t = slot_time(v);
+        if (t <= now - window_size || t > now || (!slot_failed(v) && !slot_success(v)))
+            continue;
+        if (!ret || t < *ret)
+            ret = t;
     }
-    global.success_replies += 1;
-    cleanup_obsolete_time_slots(now);
+
+    return ret;
 }
@@ -1,31 +1,55 @@
 #pragma once
 
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
 
+/* replies counters for the last window_size seconds
+ *
+ * fixed-size ring of the per-second slots. slot for the second 'now' is time_slots[now % window_size].
+ * every slot is packed into the single atomic word [time:32][failed:16][success:16]
+ * and is updated or recycled by CAS, so methods are safe to call concurrently without locks.
+ *
+ * window totals are kept in the running sums. counters are subtracted from the sums
+ * by the one who zeroed them in the slot: either on the slot recycling
+ * or on the expiration of the slots left behind when the window moves forward */
 class GatewayStats {
+  public:
     struct Stats {
         int failed_replies;
         int success_replies;
-        Stats(int failed_replies, int success_replies)
-            : failed_replies(failed_replies)
-            , success_replies(success_replies)
-        {
-        }
     };
-    std::map<int, Stats> time_slots;
-    int                  window_size;
+
+  private:
+    std::unique_ptr<std::atomic<uint64_t>[]> time_slots;
+    int                                      window_size;
+    std::atomic<int>                         last_time; // latest second seen
+    std::atomic<int>                         failed_replies;
+    std::atomic<int>                         success_replies;
+
+    int  slot_index(int time) const { return ((time % window_size) + window_size) % window_size; }
+    void add_reply(int now, bool failed);
+    void expire_slot(int idx, int window_start);
 
   public:
-    Stats         global{ 0, 0 };
-    unsigned long throttled_requests{ 0 };
-    unsigned long throttled_requests_randomly{ 0 };
-    unsigned long checked_requests{ 0 };
+    std::atomic<unsigned long> throttled_requests{ 0 };
+    std::atomic<unsigned long> throttled_requests_randomly{ 0 };
+    std::atomic<unsigned long> checked_requests{ 0 };
+
+    GatewayStats(int window_size_seconds);
+    /* move counters from src to the new window */
+    GatewayStats(int window_size_seconds, const GatewayStats &src);
+
+    int get_window_size() const { return window_size; }
 
-    void set_window_size(int window_size_seconds) { window_size = window_size_seconds; }
+    /* move window forward to the second 'now'. expires left behind slots */
+    void update_time(int now);
 
-    void cleanup_obsolete_time_slots(int now);
     void add_failed_reply(int now);
     void add_success_reply(int now);
 
-    const std::map<int, Stats> &getTimeSlots() const { return time_slots; }
+    /* sum of the counters within the window ending at the latest seen second. O(1) */
+    Stats              get_window_stats() const;
+    std::optional<int> get_oldest_time_slot() const;
 };
@@ -1,6 +1,8 @@
 #include "GatewaysCache.h"
 #include "AmUtils.h"
 
+#include <random>
+
 #define SKIP_RATE_MIN 20.0
 #define SKIP_RATE_MAX 100.0
 
@@ -85,10 +87,9 @@ GatewaysCacheALeg::GatewaysCacheALeg()
 
 std::optional<string> GatewaysCacheALeg::get_jwt_auth_secret(GatewaysCacheDataBase::GatewayIdType gateway_id)
 {
-    AmLock lock(mutex);
-
-    auto gw_it = gateways.find(gateway_id);
-    if (gw_it == gateways.end())
+    auto gws   = get_gateways();
+    auto gw_it = gws->find(gateway_id);
+    if (gw_it == gws->end())
         return std::nullopt;
 
     const auto &ret = gw_it->second.jwt_auth_secret;
@@ -159,7 +160,7 @@ GatewayDataBleg::GatewayDataBleg(GatewayIdType gateway_id, const AmArg &r)
 
     failure_rate_multiplier = (SKIP_RATE_MAX - SKIP_RATE_MIN) / (throttling_threshold_end - throttling_threshold_start);
 
-    stats.set_window_size(throttling_window);
+    stats = std::make_shared<GatewayStats>(throttling_window);
 
     throttling_enabled = true;
 }
@@ -200,28 +201,27 @@ GatewayDataBleg::GatewayDataBleg::operator AmArg() const
     // stats
     AmArg &s = throttling["stats"];
 
-    auto &slots           = stats.getTimeSlots();
-    auto  it              = slots.begin();
-    s["oldest_time_slot"] = (it != slots.end()) ? it->first : AmArg();
+    auto oldest_time_slot = stats->get_oldest_time_slot();
+    s["oldest_time_slot"] = oldest_time_slot ? AmArg(*oldest_time_slot) : AmArg();
 
-    s["failed_replies"]  = stats.global.failed_replies;
-    s["success_replies"] = stats.global.success_replies;
+    auto window_stats    = stats->get_window_stats();
+    s["failed_replies"]  = window_stats.failed_replies;
+    s["success_replies"] = window_stats.success_replies;
 
-    auto failure_rate = getFailureRate();
+    auto failure_rate = getFailureRate(window_stats);
     s["failure_rate"] = failure_rate;
     s["skip_rate"]    = getSkipRate(failure_rate);
 
-    s["checked_requests"]            = stats.checked_requests;
-    s["throttled_requests"]          = stats.throttled_requests;
-    s["throttled_requests_randomly"] = stats.throttled_requests_randomly;
+    s["checked_requests"]            = stats->checked_requests.load();
+    s["throttled_requests"]          = stats->throttled_requests.load();
+    s["throttled_requests_randomly"] = stats->throttled_requests_randomly.load();
 
     return a;
 }
 
-double GatewayDataBleg::getFailureRate() const
+double GatewayDataBleg::getFailureRate(const GatewayStats::Stats &s) const
 {
-    const auto &s = stats.global;
-    int         n = s.failed_replies + s.success_replies;
+    int n = s.failed_replies + s.success_replies;
     if (n < throttling_minimum_calls)
         return 0;
 
@@ -242,16 +242,13 @@ double GatewayDataBleg::getSkipRate(double failure_rate) const
 GatewaysCacheBLeg::GatewaysCacheBLeg()
     : GatewaysCacheBase()
 {
-    std::random_device rd;
-    random_generator.seed(rd());
 }
 
 void GatewaysCacheBLeg::update_reply_stats(GatewayDataBleg::GatewayIdType gateway_id, const AmSipReply &reply)
 {
-    AmLock lock(mutex);
-
-    auto gw_it = gateways.find(gateway_id);
-    if (gw_it == gateways.end())
+    auto gws   = get_gateways();
+    auto gw_it = gws->find(gateway_id);
+    if (gw_it == gws->end())
         return;
 
     auto &gw = gw_it->second;
@@ -260,48 +257,50 @@ void GatewaysCacheBLeg::update_reply_stats(GatewayDataBleg::GatewayIdType gatewa
 
     if (reply.local_reply) {
         if (gw.throttling_local_codes.contains(reply.code)) {
-            gw.stats.add_failed_reply(reply.recv_timestamp.tv_sec);
+            gw.stats->add_failed_reply(reply.recv_timestamp.tv_sec);
             return;
         }
     } else if (gw.throttling_remote_codes.contains(reply.code)) {
-        gw.stats.add_failed_reply(reply.recv_timestamp.tv_sec);
+        gw.stats->add_failed_reply(reply.recv_timestamp.tv_sec);
         return;
     }
 
-    gw.stats.add_success_reply(reply.recv_timestamp.tv_sec);
+    gw.stats->add_success_reply(reply.recv_timestamp.tv_sec);
 }
 
 bool GatewaysCacheBLeg::should_skip(GatewayDataBleg::GatewayIdType gateway_id, int now)
 {
-    AmLock lock(mutex);
+    static thread_local std::mt19937                    random_generator{ std::random_device{}() };
+    static thread_local std::uniform_int_distribution<> random_distribution{ 0, 99 };
 
-    auto gw_it = gateways.find(gateway_id);
-    if (gw_it == gateways.end())
+    auto gws   = get_gateways();
+    auto gw_it = gws->find(gateway_id);
+    if (gw_it == gws->end())
         return false;
 
     auto &gw = gw_it->second;
     if (!gw.throttling_enabled)
         return false;
 
-    auto &s = gw.stats;
+    auto &s = *gw.stats;
 
-    s.checked_requests++;
-    s.cleanup_obsolete_time_slots(now);
+    s.checked_requests.fetch_add(1, std::memory_order_relaxed);
+    s.update_time(now);
 
-    auto skip_rate = gw.getSkipRate(gw.getFailureRate());
+    auto skip_rate = gw.getSkipRate(gw.getFailureRate(s.get_window_stats()));
 
     if (skip_rate == 0)
         return false;
 
     if (skip_rate >= 100) {
-        s.throttled_requests++;
+        s.throttled_requests.fetch_add(1, std::memory_order_relaxed);
         return true;
     }
 
     auto ret = (skip_rate > random_distribution(random_generator));
 
     if (ret)
-        s.throttled_requests_randomly++;
+        s.throttled_requests_randomly.fetch_add(1, std::memory_order_relaxed);
 
     return ret;
 }
@@ -309,10 +308,9 @@ bool GatewaysCacheBLeg::should_skip(GatewayDataBleg::GatewayIdType gateway_id, i
 std::optional<GatewayDataBleg::TelRedirectData>
 GatewaysCacheBLeg::get_redirect_data(GatewayDataBleg::GatewayIdType gateway_id)
 {
-    AmLock lock(mutex);
-
-    auto gw_it = gateways.find(gateway_id);
-    if (gw_it == gateways.end())
+    auto gws   = get_gateways();
+    auto gw_it = gws->find(gateway_id);
+    if (gw_it == gws->end())
         return std::nullopt;
 
     return gw_it->second.tel_redirect_data;
@@ -7,7 +7,8 @@
 
 #include <unordered_map>
 #include <set>
-#include <random>
+#include <atomic>
+#include <memory>
 #include <optional>
 
 struct GatewaysCacheDataBase {
@@ -59,12 +60,23 @@ struct GatewaysCacheDataBase {
 template <typename GatewayDataType> class GatewaysCacheBase {
   protected:
     using GatewaysContainer = std::unordered_map<GatewaysCacheDataBase::GatewayIdType, GatewayDataType>;
-    GatewaysContainer gateways;
-    AmMutex           mutex;
+    using GatewaysSnapshot  = std::shared_ptr<const GatewaysContainer>;
+
+    /* immutable snapshot replaced on update().
+     * readers do not take locks and keep loaded snapshot alive while use it */
+    std::atomic<GatewaysSnapshot> gateways;
+    AmMutex                       update_mutex;
 
     virtual void merge(GatewayDataType &dst, const GatewayDataType &src) = 0;
 
+    GatewaysSnapshot get_gateways() const { return gateways.load(std::memory_order_acquire); }
+
   public:
+    GatewaysCacheBase()
+        : gateways(std::make_shared<const GatewaysContainer>())
+    {
+    }
+
     void update(const AmArg &data)
     {
         if (!isArgArray(data))
@@ -81,16 +93,18 @@ template <typename GatewayDataType> class GatewaysCacheBase {
             }
         }
 
-        AmLock lock(mutex);
-        gateways.swap(tmp);
+        AmLock lock(update_mutex);
 
-        /* copy runtime stats data for gateways with enabled throttling
-         * TODO: move stats to another container */
-        for (const auto &old_gw : tmp) {
-            if (auto it = gateways.find(old_gw.first); it != gateways.end()) {
-                merge(it->second, old_gw.second);
+        /* runtime stats data for gateways with enabled throttling
+         * is shared with the new snapshot */
+        auto old_gateways = get_gateways();
+        for (auto &[id, gw] : tmp) {
+            if (auto it = old_gateways->find(id); it != old_gateways->end()) {
+                merge(gw, it->second);
             }
         }
+
+        gateways.store(std::make_shared<const GatewaysContainer>(std::move(tmp)), std::memory_order_release);
     }
 
     void info(const AmArg &arg, AmArg &ret)
@@ -98,24 +112,23 @@ template <typename GatewayDataType> class GatewaysCacheBase {
         auto &entries = ret["gateways"];
         entries.assertStruct();
 
-        AmLock lock(mutex);
+        auto gws = get_gateways();
 
         if (0 == arg.size()) {
-            for (const auto &[id, gw] : gateways)
+            for (const auto &[id, gw] : *gws)
                 entries[long2str(id)] = gw;
         } else {
-            auto gw = gateways.find(arg2int(arg[0]));
-            if (gw != gateways.end())
+            auto gw = gws->find(arg2int(arg[0]));
+            if (gw != gws->end())
                 entries[long2str(gw->first)] = gw->second;
         }
     }
 
     std::optional<GatewaysCacheDataBase::SipSettings> get_sip_settings(GatewaysCacheDataBase::GatewayIdType gateway_id)
     {
-        AmLock lock(mutex);
-
-        auto gw_it = gateways.find(gateway_id);
-        if (gw_it == gateways.end())
+        auto gws   = get_gateways();
+        auto gw_it = gws->find(gateway_id);
+        if (gw_it == gws->end())
             return std::nullopt;
 
         return gw_it->second.sip_settings;
@@ -124,10 +137,9 @@ template <typename GatewayDataType> class GatewaysCacheBase {
     // return [ice_enabled, rtcp_mux_enabled, rtcp_feedback_enabled]
     std::tuple<bool, bool, bool> get_media_settings_enabled(GatewaysCacheDataBase::GatewayIdType gateway_id)
     {
-        AmLock lock(mutex);
-
-        auto gw_it = gateways.find(gateway_id);
-        if (gw_it == gateways.end())
+        auto gws   = get_gateways();
+        auto gw_it = gws->find(gateway_id);
+        if (gw_it == gws->end())
             return { false, false, false };
 
         const auto &m = gw_it->second.media_settings;
@@ -139,10 +151,9 @@ template <typename GatewayDataType> class GatewaysCacheBase {
     // return [ice_allowed, rtcp_mux_allowed, rtcp_feedback_allowed]
     std::tuple<bool, bool, bool> get_media_settings_allowed(GatewaysCacheDataBase::GatewayIdType gateway_id)
     {
-        AmLock lock(mutex);
-
-        auto gw_it = gateways.find(gateway_id);
-        if (gw_it == gateways.end())
+        auto gws   = get_gateways();
+        auto gw_it = gws->find(gateway_id);
+        if (gw_it == gws->end())
             return { true, true, true };
 
         const auto &m = gw_it->second.media_settings;
@@ -177,12 +188,13 @@ struct GatewayDataBleg : public GatewaysCacheDataBase {
     std::set<int> throttling_local_codes;
     std::set<int> throttling_remote_codes;
 
-    GatewayStats stats;
+    // shared between snapshots. see GatewaysCacheBLeg::merge()
+    std::shared_ptr<GatewayStats> stats;
 
     GatewayDataBleg(GatewayIdType gateway_id, const AmArg &r);
     operator AmArg() const final;
 
-    double getFailureRate() const;
+    double getFailureRate(const GatewayStats::Stats &s) const;
     double getSkipRate(double failure_rate) const;
 };
 
@@ -198,16 +210,14 @@ class GatewaysCacheALeg : public GatewaysCacheBase<GatewayDataAleg> {
 };
 
 class GatewaysCacheBLeg : public GatewaysCacheBase<GatewayDataBleg> {
-  private:
-    std::mt19937                    random_generator;
-    std::uniform_int_distribution<> random_distribution{ 0, 99 };
-
   protected:
     void merge(GatewayDataBleg &dst, const GatewayDataBleg &src) final
     {
         if (dst.throttling_enabled && src.throttling_enabled) {
-            dst.stats = src.stats;
-            dst.stats.set_window_size(src.throttling_window);
+            if (dst.throttling_window == src.throttling_window)
+                dst.stats = src.stats;
+            else
+                dst.stats = std::make_shared<GatewayStats>(dst.throttling_window, *src.stats);
         }
     }
 
@@ -0,0 +1,347 @@
+#include "sems.h"
+#include "GetProfileBatcher.h"
+#include "log.h"
+#include "yeti_base.h"
+#include "AmEventDispatcher.h"
+#include "AmSessionContainer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define DEFAULT_BATCH_WINDOW_USEC 2000
+
+// postgresql limit for the bind parameters count of the single query
+#define PG_MAX_QUERY_PARAMS 65535
+
+static const string GETPROFILE_BATCHER_QUEUE_NAME(MOD_NAME "_getprofile_batcher");
+
+GetProfileBatcher::GetProfileBatcher()
+    : AmEventFdQueue(this)
+    , batch_size(0)
+    , batch_window(DEFAULT_BATCH_WINDOW_USEC)
+    , next_token(0)
+    , epoll_fd(-1)
+    , stopped(false)
+    , batches(stat_group(Counter, MOD_NAME, "getprofile_batches")
+                  .setHelp("coalesced getprofile queries posted to the routing database worker")
+                  .addAtomicCounter())
+    , batched_requests(stat_group(Counter, MOD_NAME, "getprofile_batched_requests")
+                           .setHelp("getprofile requests sent within the coalesced queries")
+                           .addAtomicCounter())
+    , resent_requests(stat_group(Counter, MOD_NAME, "getprofile_batch_resent_requests")
+                          .setHelp("getprofile requests resent one by one after the coalesced query error")
+                          .addAtomicCounter())
+    , batch_delay(LatencyHistograms::instance().add(MOD_NAME "_getprofile_batch_delay_usec"))
+{
+    LatencyHistograms::instance().setHelp(MOD_NAME "_getprofile_batch_delay_usec",
+                                          "time the oldest getprofile request waited for the batch flush in usec");
+}
+
+int GetProfileBatcher::configure(const string &function, const PreparedQueryArgs &args_types, int size,
+                                 int batch_window_usec)
+{
+    routing_function = function;
+    types            = args_types;
+    batch_size       = size > 1 ? static_cast<size_t>(size) : 0;
+    batch_window     = std::chrono::microseconds(batch_window_usec > 0 ? batch_window_usec : DEFAULT_BATCH_WINDOW_USEC);
+
+    if (!enabled())
+        return 0;
+
+    if (!types.empty() && batch_size * types.size() > PG_MAX_QUERY_PARAMS) {
+        batch_size = PG_MAX_QUERY_PARAMS / types.size();
+        WARN("getprofile batch size is limited to %lu by the query parameters count", batch_size);
+    }
+
+    batch_sql.assign(batch_size, string());
+
+    DBG("getprofile batcher: batch_size: %lu, batch_window: %ld usec", batch_size,
+        static_cast<long>(batch_window.count()));
+
+    if ((epoll_fd = epoll_create(3)) == -1) {
+        ERROR("epoll_create() call failed");
+        return -1;
+    }
+    timer.link(epoll_fd);
+    stop_event.link(epoll_fd);
+    epoll_link(epoll_fd);
+
+    return 0;
+}
+
+string GetProfileBatcher::build_batch_sql(const string &routing_function, const PreparedQueryArgs &types,
+                                          size_t requests)
+{
+    std::ostringstream sql;
+    size_t             param = 1;
+
+    for (size_t i = 1; i <= requests; i++) {
+        if (i > 1)
+            sql << " UNION ALL ";
+        sql << "SELECT " << i << " AS batch_idx, p.* FROM " << routing_function << '(';
+        for (size_t k = 0; k < types.size(); k++, param++) {
+            if (k)
+                sql << ',';
+            // explicit casts instead of the prepared statement types
+            sql << '$' << param << "::" << types[k];
+        }
+        sql << ") WITH ORDINALITY p";
+    }
+    sql << " ORDER BY batch_idx, ordinality";
+
+    return sql.str();
+}
+
+const string &GetProfileBatcher::get_batch_sql(size_t requests)
+{
+    auto &sql = batch_sql[requests - 1];
+    if (sql.empty())
+        sql = build_batch_sql(routing_function, types, requests);
+    return sql;
+}
+
+bool GetProfileBatcher::split_batch_result(AmArg &result, size_t requests_count, vector<AmArg> &rows)
+{
+    rows.assign(requests_count, AmArg());
+    for (auto &r : rows)
+        r.assertArray();
+
+    if (!isArgArray(result))
+        return false;
+
+    for (size_t i = 0; i < result.size(); i++) {
+        AmArg &row = result.get(i);
+        if (!isArgStruct(row) || !row.hasMember("batch_idx"))
+            return false;
+
+        auto &idx_arg = row["batch_idx"];
+        long  idx;
+        if (isArgInt(idx_arg))
+            idx = idx_arg.asInt();
+        else if (isArgLongLong(idx_arg))
+            idx = static_cast<long>(idx_arg.asLongLong());
+        else
+            return false;
+
+        if (idx < 1 || static_cast<size_t>(idx) > requests_count)
+            return false;
+
+        row.asStruct()->erase("batch_idx");
+        row.asStruct()->erase("ordinality");
+        rows[idx - 1].push(row);
+    }
+
+    return true;
+}
+
+vector<GetProfileBatcher::request> GetProfileBatcher::take_pending()
+{
+    batch_delay.add(first_request_time);
+
+    vector<request> ret;
+    ret.swap(pending);
+    pending.reserve(batch_size);
+    return ret;
+}
+
+void GetProfileBatcher::post(const string &local_tag, std::unique_ptr<PGParamExecute> getprofile_event)
+{
+    vector<request> ready;
+    {
+        AmLock l(pending_mutex);
+        if (pending.empty()) {
+            first_request_time = LatencyHistogram::clock::now();
+            timer.set(batch_window.count(), false);
+        }
+        pending.emplace_back(request{ local_tag, std::move(getprofile_event) });
+
+        if (pending.size() >= batch_size)
+            ready = take_pending();
+    }
+
+    if (!ready.empty())
+        flush(std::move(ready));
+}
+
+void GetProfileBatcher::flush(vector<request> requests)
+{
+    if (requests.size() == 1) {
+        // nothing to coalesce
+        AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, requests.front().event.release());
+        return;
+    }
+
+    string token, sql;
+    {
+        AmLock l(inflight_mutex);
+        token = std::to_string(next_token++);
+        sql   = get_batch_sql(requests.size());
+    }
+
+    std::unique_ptr<PGParamExecute> event(
+        new PGParamExecute(PGQueryData(yeti_routing_pg_worker, sql, false /*single*/, GETPROFILE_BATCHER_QUEUE_NAME,
+                                       token),
+                           PGTransactionData(), false /* prepared */));
+
+    // keep original events params untouched to resend them on error
+    auto &params = event->qdata.info[0].params;
+    params.reserve(types.size() * requests.size());
+    for (const auto &r : requests) {
+        const auto &p = r.event->qdata.info[0].params;
+        params.insert(params.end(), p.begin(), p.end());
+    }
+
+    batches.inc();
+    batched_requests.inc(requests.size());
+
+    {
+        AmLock l(inflight_mutex);
+        inflight.emplace(token, std::move(requests));
+    }
+
+    AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, event.release());
+}
+
+void GetProfileBatcher::flush_expired(bool force)
+{
+    vector<request> ready;
+    {
+        AmLock l(pending_mutex);
+        if (pending.empty())
+            return;
+        if (force || LatencyHistogram::clock::now() - first_request_time >= batch_window) {
+            ready = take_pending();
+        } else {
+            // timer of the batch flushed by size. wait for the rest of the current batch window
+            auto usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                batch_window - (LatencyHistogram::clock::now() - first_request_time));
+            // zero value disarms the timer
+            timer.set(std::max<long>(usec.count(), 1), false);
+        }
+    }
+
+    if (!ready.empty())
+        flush(std::move(ready));
+}
+
+void GetProfileBatcher::resend(vector<request> &requests)
+{
+    resent_requests.inc(requests.size());
+    for (auto &r : requests)
+        AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, r.event.release());
+}
+
+void GetProfileBatcher::on_batch_reply(const string &token, AmEvent *ev)
+{
+    vector<request> requests;
+    {
+        AmLock l(inflight_mutex);
+        auto   it = inflight.find(token);
+        if (it == inflight.end()) {
+            ERROR("getprofile batcher: reply for unknown batch %s", token.data());
+            return;
+        }
+        requests = std::move(it->second);
+        inflight.erase(it);
+    }
+
+    if (auto e = dynamic_cast<PGResponse *>(ev)) {
+        vector<AmArg> rows;
+        if (!split_batch_result(e->result, requests.size(), rows)) {
+            ERROR("getprofile batcher: unexpected batch %s reply: %s", token.data(), AmArg::print(e->result).data());
+            resend(requests);
+            return;
+        }
+        for (size_t i = 0; i < requests.size(); i++) {
+            AmSessionContainer::instance()->postEvent(requests[i].local_tag, new PGResponse(rows[i], string()));
+        }
+    } else if (auto e = dynamic_cast<PGResponseError *>(ev)) {
+        // isolate the failed request
+        ERROR("getprofile batcher: batch %s error: %s. resend %lu requests", token.data(), e->error.data(),
+              requests.size());
+        resend(requests);
+    } else if (dynamic_cast<PGTimeout *>(ev)) {
+        ERROR("getprofile batcher: batch %s timeout", token.data());
+        for (const auto &r : requests)
+            AmSessionContainer::instance()->postEvent(r.local_tag, new PGTimeout(string()));
+    }
+}
+
+void GetProfileBatcher::process(AmEvent *ev)
+{
+    if (auto e = dynamic_cast<PGResponse *>(ev)) {
+        on_batch_reply(e->token, ev);
+    } else if (auto e = dynamic_cast<PGResponseError *>(ev)) {
+        on_batch_reply(e->token, ev);
+    } else if (auto e = dynamic_cast<PGTimeout *>(ev)) {
+        on_batch_reply(e->token, ev);
+    }
+}
+
+void GetProfileBatcher::getStats(AmArg &ret)
+{
+    ret["batch_size"]   = static_cast<long>(batch_size);
+    ret["batch_window"] = static_cast<long>(batch_window.count());
+    {
+        AmLock l(pending_mutex);
+        ret["pending"] = static_cast<long>(pending.size());
+    }
+    {
+        AmLock l(inflight_mutex);
+        ret["inflight_batches"] = static_cast<long>(inflight.size());
+    }
+}
+
+void GetProfileBatcher::run()
+{
+    int                f;
+    bool               running;
+    struct epoll_event events[3];
+
+    setThreadName("getprofile-batch");
+
+    AmEventDispatcher::instance()->addEventQueue(GETPROFILE_BATCHER_QUEUE_NAME, this);
+
+    running = true;
+    do {
+        int ret = epoll_wait(epoll_fd, events, 3, -1);
+        if (ret == -1 && errno != EINTR) {
+            ERROR("epoll_wait: %s", strerror(errno));
+        }
+        if (ret < 1)
+            continue;
+        for (int n = 0; n < ret; ++n) {
+            f = events[n].data.fd;
+
+            if (f == timer) {
+                timer.read();
+                flush_expired(false);
+            } else if (f == -queue_fd()) {
+                clear_pending();
+                processEvents();
+            } else if (f == stop_event) {
+                stop_event.read();
+                running = false;
+                break;
+            }
+        }
+    } while (running);
+
+    // do not hold accumulated requests on shutdown
+    flush_expired(true);
+
+    AmEventDispatcher::instance()->delEventQueue(GETPROFILE_BATCHER_QUEUE_NAME);
+
+    epoll_unlink(epoll_fd);
+    close(epoll_fd);
+    stopped.set(true);
+}
+
+void GetProfileBatcher::on_stop()
+{
+    stop_event.fire();
+    stopped.wait_for();
+}
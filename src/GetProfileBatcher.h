@@ -0,0 +1,100 @@
+#pragma once
+
+#include "AmThread.h"
+#include "AmEventFdQueue.h"
+#include "AmStatistics.h"
+#include "AmArg.h"
+
+#include "db/DbTypes.h"
+#include "LatencyHistogram.h"
+
+#include "ampi/PostgreSqlAPI.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+
+using std::map;
+using std::string;
+using std::vector;
+
+/* coalesces getprofile queries of the concurrent INVITEs into the single routing DB call.
+ *
+ * queries are accumulated until the batch reaches batch_size
+ * or its oldest query is waiting longer than batch_window.
+ * batch is sent as the one non-prepared query:
+ *   SELECT 1 AS batch_idx, p.* FROM routing_function($1,...) WITH ORDINALITY p UNION ALL
+ *   SELECT 2, p.* FROM routing_function($N+1,...) WITH ORDINALITY p ...
+ * reply rows are split back by batch_idx and posted as PGResponse to the sessions by local_tag.
+ *
+ * single routing function exception fails the whole batch,
+ * so the queries of the failed batch are resent one by one as the usual prepared getprofile */
+class GetProfileBatcher : public AmThread,
+                          public AmEventFdQueue,
+                          public AmEventHandler {
+    struct request {
+        string                          local_tag;
+        std::unique_ptr<PGParamExecute> event;
+    };
+
+    string                    routing_function;
+    PreparedQueryArgs         types;
+    size_t                    batch_size;
+    std::chrono::microseconds batch_window;
+
+    AmMutex                             pending_mutex;
+    vector<request>                     pending;
+    LatencyHistogram::clock::time_point first_request_time;
+
+    AmMutex                      inflight_mutex;
+    map<string, vector<request>> inflight;
+    unsigned long long           next_token;
+    // batch_sql[n - 1] is the query for n coalesced requests. built on the first use. guarded by inflight_mutex
+    vector<string> batch_sql;
+
+    int               epoll_fd;
+    AmEventFd         stop_event;
+    AmTimerFd         timer;
+    AmCondition<bool> stopped;
+
+    AtomicCounter    &batches;
+    AtomicCounter    &batched_requests;
+    AtomicCounter    &resent_requests;
+    LatencyHistogram &batch_delay;
+
+    /* must be called with pending_mutex locked */
+    vector<request> take_pending();
+    /* must be called with inflight_mutex locked */
+    const string &get_batch_sql(size_t requests);
+
+    void flush(vector<request> requests);
+    void flush_expired(bool force);
+    void resend(vector<request> &requests);
+    void on_batch_reply(const string &token, AmEvent *ev);
+
+  public:
+    GetProfileBatcher();
+
+    /* batch_size <= 1 disables coalescing */
+    int configure(const string &routing_function, const PreparedQueryArgs &types, int batch_size,
+                  int batch_window_usec);
+
+    bool enabled() const { return batch_size > 1; }
+
+    /* takes ownership of the prepared getprofile query event */
+    void post(const string &local_tag, std::unique_ptr<PGParamExecute> getprofile_event);
+
+    void getStats(AmArg &ret);
+
+    void run() override;
+    void on_stop() override;
+    void process(AmEvent *ev) override;
+
+    static string build_batch_sql(const string &routing_function, const PreparedQueryArgs &types, size_t requests);
+
+    /* split rows of the batch reply by batch_idx into requests_count arrays.
+     * removes batch_idx and ordinality columns. returns false on unexpected reply */
+    static bool split_batch_result(AmArg &result, size_t requests_count, vector<AmArg> &rows);
+};
@@ -27,7 +27,9 @@
 #include "sip/parse_common.h"
 #include "log.h"
 #include "AmUtils.h"
+#include "SipHeadersIndex.h"
 #include <algorithm>
+#include <strings.h>
 
 const char *FilterType2String(FilterType ft)
 {
@@ -86,6 +88,7 @@ bool readFilter(AmConfigReader &cfg, const char *cfg_key_filter, const char *cfg
         std::transform(c.begin(), c.end(), c.begin(), ::tolower);
         hf.filter_list.insert(c);
     }
+    hf.compile();
 
     filter_list.push_back(hf);
     return true;
@@ -189,138 +192,139 @@ int skip_header(const std::string &hdr, size_t start_pos, size_t &name_end, size
     return 0;
 }
 
-int inplaceHeaderFilter(string &hdrs, const vector<FilterEntry> &filter_list)
+void HeaderNameMatcher::compile(const set<string> &filter_list)
 {
-    if (!hdrs.length() || !filter_list.size())
-        return 0;
+    exact.clear();
+    prefixes.clear();
+    suffixes.clear();
+    match_any = false;
 
-    DBG("applying %zd header filters", filter_list.size());
+    for (const auto &p : filter_list) {
+        string name(p);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
 
-    for (vector<FilterEntry>::const_iterator fe = filter_list.begin(); fe != filter_list.end(); fe++) {
-        const set<string> &headerfilter_list = fe->filter_list;
-        const FilterType  &f_type            = fe->filter_type;
+        exact.emplace_back(SipHeadersIndex::hash(name), name);
 
-        if (!isActiveFilter(f_type))
+        if (name.empty())
             continue;
-
-        // todo: multi-line header support
-
-        size_t start_pos = 0;
-        while (start_pos < hdrs.length()) {
-            size_t name_end, val_begin, val_end, hdr_end;
-            int    res;
-            if ((res = skip_header(hdrs, start_pos, name_end, val_begin, val_end, hdr_end)) != 0) {
-                return res;
-            }
-            string hdr_name = hdrs.substr(start_pos, name_end - start_pos);
-            std::transform(hdr_name.begin(), hdr_name.end(), hdr_name.begin(), ::tolower);
-            bool erase = false;
-            if (f_type == Whitelist) {
-                erase = headerfilter_list.find(hdr_name) == headerfilter_list.end();
-            } else if (f_type == Blacklist) {
-                erase = headerfilter_list.find(hdr_name) != headerfilter_list.end();
-            }
-            if (erase) {
-                DBG("erasing header '%s' by %s", hdr_name.c_str(), FilterType2String(f_type));
-                hdrs.erase(start_pos, hdr_end - start_pos);
-            } else {
-                start_pos = hdr_end;
-            }
+        if (name.front() == '*') {
+            if (name.size() == 1)
+                match_any = true;
+            else
+                suffixes.emplace_back(name.substr(1));
+        } else if (name.back() == '*') {
+            prefixes.emplace_back(name.substr(0, name.size() - 1));
         }
     }
 
-    return 0;
+    std::sort(exact.begin(), exact.end());
+    compiled = true;
+}
+
+bool HeaderNameMatcher::match_exact(std::string_view name) const
+{
+    auto h  = SipHeadersIndex::hash(name);
+    auto it = std::lower_bound(exact.begin(), exact.end(), h, [](const auto &e, uint64_t v) { return e.first < v; });
+    for (; it != exact.end() && it->first == h; ++it) {
+        if (it->second.size() == name.size() && 0 == strncasecmp(it->second.data(), name.data(), name.size()))
+            return true;
+    }
+    return false;
 }
 
+bool HeaderNameMatcher::match_pattern(std::string_view name) const
+{
+    if (name.empty())
+        return false;
 
-class PatternMatchFunctor {
-    const string &v;
+    if (match_any)
+        return true;
 
-  public:
-    PatternMatchFunctor(const string &v)
-        : v(v)
-    {
-    }
-    bool match(const string &p) const
-    {
-        if (*p.begin() == '*') {
-            // endwith
-            size_t plen = p.size() - 1;
-            if (plen == 0)
-                return true; // any
-            size_t vlen = v.size();
-            if (plen > vlen)
-                return false;
-            return 0 == memcmp(p.data() + 1, v.data() + vlen - plen, plen);
-        } else if (*p.rbegin() == '*') {
-            // startwith
-            size_t plen = p.size() - 1;
-            size_t vlen = v.size();
-            if (plen > vlen)
-                return false;
-            return 0 == memcmp(p.data(), v.data(), plen);
-        } else {
-            // full
-            return p == v;
-        }
+    for (const auto &p : prefixes) {
+        if (p.size() <= name.size() && 0 == strncasecmp(p.data(), name.data(), p.size()))
+            return true;
     }
-    bool operator()(const string &p) const
-    {
-        if (match(p)) {
-            DBG("'%s' matched with '%s'", v.c_str(), p.c_str());
+
+    for (const auto &s : suffixes) {
+        if (s.size() <= name.size() && 0 == strncasecmp(s.data(), name.data() + name.size() - s.size(), s.size()))
             return true;
-        }
-        return false;
     }
-};
 
-inline bool matchListPattern(const string &s, const set<string> &l)
-{
-    if (s.empty())
-        return false;
-    PatternMatchFunctor f(s);
-    return std::find_if(l.begin(), l.end(), f) != l.end();
+    return match_exact(name);
 }
 
-int inplaceHeaderPatternFilter(string &hdrs, const vector<FilterEntry> &filter_list)
+/* applies all active filter entries within the single headers pass.
+ * header is kept if it is passed by every entry.
+ * output is built into the new buffer instead of the erasing from the middle of hdrs */
+static int filterHeaders(string &hdrs, const vector<FilterEntry> &filter_list, bool use_patterns)
 {
     if (!hdrs.length() || !filter_list.size())
         return 0;
 
-    DBG("applying %zd header pattern filters", filter_list.size());
-
-    for (vector<FilterEntry>::const_iterator fe = filter_list.begin(); fe != filter_list.end(); fe++) {
-        const set<string> &headerfilter_list = fe->filter_list;
-        const FilterType  &f_type            = fe->filter_type;
+    // entries created without compile() use the temporary matchers
+    vector<HeaderNameMatcher>                                 tmp_matchers;
+    vector<std::pair<FilterType, const HeaderNameMatcher *>> active;
 
-        if (!isActiveFilter(f_type))
+    tmp_matchers.reserve(filter_list.size());
+    active.reserve(filter_list.size());
+    for (const auto &fe : filter_list) {
+        if (!isActiveFilter(fe.filter_type))
             continue;
+        if (fe.matcher.is_compiled()) {
+            active.emplace_back(fe.filter_type, &fe.matcher);
+        } else {
+            tmp_matchers.emplace_back().compile(fe.filter_list);
+            active.emplace_back(fe.filter_type, &tmp_matchers.back());
+        }
+    }
 
-        size_t start_pos = 0;
-        while (start_pos < hdrs.length()) {
-            int    res;
-            size_t name_end, val_begin, val_end, hdr_end;
+    if (active.empty())
+        return 0;
 
-            if ((res = skip_header(hdrs, start_pos, name_end, val_begin, val_end, hdr_end)) != 0) {
-                return res;
-            }
+    DBG("applying %zd header %sfilters", active.size(), use_patterns ? "pattern " : "");
 
-            string hdr_name = hdrs.substr(start_pos, name_end - start_pos);
-            std::transform(hdr_name.begin(), hdr_name.end(), hdr_name.begin(), ::tolower);
+    string out;
+    out.reserve(hdrs.length());
 
-            bool erase = false;
-            if (f_type == Whitelist) {
-                erase = !matchListPattern(hdr_name, headerfilter_list);
-            } else if (f_type == Blacklist) {
-                erase = matchListPattern(hdr_name, headerfilter_list);
-            }
-            if (erase) {
-                DBG("erasing header '%s' by %s", hdr_name.c_str(), FilterType2String(f_type));
-                hdrs.erase(start_pos, hdr_end - start_pos);
-            } else {
-                start_pos = hdr_end;
+    int    res       = 0;
+    size_t start_pos = 0;
+    while (start_pos < hdrs.length()) {
+        size_t name_end, val_begin, val_end, hdr_end;
+        if ((res = skip_header(hdrs, start_pos, name_end, val_begin, val_end, hdr_end)) != 0) {
+            // keep unparsed rest as is
+            out.append(hdrs, start_pos, string::npos);
+            break;
+        }
+
+        std::string_view hdr_name(hdrs.data() + start_pos, name_end - start_pos);
+
+        bool erase = false;
+        for (const auto &[f_type, matcher] : active) {
+            bool matched = use_patterns ? matcher->match_pattern(hdr_name) : matcher->match_exact(hdr_name);
+            if (f_type == Whitelist ? !matched : matched) {
+                DBG("erasing header '%.*s' by %s", static_cast<int>(hdr_name.size()), hdr_name.data(),
+                    FilterType2String(f_type));
+                erase = true;
+                break;
             }
         }
+
+        if (!erase)
+            out.append(hdrs, start_pos, hdr_end - start_pos);
+
+        start_pos = hdr_end;
     }
-    return 0;
+
+    hdrs.swap(out);
+    return res;
+}
+
+int inplaceHeaderFilter(string &hdrs, const vector<FilterEntry> &filter_list)
+{
+    return filterHeaders(hdrs, filter_list, false);
+}
+
+int inplaceHeaderPatternFilter(string &hdrs, const vector<FilterEntry> &filter_list)
+{
+    return filterHeaders(hdrs, filter_list, true);
 }
@@ -36,11 +36,44 @@ using std::set;
 #include <vector>
 using std::vector;
 
+#include <string_view>
+#include <cstdint>
+
 enum FilterType { Transparent = 0, Whitelist, Blacklist, Undefined };
 
+/* precompiled lowercase header names list.
+ * exact names are kept sorted by the case-insensitive name hash,
+ * 'prefix*' and '*suffix' patterns are kept in the separate tables.
+ * lookups do not copy or lowercase the checked name */
+class HeaderNameMatcher {
+    vector<std::pair<uint64_t, string>> exact;
+    vector<string>                      prefixes;
+    vector<string>                      suffixes;
+    bool                                match_any;
+    bool                                compiled;
+
+  public:
+    HeaderNameMatcher()
+        : match_any(false)
+        , compiled(false)
+    {
+    }
+
+    void compile(const set<string> &filter_list);
+    bool is_compiled() const { return compiled; }
+
+    bool match_exact(std::string_view name) const;
+    /* exact names, 'prefix*', '*suffix' and '*' patterns */
+    bool match_pattern(std::string_view name) const;
+};
+
 struct FilterEntry {
-    FilterType  filter_type;
-    set<string> filter_list;
+    FilterType        filter_type;
+    set<string>       filter_list;
+    HeaderNameMatcher matcher;
+
+    /* must be called after filter_list changes to use matcher */
+    void compile() { matcher.compile(filter_list); }
 
     bool operator==(const FilterEntry &rhs) const
     {
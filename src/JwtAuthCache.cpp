@@ -0,0 +1,104 @@
+#include "JwtAuthCache.h"
+#include "log.h"
+
+#include <botan/hash.h>
+
+#include <algorithm>
+
+JwtAuthCache::JwtAuthCache()
+    : max_shard_size(0)
+    , max_ttl(0)
+    , generation(0)
+    , hits(stat_group(Counter, MOD_NAME, "jwt_auth_cache_hits")
+               .setHelp("JWT auth results taken from the verified tokens cache")
+               .addAtomicCounter())
+    , misses(stat_group(Counter, MOD_NAME, "jwt_auth_cache_misses")
+                 .setHelp("JWT auth requests processed with the signature verification")
+                 .addAtomicCounter())
+{
+}
+
+void JwtAuthCache::configure(size_t max_size, time_t max_ttl)
+{
+    max_shard_size = max_size ? std::max<size_t>(max_size / shards_count, 1) : 0;
+    this->max_ttl  = max_ttl;
+}
+
+JwtAuthCache::key_type JwtAuthCache::make_key(std::string_view token)
+{
+    thread_local auto sha256 = Botan::HashFunction::create_or_throw("SHA-256");
+
+    key_type key;
+    sha256->update(reinterpret_cast<const uint8_t *>(token.data()), token.size());
+    sha256->final(key.data());
+    return key;
+}
+
+std::optional<int> JwtAuthCache::get(const key_type &key, time_t now)
+{
+    if (!enabled())
+        return std::nullopt;
+
+    auto &s = get_shard(key);
+
+    {
+        AmLock l(s.mutex);
+        if (auto it = s.entries.find(key); it != s.entries.end()) {
+            if (now <= it->second.exp) {
+                hits.inc();
+                return it->second.auth_id;
+            }
+            s.entries.erase(it);
+        }
+    }
+
+    misses.inc();
+    return std::nullopt;
+}
+
+void JwtAuthCache::put(const key_type &key, int auth_id, time_t exp, uint64_t verified_generation)
+{
+    if (!enabled())
+        return;
+
+    auto &s = get_shard(key);
+
+    AmLock l(s.mutex);
+
+    // clear() was called during the verification
+    if (verified_generation != generation.load())
+        return;
+
+    time_t now = time(nullptr);
+    if (exp - now > max_ttl)
+        exp = now + max_ttl;
+
+    if (s.entries.size() >= max_shard_size) {
+        std::erase_if(s.entries, [now](const auto &it) { return now > it.second.exp; });
+        if (s.entries.size() >= max_shard_size)
+            s.entries.erase(s.entries.begin());
+    }
+
+    s.entries.insert_or_assign(key, entry{ auth_id, exp });
+}
+
+void JwtAuthCache::clear()
+{
+    // increment before the shards cleanup to reject results verified against the old data
+    generation.fetch_add(1);
+
+    for (auto &s : shards) {
+        AmLock l(s.mutex);
+        s.entries.clear();
+    }
+}
+
+size_t JwtAuthCache::size()
+{
+    size_t ret = 0;
+    for (auto &s : shards) {
+        AmLock l(s.mutex);
+        ret += s.entries.size();
+    }
+    return ret;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "AmThread.h"
+#include "AmStatistics.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+/* verified JWT results to skip the signature verification
+ * for the tokens reused by clients until they expire.
+ *
+ * entries are keyed by SHA-256 of the raw token and stored in the mutex protected shards.
+ * shard size is bounded, expired entries are evicted first on overflow.
+ * entries lifetime is limited by max_ttl even for the tokens with the far or missing 'exp'.
+ * clear() must be called after any change of the data used to resolve the auth_id
+ * or verify the signature. generation check prevents results
+ * verified against the old data from being stored after clear() */
+class JwtAuthCache {
+  public:
+    using key_type = std::array<uint8_t, 32>;
+
+    static constexpr size_t shards_count = 16;
+
+  private:
+    struct key_hash {
+        size_t operator()(const key_type &key) const
+        {
+            size_t h;
+            memcpy(&h, key.data(), sizeof(h));
+            return h;
+        }
+    };
+
+    struct entry {
+        int    auth_id;
+        time_t exp;
+    };
+
+    struct shard {
+        AmMutex                                       mutex;
+        std::unordered_map<key_type, entry, key_hash> entries;
+    };
+
+    std::array<shard, shards_count> shards;
+    size_t                          max_shard_size;
+    time_t                          max_ttl;
+    std::atomic<uint64_t>           generation;
+
+    AtomicCounter &hits;
+    AtomicCounter &misses;
+
+    shard &get_shard(const key_type &key) { return shards[key[sizeof(size_t)] % shards_count]; }
+
+  public:
+    JwtAuthCache();
+
+    /* zero size disables the cache. max_ttl is in seconds */
+    void configure(size_t max_size, time_t max_ttl);
+    bool enabled() const { return max_shard_size != 0; }
+
+    static key_type make_key(std::string_view token);
+
+    uint64_t get_generation() const { return generation.load(); }
+
+    /* returns cached auth_id for not expired token */
+    std::optional<int> get(const key_type &key, time_t now);
+    /* generation must be obtained before the data used for verification */
+    void put(const key_type &key, int auth_id, time_t exp, uint64_t verified_generation);
+    void clear();
+
+    size_t size();
+};
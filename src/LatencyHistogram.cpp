@@ -0,0 +1,200 @@
+#include "LatencyHistogram.h"
+
+#include <bit>
+#include <sys/time.h>
+
+#define LATENCY_HISTOGRAMS_CONTAINER_NAME MOD_NAME "_latency"
+
+/* LatencyHistogram */
+
+LatencyHistogram::LatencyHistogram()
+    : sum(0)
+    , count(0)
+{
+    for (auto &b : buckets)
+        b.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucket_index(unsigned long long usec)
+{
+    static constexpr unsigned long long lowest_bound  = 1ULL << min_exponent;
+    static constexpr unsigned long long highest_bound = 1ULL << max_exponent;
+
+    if (usec <= lowest_bound)
+        return 0;
+    if (usec > highest_bound)
+        return buckets_count - 1;
+
+    // usec is within (2^e, 2^(e+1)]
+    int                exponent = std::bit_width(usec - 1) - 1;
+    unsigned long long base     = 1ULL << exponent;
+    unsigned long long step     = base / sub_buckets;
+    int                sub_idx  = static_cast<int>((usec - base + step - 1) / step); // 1..sub_buckets
+
+    return 1 + (exponent - min_exponent) * sub_buckets + (sub_idx - 1);
+}
+
+unsigned long long LatencyHistogram::bucket_upper_bound(int idx)
+{
+    if (idx <= 0)
+        return 1ULL << min_exponent;
+    if (idx >= buckets_count - 1)
+        return ~0ULL;
+
+    idx -= 1;
+    unsigned long long base = 1ULL << (min_exponent + idx / sub_buckets);
+    return base + (base / sub_buckets) * (idx % sub_buckets + 1);
+}
+
+void LatencyHistogram::add(unsigned long long usec)
+{
+    buckets[bucket_index(usec)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(usec, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::add(const struct timeval &start)
+{
+    struct timeval now, diff;
+    gettimeofday(&now, nullptr);
+    timersub(&now, &start, &diff);
+    if (diff.tv_sec < 0) {
+        add(0ULL);
+        return;
+    }
+    add(static_cast<unsigned long long>(diff.tv_sec) * 1000000 + static_cast<unsigned long long>(diff.tv_usec));
+}
+
+void LatencyHistogram::add_interval(const clock::time_point &start, const clock::time_point &end)
+{
+    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    add(usec > 0 ? static_cast<unsigned long long>(usec) : 0ULL);
+}
+
+unsigned long long LatencyHistogram::get_quantile(double q) const
+{
+    auto total = get_count();
+    if (!total)
+        return 0;
+
+    auto               rank = static_cast<unsigned long long>(q * static_cast<double>(total));
+    unsigned long long acc  = 0;
+    for (int i = 0; i < buckets_count; i++) {
+        acc += get_bucket(i);
+        if (acc > rank)
+            return bucket_upper_bound(i);
+    }
+    return bucket_upper_bound(buckets_count - 1);
+}
+
+/* LatencyHistogramsGroup */
+
+struct LatencyHistogramsGroup : public StatCountersGroupsInterface {
+    enum group_type { GroupBucket = 0, GroupSum, GroupCount };
+
+    const vector<const LatencyHistogram *> &histograms;
+    const vector<map<string, string>>      &labels;
+    group_type                              type;
+
+    LatencyHistogramsGroup(const vector<const LatencyHistogram *> &histograms,
+                           const vector<map<string, string>> &labels, group_type type)
+        : StatCountersGroupsInterface(Counter)
+        , histograms(histograms)
+        , labels(labels)
+        , type(type)
+    {
+    }
+
+    void iterate_counters(iterate_counters_callback_type callback) override
+    {
+        for (size_t i = 0; i < histograms.size(); i++) {
+            const auto &h = *histograms[i];
+            switch (type) {
+            case GroupSum:   callback(h.get_sum(), labels[i]); break;
+            case GroupCount: callback(h.get_count(), labels[i]); break;
+            case GroupBucket:
+            {
+                // cumulative buckets. skip empty tail to keep output compact
+                auto               total = h.get_count();
+                unsigned long long acc   = 0;
+                auto               l     = labels[i];
+                for (int b = 0; b < LatencyHistogram::buckets_count - 1; b++) {
+                    acc += h.get_bucket(b);
+                    l["le"] = std::to_string(LatencyHistogram::bucket_upper_bound(b));
+                    callback(acc, l);
+                    if (acc >= total)
+                        break;
+                }
+                l["le"] = "+Inf";
+                callback(total, l);
+            } break;
+            }
+        }
+    }
+};
+
+/* LatencyHistograms */
+
+LatencyHistograms::LatencyHistograms()
+{
+    statistics::instance()->add_groups_container(LATENCY_HISTOGRAMS_CONTAINER_NAME, this, false);
+}
+
+LatencyHistograms &LatencyHistograms::instance()
+{
+    static LatencyHistograms *_instance = new LatencyHistograms();
+    return *_instance;
+}
+
+LatencyHistogram &LatencyHistograms::add(const string &name, const map<string, string> &labels)
+{
+    AmLock l(histograms_mutex);
+    histograms.emplace_back(name, labels);
+    return histograms.back().histogram;
+}
+
+void LatencyHistograms::setHelp(const string &name, const string &help)
+{
+    AmLock l(histograms_mutex);
+    help_strings[name] = help;
+}
+
+void LatencyHistograms::operator()(const string &, iterate_groups_callback_type callback)
+{
+    struct metric {
+        vector<const LatencyHistogram *> histograms;
+        vector<map<string, string>>      labels;
+    };
+    map<string, metric> metrics;
+
+    {
+        AmLock l(histograms_mutex);
+        for (const auto &e : histograms) {
+            auto &m = metrics[e.name];
+            m.histograms.push_back(&e.histogram);
+            m.labels.push_back(e.labels);
+        }
+    }
+
+    for (const auto &[name, m] : metrics) {
+        string help;
+        {
+            AmLock l(histograms_mutex);
+            auto   it = help_strings.find(name);
+            if (it != help_strings.end())
+                help = it->second;
+        }
+
+        LatencyHistogramsGroup bucket_group(m.histograms, m.labels, LatencyHistogramsGroup::GroupBucket);
+        bucket_group.setHelp(help);
+        callback(name + "_bucket", bucket_group);
+
+        LatencyHistogramsGroup sum_group(m.histograms, m.labels, LatencyHistogramsGroup::GroupSum);
+        sum_group.setHelp(help);
+        callback(name + "_sum", sum_group);
+
+        LatencyHistogramsGroup count_group(m.histograms, m.labels, LatencyHistogramsGroup::GroupCount);
+        count_group.setHelp(help);
+        callback(name + "_count", count_group);
+    }
+}
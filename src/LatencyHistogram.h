@@ -0,0 +1,88 @@
+#pragma once
+
+#include <AmStatistics.h>
+#include <AmThread.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+/* log-linear (HDR-like) histogram of durations in microseconds
+ * with the fixed memory footprint and lock-free updates.
+ *
+ * each power of two range (2^e, 2^(e+1)] within [2^min_exponent, 2^max_exponent]
+ * is split into sub_buckets linear buckets.
+ * values below the lowest bound go to the first bucket,
+ * values above the highest bound go to the last (+Inf) bucket */
+class LatencyHistogram {
+  public:
+    static constexpr int min_exponent  = 4;  // 16us
+    static constexpr int max_exponent  = 25; // ~33.5s
+    static constexpr int sub_buckets   = 4;
+    static constexpr int buckets_count = (max_exponent - min_exponent) * sub_buckets + 2;
+
+    using clock = std::chrono::steady_clock;
+
+  private:
+    std::array<std::atomic<unsigned long long>, buckets_count> buckets;
+    std::atomic<unsigned long long>                            sum;
+    std::atomic<unsigned long long>                            count;
+
+  public:
+    LatencyHistogram();
+
+    static int                bucket_index(unsigned long long usec);
+    static unsigned long long bucket_upper_bound(int idx);
+
+    void add(unsigned long long usec);
+    void add(const clock::time_point &start) { add_interval(start, clock::now()); }
+    void add(const struct timeval &start);
+    void add_interval(const clock::time_point &start, const clock::time_point &end);
+
+    unsigned long long get_count() const { return count.load(std::memory_order_relaxed); }
+    unsigned long long get_sum() const { return sum.load(std::memory_order_relaxed); }
+    unsigned long long get_bucket(int idx) const { return buckets[idx].load(std::memory_order_relaxed); }
+
+    /* approximated value (bucket upper bound) for the quantile q in [0,1] */
+    unsigned long long get_quantile(double q) const;
+};
+
+/* registry of the latency histograms exported to the statistics
+ * as <name>_bucket{le="usec"}, <name>_sum and <name>_count counters */
+class LatencyHistograms : public StatsCountersGroupsContainerInterface {
+    struct entry {
+        string              name;
+        map<string, string> labels;
+        LatencyHistogram    histogram;
+
+        entry(const string &name, const map<string, string> &labels)
+            : name(name)
+            , labels(labels)
+        {
+        }
+    };
+
+    std::list<entry>    histograms;
+    map<string, string> help_strings;
+    AmMutex             histograms_mutex;
+
+    LatencyHistograms();
+
+  public:
+    static LatencyHistograms &instance();
+
+    /* returned reference remains valid for the whole process lifetime */
+    LatencyHistogram &add(const string &name, const map<string, string> &labels = {});
+    void              setHelp(const string &name, const string &help);
+
+    /* StatsCountersGroupsContainerInterface */
+    void operator()(const string &name, iterate_groups_callback_type callback) override;
+};
@@ -2,8 +2,12 @@
 #include "HeaderFilter.h"
 #include "db/DbHelpers.h"
 
+#include <map>
+#include <set>
+
 OriginationPreAuth::OriginationPreAuth(YetiCfg &ycfg)
     : ycfg(ycfg)
+    , ip_auth_ids_loaded(false)
 {
 }
 
@@ -24,7 +28,8 @@ OriginationPreAuth::LoadBalancerData::operator AmArg() const
 }
 
 OriginationPreAuth::IPAuthData::IPAuthData(const AmArg &r)
-    : ip(DbAmArg_hash_get_str(r, "ip"))
+    : id(DbAmArg_hash_get_int(r, "id"))
+    , ip(DbAmArg_hash_get_str(r, "ip"))
     , x_yeti_auth(DbAmArg_hash_get_str(r, "x_yeti_auth"))
     , require_incoming_auth(DbAmArg_hash_get_bool(r, "require_incoming_auth"))
     , require_identity_parsing(DbAmArg_hash_get_bool(r, "require_identity_parsing"))
@@ -36,6 +41,7 @@ OriginationPreAuth::IPAuthData::IPAuthData(const AmArg &r)
 OriginationPreAuth::IPAuthData::operator AmArg() const
 {
     AmArg a;
+    a["id"]                       = id;
     a["ip"]                       = ip;
     a["subnet"]                   = subnet;
     a["x_yeti_auth"]              = x_yeti_auth;
@@ -61,18 +67,99 @@ void OriginationPreAuth::reloadLoadBalancers(const AmArg &data)
 void OriginationPreAuth::reloadLoadIPAuth(const AmArg &data)
 {
     IPAuthDataContainer tmp_ip_auths;
+    bool                ids_loaded = true;
     if (isArgArray(data)) {
         for (size_t i = 0; i < data.size(); i++) {
+            if (!data[i].hasMember("id"))
+                ids_loaded = false;
             tmp_ip_auths.emplace_back(data[i]);
         }
     }
 
     DBG("loaded %zd IP auth data entries", tmp_ip_auths.size());
 
+    if (!ids_loaded && ycfg.db_delta_reloads)
+        ERROR("load_ip_auth2() returned no 'id' column. IP auth delta reloads are disabled");
+
     AmLock l(mutex);
 
     ip_auths.swap(tmp_ip_auths);
+    ip_auth_ids_loaded = ids_loaded;
+
+    rebuildSubnetsTree();
+}
+
+void OriginationPreAuth::applyIPAuthDelta(const AmArg &data)
+{
+    if (!isArgArray(data))
+        return;
+
+    // parse rows before the patching. exception leaves entries untouched
+    std::set<int>                      changed;
+    std::map<int, IPAuthDataContainer> upserts;
+    for (size_t i = 0; i < data.size(); i++) {
+        const AmArg &row = data[i];
+        if (!row.hasMember("id"))
+            throw string("no id in the IP auth delta row");
+        int id = DbAmArg_hash_get_int(row, "id");
+        changed.emplace(id);
+        if (!DbAmArg_hash_get_bool(row, "deleted"))
+            upserts[id].emplace_back(row);
+    }
+
+    AmLock l(mutex);
+
+    if (!ip_auth_ids_loaded)
+        throw string("IP auth entries are loaded without ids");
+
+    std::set<int> loaded;
+    for (const auto &auth : ip_auths) {
+        if (changed.contains(auth.id))
+            loaded.emplace(auth.id);
+    }
+
+    auto take_upserts = [&upserts](decltype(upserts)::iterator it, IPAuthDataContainer &dst) {
+        dst.insert(dst.end(), std::make_move_iterator(it->second.begin()), std::make_move_iterator(it->second.end()));
+        return upserts.erase(it);
+    };
+
+    /* entries sharing the subnet are matched in the load order. keep it:
+     * rows of the loaded id replace its first entry, rows of the new id are placed
+     * before the first entry with the greater id */
+    IPAuthDataContainer patched;
+    patched.reserve(ip_auths.size() + data.size());
+    for (auto &auth : ip_auths) {
+        for (auto it = upserts.begin(); it != upserts.end() && it->first < auth.id;) {
+            if (loaded.contains(it->first))
+                ++it;
+            else
+                it = take_upserts(it, patched);
+        }
+        if (!changed.contains(auth.id)) {
+            patched.emplace_back(std::move(auth));
+        } else if (auto it = upserts.find(auth.id); it != upserts.end()) {
+            take_upserts(it, patched);
+        }
+    }
+    for (auto it = upserts.begin(); it != upserts.end();)
+        it = take_upserts(it, patched);
 
+    ip_auths.swap(patched);
+
+    DBG("applied IP auth delta for %zd ids. %zd entries", changed.size(), ip_auths.size());
+
+    // entries indexes are changed. tree rebuilding is cheap comparing to the full DB data reload
+    rebuildSubnetsTree();
+}
+
+bool OriginationPreAuth::isIPAuthDeltaSupported()
+{
+    AmLock l(mutex);
+    return ip_auth_ids_loaded;
+}
+
+void OriginationPreAuth::rebuildSubnetsTree()
+{
     subnets_tree.clear();
     int idx = 0;
     for (const auto &auth : ip_auths)
@@ -112,7 +199,8 @@ void OriginationPreAuth::ShowIPAuth(const AmArg &arg, AmArg &ret)
     // ret["tree"] = subnets_tree;
 }
 
-bool OriginationPreAuth::onRequest(const AmSipRequest &req, bool match_subnet, Reply &reply)
+bool OriginationPreAuth::onRequest(const AmSipRequest &req, const SipHeadersIndex &hdrs_index, bool match_subnet,
+                                   Reply &reply)
 {
     /* determine src IP to match:
      * use X-AUTH-IP header value if exists
@@ -138,42 +226,28 @@ bool OriginationPreAuth::onRequest(const AmSipRequest &req, bool match_subnet, R
 
     static string x_yeti_auth_hdr("X-YETI-AUTH");
 
-    size_t start_pos = 0;
-    while (start_pos < req.hdrs.length()) {
-        size_t name_end, val_begin, val_end, hdr_end, hdr_length;
-        int    res;
-        if ((res = skip_header(req.hdrs, start_pos, name_end, val_begin, val_end, hdr_end)) != 0) {
-            break;
+    if (auto h = hdrs_index.find(ycfg.ip_auth_hdr)) {
+        DBG3("found first %s hdr", ycfg.ip_auth_hdr.data());
+        if (reply.request_is_from_trusted_lb) {
+            reply.orig_ip = hdrs_index.value(*h);
+            DBG("use %s value %s as source IP", ycfg.ip_auth_hdr.data(), reply.orig_ip.data());
         }
-        const char *hdr = req.hdrs.c_str() + start_pos;
-        hdr_length      = name_end - start_pos;
-        if (hdr_length == ycfg.ip_auth_hdr.size() && 0 == strncasecmp(hdr, ycfg.ip_auth_hdr.c_str(), hdr_length)) {
-            // req.hdrs.substr(val_begin, val_end-val_begin);
-            if (reply.orig_ip.empty()) {
-                DBG3("found first %s hdr", ycfg.ip_auth_hdr.data());
-                if (reply.request_is_from_trusted_lb) {
-                    reply.orig_ip = req.hdrs.substr(val_begin, val_end - val_begin);
-                    DBG("use %s value %s as source IP", ycfg.ip_auth_hdr.data(), reply.orig_ip.data());
-                }
-            }
-        } else if (hdr_length == x_yeti_auth_hdr.size() && 0 == strncasecmp(hdr, x_yeti_auth_hdr.c_str(), hdr_length)) {
-            if (reply.x_yeti_auth.empty()) {
-                reply.x_yeti_auth = req.hdrs.substr(val_begin, val_end - val_begin);
-                DBG("found first X-YETI-AUTH hdr with value: %s", reply.x_yeti_auth.data());
-            }
-        } else if (!ycfg.auth_default_realm_header.empty() && hdr_length == ycfg.auth_default_realm_header.size() &&
-                   0 == strncasecmp(hdr, ycfg.auth_default_realm_header.c_str(), hdr_length))
-        {
-            if (reply.x_default_realm.empty()) {
-                DBG3("found first %s hdr", ycfg.auth_default_realm_header.c_str());
-                if (reply.request_is_from_trusted_lb) {
-                    reply.x_default_realm = req.hdrs.substr(val_begin, val_end - val_begin);
-                    DBG("use %s value %s as default realm", ycfg.auth_default_realm_header.c_str(),
-                        reply.x_default_realm.data());
-                }
+    }
+
+    if (auto h = hdrs_index.find(x_yeti_auth_hdr)) {
+        reply.x_yeti_auth = hdrs_index.value(*h);
+        DBG("found first X-YETI-AUTH hdr with value: %s", reply.x_yeti_auth.data());
+    }
+
+    if (!ycfg.auth_default_realm_header.empty()) {
+        if (auto h = hdrs_index.find(ycfg.auth_default_realm_header)) {
+            DBG3("found first %s hdr", ycfg.auth_default_realm_header.c_str());
+            if (reply.request_is_from_trusted_lb) {
+                reply.x_default_realm = hdrs_index.value(*h);
+                DBG("use %s value %s as default realm", ycfg.auth_default_realm_header.c_str(),
+                    reply.x_default_realm.data());
             }
         }
-        start_pos = hdr_end;
     }
 
     if (reply.orig_ip.empty()) {
@@ -2,6 +2,7 @@
 
 #include "cfg/YetiCfg.h"
 #include "IPTree.h"
+#include "SipHeadersIndex.h"
 
 class OriginationPreAuth final {
     YetiCfg &ycfg;
@@ -17,6 +18,7 @@ class OriginationPreAuth final {
     using LoadBalancersContainer = vector<LoadBalancerData>;
 
     struct IPAuthData {
+        int      id;
         string   ip;
         AmSubnet subnet;
         string   x_yeti_auth;
@@ -30,9 +32,12 @@ class OriginationPreAuth final {
 
     LoadBalancersContainer load_balancers;
     IPAuthDataContainer    ip_auths;
+    bool                   ip_auth_ids_loaded; // every loaded entry has id. required by the delta
     AmMutex                mutex;
     IPTree                 subnets_tree;
 
+    void rebuildSubnetsTree();
+
   public:
     struct Reply {
         string orig_ip;
@@ -46,9 +51,14 @@ class OriginationPreAuth final {
     OriginationPreAuth(YetiCfg &cfg);
     void reloadLoadBalancers(const AmArg &data);
     void reloadLoadIPAuth(const AmArg &data);
+    /* rows of the changed ids replace all their entries in place.
+     * id with the single row with 'deleted' flag is removed */
+    void applyIPAuthDelta(const AmArg &data);
+    /* false if the last full load returned no ids */
+    bool isIPAuthDeltaSupported();
 
     void ShowTrustedBalancers(AmArg &ret);
     void ShowIPAuth(const AmArg &arg, AmArg &ret);
 
-    bool onRequest(const AmSipRequest &req, bool match_subnet, Reply &reply);
+    bool onRequest(const AmSipRequest &req, const SipHeadersIndex &hdrs_index, bool match_subnet, Reply &reply);
 };
@@ -37,6 +37,11 @@
 #include <algorithm>
 #include <stdlib.h>
 
+// expected size of the single $xy expression value to presize the output buffer
+#define EXPRESSION_SIZE_ESTIMATE 32
+#define MAX_CACHED_TEMPLATES     10000
+#define MAX_KEPT_TEMPLATES       (MAX_CACHED_TEMPLATES * 3 / 4)
+
 int replaceParsedParam(const string &s, size_t p, const AmShallowUriParser &parsed, string &res)
 {
     int skip_chars = 1;
@@ -133,239 +138,215 @@ int replaceParsedParam(const string &s, size_t p, const AmShallowUriParser &pars
 /* IMPORTANT: be sure to free() the returned string after use */
 char *url_encode(const char *str);
 
-string replaceParameters(const string &s, const char *r_type, const AmSipRequest &req,
-                         const SBCCallProfile *call_profile, const string &app_param,
-                         const string &outbound_interface_host, AmShallowUriParser &ruri_parser,
-                         AmShallowUriParser &from_parser, AmShallowUriParser &to_parser, bool rebuild_ruri,
-                         bool rebuild_from, bool rebuild_to)
+/* evaluate $xy expression at the source position p (next to '$') and append result to the res */
+static void replaceExpression(const string &s, size_t p, const ParamTemplate *nested, const char *r_type,
+                              const AmSipRequest &req, const SBCCallProfile *call_profile, const string &app_param,
+                              const string &outbound_interface_host, AmShallowUriParser &ruri_parser,
+                              AmShallowUriParser &from_parser, AmShallowUriParser &to_parser, bool rebuild_ruri,
+                              bool rebuild_from, bool rebuild_to, string &res)
 {
-    string        res;
-    bool          is_replaced = false;
-    size_t        p           = 0;
-    bool          is_escaped  = false;
-    const string &used_hdrs   = req.hdrs; //(hdrs == NULL) ? req.hdrs : *hdrs;
-    while (p < s.length()) {
-        size_t skip_chars = 1;
+    const string &used_hdrs = req.hdrs;
+
+    switch (s[p]) {
+    case 'f':
+    { // from
+        if ((s.length() == p + 1) || (s[p + 1] == '.')) {
+            if (rebuild_from) {
+                res += from_parser.nameaddr_str();
+            } else {
+                res += req.from;
+            }
+            break;
+        }
 
-        if (is_escaped) {
-            switch (s[p]) {
-            case 'r': res += '\r'; break;
-            case 'n': res += '\n'; break;
-            case 't': res += '\t'; break;
-            default:  res += s[p]; break;
+        if (s[p + 1] == 't') { // $ft - from tag
+            res += req.from_tag;
+            break;
+        }
+
+        if (from_parser.get_uri_host().empty()) {
+            if (!from_parser.parse_uri(req.from)) {
+                WARN("Error parsing From URI '%s'", req.from.c_str());
+                break;
             }
-            is_escaped = false;
-        } else { // not escaped
-            if (s[p] == '\\') {
-                if (p == s.length() - 1) {
-                    res += '\\'; // add single \ at the end
-                } else {
-                    is_escaped  = true;
-                    is_replaced = true;
-                }
-            } else if ((s[p] == '$') && (s.length() >= p + 1)) {
-                is_replaced = true;
-                p++;
-                switch (s[p]) {
-                case 'f':
-                { // from
-                    if ((s.length() == p + 1) || (s[p + 1] == '.')) {
-                        if (rebuild_from) {
-                            res += from_parser.nameaddr_str();
-                        } else {
-                            res += req.from;
-                        }
-                        break;
-                    }
+        }
 
-                    if (s[p + 1] == 't') { // $ft - from tag
-                        res += req.from_tag;
-                        break;
-                    }
+        replaceParsedParam(s, p, from_parser, res);
+    }; break;
 
-                    if (from_parser.get_uri_host().empty()) {
-                        if (!from_parser.parse_uri(req.from)) {
-                            WARN("Error parsing From URI '%s'", req.from.c_str());
-                            break;
-                        }
-                    }
+    case 't':
+    { // to
+        if ((s.length() == p + 1) || (s[p + 1] == '.')) {
+            if (rebuild_to) {
+                res += to_parser.nameaddr_str();
+            } else {
+                res += req.to;
+            }
+            break;
+        }
 
-                    skip_chars = replaceParsedParam(s, p, from_parser, res);
-                }; break;
-
-                case 't':
-                { // to
-                    if ((s.length() == p + 1) || (s[p + 1] == '.')) {
-                        if (rebuild_to) {
-                            res += to_parser.nameaddr_str();
-                        } else {
-                            res += req.to;
-                        }
-                        break;
-                    }
+        if (s[p + 1] == 't') { // $tt - to tag
+            res += req.to_tag;
+            break;
+        }
 
-                    if (s[p + 1] == 't') { // $tt - to tag
-                        res += req.to_tag;
-                        break;
-                    }
+        if (to_parser.get_uri_host().empty()) {
+            if (!to_parser.parse_uri(req.to)) {
+                WARN("Error parsing To URI '%s'", req.to.c_str());
+                break;
+            }
+        }
 
-                    if (to_parser.get_uri_host().empty()) {
-                        if (!to_parser.parse_uri(req.to)) {
-                            WARN("Error parsing To URI '%s'", req.to.c_str());
-                            break;
-                        }
-                    }
+        replaceParsedParam(s, p, to_parser, res);
+    }; break;
 
-                    skip_chars = replaceParsedParam(s, p, to_parser, res);
-                }; break;
-
-                case 'r':
-                { // r-uri
-                    if ((s.length() == p + 1) || (s[p + 1] == '.')) {
-                        if (rebuild_ruri) {
-                            res += ruri_parser.uri_str();
-                        } else {
-                            res += req.r_uri;
-                        }
-                        break;
-                    }
+    case 'r':
+    { // r-uri
+        if ((s.length() == p + 1) || (s[p + 1] == '.')) {
+            if (rebuild_ruri) {
+                res += ruri_parser.uri_str();
+            } else {
+                res += req.r_uri;
+            }
+            break;
+        }
 
-                    if (ruri_parser.get_uri_host().empty()) {
-                        if (!ruri_parser.parse_uri(req.r_uri)) {
-                            WARN("Error parsing R-URI '%s'", req.r_uri.c_str());
-                            break;
-                        }
-                    }
-                    skip_chars = replaceParsedParam(s, p, ruri_parser, res);
-                }; break;
-
-                case 'c':
-                { // call-id
-                    if ((s.length() == p + 1) || (s[p + 1] == 'i')) {
-                        res += req.callid;
-                        break;
-                    }
-                    WARN("unknown replacement $c%c", s[p + 1]);
-                }; break;
-
-                case 's':
-                { // source (remote)
-                    if (s.length() < p + 1) {
-                        WARN("unknown replacement $s");
-                        break;
-                    }
+        if (ruri_parser.get_uri_host().empty()) {
+            if (!ruri_parser.parse_uri(req.r_uri)) {
+                WARN("Error parsing R-URI '%s'", req.r_uri.c_str());
+                break;
+            }
+        }
+        replaceParsedParam(s, p, ruri_parser, res);
+    }; break;
 
-                    if (s[p + 1] == 'i') { // $si source IP address
-                        res += req.remote_ip;
-                        break;
-                    } else if (s[p + 1] == 'p') { // $sp source port
-                        res += int2str(req.remote_port);
-                        break;
-                    }
+    case 'c':
+    { // call-id
+        if ((s.length() == p + 1) || (s[p + 1] == 'i')) {
+            res += req.callid;
+            break;
+        }
+        WARN("unknown replacement $c%c", s[p + 1]);
+    }; break;
 
-                    WARN("unknown replacement $s%c", s[p + 1]);
-                }; break;
+    case 's':
+    { // source (remote)
+        if (s.length() < p + 1) {
+            WARN("unknown replacement $s");
+            break;
+        }
 
-                case 'd':
-                { // destination (remote UAS)
-                    if (s.length() < p + 1) {
-                        WARN("unknown replacement $s");
-                        break;
-                    }
+        if (s[p + 1] == 'i') { // $si source IP address
+            res += req.remote_ip;
+            break;
+        } else if (s[p + 1] == 'p') { // $sp source port
+            res += int2str(req.remote_port);
+            break;
+        }
 
-                    if (!call_profile->next_hop.empty()) {
-                        cstring               _next_hop = stl2cstr(call_profile->next_hop);
-                        list<sip_destination> dest_list;
-                        if (parse_next_hop(_next_hop, dest_list)) {
-                            WARN("parse_next_hop %.*s failed", _next_hop.len, _next_hop.s);
-                            break;
-                        }
-
-                        if (dest_list.size() == 0) {
-                            WARN("next-hop is not empty, but the resulting destination list is");
-                            break;
-                        }
-
-                        const sip_destination &dest = dest_list.front();
-                        if (s[p + 1] == 'i') { // $di remote UAS IP address
-                            res += c2stlstr(dest.host);
-                            break;
-                        } else if (s[p + 1] == 'p') { // $dp remote UAS port
-                            res += int2str(dest.port);
-                            break;
-                        }
-
-                        WARN("unknown replacement $d%c", s[p + 1]);
-                        break;
-                    }
+        WARN("unknown replacement $s%c", s[p + 1]);
+    }; break;
 
-                    if (ruri_parser.get_uri_host().empty()) {
-                        if (!ruri_parser.parse_uri(req.r_uri)) {
-                            WARN("Error parsing R-URI '%s'", req.r_uri.c_str());
-                            break;
-                        }
-                    }
+    case 'd':
+    { // destination (remote UAS)
+        if (s.length() < p + 1) {
+            WARN("unknown replacement $s");
+            break;
+        }
 
-                    if (s[p + 1] == 'i') { // $di remote UAS IP address
-                        res += ruri_parser.get_uri_host();
-                        break;
-                    } else if (s[p + 1] == 'p') { // $dp remote UAS port
-                        res += int2str(ruri_parser.get_uri_port());
-                        break;
-                    }
+        if (!call_profile->next_hop.empty()) {
+            cstring               _next_hop = stl2cstr(call_profile->next_hop);
+            list<sip_destination> dest_list;
+            if (parse_next_hop(_next_hop, dest_list)) {
+                WARN("parse_next_hop %.*s failed", _next_hop.len, _next_hop.s);
+                break;
+            }
 
-                    WARN("unknown replacement $d%c", s[p + 1]);
-                }; break; // case 'd'
+            if (dest_list.size() == 0) {
+                WARN("next-hop is not empty, but the resulting destination list is");
+                break;
+            }
 
-                case 'R':
-                { // received (local)
-                    if (s.length() < p + 1) {
-                        WARN("unknown replacement $R");
-                        break;
-                    }
+            const sip_destination &dest = dest_list.front();
+            if (s[p + 1] == 'i') { // $di remote UAS IP address
+                res += c2stlstr(dest.host);
+                break;
+            } else if (s[p + 1] == 'p') { // $dp remote UAS port
+                res += int2str(dest.port);
+                break;
+            }
 
-                    if (s[p + 1] == 'i') { // $Ri received IP address
-                        res += req.local_ip.c_str();
-                        break;
-                    } else if (s[p + 1] == 'p') { // $Rp received port
-                        res += int2str(req.local_port);
-                        break;
-                    } else if (s[p + 1] == 'f') { // $Rf received interface id
-                        res += int2str(req.local_if);
-                        break;
-                    } else if (s[p + 1] == 'n') { // $Rn received interface name
-                        if (req.local_if < AmConfig.sip_ifs.size()) {
-                            res += AmConfig.sip_ifs[req.local_if].name;
-                        }
-                        break;
-                    } else if (s[p + 1] == 'I') { // $RI received interface public IP
-                        if (req.local_if < AmConfig.sip_ifs.size()) {
-                            // TODO: use smth like req.local_proto to get correct public_ip
-                            res += AmConfig.sip_ifs[req.local_if].proto_info[0]->public_ip;
-                        }
-                        break;
-                    }
-                    WARN("unknown replacement $R%c", s[p + 1]);
-                }; break; // case 'R'
-
-                case 'O':
-                { // outbound (after route)
-                    if (s.length() < p + 1) {
-                        WARN("unknown replacement $O");
-                        break;
-                    }
-                    if (s[p + 1] == 'i') { // $Oi outbound IP address
-                        if (!outbound_interface_host.empty()) {
-                            /*DBG("replace $Oi with '%s' in %s (%s)",
-                                outbound_interface_host.data(), r_type, s.data());*/
-                            res += outbound_interface_host;
-                        } else {
-                            ERROR("$Oi is used in %s (%s) before outbound interface resolved", r_type, s.data());
-                        }
-                        break;
-                    }
-                    WARN("unknown replacement $O%c", s[p + 1]);
-                }; break;
+            WARN("unknown replacement $d%c", s[p + 1]);
+            break;
+        }
+
+        if (ruri_parser.get_uri_host().empty()) {
+            if (!ruri_parser.parse_uri(req.r_uri)) {
+                WARN("Error parsing R-URI '%s'", req.r_uri.c_str());
+                break;
+            }
+        }
+
+        if (s[p + 1] == 'i') { // $di remote UAS IP address
+            res += ruri_parser.get_uri_host();
+            break;
+        } else if (s[p + 1] == 'p') { // $dp remote UAS port
+            res += int2str(ruri_parser.get_uri_port());
+            break;
+        }
+
+        WARN("unknown replacement $d%c", s[p + 1]);
+    }; break; // case 'd'
+
+    case 'R':
+    { // received (local)
+        if (s.length() < p + 1) {
+            WARN("unknown replacement $R");
+            break;
+        }
+
+        if (s[p + 1] == 'i') { // $Ri received IP address
+            res += req.local_ip.c_str();
+            break;
+        } else if (s[p + 1] == 'p') { // $Rp received port
+            res += int2str(req.local_port);
+            break;
+        } else if (s[p + 1] == 'f') { // $Rf received interface id
+            res += int2str(req.local_if);
+            break;
+        } else if (s[p + 1] == 'n') { // $Rn received interface name
+            if (req.local_if < AmConfig.sip_ifs.size()) {
+                res += AmConfig.sip_ifs[req.local_if].name;
+            }
+            break;
+        } else if (s[p + 1] == 'I') { // $RI received interface public IP
+            if (req.local_if < AmConfig.sip_ifs.size()) {
+                // TODO: use smth like req.local_proto to get correct public_ip
+                res += AmConfig.sip_ifs[req.local_if].proto_info[0]->public_ip;
+            }
+            break;
+        }
+        WARN("unknown replacement $R%c", s[p + 1]);
+    }; break; // case 'R'
+
+    case 'O':
+    { // outbound (after route)
+        if (s.length() < p + 1) {
+            WARN("unknown replacement $O");
+            break;
+        }
+        if (s[p + 1] == 'i') { // $Oi outbound IP address
+            if (!outbound_interface_host.empty()) {
+                /*DBG("replace $Oi with '%s' in %s (%s)",
+                    outbound_interface_host.data(), r_type, s.data());*/
+                res += outbound_interface_host;
+            } else {
+                ERROR("$Oi is used in %s (%s) before outbound interface resolved", r_type, s.data());
+            }
+            break;
+        }
+        WARN("unknown replacement $O%c", s[p + 1]);
+    }; break;
 
 #define case_HDR(pv_char, pv_name, hdr_name)                                                                           \
     case pv_char:                                                                                                      \
@@ -386,214 +367,396 @@ string replaceParameters(const string &s, const char *r_type, const AmSipRequest
             if (uri_parser.get_uri_port())                                                                             \
                 res += ":" + int2str(uri_parser.get_uri_port());                                                       \
         } else {                                                                                                       \
-            skip_chars = replaceParsedParam(s, p, uri_parser, res);                                                    \
+            replaceParsedParam(s, p, uri_parser, res);                                                                 \
         }                                                                                                              \
     }; break;
 
-                    case_HDR('a', "PAI", SIP_HDR_P_ASSERTED_IDENTITY);  // P-Asserted-Identity
-                    case_HDR('p', "PPI", SIP_HDR_P_PREFERRED_IDENTITY); // P-Preferred-Identity
+        case_HDR('a', "PAI", SIP_HDR_P_ASSERTED_IDENTITY);  // P-Asserted-Identity
+        case_HDR('p', "PPI", SIP_HDR_P_PREFERRED_IDENTITY); // P-Preferred-Identity
 
-                case 'P':
-                { // app-params
-                    if (s[p + 1] != '(') {
-                        WARN("Error parsing P param replacement (missing '(')");
-                        break;
-                    }
-                    if (s.length() < p + 3) {
-                        WARN("Error parsing P param replacement (short string)");
-                        break;
-                    }
+    case 'P':
+    { // app-params
+        if (s[p + 1] != '(') {
+            WARN("Error parsing P param replacement (missing '(')");
+            break;
+        }
+        if (s.length() < p + 3) {
+            WARN("Error parsing P param replacement (short string)");
+            break;
+        }
 
-                    size_t skip_p = p + 2;
-                    for (; skip_p < s.length() && s[skip_p] != ')'; skip_p++) {
-                    }
-                    if (skip_p == s.length()) {
-                        WARN("Error parsing P param replacement (unclosed brackets)");
-                        break;
-                    }
-                    string param_name = s.substr(p + 2, skip_p - p - 2);
-                    // DBG("param_name = '%s' (skip-p - p = %d)", param_name.c_str(), skip_p-p);
-                    res += get_header_keyvalue(app_param, param_name);
-                    skip_chars = skip_p - p;
-                } break;
-
-                case 'H':
-                { // header
-                    size_t name_offset = 2;
-                    if (s[p + 1] != '(') {
-                        if (s[p + 2] != '(') {
-                            WARN("Error parsing H header replacement (missing '(')");
-                            break;
-                        }
-                        name_offset = 3;
-                    }
-                    if (s.length() < name_offset + 1) {
-                        WARN("Error parsing H header replacement (short string)");
-                        break;
-                    }
-                    size_t skip_p = p + name_offset;
-                    for (; skip_p < s.length() && s[skip_p] != ')'; skip_p++) {
-                    }
-                    if (skip_p == s.length()) {
-                        WARN("Error parsing H header replacement (unclosed brackets)");
-                        break;
-                    }
-                    string hdr_name = s.substr(p + name_offset, skip_p - p - name_offset);
-                    // DBG("param_name = '%s' (skip-p - p = %d)", param_name.c_str(), skip_p-p);
-                    if (name_offset == 2) {
-                        // full header
-                        res += getHeader(used_hdrs, hdr_name);
-                    } else {
-                        // parse URI and use component
-                        AmShallowUriParser uri_parser;
-                        auto               hdr = getHeader(used_hdrs, hdr_name);
-                        if ((s[p + 1] == '.')) {
-                            res += hdr;
-                            break;
-                        }
-
-                        if (!uri_parser.parse_uri(hdr)) {
-                            WARN("Error parsing header %s URI '%s'", hdr_name.c_str(), hdr.c_str());
-                            break;
-                        }
-                        // TODO: find out how to correct skip_chars correctly
-                        replaceParsedParam(s, p, uri_parser, res);
-                    }
-                    skip_chars = skip_p - p;
-                } break; // case 'H'
-
-                case '_':
-                {                             // modify
-                    if (s.length() < p + 4) { // $_O()
-                        WARN("Error parsing $_ modifier replacement (short string)");
-                        break;
-                    }
+        size_t skip_p = p + 2;
+        for (; skip_p < s.length() && s[skip_p] != ')'; skip_p++) {
+        }
+        if (skip_p == s.length()) {
+            WARN("Error parsing P param replacement (unclosed brackets)");
+            break;
+        }
+        string param_name = s.substr(p + 2, skip_p - p - 2);
+        // DBG("param_name = '%s' (skip-p - p = %d)", param_name.c_str(), skip_p-p);
+        res += get_header_keyvalue(app_param, param_name);
+    } break;
 
-                    char operation = s[p + 1];
-                    if (operation != 'U' && operation != 'l' && operation != 's' && operation != '5') {
-                        WARN("Error parsing $_%c string modifier: unknown operator '%c'", operation, operation);
-                    }
+    case 'H':
+    { // header
+        size_t name_offset = 2;
+        if (s[p + 1] != '(') {
+            if (s[p + 2] != '(') {
+                WARN("Error parsing H header replacement (missing '(')");
+                break;
+            }
+            name_offset = 3;
+        }
+        if (s.length() < name_offset + 1) {
+            WARN("Error parsing H header replacement (short string)");
+            break;
+        }
+        size_t skip_p = p + name_offset;
+        for (; skip_p < s.length() && s[skip_p] != ')'; skip_p++) {
+        }
+        if (skip_p == s.length()) {
+            WARN("Error parsing H header replacement (unclosed brackets)");
+            break;
+        }
+        string hdr_name = s.substr(p + name_offset, skip_p - p - name_offset);
+        // DBG("param_name = '%s' (skip-p - p = %d)", param_name.c_str(), skip_p-p);
+        if (name_offset == 2) {
+            // full header
+            res += getHeader(used_hdrs, hdr_name);
+        } else {
+            // parse URI and use component
+            AmShallowUriParser uri_parser;
+            auto               hdr = getHeader(used_hdrs, hdr_name);
+            if ((s[p + 1] == '.')) {
+                res += hdr;
+                break;
+            }
 
-                    if (s[p + 2] != '(') {
-                        WARN("Error parsing $U upcase replacement (missing '(')");
-                        break;
-                    }
+            if (!uri_parser.parse_uri(hdr)) {
+                WARN("Error parsing header %s URI '%s'", hdr_name.c_str(), hdr.c_str());
+                break;
+            }
+            replaceParsedParam(s, p, uri_parser, res);
+        }
+    } break; // case 'H'
 
-                    size_t skip_p = p + 3;
-                    skip_p        = skip_to_end_of_brackets(s, skip_p);
+    case '_':
+    {                             // modify
+        if (s.length() < p + 4) { // $_O()
+            WARN("Error parsing $_ modifier replacement (short string)");
+            break;
+        }
 
-                    if (skip_p == s.length()) {
-                        WARN("Error parsing $_ modifier (unclosed brackets)");
-                        skip_chars = skip_p - p;
-                        break;
-                    }
+        char operation = s[p + 1];
+        if (operation != 'U' && operation != 'l' && operation != 's' && operation != '5') {
+            WARN("Error parsing $_%c string modifier: unknown operator '%c'", operation, operation);
+        }
 
-                    string br_str = s.substr(p + 3, skip_p - p - 3);
-                    string br_str_replaced =
-                        replaceParameters(br_str, "$_*(...)", req, call_profile, app_param, outbound_interface_host,
-                                          ruri_parser, from_parser, to_parser, rebuild_ruri, rebuild_from, rebuild_to);
-
-                    br_str = br_str_replaced;
-                    switch (operation) {
-                    case 'u': // uppercase
-                        transform(br_str_replaced.begin(), br_str_replaced.end(), br_str_replaced.begin(), ::toupper);
-                        break;
-                    case 'l': // lowercase
-                        transform(br_str_replaced.begin(), br_str_replaced.end(), br_str_replaced.begin(), ::tolower);
-                        break;
-                    case 's': // size (string length)
-                        br_str_replaced = int2str((unsigned int)br_str.length());
-                        break;
-                    case '5': // md5
-                        br_str_replaced = calculateMD5(br_str);
-                        break;
-                    case 't': // extract 'transport' (last 3 characters)
-                        if (br_str.length() >= 4) {
-                            br_str_replaced = br_str.substr(br_str.length() - 3);
-                        }
-                        break;
-                    case 'r':
-                    { // random
-                        int r_max;
-                        if (!str2int(br_str, r_max)) {
-                            WARN("Error parsing $_r(%s) for random value, returning 0", br_str.c_str());
-                            br_str_replaced = "0";
-                        } else {
-                            br_str_replaced = int2str(rand() % r_max);
-                        }
-                    } break;
-                    default:
-                        WARN("Error parsing $_%c string modifier: unknown operator '%c'", operation, operation);
-                        break;
-                    } // switch(operation)
-
-                    DBG("applied operator '%c': '%s' => '%s'", operation, br_str.c_str(), br_str_replaced.c_str());
-
-                    res += br_str_replaced;
-
-                    skip_chars = skip_p - p;
-                } break; // case '_':
-
-                case 'm': // Request method
-                    res += req.method;
-                    break;
-
-                case '#':
-                { // URL encoding
-                    if (s[p + 1] != '(') {
-                        WARN("Error parsing $# URL encoding (missing '(')");
-                        break;
-                    }
-                    if (s.length() < p + 3) {
-                        WARN("Error parsing $# URL encoding (short string)");
-                        break;
-                    }
+        if (s[p + 2] != '(') {
+            WARN("Error parsing $U upcase replacement (missing '(')");
+            break;
+        }
 
-                    size_t skip_p = p + 2;
-                    skip_p        = skip_to_end_of_brackets(s, skip_p);
+        size_t skip_p = p + 3;
+        skip_p        = skip_to_end_of_brackets(s, skip_p);
 
-                    if (skip_p == s.length()) {
-                        WARN("Error parsing $# URL encoding (unclosed brackets)");
-                        skip_chars = skip_p - p;
-                        break;
-                    }
+        if (skip_p == s.length()) {
+            WARN("Error parsing $_ modifier (unclosed brackets)");
+            break;
+        }
 
-                    string expr_str = s.substr(p + 2, skip_p - p - 2);
-                    string expr_replaced =
-                        replaceParameters(expr_str, r_type, req, call_profile, app_param, outbound_interface_host,
-                                          ruri_parser, from_parser, to_parser, rebuild_ruri, rebuild_from, rebuild_to);
+        string br_str_replaced;
+        if (nested) {
+            br_str_replaced = nested->replace("$_*(...)", req, call_profile, app_param, outbound_interface_host,
+                                              ruri_parser, from_parser, to_parser, rebuild_ruri, rebuild_from,
+                                              rebuild_to);
+        }
 
-                    char *val_escaped = url_encode(expr_replaced.c_str());
-                    res += string(val_escaped);
-                    free(val_escaped);
+        string br_str = br_str_replaced;
+        switch (operation) {
+        case 'u': // uppercase
+            transform(br_str_replaced.begin(), br_str_replaced.end(), br_str_replaced.begin(), ::toupper);
+            break;
+        case 'l': // lowercase
+            transform(br_str_replaced.begin(), br_str_replaced.end(), br_str_replaced.begin(), ::tolower);
+            break;
+        case 's': // size (string length)
+            br_str_replaced = int2str((unsigned int)br_str.length());
+            break;
+        case '5': // md5
+            br_str_replaced = calculateMD5(br_str);
+            break;
+        case 't': // extract 'transport' (last 3 characters)
+            if (br_str.length() >= 4) {
+                br_str_replaced = br_str.substr(br_str.length() - 3);
+            }
+            break;
+        case 'r':
+        { // random
+            int r_max;
+            if (!str2int(br_str, r_max)) {
+                WARN("Error parsing $_r(%s) for random value, returning 0", br_str.c_str());
+                br_str_replaced = "0";
+            } else {
+                br_str_replaced = int2str(rand() % r_max);
+            }
+        } break;
+        default:
+            WARN("Error parsing $_%c string modifier: unknown operator '%c'", operation, operation);
+            break;
+        } // switch(operation)
+
+        DBG("applied operator '%c': '%s' => '%s'", operation, br_str.c_str(), br_str_replaced.c_str());
+
+        res += br_str_replaced;
+    } break; // case '_':
+
+    case 'm': // Request method
+        res += req.method;
+        break;
+
+    case '#':
+    { // URL encoding
+        if (s[p + 1] != '(') {
+            WARN("Error parsing $# URL encoding (missing '(')");
+            break;
+        }
+        if (s.length() < p + 3) {
+            WARN("Error parsing $# URL encoding (short string)");
+            break;
+        }
 
-                    skip_chars = skip_p - p;
-                } break; // case '#'
+        size_t skip_p = p + 2;
+        skip_p        = skip_to_end_of_brackets(s, skip_p);
 
-                default:
-                {
-                    WARN("unknown replace pattern $%c%c while replacing %s with value '%s'", s[p], s[p + 1], r_type,
-                         s.c_str());
-                }; break;
+        if (skip_p == s.length()) {
+            WARN("Error parsing $# URL encoding (unclosed brackets)");
+            break;
+        }
+
+        string expr_replaced;
+        if (nested) {
+            expr_replaced = nested->replace(r_type, req, call_profile, app_param, outbound_interface_host, ruri_parser,
+                                            from_parser, to_parser, rebuild_ruri, rebuild_from, rebuild_to);
+        }
 
-                }; // switch (s[p])
+        char *val_escaped = url_encode(expr_replaced.c_str());
+        res += string(val_escaped);
+        free(val_escaped);
+    } break; // case '#'
 
-                p += skip_chars; // skip $.X
+    default:
+    {
+        WARN("unknown replace pattern $%c%c while replacing %s with value '%s'", s[p], s[p + 1], r_type,
+             s.c_str());
+    }; break;
+
+    }; // switch (s[p])
+}
+
+/* skip_chars of replaceParsedParam() */
+static size_t parsed_param_length(const string &s, size_t p)
+{
+    if (s[p + 1] != 'P' || s.length() <= p + 3 || s[p + 2] != '(')
+        return 1;
+
+    auto skip_p = s.find(')', p + 3);
+    if (skip_p == string::npos)
+        return 1;
+
+    return skip_p - p;
+}
+
+size_t ParamTemplate::expression_length(const string &s, size_t p)
+{
+    switch (s[p]) {
+    case 'f':
+    case 't':
+        if (s.length() == p + 1 || s[p + 1] == '.' || s[p + 1] == 't')
+            return 1;
+        return parsed_param_length(s, p);
+    case 'r':
+        if (s.length() == p + 1 || s[p + 1] == '.')
+            return 1;
+        return parsed_param_length(s, p);
+    case 'a':
+    case 'p':
+        if (s.length() == p + 1 || s[p + 1] == '.' || s[p + 1] == 'i')
+            return 1;
+        return parsed_param_length(s, p);
+    case 'P':
+    {
+        if (s[p + 1] != '(' || s.length() < p + 3)
+            return 1;
+        auto skip_p = s.find(')', p + 2);
+        if (skip_p == string::npos)
+            return 1;
+        return skip_p - p;
+    }
+    case 'H':
+    {
+        size_t name_offset = 2;
+        if (s[p + 1] != '(') {
+            if (s[p + 2] != '(')
+                return 1;
+            name_offset = 3;
+        }
+        if (s.length() < name_offset + 1)
+            return 1;
+        auto skip_p = s.find(')', p + name_offset);
+        if (skip_p == string::npos)
+            return 1;
+        if (name_offset == 3 && s[p + 1] == '.') // $H.(name) consumes '$H.' only
+            return 1;
+        return skip_p - p;
+    }
+    case '_':
+        if (s.length() < p + 4 || s[p + 2] != '(')
+            return 1;
+        return skip_to_end_of_brackets(s, p + 3) - p;
+    case '#':
+        if (s[p + 1] != '(' || s.length() < p + 3)
+            return 1;
+        return skip_to_end_of_brackets(s, p + 2) - p;
+    default: return 1;
+    }
+}
+
+ParamTemplate::ParamTemplate(const string &s)
+    : source(s)
+    , expressions_count(0)
+    , is_replaced(false)
+{
+    compile();
+}
+
+void ParamTemplate::add_literal(char c)
+{
+    if (ops.empty() || ops.back().type != op::LITERAL)
+        ops.push_back({ op::LITERAL, literals.size(), 0, nullptr });
+    literals += c;
+    ops.back().length++;
+}
+
+void ParamTemplate::compile()
+{
+    const string &s          = source;
+    size_t        p          = 0;
+    bool          is_escaped = false;
+
+    while (p < s.length()) {
+        if (is_escaped) {
+            switch (s[p]) {
+            case 'r': add_literal('\r'); break;
+            case 'n': add_literal('\n'); break;
+            case 't': add_literal('\t'); break;
+            default:  add_literal(s[p]); break;
+            }
+            is_escaped = false;
+        } else if (s[p] == '\\') {
+            if (p == s.length() - 1) {
+                add_literal('\\'); // add single \ at the end
             } else {
-                res += s[p];
+                is_escaped  = true;
+                is_replaced = true;
+            }
+        } else if (s[p] == '$') {
+            is_replaced = true;
+            p++;
+            if (p == s.length()) {
+                WARN("unexpected '$' at the end of '%s'", s.data());
+                break;
             }
-        } // end not escaped
+
+            size_t length = expression_length(s, p);
+            ops.push_back({ op::EXPRESSION, p, length, nullptr });
+            expressions_count++;
+
+            // brackets content of the $_x(...) and $#(...)
+            size_t nested_offset = 0;
+            if (s[p] == '_' && length > 2)
+                nested_offset = 3;
+            else if (s[p] == '#' && length > 1)
+                nested_offset = 2;
+            if (nested_offset && p + length < s.length()) {
+                ops.back().nested.reset(new ParamTemplate(s.substr(p + nested_offset, length - nested_offset)));
+            }
+
+            p += length; // skip $.X
+        } else {
+            add_literal(s[p]);
+        }
 
         p++;
-    } // while (p<s.length())
+    }
+}
+
+string ParamTemplate::replace(const char *r_type, const AmSipRequest &req, const SBCCallProfile *call_profile,
+                              const string &app_param, const string &outbound_interface_host,
+                              AmShallowUriParser &ruri_parser, AmShallowUriParser &from_parser,
+                              AmShallowUriParser &to_parser, bool rebuild_ruri, bool rebuild_from,
+                              bool rebuild_to) const
+{
+    string res;
+    res.reserve(literals.size() + expressions_count * EXPRESSION_SIZE_ESTIMATE);
+
+    for (const auto &o : ops) {
+        if (o.type == op::LITERAL) {
+            res.append(literals, o.offset, o.length);
+            continue;
+        }
+        replaceExpression(source, o.offset, o.nested.get(), r_type, req, call_profile, app_param,
+                          outbound_interface_host, ruri_parser, from_parser, to_parser, rebuild_ruri, rebuild_from,
+                          rebuild_to, res);
+    }
 
     if (is_replaced) {
-        DBG("%s pattern replace: '%s' -> '%s'", r_type, s.c_str(), res.c_str());
+        DBG("%s pattern replace: '%s' -> '%s'", r_type, source.c_str(), res.c_str());
     }
 
     return res;
 }
 
+ParamTemplatesCache &ParamTemplatesCache::instance()
+{
+    static ParamTemplatesCache cache;
+    return cache;
+}
+
+std::shared_ptr<const ParamTemplate> ParamTemplatesCache::get(const string &s)
+{
+    AmLock l(templates_mutex);
+
+    auto it = templates.find(s);
+    if (it != templates.end())
+        return it->second;
+
+    /* values are generated by the routing procedures. do not grow unlimited.
+     * only the part of entries is evicted to keep the hit rate stable */
+    if (templates.size() >= MAX_CACHED_TEMPLATES) {
+        auto evict_it = templates.begin();
+        while (templates.size() > MAX_KEPT_TEMPLATES)
+            evict_it = templates.erase(evict_it);
+    }
+
+    return templates.emplace(s, std::make_shared<const ParamTemplate>(s)).first->second;
+}
+
+size_t ParamTemplatesCache::size()
+{
+    AmLock l(templates_mutex);
+    return templates.size();
+}
+
+string replaceParameters(const string &s, const char *r_type, const AmSipRequest &req,
+                         const SBCCallProfile *call_profile, const string &app_param,
+                         const string &outbound_interface_host, AmShallowUriParser &ruri_parser,
+                         AmShallowUriParser &from_parser, AmShallowUriParser &to_parser, bool rebuild_ruri,
+                         bool rebuild_from, bool rebuild_to)
+{
+    return ParamTemplate(s).replace(r_type, req, call_profile, app_param, outbound_interface_host, ruri_parser,
+                                    from_parser, to_parser, rebuild_ruri, rebuild_from, rebuild_to);
+}
 
 // URL encoding functions
 // source code from http://www.geekhideout.com/urlcode.shtml
@@ -27,13 +27,77 @@
 #define _ParamReplacer_h_
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 using std::string;
+using std::vector;
 
 #include "AmSipMsg.h"
 #include "AmShallowUriParser.h"
+#include "AmThread.h"
 
 struct SBCCallProfile;
 
+/* $xy parameters replacement template parsed once.
+ *
+ * escapes are resolved at the compile time, so the template is a flat list
+ * of the literal spans and $xy expressions with the precalculated source extent.
+ * replace() appends them to the presized output buffer.
+ * URI parsers are invoked only by the expressions which reference them */
+class ParamTemplate {
+  public:
+    struct op {
+        enum type { LITERAL, EXPRESSION } type;
+        // literals offset for LITERAL, source offset of the selector char (after '$') for EXPRESSION
+        size_t offset;
+        size_t length;
+        // compiled brackets content of $_x(...) and $#(...)
+        std::unique_ptr<ParamTemplate> nested;
+    };
+
+  private:
+    string     source;
+    string     literals;
+    vector<op> ops;
+    size_t     expressions_count;
+    bool       is_replaced;
+
+    void compile();
+    void add_literal(char c);
+
+  public:
+    ParamTemplate(const string &s);
+
+    const string     &get_source() const { return source; }
+    const vector<op> &get_ops() const { return ops; }
+
+    /* true if template contains neither expressions nor escapes
+     * and replacement result is always equal to the source */
+    bool is_plain() const { return !is_replaced; }
+
+    string replace(const char *r_type, const AmSipRequest &req, const SBCCallProfile *call_profile,
+                   const string &app_param, const string &outbound_interface_host, AmShallowUriParser &ruri_parser,
+                   AmShallowUriParser &from_parser, AmShallowUriParser &to_parser, bool rebuild_ruri,
+                   bool rebuild_from, bool rebuild_to) const;
+
+    /* skip_chars of the $xy expression at the source position p (next to '$').
+     * expression takes s[p - 1 .. p + skip_chars] */
+    static size_t expression_length(const string &s, size_t p);
+};
+
+/* compiled templates shared by the calls with the same profile values */
+class ParamTemplatesCache {
+    std::unordered_map<string, std::shared_ptr<const ParamTemplate>> templates;
+    AmMutex                                                          templates_mutex;
+
+  public:
+    static ParamTemplatesCache &instance();
+
+    std::shared_ptr<const ParamTemplate> get(const string &s);
+    size_t                               size();
+};
+
 // $xy parameters replacement
 string replaceParameters(const string &s, const char *r_type, const AmSipRequest &req,
                          const SBCCallProfile *call_profile, const string &app_param,
@@ -62,10 +126,20 @@ struct ParamReplacerCtx {
     {
     }
 
+    string replaceParameters(const ParamTemplate &t, const char *r_type, const AmSipRequest &req)
+    {
+        if (t.is_plain())
+            return t.get_source();
+        return t.replace(r_type, req, call_profile, app_param, outbound_interface_host, ruri_parser, from_parser,
+                         to_parser, ruri_modified, from_modified, to_modified);
+    }
+
     string replaceParameters(const string &s, const char *r_type, const AmSipRequest &req)
     {
-        return ::replaceParameters(s, r_type, req, call_profile, app_param, outbound_interface_host, ruri_parser,
-                                   from_parser, to_parser, ruri_modified, from_modified, to_modified);
+        // nothing to compile for the plain values
+        if (s.find_first_of("$\\") == string::npos)
+            return s;
+        return replaceParameters(*ParamTemplatesCache::instance().get(s), r_type, req);
     }
 };
 
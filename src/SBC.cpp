@@ -52,6 +52,7 @@ SBC - feature-wishlist
 #include "ParamReplacer.h"
 #include "SDPFilter.h"
 #include "SBCCallLeg.h"
+#include "CallSetupStats.h"
 
 #include "AmEventQueueProcessor.h"
 
@@ -88,9 +89,9 @@ void assertEndCRLF(string &s)
 ///////////////////////////////////////////////////////////////////////////////////////////
 
 SBCCallLeg *CallLegCreator::create(fake_logger *logger, OriginationPreAuth::Reply &ip_auth_data,
-                                   Auth::auth_id_type auth_result_id)
+                                   const SipHeadersIndex &hdrs_index, Auth::auth_id_type auth_result_id)
 {
-    return new SBCCallLeg(logger, ip_auth_data, auth_result_id, new AmSipDialog());
+    return new SBCCallLeg(logger, ip_auth_data, hdrs_index, auth_result_id, new AmSipDialog());
 }
 
 SBCCallLeg *CallLegCreator::create(SBCCallLeg *caller, AmSipDialog *dlg)
@@ -250,10 +251,17 @@ AmSession *SBCFactory::onInvite(const AmSipRequest &req, const string &, const m
     if (yeti->config.early_100_trying)
         answer_100_trying(req, early_trying_logger);
 
+    auto &call_setup_stats = CallSetupStats::instance();
+    auto  stage_start      = LatencyHistogram::clock::now();
+
+    // single headers pass shared by the INVITE processing stages
+    SipHeadersIndex hdrs_index(req.hdrs);
+
     PROF_START(pre_auth);
-    auto pre_auth_result = yeti->orig_pre_auth.onRequest(req, true /*match_subnet */, ip_auth_data);
+    auto pre_auth_result = yeti->orig_pre_auth.onRequest(req, hdrs_index, true /*match_subnet */, ip_auth_data);
     PROF_END(pre_auth);
     PROF_PRINT("orig pre auth", pre_auth);
+    call_setup_stats.add(CallSetupStats::PRE_AUTH, stage_start);
 
     DBG("pre auth result: %d", pre_auth_result);
 
@@ -275,7 +283,9 @@ AmSession *SBCFactory::onInvite(const AmSipRequest &req, const string &, const m
     }
 
     AmArg ret;
-    auto  auth_result_id = yeti->router.check_request_auth(req, ip_auth_data, ret);
+    stage_start         = LatencyHistogram::clock::now();
+    auto auth_result_id = yeti->router.check_request_auth(req, hdrs_index, ip_auth_data, ret);
+    call_setup_stats.add(CallSetupStats::AUTH, stage_start);
     if (auth_result_id > 0) {
         DBG("successfully authorized with id %d", auth_result_id);
         if (!yeti->router.is_skip_logging_invite_success())
@@ -310,7 +320,7 @@ AmSession *SBCFactory::onInvite(const AmSipRequest &req, const string &, const m
         return nullptr;
     }
 
-    SBCCallLeg *leg = callLegCreator->create(early_trying_logger, ip_auth_data, auth_result_id);
+    SBCCallLeg *leg = callLegCreator->create(early_trying_logger, ip_auth_data, hdrs_index, auth_result_id);
 
     if (!leg) {
         DBG("failed to create B2B leg");
@@ -366,10 +376,11 @@ void SBCFactory::onOoDRequest(const AmSipRequest &req, const string &app_name)
         }
 
         OriginationPreAuth::Reply ip_auth_data;
-        yeti->orig_pre_auth.onRequest(req, false /*match_subnet */, ip_auth_data);
+        SipHeadersIndex           hdrs_index(req.hdrs);
+        yeti->orig_pre_auth.onRequest(req, hdrs_index, false /*match_subnet */, ip_auth_data);
 
         AmArg              ret;
-        Auth::auth_id_type auth_id = yeti->router.check_request_auth(req, ip_auth_data, ret);
+        Auth::auth_id_type auth_id = yeti->router.check_request_auth(req, hdrs_index, ip_auth_data, ret);
 
         if (auth_id == Auth::NO_AUTH) {
             send_and_log_auth_challenge(req, ip_auth_data, "no Authorization header", true);
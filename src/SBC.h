@@ -53,7 +53,7 @@ using std::string;
 
 struct CallLegCreator {
     virtual SBCCallLeg *create(fake_logger *logger, OriginationPreAuth::Reply &ip_auth_data,
-                               Auth::auth_id_type auth_result_id);
+                               const SipHeadersIndex &hdrs_index, Auth::auth_id_type auth_result_id);
     virtual SBCCallLeg *create(SBCCallLeg *caller, AmSipDialog *dlg);
     virtual ~CallLegCreator() {}
 };
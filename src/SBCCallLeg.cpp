@@ -25,6 +25,7 @@
 #include "HeaderFilter.h"
 #include "ParamReplacer.h"
 #include "SDPFilter.h"
+#include "CallSetupStats.h"
 
 #include <algorithm>
 
@@ -137,10 +138,12 @@ void in_memory_msg_logger::feed_to_logger(msg_logger *logger)
 
 // A leg constructor (from SBCDialog)
 SBCCallLeg::SBCCallLeg(fake_logger *early_logger, OriginationPreAuth::Reply &ip_auth_data,
-                       Auth::auth_id_type auth_result_id, AmSipDialog *p_dlg, AmSipSubscription *p_subs)
+                       const SipHeadersIndex &uac_req_hdrs_index, Auth::auth_id_type auth_result_id,
+                       AmSipDialog *p_dlg, AmSipSubscription *p_subs)
     : CallLeg(p_dlg, p_subs)
     , m_state(BB_Init)
     , yeti(Yeti::instance())
+    , uac_req_hdrs_index(uac_req_hdrs_index)
     , sdp_session_version(0)
     , has_sdp_session_version(false)
     , sdp_session_offer_last_cseq(0)
@@ -309,6 +312,22 @@ void SBCCallLeg::processResourcesAndSdp()
 {
     DBG("%s(%p,leg%s)", FUNC_NAME, to_void(this), a_leg ? "A" : "B");
 
+    SqlCallProfile *profile = call_ctx->getCurrentProfile();
+
+    /* lega_res_chk_step:
+     *   true - checking legA resources
+     *   false - checking legB or combined resources
+     */
+    resources_check.lega_res_chk_step = profile ? profile->legab_res_mode_enabled : false;
+    resources_check.attempt           = 0;
+    resources_check.pending           = false;
+    resources_check.stage_start_time  = std::chrono::steady_clock::now();
+
+    checkResourcesAndSdp();
+}
+
+void SBCCallLeg::checkResourcesAndSdp(const ResourceCheckReplyEvent *check_reply)
+{
     SqlCallProfile *profile = nullptr;
 
     ResourceList::iterator ri;
@@ -330,17 +349,13 @@ void SBCCallLeg::processResourcesAndSdp()
             throw AmSession::Exception(500, SIP_REPLY_SERVER_INTERNAL_ERROR);
         }
 
-        /* lega_res_chk_step:
-         *   true - checking legA resources
-         *   false - checking legB or combined resources
-         */
-        bool lega_res_chk_step = profile->legab_res_mode_enabled;
-        auto now               = uac_req.recv_timestamp.tv_sec;
-        int  attempt           = 0;
+        bool &lega_res_chk_step = resources_check.lega_res_chk_step;
+        int  &attempt           = resources_check.attempt;
+        auto  now               = uac_req.recv_timestamp.tv_sec;
         do {
             DBG("check throttling for profile. attempt %d", attempt);
 
-            if (profile->legb_gw_cache_id &&
+            if (!check_reply && profile->legb_gw_cache_id &&
                 // check throttling before first resource checking only
                 (!profile->legab_res_mode_enabled || lega_res_chk_step))
             {
@@ -373,11 +388,23 @@ void SBCCallLeg::processResourcesAndSdp()
 
             DBG("check resources for profile. attempt %d", attempt);
 
-            ResourceList &rl      = profile->getResourceList(lega_res_chk_step);
-            string       &handler = call_ctx->getResourceHandler(*profile, lega_res_chk_step);
+            ResourceList    &rl      = profile->getResourceList(lega_res_chk_step);
+            ResourceHandler &handler = call_ctx->getResourceHandler(*profile, lega_res_chk_step);
 
             if (rl.empty()) {
                 rctl_ret = RES_CTL_OK;
+            } else if (check_reply) {
+                rctl_ret    = rctl.get_async_reply(*check_reply, rl, handler, getLocalTag(), resource_config, ri);
+                check_reply = nullptr;
+            } else if (rctl.is_async_check_enabled()) {
+                resources_check.start_time = std::chrono::steady_clock::now();
+                rctl_ret = rctl.get_async(rl, handler, getLocalTag(), resource_config, ri, ++resources_check.check_id);
+                if (rctl_ret == RES_CTL_PENDING) {
+                    DBG("wait for the resources check %u reply", resources_check.check_id);
+                    resources_check.pending = true;
+                    setTimer(YETI_RESOURCES_CHECK_TIMER, rctl.get_async_check_timeout() / 1000.0);
+                    return;
+                }
             } else {
                 rctl_ret = rctl.get(rl, handler, getLocalTag(), resource_config, ri);
             }
@@ -458,12 +485,14 @@ void SBCCallLeg::processResourcesAndSdp()
 
         PROF_END(rchk);
         PROF_PRINT("check and grab resources", rchk);
+        CallSetupStats::instance().add(CallSetupStats::RESOURCES_CHECK, resources_check.stage_start_time);
 
         profile = call_ctx->getCurrentProfile();
         cdr->update_with_resource_list(*profile);
         updateCallProfile(*profile);
 
         PROF_START(sdp_processing);
+        auto sdp_processing_start = LatencyHistogram::clock::now();
 
         // filterSDP
         int res = processSdpOffer(this, call_profile, aleg_modified_req.body, aleg_modified_req.method,
@@ -482,6 +511,7 @@ void SBCCallLeg::processResourcesAndSdp()
         }
         PROF_END(sdp_processing);
         PROF_PRINT("initial sdp processing", sdp_processing);
+        CallSetupStats::instance().add(CallSetupStats::SDP_PROCESSING, sdp_processing_start);
 
         call_ctx->bleg_negotiated_media = call_ctx->bleg_initial_offer.media;
 
@@ -515,6 +545,44 @@ void SBCCallLeg::processResourcesAndSdp()
     return;
 }
 
+void SBCCallLeg::onResourceCheckReply(const ResourceCheckReplyEvent &e)
+{
+    DBG("%s onResourceCheckReply(%u)", getLocalTag().c_str(), e.check_id);
+
+    getCtx_void;
+
+    if (!resources_check.pending || e.check_id != resources_check.check_id) {
+        DBG("[%s] ignore stale resources check %u reply", getLocalTag().c_str(), e.check_id);
+        return;
+    }
+
+    resources_check.pending = false;
+    removeTimer(YETI_RESOURCES_CHECK_TIMER);
+
+    if (AmBasicSipDialog::Cancelling == dlg->getStatus()) {
+        DBG("[%s] ignore resources check reply in Cancelling state", getLocalTag().c_str());
+        return;
+    }
+
+    try {
+        checkResourcesAndSdp(&e);
+    } catch (AmSession::Exception &e) {
+        onEarlyEventException(static_cast<unsigned int>(e.code), e.reason);
+    } catch (InternalException &e) {
+        onEarlyEventException(e.response_code, e.response_reason);
+    }
+}
+
+void SBCCallLeg::onResourcesCheckTimeout()
+{
+    if (!resources_check.pending)
+        return;
+
+    ERROR("[%s] resources check %u timeout", getLocalTag().c_str(), resources_check.check_id);
+
+    onResourceCheckReply(ResourceCheckReplyEvent(resources_check.check_id, true, AmArg(), resources_check.start_time));
+}
+
 bool SBCCallLeg::chooseNextProfile()
 {
     DBG("%s", getLocalTag().data());
@@ -571,8 +639,8 @@ bool SBCCallLeg::chooseNextProfile()
         }
 
         DBG("no throttling. check it for resources");
-        ResourceList &rl      = profile->getResourceList();
-        string       &handler = call_ctx->getResourceHandler(*profile);
+        ResourceList    &rl      = profile->getResourceList();
+        ResourceHandler &handler = call_ctx->getResourceHandler(*profile);
 
         if (rl.empty()) {
             rctl_ret = RES_CTL_OK;
@@ -729,7 +797,8 @@ void SBCCallLeg::onPostgresResponse(PGResponse &e)
 {
     router.update_counters(profile_request_start_time);
 
-    bool ret;
+    auto &call_setup_stats = CallSetupStats::instance();
+    bool  ret;
     // cast result to call profiles here
     try {
         if (!isArgArray(e.result)) {
@@ -756,16 +825,35 @@ void SBCCallLeg::onPostgresResponse(PGResponse &e)
             // read profile
             ret = false;
             try {
-                ret = yeti.callprofiles_cache.complete_profile(a);
-                if (ret) {
-                    if (yeti.config.postgresql_debug) {
-                        for (auto &it : *a.asStruct()) {
-                            DBG("%s/merged_profile[%d]: %s %s", getLocalTag().data(), i, it.first.data(),
-                                arg2json(it.second).data());
+                auto stage_start = LatencyHistogram::clock::now();
+                auto cached      = yeti.callprofiles_cache.get_profile(a);
+                if (cached &&
+                    cached->can_overlay(a, router.get_lega_gw_cache_key(), router.get_legb_gw_cache_key()))
+                {
+                    // copy typed cached profile and apply the per-call fields only
+                    p = *cached;
+                    call_setup_stats.add(CallSetupStats::COMPLETE_PROFILE, stage_start);
+                    stage_start = LatencyHistogram::clock::now();
+                    ret = p.overlayFromTuple(a, getLocalTag(), router.get_lega_gw_cache_key(),
+                                             router.get_legb_gw_cache_key());
+                    call_setup_stats.add(CallSetupStats::READ_PROFILE, stage_start);
+                    yeti.callprofiles_cache.inc_overlaid();
+                } else {
+                    ret = yeti.callprofiles_cache.complete_profile(a);
+                    call_setup_stats.add(CallSetupStats::COMPLETE_PROFILE, stage_start);
+                    if (ret) {
+                        yeti.callprofiles_cache.inc_merged();
+                        if (yeti.config.postgresql_debug) {
+                            for (auto &it : *a.asStruct()) {
+                                DBG("%s/merged_profile[%d]: %s %s", getLocalTag().data(), i, it.first.data(),
+                                    arg2json(it.second).data());
+                            }
                         }
+                        stage_start = LatencyHistogram::clock::now();
+                        ret = p.readFromTuple(a, getLocalTag(), router.getDynFields(), router.get_lega_gw_cache_key(),
+                                              router.get_legb_gw_cache_key());
+                        call_setup_stats.add(CallSetupStats::READ_PROFILE, stage_start);
                     }
-                    ret = p.readFromTuple(a, getLocalTag(), router.getDynFields(), router.get_lega_gw_cache_key(),
-                                          router.get_legb_gw_cache_key());
                 }
             } catch (AmArg::OutOfBoundsException &e) {
                 ERROR("OutOfBoundsException while reading from profile tuple: %s", AmArg::print(a).data());
@@ -986,7 +1074,7 @@ void SBCCallLeg::onProfilesReady()
         throw AmSession::Exception(400, "Failed to parse R-URI");
     }
 
-    call_ctx->cdr->update_with_aleg_sip_request(uac_req);
+    call_ctx->cdr->update_with_aleg_sip_request(uac_req, uac_req_hdrs_index);
     call_ctx->initial_invite = new AmSipRequest(aleg_modified_req);
 
     if (yeti.config.early_100_trying) {
@@ -1424,8 +1512,9 @@ bool SBCCallLeg::onTimerEvent(int timer_id)
                 radius_accounting_interim_post_event_set_timer(this);
             }
             return true;
-        case YETI_FAKE_RINGING_TIMER: onFakeRingingTimer(); return true;
-        default:                      return false;
+        case YETI_FAKE_RINGING_TIMER:    onFakeRingingTimer(); return true;
+        case YETI_RESOURCES_CHECK_TIMER: onResourcesCheckTimeout(); return true;
+        default:                         return false;
         }
     }
     return false;
@@ -2765,6 +2854,11 @@ void SBCCallLeg::process(AmEvent *ev)
             return;
         }
 
+        if (auto res_event = dynamic_cast<ResourceCheckReplyEvent *>(ev)) {
+            onResourceCheckReply(*res_event);
+            return;
+        }
+
         AmRtpTimeoutEvent *rtp_event = dynamic_cast<AmRtpTimeoutEvent *>(ev);
         if (rtp_event) {
             DBG("rtp event id: %d", rtp_event->event_id);
@@ -2950,37 +3044,32 @@ void SBCCallLeg::onInvite(const AmSipRequest &req)
     gettimeofday(&call_start_time, nullptr);
 
     uac_req = req;
+    // headers index is built by SBCFactory for the same request
+    uac_req_hdrs_index.rebind(uac_req.hdrs);
 
     // process Identity headers
     if (yeti.isIdentityValidatorAvailbale() && ip_auth_data.require_identity_parsing) {
         static string  identity_header_name("identity");
-        size_t         start_pos = 0;
         vector<string> ident_hdrs{};
-        while (start_pos < req.hdrs.length()) {
-            size_t name_end, val_begin, val_end, hdr_end;
-            if (skip_header(req.hdrs, start_pos, name_end, val_begin, val_end, hdr_end)) {
-                ERROR("failed to parse headers: %s", req.hdrs.data());
-                dlg->reply(req, 500, SIP_REPLY_SERVER_INTERNAL_ERROR);
-                dlg->drop();
-                dlg->dropTransactions();
-                setStopped();
-                return;
-            }
-            string hdr_name = req.hdrs.substr(start_pos, name_end - start_pos);
-            std::transform(hdr_name.begin(), hdr_name.end(), hdr_name.begin(), ::tolower);
-            if (hdr_name == identity_header_name) {
-                string hdr_value = req.hdrs.substr(val_begin, val_end - val_begin);
-                if (hdr_value.find(',') != string::npos) {
-                    auto values = explode(hdr_value, ",", false);
-                    for (auto const &v : values) {
-                        ident_hdrs.emplace_back(trim(v, " \n"));
-                    }
-                } else {
-                    ident_hdrs.emplace_back(trim(hdr_value, " \n"));
+        if (!uac_req_hdrs_index.is_complete()) {
+            ERROR("failed to parse headers: %s", req.hdrs.data());
+            dlg->reply(req, 500, SIP_REPLY_SERVER_INTERNAL_ERROR);
+            dlg->drop();
+            dlg->dropTransactions();
+            setStopped();
+            return;
+        }
+        uac_req_hdrs_index.for_each(identity_header_name, [&](const SipHeadersIndex::header &h) {
+            string hdr_value(uac_req_hdrs_index.value(h));
+            if (hdr_value.find(',') != string::npos) {
+                auto values = explode(hdr_value, ",", false);
+                for (auto const &v : values) {
+                    ident_hdrs.emplace_back(trim(v, " \n"));
                 }
+            } else {
+                ident_hdrs.emplace_back(trim(hdr_value, " \n"));
             }
-            start_pos = hdr_end;
-        }
+        });
 
         if (ident_hdrs.empty())
             onIdentityReady();
@@ -3002,7 +3091,7 @@ void SBCCallLeg::onIdentityReady(const AmArg *identity_data_ptr)
 
     gettimeofday(&profile_request_start_time, nullptr);
     try {
-        router.db_async_get_profiles(getLocalTag(), uac_req, auth_result_id, identity_data_ptr);
+        router.db_async_get_profiles(getLocalTag(), uac_req, uac_req_hdrs_index, auth_result_id, identity_data_ptr);
     } catch (GetProfileException &e) {
         DBG("GetProfile exception on %s thread: fatal = %d code  = '%d'", e.fatal, e.code);
         ERROR("SQL cant get profiles. Drop request");
@@ -3120,6 +3209,7 @@ void SBCCallLeg::onRoutingReady()
         // no CC module connected a callee yet
         // connect to the B leg(s) using modified request
         connectCallee(to, ruri, from, aleg_modified_req, modified_req, callee_dlg.release());
+        CallSetupStats::instance().add(CallSetupStats::FIRST_BLEG_INVITE, uac_req.recv_timestamp);
     }
 }
 
@@ -4185,7 +4275,7 @@ void SBCCallLeg::setRejectCdr(int disconnect_code_id)
         auto &cdr = *call_ctx->cdr;
 
         cdr.update_init_aleg(getLocalTag(), getLocalTag(), uac_req.callid);
-        cdr.update_with_aleg_sip_request(uac_req);
+        cdr.update_with_aleg_sip_request(uac_req, uac_req_hdrs_index);
 
         cdr.set_start_time(call_start_time);
         cdr.update_with_action(End);
@@ -52,7 +52,8 @@ class SBCCallLeg : public CallLeg, public CredentialHolder {
 
     AmSipRequest aleg_modified_req;
     AmSipRequest modified_req;
-    AmSipRequest uac_req;
+    AmSipRequest    uac_req;
+    SipHeadersIndex uac_req_hdrs_index;
 
     string           ruri, to, from;
     ParamReplacerCtx ctx;
@@ -97,6 +98,17 @@ class SBCCallLeg : public CallLeg, public CredentialHolder {
 
     struct timeval profile_request_start_time;
 
+    /* state of the profiles resources checking.
+     * preserved between async resources check request and reply */
+    struct {
+        bool                                  lega_res_chk_step = false;
+        int                                   attempt           = 0;
+        unsigned int                          check_id          = 0;
+        bool                                  pending           = false;
+        std::chrono::steady_clock::time_point start_time{};       // last async check request
+        std::chrono::steady_clock::time_point stage_start_time{}; // first check for all attempts
+    } resources_check;
+
     void setLogger(msg_logger *_logger);
 
     /** handler called when call is stopped (see AmSession) */
@@ -134,6 +146,7 @@ class SBCCallLeg : public CallLeg, public CredentialHolder {
 
     void processAorResolving();
     void processResourcesAndSdp();
+    void checkResourcesAndSdp(const ResourceCheckReplyEvent *check_reply = nullptr);
 
     /*! create new B leg (serial fork)*/
     /*! choose next profile, create cdr and check resources */
@@ -148,6 +161,8 @@ class SBCCallLeg : public CallLeg, public CredentialHolder {
     void onJsonRpcRequest(JsonRpcRequestEvent &ev);
     void onRadiusReply(const RadiusReplyEvent &ev);
     void onSipRegistrarResolveResponse(const SipRegistrarResolveResponseEvent &e);
+    void onResourceCheckReply(const ResourceCheckReplyEvent &e);
+    void onResourcesCheckTimeout();
     void onValidateIdentitiesResponse(const ValidateIdentitiesResponse &e);
     void onHttpPostResponse(const HttpPostResponseEvent &e);
     void onRtpTimeoutOverride(const AmRtpTimeoutEvent &rtp_event);
@@ -179,7 +194,8 @@ class SBCCallLeg : public CallLeg, public CredentialHolder {
     ResourceControl &rctl;
 
     SBCCallLeg(fake_logger *early_trying_logger, OriginationPreAuth::Reply &ip_auth_data,
-               Auth::auth_id_type auth_result_id, AmSipDialog *dlg = NULL, AmSipSubscription *p_subs = NULL);
+               const SipHeadersIndex &uac_req_hdrs_index, Auth::auth_id_type auth_result_id, AmSipDialog *dlg = NULL,
+               AmSipSubscription *p_subs = NULL);
     SBCCallLeg(SBCCallLeg *caller, AmSipDialog *dlg = NULL, AmSipSubscription *p_subs = NULL);
     ~SBCCallLeg();
 
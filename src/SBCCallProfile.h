@@ -36,6 +36,7 @@
 #include "sip/resolver.h"
 #include "sip/types.h"
 #include "atomic_types.h"
+#include "resources/Resource.h"
 
 #include <set>
 #include <string>
@@ -222,7 +223,7 @@ struct SBCCallProfile : public AmObject {
     bool aleg_relay_hold, bleg_relay_hold;
     bool relay_timestamp_aligning;
 
-    string resource_handler;
+    ResourceHandler resource_handler;
 
     int  static_codecs_aleg_id;
     int  static_codecs_bleg_id;
@@ -440,6 +441,7 @@ struct SBCCallProfile : public AmObject {
         , aleg_relay_hold(true)
         , bleg_relay_hold(true)
         , relay_timestamp_aligning(false)
+        , resource_handler(0)
         , force_relay_CN(false)
         , sst_enabled(false)
         , sst_aleg_enabled(false)
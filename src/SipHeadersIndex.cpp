@@ -0,0 +1,146 @@
+#include "SipHeadersIndex.h"
+#include "HeaderFilter.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <strings.h>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME        0x100000001b3ULL
+
+static inline char normalize_char(char c)
+{
+    if (c == '-')
+        return '_';
+    return static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+}
+
+uint64_t SipHeadersIndex::hash(std::string_view name)
+{
+    // FNV-1a of the lowercased name with '-' replaced by '_'
+    uint64_t h = FNV_OFFSET_BASIS;
+    for (auto c : name) {
+        h ^= static_cast<unsigned char>(normalize_char(c));
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+SipHeadersIndex::SipHeadersIndex()
+    : hdrs(nullptr)
+    , complete(true)
+{
+}
+
+SipHeadersIndex::SipHeadersIndex(const string &hdrs)
+    : SipHeadersIndex()
+{
+    build(hdrs);
+}
+
+void SipHeadersIndex::build(const string &hdrs_block)
+{
+    hdrs     = &hdrs_block;
+    complete = true;
+    headers.clear();
+    lookup.clear();
+
+    size_t start_pos = 0, name_end, val_begin, val_end, hdr_end;
+    while (start_pos < hdrs_block.length()) {
+        if (skip_header(hdrs_block, start_pos, name_end, val_begin, val_end, hdr_end) != 0) {
+            complete = false;
+            break;
+        }
+
+        lookup.push_back({ hash({ hdrs_block.data() + start_pos, name_end - start_pos }),
+                           static_cast<uint32_t>(headers.size()) });
+        headers.push_back({ start_pos, name_end, val_begin, val_end, hdr_end });
+
+        start_pos = hdr_end;
+    }
+
+    std::sort(lookup.begin(), lookup.end());
+}
+
+void SipHeadersIndex::rebind(const string &hdrs_copy)
+{
+    if (hdrs && !same_names(hdrs_copy)) {
+        ERROR("rebind headers index to the different headers block. rebuild index");
+        build(hdrs_copy);
+        return;
+    }
+    hdrs = &hdrs_copy;
+}
+
+bool SipHeadersIndex::same_names(const string &hdrs_copy) const
+{
+    if (hdrs->length() != hdrs_copy.length())
+        return false;
+
+    for (const auto &h : headers) {
+        auto len = h.name_end - h.name_begin;
+        if (0 != hdrs->compare(h.name_begin, len, hdrs_copy, h.name_begin, len))
+            return false;
+    }
+    return true;
+}
+
+bool SipHeadersIndex::name_matches(const header &h, std::string_view name) const
+{
+    return h.name_end - h.name_begin == name.size() &&
+           0 == strncasecmp(hdrs->data() + h.name_begin, name.data(), name.size());
+}
+
+bool SipHeadersIndex::name_matches_normalized(const header &h, std::string_view name) const
+{
+    if (h.name_end - h.name_begin != name.size())
+        return false;
+
+    const char *p = hdrs->data() + h.name_begin;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (normalize_char(p[i]) != normalize_char(name[i]))
+            return false;
+    }
+    return true;
+}
+
+vector<SipHeadersIndex::lookup_entry>::const_iterator SipHeadersIndex::lower_bound(uint64_t h) const
+{
+    return std::lower_bound(lookup.begin(), lookup.end(), lookup_entry{ h, 0 });
+}
+
+const SipHeadersIndex::header *SipHeadersIndex::find(std::string_view name) const
+{
+    auto h = hash(name);
+    for (auto it = lower_bound(h); it != lookup.end() && it->hash == h; ++it) {
+        const auto &hdr = headers[it->idx];
+        if (name_matches(hdr, name))
+            return &hdr;
+    }
+    return nullptr;
+}
+
+const SipHeadersIndex::header *SipHeadersIndex::find_normalized(std::string_view name) const
+{
+    auto h = hash(name);
+    for (auto it = lower_bound(h); it != lookup.end() && it->hash == h; ++it) {
+        const auto &hdr = headers[it->idx];
+        if (name_matches_normalized(hdr, name))
+            return &hdr;
+    }
+    return nullptr;
+}
+
+string SipHeadersIndex::get(std::string_view name) const
+{
+    string ret;
+    bool   first = true;
+    for_each(name, [&](const header &h) {
+        if (!first)
+            ret.append(", ");
+        ret.append(value(h));
+        first = false;
+    });
+    return ret;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using std::string;
+using std::vector;
+
+/* index of the SIP headers block built with the single skip_header() pass.
+ *
+ * keeps value spans of all headers in the original order
+ * and (case-insensitive name hash, header position) pairs sorted for the lookup,
+ * so consumers of the same request do not scan the whole block for every header name.
+ * '-' and '_' are hashed equally to support the normalized lookups (X-Foo matches X_Foo)
+ *
+ * index refers to the indexed string and stores offsets only.
+ * use rebind() to reuse it for the copy of the same headers block */
+class SipHeadersIndex {
+  public:
+    struct header {
+        size_t name_begin;
+        size_t name_end;
+        size_t val_begin;
+        size_t val_end;
+        size_t hdr_end;
+    };
+
+  private:
+    struct lookup_entry {
+        uint64_t hash;
+        uint32_t idx;
+
+        bool operator<(const lookup_entry &rhs) const
+        {
+            return hash < rhs.hash || (hash == rhs.hash && idx < rhs.idx);
+        }
+    };
+
+    const string        *hdrs;
+    vector<header>       headers;
+    vector<lookup_entry> lookup;
+    bool                 complete;
+
+    bool name_matches(const header &h, std::string_view name) const;
+    bool name_matches_normalized(const header &h, std::string_view name) const;
+    /* hdrs_copy has the same length and header names at the indexed positions */
+    bool same_names(const string &hdrs_copy) const;
+
+  public:
+    SipHeadersIndex();
+    SipHeadersIndex(const string &hdrs);
+
+    void build(const string &hdrs);
+    /* switch to the equal copy of the indexed headers block */
+    void rebind(const string &hdrs_copy);
+
+    /* false if the headers block parsing was interrupted by the malformed header */
+    bool is_complete() const { return complete; }
+
+    const string         &get_hdrs() const { return *hdrs; }
+    const vector<header> &get_headers() const { return headers; }
+
+    std::string_view name(const header &h) const { return { hdrs->data() + h.name_begin, h.name_end - h.name_begin }; }
+    std::string_view value(const header &h) const { return { hdrs->data() + h.val_begin, h.val_end - h.val_begin }; }
+
+    /* first header with the name or nullptr */
+    const header *find(std::string_view name) const;
+    /* same as find() but '-' and '_' in names are equal */
+    const header *find_normalized(std::string_view name) const;
+
+    /* all values of the headers with the name joined by ", " (same as getHeader()) */
+    string get(std::string_view name) const;
+
+    /* call f(const header &) for the headers with the name in the original order */
+    template <typename F> void for_each(std::string_view name, F f) const
+    {
+        auto h = hash(name);
+        for (auto it = lower_bound(h); it != lookup.end() && it->hash == h; ++it) {
+            const auto &hdr = headers[it->idx];
+            if (name_matches(hdr, name))
+                f(hdr);
+        }
+    }
+
+    /* same as for_each() but '-' and '_' in names are equal */
+    template <typename F> void for_each_normalized(std::string_view name, F f) const
+    {
+        auto h = hash(name);
+        for (auto it = lower_bound(h); it != lookup.end() && it->hash == h; ++it) {
+            const auto &hdr = headers[it->idx];
+            if (name_matches_normalized(hdr, name))
+                f(hdr);
+        }
+    }
+
+    static uint64_t hash(std::string_view name);
+
+  private:
+    vector<lookup_entry>::const_iterator lower_bound(uint64_t h) const;
+};
@@ -11,6 +11,8 @@
 #include "jsonArg.h"
 
 #include <algorithm>
+#include <string_view>
+#include <unordered_map>
 
 SqlCallProfile::SqlCallProfile()
     : aleg_override_id(0)
@@ -58,6 +60,144 @@ bool SqlCallProfile::is_empty_profile(const AmArg &a)
     return true;
 }
 
+/* profile fields which depend on the single tuple key only.
+ * readFromTuple() reads all of them, overlayFromTuple() only ones present in the tuple */
+struct profile_field {
+    const char *key;
+    void (*read)(SqlCallProfile &p, const AmArg &t);
+};
+
+#define PROFILE_STR(key, field)                                                                                        \
+    { key, [](SqlCallProfile &p, const AmArg &t) { p.field = DbAmArg_hash_get_str(t, key); } }
+#define PROFILE_INT(key, field, default_value)                                                                         \
+    { key, [](SqlCallProfile &p, const AmArg &t) { p.field = DbAmArg_hash_get_int(t, key, default_value); } }
+#define PROFILE_BOOL(key, field, default_value)                                                                        \
+    { key, [](SqlCallProfile &p, const AmArg &t) { p.field = DbAmArg_hash_get_bool(t, key, default_value); } }
+
+// common fields both for routing and refusing profiles
+static const profile_field common_fields[] = {
+    PROFILE_STR("ruri", ruri),
+    PROFILE_STR("outbound_proxy", outbound_proxy),
+    PROFILE_STR("bleg_route_set", bleg_route_set),
+    PROFILE_STR("append_headers", append_headers),
+    PROFILE_INT("time_limit", time_limit, 0),
+    PROFILE_INT("aleg_policy_id", aleg_override_id, 0),
+    PROFILE_BOOL("trusted_hdrs_gw", trusted_hdrs_gw, false),
+    PROFILE_BOOL("record_audio", record_audio, false),
+};
+
+// fields for the routing profiles only
+static const profile_field routing_fields[] = {
+    PROFILE_STR("from", from),
+    PROFILE_STR("to", to),
+    PROFILE_STR("call_id", callid),
+    PROFILE_BOOL("dlg_nat_handling", dlg_nat_handling, false),
+    PROFILE_BOOL("force_outbound_proxy", force_outbound_proxy, false),
+    PROFILE_BOOL("aleg_force_outbound_proxy", aleg_force_outbound_proxy, false),
+    PROFILE_STR("aleg_outbound_proxy", aleg_outbound_proxy),
+    PROFILE_STR("aleg_route_set", aleg_route_set),
+    PROFILE_STR("next_hop", next_hop),
+    PROFILE_BOOL("next_hop_1st_req", next_hop_1st_req, false),
+    PROFILE_BOOL("patch_ruri_next_hop", patch_ruri_next_hop, false),
+    PROFILE_STR("aleg_next_hop", aleg_next_hop),
+    PROFILE_BOOL("enable_auth", auth_enabled, false),
+    PROFILE_STR("auth_user", auth_credentials.user),
+    PROFILE_STR("auth_pwd", auth_credentials.pwd),
+    PROFILE_BOOL("enable_aleg_auth", auth_aleg_enabled, false),
+    PROFILE_STR("auth_aleg_user", auth_aleg_credentials.user),
+    PROFILE_STR("auth_aleg_pwd", auth_aleg_credentials.pwd),
+    PROFILE_STR("append_headers_req", append_headers_req),
+    PROFILE_STR("aleg_append_headers_req", aleg_append_headers_req),
+    PROFILE_STR("aleg_append_headers_reply", aleg_append_headers_reply),
+    PROFILE_BOOL("enable_rtprelay", rtprelay_enabled, false),
+    PROFILE_BOOL("bleg_force_symmetric_rtp", force_symmetric_rtp, false),
+    PROFILE_BOOL("aleg_force_symmetric_rtp", aleg_force_symmetric_rtp, false),
+    PROFILE_STR("rtprelay_interface", rtprelay_interface),
+    PROFILE_STR("aleg_rtprelay_interface", aleg_rtprelay_interface),
+    PROFILE_STR("outbound_interface", outbound_interface),
+    PROFILE_STR("aleg_outbound_interface", aleg_outbound_interface),
+    PROFILE_BOOL("bleg_force_cancel_routeset", bleg_force_cancel_routeset, false),
+    PROFILE_INT("bleg_policy_id", bleg_override_id, 0),
+    PROFILE_INT("ringing_timeout", ringing_timeout, 0),
+    PROFILE_STR("global_tag", global_tag),
+    PROFILE_BOOL("rtprelay_dtmf_filtering", rtprelay_dtmf_filtering, false),
+    PROFILE_BOOL("rtprelay_dtmf_detection", rtprelay_dtmf_detection, false),
+    PROFILE_BOOL("rtprelay_force_dtmf_relay", rtprelay_force_dtmf_relay, true),
+    PROFILE_BOOL("aleg_symmetric_rtp_nonstop", aleg_symmetric_rtp_nonstop, false),
+    PROFILE_BOOL("bleg_symmetric_rtp_nonstop", bleg_symmetric_rtp_nonstop, false),
+    PROFILE_BOOL("aleg_relay_options", aleg_relay_options, false),
+    PROFILE_BOOL("bleg_relay_options", bleg_relay_options, false),
+    PROFILE_BOOL("aleg_relay_update", aleg_relay_update, true),
+    PROFILE_BOOL("bleg_relay_update", bleg_relay_update, true),
+    PROFILE_BOOL("filter_noaudio_streams", filter_noaudio_streams, true),
+    PROFILE_BOOL("aleg_rtp_ping", aleg_rtp_ping, false),
+    PROFILE_BOOL("bleg_rtp_ping", bleg_rtp_ping, false),
+    PROFILE_INT("aleg_sdp_c_location_id", aleg_conn_location_id, 0),
+    PROFILE_INT("bleg_sdp_c_location_id", bleg_conn_location_id, 0),
+    PROFILE_INT("dead_rtp_time", dead_rtp_time, AmConfig.dead_rtp_time),
+    PROFILE_BOOL("aleg_relay_reinvite", aleg_relay_reinvite, true),
+    PROFILE_BOOL("bleg_relay_reinvite", bleg_relay_reinvite, true),
+    PROFILE_BOOL("aleg_relay_hold", aleg_relay_hold, true),
+    PROFILE_BOOL("bleg_relay_hold", bleg_relay_hold, true),
+    PROFILE_STR("aleg_contact_user", aleg_contact_user),
+    PROFILE_STR("bleg_contact_user", bleg_contact_user),
+    PROFILE_BOOL("rtp_relay_timestamp_aligning", relay_timestamp_aligning, false),
+    PROFILE_BOOL("allow_1xx_wo2tag", allow_1xx_without_to_tag, false),
+    PROFILE_INT("invite_timeout", inv_transaction_timeout, 0),
+    PROFILE_INT("srv_failover_timeout", inv_srv_failover_timeout, 0),
+    PROFILE_BOOL("rtp_force_relay_cn", force_relay_CN, false),
+    PROFILE_INT("aleg_sensor_id", aleg_sensor_id, -1),
+    PROFILE_INT("bleg_sensor_id", bleg_sensor_id, -1),
+    PROFILE_INT("aleg_sensor_level_id", aleg_sensor_level_id, 0),
+    PROFILE_INT("bleg_sensor_level_id", bleg_sensor_level_id, 0),
+    PROFILE_INT("aleg_dtmf_send_mode_id", aleg_dtmf_send_mode_id, DTMF_TX_MODE_RFC2833),
+    PROFILE_INT("bleg_dtmf_send_mode_id", bleg_dtmf_send_mode_id, DTMF_TX_MODE_RFC2833),
+    PROFILE_BOOL("suppress_early_media", suppress_early_media, false),
+    PROFILE_BOOL("force_one_way_early_media", force_one_way_early_media, false),
+    PROFILE_INT("fake_180_timer", fake_ringing_timeout, 0),
+    PROFILE_INT("aleg_rel100_mode_id", aleg_rel100_mode_id, -1),
+    PROFILE_INT("bleg_rel100_mode_id", bleg_rel100_mode_id, -1),
+    PROFILE_INT("radius_auth_profile_id", radius_profile_id, 0),
+    PROFILE_INT("aleg_radius_acc_profile_id", aleg_radius_acc_profile_id, 0),
+    PROFILE_INT("bleg_radius_acc_profile_id", bleg_radius_acc_profile_id, 0),
+    PROFILE_INT("bleg_transport_protocol_id", bleg_transport_id, 0),
+    PROFILE_INT("bleg_outbound_proxy_transport_protocol_id", outbound_proxy_transport_id, 0),
+    PROFILE_INT("aleg_outbound_proxy_transport_protocol_id", aleg_outbound_proxy_transport_id, 0),
+    PROFILE_INT("bleg_protocol_priority_id", bleg_protocol_priority_id, dns_priority::IPv4_only),
+    PROFILE_INT("bleg_max_30x_redirects", bleg_max_30x_redirects, 0),
+    PROFILE_INT("bleg_max_transfers", bleg_max_transfers, 0),
+    PROFILE_BOOL("aleg_auth_required", auth_required, false),
+    PROFILE_INT("registered_aor_id", registered_aor_id, 0),
+    PROFILE_INT("registered_aor_mode_id", registered_aor_mode_id, SqlCallProfile::REGISTERED_AOR_MODE_AS_IS),
+    PROFILE_INT("pidflo_mode_id", pidflo_mode_id, SqlCallProfile::PIDFLO_MODE_DISABLED),
+    PROFILE_INT("aleg_media_encryption_mode_id", aleg_media_encryption_mode_id, 0),
+    PROFILE_INT("bleg_media_encryption_mode_id", bleg_media_encryption_mode_id, 0),
+    PROFILE_STR("push_token", push_token),
+};
+
+#undef PROFILE_STR
+#undef PROFILE_INT
+#undef PROFILE_BOOL
+
+template <size_t N> static void read_profile_fields(SqlCallProfile &p, const AmArg &t, const profile_field (&fields)[N])
+{
+    for (const auto &f : fields)
+        f.read(p, t);
+}
+
+static const std::unordered_map<std::string_view, const profile_field *> &profile_fields_index()
+{
+    static const std::unordered_map<std::string_view, const profile_field *> index = [] {
+        std::unordered_map<std::string_view, const profile_field *> ret;
+        for (const auto &f : common_fields)
+            ret.emplace(f.key, &f);
+        for (const auto &f : routing_fields)
+            ret.emplace(f.key, &f);
+        return ret;
+    }();
+    return index;
+}
+
 bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, const DynFieldsT &df,
                                    const string &lega_gw_cache_key, const string &legb_gw_cache_key)
 {
@@ -65,9 +205,7 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
 
     // common fields both for routing and refusing profiles
 
-    ruri           = DbAmArg_hash_get_str(t, "ruri");
-    outbound_proxy = DbAmArg_hash_get_str(t, "outbound_proxy");
-    bleg_route_set = DbAmArg_hash_get_str(t, "bleg_route_set");
+    read_profile_fields(*this, t, common_fields);
 
     if (t.hasMember("lega_res") || t.hasMember("legb_res")) {
         lega_res               = DbAmArg_hash_get_str(t, "lega_res");
@@ -77,14 +215,6 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
         resources = DbAmArg_hash_get_str(t, "resources");
     }
 
-    append_headers = DbAmArg_hash_get_str(t, "append_headers");
-
-    time_limit       = DbAmArg_hash_get_int(t, "time_limit", 0);
-    aleg_override_id = DbAmArg_hash_get_int(t, "aleg_policy_id", 0);
-
-    trusted_hdrs_gw = DbAmArg_hash_get_bool(t, "trusted_hdrs_gw", false);
-    record_audio    = DbAmArg_hash_get_bool(t, "record_audio", false);
-
     dump_level_id = DbAmArg_hash_get_int(t, "dump_level_id", 0);
     dump_level_id |= AmConfig.dump_level;
     log_rtp = dump_level_id & LOG_RTP_MASK;
@@ -107,23 +237,7 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
 
     // fields fore the routing profiles only
 
-    from   = DbAmArg_hash_get_str(t, "from");
-    to     = DbAmArg_hash_get_str(t, "to");
-    callid = DbAmArg_hash_get_str(t, "call_id");
-
-    dlg_nat_handling = DbAmArg_hash_get_bool(t, "dlg_nat_handling", false);
-
-    force_outbound_proxy = DbAmArg_hash_get_bool(t, "force_outbound_proxy", false);
-    outbound_proxy       = DbAmArg_hash_get_str(t, "outbound_proxy");
-
-    aleg_force_outbound_proxy = DbAmArg_hash_get_bool(t, "aleg_force_outbound_proxy", false);
-    aleg_outbound_proxy       = DbAmArg_hash_get_str(t, "aleg_outbound_proxy");
-    aleg_route_set            = DbAmArg_hash_get_str(t, "aleg_route_set");
-
-    next_hop            = DbAmArg_hash_get_str(t, "next_hop");
-    next_hop_1st_req    = DbAmArg_hash_get_bool(t, "next_hop_1st_req", false);
-    patch_ruri_next_hop = DbAmArg_hash_get_bool(t, "patch_ruri_next_hop", false);
-    aleg_next_hop       = DbAmArg_hash_get_str(t, "aleg_next_hop");
+    read_profile_fields(*this, t, routing_fields);
 
     if (!readFilterSet(t, "transit_headers_a2b", headerfilter_a2b)) {
         ERROR("failed to read transit_headers_a2b");
@@ -205,14 +319,6 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
 #undef CP_SST_CFGVAR
 #undef CP_SESSION_REFRESH_METHOD
 
-    auth_enabled          = DbAmArg_hash_get_bool(t, "enable_auth", false);
-    auth_credentials.user = DbAmArg_hash_get_str(t, "auth_user");
-    auth_credentials.pwd  = DbAmArg_hash_get_str(t, "auth_pwd");
-
-    auth_aleg_enabled          = DbAmArg_hash_get_bool(t, "enable_aleg_auth", false);
-    auth_aleg_credentials.user = DbAmArg_hash_get_str(t, "auth_aleg_user");
-    auth_aleg_credentials.pwd  = DbAmArg_hash_get_str(t, "auth_aleg_pwd");
-
     vector<string> reply_translations_v = explode(DbAmArg_hash_get_str_any(t, "reply_translations"), "|");
 
     for (vector<string>::iterator it = reply_translations_v.begin(); it != reply_translations_v.end(); it++) {
@@ -244,22 +350,6 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
         reply_translations[from_code] = make_pair(to_code, to_reply.substr(s_pos));
     }
 
-    append_headers_req        = DbAmArg_hash_get_str(t, "append_headers_req");
-    aleg_append_headers_req   = DbAmArg_hash_get_str(t, "aleg_append_headers_req");
-    aleg_append_headers_reply = DbAmArg_hash_get_str(t, "aleg_append_headers_reply");
-
-    rtprelay_enabled         = DbAmArg_hash_get_bool(t, "enable_rtprelay", false);
-    force_symmetric_rtp      = DbAmArg_hash_get_bool(t, "bleg_force_symmetric_rtp", false);
-    aleg_force_symmetric_rtp = DbAmArg_hash_get_bool(t, "aleg_force_symmetric_rtp", false);
-
-    rtprelay_interface      = DbAmArg_hash_get_str(t, "rtprelay_interface");
-    aleg_rtprelay_interface = DbAmArg_hash_get_str(t, "aleg_rtprelay_interface");
-
-    outbound_interface      = DbAmArg_hash_get_str(t, "outbound_interface");
-    aleg_outbound_interface = DbAmArg_hash_get_str(t, "aleg_outbound_interface");
-
-    bleg_force_cancel_routeset = DbAmArg_hash_get_bool(t, "bleg_force_cancel_routeset", false);
-
     if (!readCodecPrefs(t)) {
         ERROR("failed to read codec prefs");
         return false;
@@ -267,65 +357,8 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
 
     disconnect_code_id = DbAmArg_hash_get_int(t, "disconnect_code_id", 0);
 
-    bleg_override_id = DbAmArg_hash_get_int(t, "bleg_policy_id", 0);
-
-    ringing_timeout = DbAmArg_hash_get_int(t, "ringing_timeout", 0);
-
-    global_tag = DbAmArg_hash_get_str(t, "global_tag");
-
-    rtprelay_dtmf_filtering   = DbAmArg_hash_get_bool(t, "rtprelay_dtmf_filtering", false);
-    rtprelay_dtmf_detection   = DbAmArg_hash_get_bool(t, "rtprelay_dtmf_detection", false);
-    rtprelay_force_dtmf_relay = DbAmArg_hash_get_bool(t, "rtprelay_force_dtmf_relay", true);
-
-    aleg_symmetric_rtp_nonstop = DbAmArg_hash_get_bool(t, "aleg_symmetric_rtp_nonstop", false);
-    bleg_symmetric_rtp_nonstop = DbAmArg_hash_get_bool(t, "bleg_symmetric_rtp_nonstop", false);
-
-    aleg_relay_options = DbAmArg_hash_get_bool(t, "aleg_relay_options", false);
-    bleg_relay_options = DbAmArg_hash_get_bool(t, "bleg_relay_options", false);
-
-    aleg_relay_update = DbAmArg_hash_get_bool(t, "aleg_relay_update", true);
-    bleg_relay_update = DbAmArg_hash_get_bool(t, "bleg_relay_update", true);
-
-    filter_noaudio_streams = DbAmArg_hash_get_bool(t, "filter_noaudio_streams", true);
-
-    aleg_rtp_ping = DbAmArg_hash_get_bool(t, "aleg_rtp_ping", false);
-    bleg_rtp_ping = DbAmArg_hash_get_bool(t, "bleg_rtp_ping", false);
-
-    aleg_conn_location_id = DbAmArg_hash_get_int(t, "aleg_sdp_c_location_id", 0);
-    bleg_conn_location_id = DbAmArg_hash_get_int(t, "bleg_sdp_c_location_id", 0);
-
-    dead_rtp_time = DbAmArg_hash_get_int(t, "dead_rtp_time", AmConfig.dead_rtp_time);
-
-    aleg_relay_reinvite = DbAmArg_hash_get_bool(t, "aleg_relay_reinvite", true);
-    bleg_relay_reinvite = DbAmArg_hash_get_bool(t, "bleg_relay_reinvite", true);
-    /*assign_bool_safe(aleg_relay_prack,"aleg_relay_prack",true,true);
-    assign_bool_safe(bleg_relay_prack,"bleg_relay_prack",true,true);*/
-    aleg_relay_hold = DbAmArg_hash_get_bool(t, "aleg_relay_hold", true);
-    bleg_relay_hold = DbAmArg_hash_get_bool(t, "bleg_relay_hold", true);
-
-    aleg_contact_user = DbAmArg_hash_get_str(t, "aleg_contact_user", "");
-    bleg_contact_user = DbAmArg_hash_get_str(t, "bleg_contact_user", "");
-
-    relay_timestamp_aligning = DbAmArg_hash_get_bool(t, "rtp_relay_timestamp_aligning", false);
-
-    allow_1xx_without_to_tag = DbAmArg_hash_get_bool(t, "allow_1xx_wo2tag", false);
-
-    inv_transaction_timeout  = DbAmArg_hash_get_int(t, "invite_timeout", 0);
-    inv_srv_failover_timeout = DbAmArg_hash_get_int(t, "srv_failover_timeout", 0);
-    /*assign_type_safe(inv_transaction_timeout,"invite_timeout",0,unsigned int,0);
-    assign_type_safe(inv_srv_failover_timeout,"srv_failover_timeout",0,unsigned int,0);*/
-
-    force_relay_CN = DbAmArg_hash_get_bool(t, "rtp_force_relay_cn", false);
-
-    aleg_sensor_id       = DbAmArg_hash_get_int(t, "aleg_sensor_id", -1);
-    bleg_sensor_id       = DbAmArg_hash_get_int(t, "bleg_sensor_id", -1);
-    aleg_sensor_level_id = DbAmArg_hash_get_int(t, "aleg_sensor_level_id", 0);
-    bleg_sensor_level_id = DbAmArg_hash_get_int(t, "bleg_sensor_level_id", 0);
-
-    aleg_dtmf_send_mode_id = DbAmArg_hash_get_int(t, "aleg_dtmf_send_mode_id", DTMF_TX_MODE_RFC2833);
-    bleg_dtmf_send_mode_id = DbAmArg_hash_get_int(t, "bleg_dtmf_send_mode_id", DTMF_TX_MODE_RFC2833);
-    aleg_dtmf_recv_modes   = DbAmArg_hash_get_int(t, "aleg_dtmf_recv_modes", DTMF_RX_MODE_ALL);
-    bleg_dtmf_recv_modes   = DbAmArg_hash_get_int(t, "bleg_dtmf_recv_modes", DTMF_RX_MODE_ALL);
+    aleg_dtmf_recv_modes = DbAmArg_hash_get_int(t, "aleg_dtmf_recv_modes", DTMF_RX_MODE_ALL);
+    bleg_dtmf_recv_modes = DbAmArg_hash_get_int(t, "bleg_dtmf_recv_modes", DTMF_RX_MODE_ALL);
 
     aleg_rtp_filter_inband_dtmf = DbAmArg_hash_get_bool(t, "aleg_rtp_filter_inband_dtmf", false);
     bleg_rtp_filter_inband_dtmf = DbAmArg_hash_get_bool(t, "bleg_rtp_filter_inband_dtmf", false);
@@ -339,36 +372,6 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
         transcoder.dtmf_mode = TranscoderSettings::DTMFNever;
     }
 
-    suppress_early_media      = DbAmArg_hash_get_bool(t, "suppress_early_media", false);
-    force_one_way_early_media = DbAmArg_hash_get_bool(t, "force_one_way_early_media", false);
-    fake_ringing_timeout      = DbAmArg_hash_get_int(t, "fake_180_timer", 0);
-
-    aleg_rel100_mode_id = DbAmArg_hash_get_int(t, "aleg_rel100_mode_id", -1);
-    bleg_rel100_mode_id = DbAmArg_hash_get_int(t, "bleg_rel100_mode_id", -1);
-
-    radius_profile_id          = DbAmArg_hash_get_int(t, "radius_auth_profile_id", 0);
-    aleg_radius_acc_profile_id = DbAmArg_hash_get_int(t, "aleg_radius_acc_profile_id", 0);
-    bleg_radius_acc_profile_id = DbAmArg_hash_get_int(t, "bleg_radius_acc_profile_id", 0);
-
-    bleg_transport_id                = DbAmArg_hash_get_int(t, "bleg_transport_protocol_id", 0);
-    outbound_proxy_transport_id      = DbAmArg_hash_get_int(t, "bleg_outbound_proxy_transport_protocol_id", 0);
-    aleg_outbound_proxy_transport_id = DbAmArg_hash_get_int(t, "aleg_outbound_proxy_transport_protocol_id", 0);
-
-    bleg_protocol_priority_id = DbAmArg_hash_get_int(t, "bleg_protocol_priority_id", dns_priority::IPv4_only);
-
-    bleg_max_30x_redirects = DbAmArg_hash_get_int(t, "bleg_max_30x_redirects", 0);
-    bleg_max_transfers     = DbAmArg_hash_get_int(t, "bleg_max_transfers", 0);
-
-    auth_required = DbAmArg_hash_get_bool(t, "aleg_auth_required", false);
-
-    registered_aor_id      = DbAmArg_hash_get_int(t, "registered_aor_id", 0);
-    registered_aor_mode_id = DbAmArg_hash_get_int(t, "registered_aor_mode_id", REGISTERED_AOR_MODE_AS_IS);
-
-    pidflo_mode_id = DbAmArg_hash_get_int(t, "pidflo_mode_id", PIDFLO_MODE_DISABLED);
-
-    aleg_media_encryption_mode_id = DbAmArg_hash_get_int(t, "aleg_media_encryption_mode_id", 0);
-    bleg_media_encryption_mode_id = DbAmArg_hash_get_int(t, "bleg_media_encryption_mode_id", 0);
-
     readMediaAcl(t, "aleg_rtp_acl", aleg_rtp_acl);
     readMediaAcl(t, "bleg_rtp_acl", bleg_rtp_acl);
 
@@ -382,8 +385,6 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
         ss_crt_id = 0;
     }
 
-    push_token = DbAmArg_hash_get_str(t, "push_token");
-
     lega_gw_cache_id = !lega_gw_cache_key.empty()
                            ? DbAmArg_hash_get_as_number<decltype(lega_gw_cache_id)>(t, lega_gw_cache_key, 0)
                            : 0;
@@ -396,6 +397,64 @@ bool SqlCallProfile::readFromTuple(const AmArg &t, const string &local_tag, cons
     return true;
 }
 
+bool SqlCallProfile::can_overlay(const AmArg &t, const string &lega_gw_cache_key,
+                                 const string &legb_gw_cache_key) const
+{
+    const auto &fields = profile_fields_index();
+    for (const auto &it : t) {
+        const auto &key = it.first;
+        if (fields.contains(key) || dyn_fields.hasMember(key) || key == "cache_id" || key == lega_gw_cache_key ||
+            key == legb_gw_cache_key || key == "lega_res" || key == "legb_res" || key == "resources")
+        {
+            continue;
+        }
+        if (key == "disconnect_code_id" && 0 == DbAmArg_hash_get_int(t, key, 0))
+            continue;
+        // refusing profile or field with the derived values
+        return false;
+    }
+    return true;
+}
+
+bool SqlCallProfile::overlayFromTuple(const AmArg &t, const string &local_tag, const string &lega_gw_cache_key,
+                                      const string &legb_gw_cache_key)
+{
+    aleg_local_tag = local_tag;
+
+    const auto &fields = profile_fields_index();
+    for (const auto &it : t) {
+        if (auto f = fields.find(it.first); f != fields.end())
+            f->second->read(*this, t);
+        if (dyn_fields.hasMember(it.first))
+            dyn_fields[it.first] = it.second;
+    }
+
+    if (t.hasMember("lega_res") || t.hasMember("legb_res")) {
+        if (legab_res_mode_enabled) {
+            if (t.hasMember("lega_res"))
+                lega_res = DbAmArg_hash_get_str(t, "lega_res");
+            if (t.hasMember("legb_res"))
+                resources = DbAmArg_hash_get_str(t, "legb_res");
+        } else {
+            // cached data has no lega_res/legb_res. 'resources' is ignored in this mode
+            lega_res               = DbAmArg_hash_get_str(t, "lega_res");
+            resources              = DbAmArg_hash_get_str(t, "legb_res");
+            legab_res_mode_enabled = true;
+        }
+    } else if (!legab_res_mode_enabled && t.hasMember("resources")) {
+        resources = DbAmArg_hash_get_str(t, "resources");
+    }
+
+    if (!lega_gw_cache_key.empty() && t.hasMember(lega_gw_cache_key))
+        lega_gw_cache_id = DbAmArg_hash_get_as_number<decltype(lega_gw_cache_id)>(t, lega_gw_cache_key, 0);
+    if (!legb_gw_cache_key.empty() && t.hasMember(legb_gw_cache_key))
+        legb_gw_cache_id = DbAmArg_hash_get_as_number<decltype(legb_gw_cache_id)>(t, legb_gw_cache_key, 0);
+
+    DBG("Yeti: overlaid SQL profile");
+
+    return true;
+}
+
 ResourceList &SqlCallProfile::getResourceList(bool a_leg)
 {
     return legab_res_mode_enabled ? (a_leg ? lega_rl : rl) : rl;
@@ -453,6 +512,7 @@ bool SqlCallProfile::readFilterSet(const AmArg &t, const char *cfg_key_filter, v
     if (s.empty()) {
         FilterEntry f;
         f.filter_type = Whitelist;
+        f.compile();
         filter_list.push_back(f);
         return true;
     }
@@ -463,6 +523,7 @@ bool SqlCallProfile::readFilterSet(const AmArg &t, const char *cfg_key_filter, v
         f.filter_type = Whitelist;
 
         if (filter->empty()) {
+            f.compile();
             filter_list.push_back(f);
             continue;
         }
@@ -473,6 +534,7 @@ bool SqlCallProfile::readFilterSet(const AmArg &t, const char *cfg_key_filter, v
         for (vector<string>::iterator value = values.begin(); value != values.end(); value++) {
             f.filter_list.insert(*value);
         }
+        f.compile();
         filter_list.push_back(f);
     }
     return true;
@@ -704,7 +766,7 @@ void SqlCallProfile::info(AmArg &s)
     s["ruri"]               = ruri;
     s["from"]               = from;
     s["to"]                 = to;
-    s["resource_handler"]   = resource_handler;
+    s["resource_handler"]   = static_cast<long long>(resource_handler);
     s["append_headers"]     = append_headers;
     s["outbound_interface"] = outbound_interface;
     for (const auto &f : dyn_fields)
@@ -48,6 +48,14 @@ struct SqlCallProfile : public SBCCallProfile
     static bool is_empty_profile(const AmArg &a);
     bool readFromTuple(const AmArg &t, const string &local_tag, const DynFieldsT &df, const string &lega_gw_cache_key,
                        const string &legb_gw_cache_key);
+
+    /* profile materialized from the cached data (see CallProfilesCache) can be completed
+     * by the per-call tuple fields only if all of them map to the single profile field */
+    bool can_overlay(const AmArg &t, const string &lega_gw_cache_key, const string &legb_gw_cache_key) const;
+    /* apply fields present in the per-call tuple over the copy of the materialized profile.
+     * equal to the readFromTuple() for the tuple merged with the cached data */
+    bool overlayFromTuple(const AmArg &t, const string &local_tag, const string &lega_gw_cache_key,
+                          const string &legb_gw_cache_key);
     ResourceList &getResourceList(bool a_leg = false);
 
     bool readFilter(const AmArg &t, const char *cfg_key_filter, vector<FilterEntry> &filter_list,
@@ -19,6 +19,7 @@
 #include "cdr/AuthCdr.h"
 #include "jsonArg.h"
 #include "cdr/CdrWriter.h"
+#include "CallSetupStats.h"
 #include <botan/base64.h>
 #include "format_helper.h"
 #include "AmSession.h"
@@ -329,6 +330,14 @@ int SqlRouter::configure(cfg_t *confuse_cfg, AmConfigReader &cfg)
     auto &getprofile_prepared     = pg_config_routing->addPrepared(getprofile_sql_statement_name, sql.str());
     getprofile_prepared.sql_types = getprofile_types;
 
+    if (getprofile_batcher.configure(routing_function, getprofile_types,
+                                     cfg_getint(routing_sec, opt_name_getprofile_batch_size),
+                                     cfg_getint(routing_sec, opt_name_getprofile_batch_window)))
+    {
+        ERROR("failed to configure getprofile batcher");
+        return 1;
+    }
+
     // prepare/execute routing connection init query
     auto routing_init_function = cfg.getParameter("routing_init_function");
     if (!routing_init_function.empty()) {
@@ -352,6 +361,11 @@ int SqlRouter::configure(cfg_t *confuse_cfg, AmConfigReader &cfg)
         return 1;
     }
 
+    if (cdr_writer.configure(cdr_cfg)) {
+        ERROR("failed to configure cdr writer");
+        return 1;
+    }
+
     PGPool cdr_db_master_pool(cdr_cfg.masterdb.host, cdr_cfg.masterdb.port, cdr_cfg.masterdb.name,
                               cdr_cfg.masterdb.user, cdr_cfg.masterdb.pass);
     cdr_db_master_pool.pool_size = cdr_cfg.pool_size;
@@ -518,10 +532,14 @@ void SqlRouter::update_counters(struct timeval &start_time)
         gt_min = diff;
 
     db_hits_time.inc(diff_time.tv_sec + diff_time.tv_usec / 1000);
+
+    CallSetupStats::instance()[CallSetupStats::GETPROFILE].add(
+        static_cast<unsigned long long>(diff_time.tv_sec) * 1000000 + diff_time.tv_usec);
 }
 
 AmArg SqlRouter::db_async_get_profiles(const std::string &local_tag, const AmSipRequest &req,
-                                       Auth::auth_id_type auth_id, const AmArg *identity_data)
+                                       const SipHeadersIndex &hdrs_index, Auth::auth_id_type auth_id,
+                                       const AmArg *identity_data)
 {
     AmArg ret;
 
@@ -605,7 +623,7 @@ AmArg SqlRouter::db_async_get_profiles(const std::string &local_tag, const AmSip
 
     // invoc headers from sip request
     for (const auto &h : used_header_fields) {
-        auto value = h.getValue(req).value_or(AmArg());
+        auto value = h.getValue(req, hdrs_index).value_or(AmArg());
         invoc_field(value);
     }
 
@@ -626,6 +644,11 @@ AmArg SqlRouter::db_async_get_profiles(const std::string &local_tag, const AmSip
         }
     }
 
+    if (getprofile_batcher.enabled()) {
+        getprofile_batcher.post(local_tag, std::move(pg_getprofile_event));
+        return ret;
+    }
+
     if (!AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, pg_getprofile_event.release())) {
         ERROR("failed to post getprofile query event");
         return 1;
@@ -673,10 +696,10 @@ void SqlRouter::write_cdr(std::unique_ptr<Cdr> &cdr, bool last)
             }
         }
 
+        string shard_key(std::move(cdr->local_tag));
         cdr.reset();
 
-        AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, pg_param_execute_event.release());
-        // cdr_writer->postcdr(cdr);
+        cdr_writer.post(shard_key, std::move(pg_param_execute_event));
     } else {
         DBG("%s(%p) trying to write already written cdr", FUNC_NAME, cdr.get());
     }
@@ -769,6 +792,10 @@ void SqlRouter::getStats(AmArg &arg)
 
     arg["hits"]    = static_cast<unsigned int>(hits.get());
     arg["db_hits"] = static_cast<unsigned int>(db_hits.get());
+
+    cdr_writer.getStats(arg["cdr_writer"]);
+    if (getprofile_batcher.enabled())
+        getprofile_batcher.getStats(arg["getprofile_batcher"]);
 }
 
 static void assertEndCRLF(string &s)
@@ -8,12 +8,14 @@
 #include "db/DbTypes.h"
 #include "cdr/CdrBase.h"
 #include "cdr/AuthCdr.h"
+#include "cdr/CdrWriter.h"
 #include "CodesTranslator.h"
 #include "UsedHeaderField.h"
 #include "Auth.h"
 #include "CallCtx.h"
 #include "OriginationPreAuth.h"
 #include "GatewaysCache.h"
+#include "GetProfileBatcher.h"
 #include "AmSession.h"
 
 #include <functional>
@@ -55,7 +57,8 @@ class SqlRouter : public Auth {
     time_t         mi;
     unsigned int   gpi;
 
-    // CdrWriter *cdr_writer;
+    CdrWriter         cdr_writer;
+    GetProfileBatcher getprofile_batcher;
 
     vector<UsedHeaderField> used_header_fields;
     int                     failover_to_slave;
@@ -84,7 +87,8 @@ class SqlRouter : public Auth {
 
     int configure(cfg_t *confuse_cfg, AmConfigReader &cfg);
 
-    AmArg db_async_get_profiles(const std::string &local_tag, const AmSipRequest &, Auth::auth_id_type auth_id,
+    AmArg db_async_get_profiles(const std::string &local_tag, const AmSipRequest &,
+                                const SipHeadersIndex &hdrs_index, Auth::auth_id_type auth_id,
                                 const AmArg *identity_data);
 
     void align_cdr(Cdr &cdr);
@@ -102,7 +106,9 @@ class SqlRouter : public Auth {
     void getStats(AmArg &arg);
     void getConfig(AmArg &arg);
 
-    const DynFieldsT &getDynFields() const { return dyn_fields; }
+    const DynFieldsT  &getDynFields() const { return dyn_fields; }
+    CdrWriter         &getCdrWriter() { return cdr_writer; }
+    GetProfileBatcher &getGetProfileBatcher() { return getprofile_batcher; }
 
     /*! return true if call refused */
     bool check_and_refuse(AmSession *session, SqlCallProfile *profile, Cdr *cdr, const AmSipRequest &req,
@@ -162,6 +162,11 @@ UsedHeaderField::UsedHeaderField(const AmArg &a)
 }
 
 std::optional<AmArg> UsedHeaderField::getValue(const AmSipRequest &req) const
+{
+    return getValue(req, SipHeadersIndex(req.hdrs));
+}
+
+std::optional<AmArg> UsedHeaderField::getValue(const AmSipRequest &req, const SipHeadersIndex &hdrs_index) const
 {
     string        hdr;
     sip_nameaddr  na;
@@ -172,7 +177,7 @@ std::optional<AmArg> UsedHeaderField::getValue(const AmSipRequest &req) const
     string string_ret;
 
     if (!getInternalHeader(req, name, hdr))
-        hdr = getHeader(req.hdrs, name);
+        hdr = hdrs_index.get(name);
 
     if (hdr.empty()) {
         DBG3("no header '%s' in SipRequest", name.c_str());
@@ -3,6 +3,7 @@
 
 #include "AmSipMsg.h"
 #include "sip/parse_nameaddr.h"
+#include "SipHeadersIndex.h"
 
 #include <string>
 #include <optional>
@@ -35,6 +36,7 @@ class UsedHeaderField {
     UsedHeaderField(const AmArg &a);
 
     std::optional<AmArg> getValue(const AmSipRequest &req) const;
+    std::optional<AmArg> getValue(const AmSipRequest &req, const SipHeadersIndex &hdrs_index) const;
 
     void        getInfo(AmArg &arg) const;
     const char *type2str() const;
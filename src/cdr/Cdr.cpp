@@ -8,6 +8,7 @@
 #include "sems.h"
 #include "yeti_version.h"
 #include "../yeti.h"
+#include "../hash/CdrFilter.h"
 
 #include <stdio.h>
 
@@ -49,6 +50,7 @@ Cdr::Cdr()
     , trusted_hdrs_gw(false)
     , inserted2list(false)
     , attempt_num(1)
+    , snapshot_sent_state(0)
     , dump_level_id(0)
     , audio_record_enabled(false)
     , disconnect_internal_code_id(0)
@@ -158,6 +160,8 @@ void Cdr::update_sql(const SqlCallProfile &profile)
     dump_level_id   = profile.dump_level_id;
     resources       = profile.resources;
 
+    resolve_dyn_fields_slots(dyn_fields, dyn_fields_slots);
+
     // should match logic in SBCCallProfile::apply_b_routing() + AmBasicSipDialog::getRoute
     bleg_predefined_route_set.clear();
     const string &route = (!profile.route.empty()) ? profile.route : profile.bleg_route_set;
@@ -178,8 +182,11 @@ void Cdr::update_sbc(const SBCCallProfile &profile)
 
 void Cdr::update_with_aleg_sip_request(const AmSipRequest &req)
 {
-    size_t pos1, pos2, pos;
+    update_with_aleg_sip_request(req, SipHeadersIndex(req.hdrs));
+}
 
+void Cdr::update_with_aleg_sip_request(const AmSipRequest &req, const SipHeadersIndex &hdrs_index)
+{
     DBG3("Cdr::%s(AmSipRequest)", FUNC_NAME);
 
     if (writed)
@@ -192,11 +199,11 @@ void Cdr::update_with_aleg_sip_request(const AmSipRequest &req)
     legA_local_port            = req.local_port;
     orig_call_id               = req.callid;
 
-    if (findHeader(req.hdrs, user_agent_hdr, 0, pos1, pos2, pos))
-        aleg_versions.emplace(req.hdrs.substr(pos1, pos2 - pos1));
+    if (auto h = hdrs_index.find(user_agent_hdr))
+        aleg_versions.emplace(hdrs_index.value(*h));
 
-    if (findHeader(req.hdrs, server_hdr, 0, pos1, pos2, pos))
-        aleg_versions.emplace(req.hdrs.substr(pos1, pos2 - pos1));
+    if (auto h = hdrs_index.find(server_hdr))
+        aleg_versions.emplace(hdrs_index.value(*h));
 
     if (req.method == SIP_METH_INVITE) {
         const AmMimeBody *body = req.body.hasContentType(SIP_APPLICATION_ISUP);
@@ -208,8 +215,8 @@ void Cdr::update_with_aleg_sip_request(const AmSipRequest &req)
         }
 
         const auto &hdr             = Yeti::instance().config.aleg_cdr_headers;
-        aleg_headers_amarg          = hdr.serialize_headers(req.hdrs);
-        aleg_headers_snapshot_amarg = hdr.serialize_headers_for_snapshot(req.hdrs);
+        aleg_headers_amarg          = hdr.serialize_headers(hdrs_index);
+        aleg_headers_snapshot_amarg = hdr.serialize_headers_for_snapshot(hdrs_index);
     }
 }
 
@@ -1073,93 +1080,35 @@ void Cdr::apply_params(QueryInfo &query_info, const DynFieldsT &)
 #undef invoc
 }
 
-void Cdr::snapshot_info(AmArg &s, const DynFieldsT &df) const
+void Cdr::snapshot_info(SnapshotSerializer &s, const DynFieldsT &df,
+                        const unordered_set<string> *wanted_fields) const
 {
-    static char      strftime_buf[64] = { 0 };
-    static struct tm tt;
-
-#define add_field(val)          s[#val] = val;
-#define add_field_as(name, val) s[name] = val;
-#define add_timeval_field(val)  s[#val] = timerisset(&val) ? timeval2str_utc(val) : AmArg();
-
-    add_timeval_field(cdr_born_time);
-    add_timeval_field(start_time);
-    add_timeval_field(connect_time);
-
-
-    localtime_r(&start_time.tv_sec, &tt);
-    int len         = strftime(strftime_buf, sizeof strftime_buf, "%F", &tt);
-    s["start_date"] = string(strftime_buf, len);
-
-    add_field(legB_remote_port);
-    add_field(legB_local_port);
-    add_field(legA_remote_port);
-    add_field(legA_local_port);
-    add_field(legB_remote_ip);
-    add_field(legB_local_ip);
-    add_field(legA_remote_ip);
-    add_field(legA_local_ip);
-
-    add_field(orig_call_id);
-    add_field(term_call_id);
-    add_field(local_tag);
-    add_field(global_tag);
-
-    add_field(time_limit);
-    add_field(dump_level_id);
-    add_field_as("audio_record_enabled", audio_record_enabled ? 1 : 0);
+    char      strftime_buf[64];
+    struct tm tt;
 
-    add_field(attempt_num);
-
-    add_field(resources);
-    add_field(active_resources);
-    if (isArgStruct(active_resources_clickhouse))
-        for (const auto &a : *active_resources_clickhouse.asStruct())
-            s[a.first] = a.second;
-
-    for (const auto &d : df) {
-        const string &fname = d.name;
-        AmArg        &f     = dyn_fields[fname];
-
-        // cast bool to int
-        if (d.type_id == DynField::BOOL) {
-            if (!isArgBool(f))
-                continue;
-            add_field_as(fname, (f.asBool() ? 1 : 0));
-            continue;
-        }
-
-        add_field_as(fname, f);
-    }
-
-    for (const auto &[k, v] : *aleg_headers_snapshot_amarg.asStruct()) {
-        add_field_as(k, v);
-    }
-
-#undef add_field
-#undef add_field_as
-#undef add_timeval_field
-}
-
-void Cdr::snapshot_info_filtered(AmArg &s, const DynFieldsT &df, const unordered_set<string> &wanted_fields) const
-{
-    static char      strftime_buf[64] = { 0 };
-    static struct tm tt;
+    auto wanted = [wanted_fields](const string &name) { return !wanted_fields || wanted_fields->count(name) > 0; };
 
 #define filter(name)                                                                                                   \
     static const string name##_key(#name);                                                                             \
-    if (wanted_fields.count(name##_key) > 0)
-#define add_field(val)          filter(val) s[val##_key] = val;
-#define add_field_as(name, val) filter(name) s[name##_key] = val;
-#define add_timeval_field(val)  filter(val) s[val##_key] = timerisset(&val) ? timeval2str_utc(val) : AmArg();
+    if (wanted(name##_key))
+#define add_field(val)          filter(val) s.add(val##_key, val);
+#define add_field_as(name, val) filter(name) s.add(name##_key, val);
+#define add_timeval_field(val)                                                                                         \
+    filter(val)                                                                                                        \
+    {                                                                                                                  \
+        if (timerisset(&val))                                                                                          \
+            s.add(val##_key, timeval2str_utc(val));                                                                    \
+        else                                                                                                           \
+            s.add_null(val##_key);                                                                                     \
+    }
 
     add_timeval_field(cdr_born_time);
     add_timeval_field(start_time);
     add_timeval_field(connect_time);
 
+    static const string start_date_key("start_date");
     localtime_r(&start_time.tv_sec, &tt);
-    int len         = strftime(strftime_buf, sizeof strftime_buf, "%F", &tt);
-    s["start_date"] = string(strftime_buf, len);
+    s.add(start_date_key, string(strftime_buf, strftime(strftime_buf, sizeof strftime_buf, "%F", &tt)));
 
     add_field(legB_remote_port);
     add_field(legB_local_port);
@@ -1184,33 +1133,33 @@ void Cdr::snapshot_info_filtered(AmArg &s, const DynFieldsT &df, const unordered
     add_field(resources);
     filter(active_resources)
     {
-        add_field_as(active_resources_key, active_resources);
+        s.add(active_resources_key, active_resources);
         if (isArgStruct(active_resources_clickhouse))
             for (const auto &a : *active_resources_clickhouse.asStruct())
-                s[a.first] = a.second;
+                s.add(a.first, a.second);
     }
 
     for (const auto &d : df) {
         const string &fname = d.name;
-        AmArg        &f     = dyn_fields[fname];
+        if (!wanted(fname))
+            continue;
+
+        AmArg &f = dyn_fields[fname];
 
         // cast bool to int
         if (d.type_id == DynField::BOOL) {
             if (!isArgBool(f))
                 continue;
-            if (!wanted_fields.count(fname))
-                continue;
-            s[fname] = f.asBool() ? 1 : 0;
+            s.add(fname, f.asBool() ? 1 : 0);
             continue;
         }
 
-        if (wanted_fields.count(fname))
-            s[fname] = f;
+        s.add(fname, f);
     }
 
     for (const auto &[k, v] : *aleg_headers_snapshot_amarg.asStruct()) {
-        if (wanted_fields.count(k))
-            s[k] = v;
+        if (wanted(k))
+            s.add(k, v);
     }
 
 #undef add_field
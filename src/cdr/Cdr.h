@@ -3,12 +3,14 @@
 #include "../SqlCallProfile.h"
 #include "../resources/Resource.h"
 #include "../ReasonParser.h"
+#include "../SipHeadersIndex.h"
 
 #include "AmRtpStream.h"
 #include "AmISUP.h"
 #include "cJSON.h"
 #include "ampi/PostgreSqlAPI.h"
 #include "CdrBase.h"
+#include "SnapshotSerializer.h"
 
 #include <unordered_set>
 
@@ -32,6 +34,9 @@ struct Cdr : public CdrBase
     bool inserted2list;
     int  attempt_num;
 
+    // snapshot_state() of the last full snapshot row. 0 if not sent
+    unsigned int snapshot_sent_state;
+
     string msg_logger_path;
     int    dump_level_id;
     bool   audio_record_enabled;
@@ -75,6 +80,21 @@ struct Cdr : public CdrBase
 
     AmArg  dyn_fields;
     string bleg_predefined_route_set;
+
+    /* dyn_fields values by the filter slots. see resolve_dyn_fields_slots().
+     * not copied because it points to the own dyn_fields */
+    struct DynFieldsSlots : vector<const AmArg *> {
+        DynFieldsSlots() = default;
+        DynFieldsSlots(const DynFieldsSlots &)
+            : vector<const AmArg *>()
+        {
+        }
+        DynFieldsSlots &operator=(const DynFieldsSlots &)
+        {
+            clear();
+            return *this;
+        }
+    } dyn_fields_slots;
     string ruri;
 
     vector<AmArg> trusted_hdrs;
@@ -138,6 +158,7 @@ struct Cdr : public CdrBase
     void update_sbc(const SBCCallProfile &profile);
 
     void update_with_aleg_sip_request(const AmSipRequest &req);
+    void update_with_aleg_sip_request(const AmSipRequest &req, const SipHeadersIndex &hdrs_index);
     void update_with_bleg_sip_request(const AmSipRequest &req);
     void update_with_bleg_sip_reply(const AmSipReply &reply);
     void update_reasons_with_sip_request(const AmSipRequest &req, bool a_leg);
@@ -180,8 +201,16 @@ struct Cdr : public CdrBase
 
     void add_versions_to_amarg(AmArg & arg) const;
 
-    void snapshot_info(AmArg & s, const DynFieldsT &df) const;
-    void snapshot_info_filtered(AmArg & s, const DynFieldsT &df, const unordered_set<string> &wanted_fields) const;
+    /* serialize snapshot fields. all fields are added if wanted_fields is nullptr */
+    void snapshot_info(SnapshotSerializer & s, const DynFieldsT &df,
+                       const unordered_set<string> *wanted_fields = nullptr) const;
+    /* changed by the call state transitions (reroute, connect, end)
+     * which require the full row in the delta snapshots */
+    unsigned int snapshot_state() const
+    {
+        return (static_cast<unsigned int>(attempt_num) << 2) | (timerisset(&connect_time) ? 2 : 0) |
+               (timerisset(&end_time) ? 1 : 0);
+    }
 
     void serialize_for_http_common(AmArg & a, const DynFieldsT &df) const;
     void serialize_for_http_connected(AmArg & a) const;
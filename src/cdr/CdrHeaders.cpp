@@ -41,11 +41,12 @@ int cdr_headers_t::add_header(std::string header_name, const std::string &serial
         return 1;
     }
 
-    std::transform(header_name.begin(), header_name.end(), header_name.begin(), normalize_aleg_header_name);
+    string key(header_name);
+    std::transform(key.begin(), key.end(), key.begin(), normalize_aleg_header_name);
 
-    DBG("add aleg_cdr_header '%s' with type %s", header_name.data(), serialization_type.data());
+    DBG("add aleg_cdr_header '%s' with type %s", key.data(), serialization_type.data());
 
-    headers.emplace(header_name, type);
+    headers.try_emplace(key, type);
 
     return 0;
 }
@@ -62,140 +63,119 @@ int cdr_headers_t::add_snapshot_header(std::string header_name, const std::strin
         return 1;
     }
 
-    std::transform(header_name.begin(), header_name.end(), header_name.begin(), normalize_aleg_header_name);
+    string key(header_name);
+    std::transform(key.begin(), key.end(), key.begin(), normalize_aleg_header_name);
 
     DBG("add aleg_cdr_header activecalls field for header '%s' "
         "with type '%s' and key '%s'",
-        header_name.data(), serialization_type.data(), snapshot_key.data());
+        key.data(), serialization_type.data(), snapshot_key.data());
 
-    snapshot_headers.try_emplace(header_name, type, snapshot_key);
+    snapshot_headers.try_emplace(key, type, snapshot_key);
 
     return 0;
 }
 
 AmArg cdr_headers_t::serialize_headers(const string &hdrs) const
 {
-    AmArg  a;
-    size_t start_pos = 0, name_end, val_begin, val_end, hdr_end;
+    return serialize_headers(SipHeadersIndex(hdrs));
+}
+
+AmArg cdr_headers_t::serialize_headers(const SipHeadersIndex &hdrs_index) const
+{
+    AmArg a;
 
     a.assertStruct();
-    while (start_pos < hdrs.length()) {
-        if (skip_header(hdrs, start_pos, name_end, val_begin, val_end, hdr_end) != 0) {
-            break;
+    for (const auto &[hdr_name, data] : headers) {
+        if (data.type == SerializeAllAsArrayOfStrings) {
+            hdrs_index.for_each_normalized(hdr_name,
+                                           [&](const auto &h) { a[hdr_name].push(string(hdrs_index.value(h))); });
+            continue;
         }
 
-        string hdr_name = hdrs.substr(start_pos, name_end - start_pos);
-        std::transform(hdr_name.begin(), hdr_name.end(), hdr_name.begin(), normalize_aleg_header_name);
-
-        auto it = headers.find(hdr_name);
-        if (it != headers.end()) {
-            auto hdr_value = hdrs.substr(val_begin, val_end - val_begin);
-            switch (it->second) {
-            case SerializeFirstAsString:
-                if (!a.hasMember(hdr_name)) {
-                    a[hdr_name] = hdr_value;
-                }
+        // lookup by the normalized name: X-Foo and X_Foo are the same header
+        auto h = hdrs_index.find_normalized(hdr_name);
+        if (!h)
+            continue;
+
+        string hdr_value(hdrs_index.value(*h));
+        switch (data.type) {
+        case SerializeFirstAsString: a[hdr_name] = hdr_value; break;
+        case SerializeAllAsArrayOfStrings: break;
+        case SerializeFirstAsSmallint:
+        {
+            int ret;
+            if (!str2int(hdr_value, ret)) {
+                ERROR("header '%s' smallint overflow for value '%s'. failover to null", hdr_name.c_str(),
+                      hdr_value.c_str());
+                a[hdr_name] = AmArg();
                 break;
-            case SerializeAllAsArrayOfStrings: a[hdr_name].push(hdr_value); break;
-            case SerializeFirstAsSmallint:
-            {
-                if (a.hasMember(hdr_name)) {
-                    break;
-                }
-
-                int ret;
-                if (!str2int(hdr_value, ret)) {
-                    ERROR("header '%s' smallint overflow for value '%s'. failover to null", hdr_name.c_str(),
-                          hdr_value.c_str());
-                    a[hdr_name] = AmArg();
-                    break;
-                }
-
-                // https://www.postgresql.org/docs/current/datatype-numeric.html
-                // smallint  2 bytes  small-range integer  -32768 to +32767
-                if (ret < std::numeric_limits<signed short>().min() || ret > std::numeric_limits<signed short>().max())
-                {
-                    ERROR("header '%s' smallint overflow for value '%s'. failover to null", hdr_name.c_str(),
-                          hdr_value.c_str());
-                    a[hdr_name] = AmArg();
-                    break;
-                }
-
-                if (int2str(ret) != hdr_value) {
-                    ERROR("header '%s' conversion overflow for value '%s'. failover to null", hdr_name.c_str(),
-                          hdr_value.c_str());
-                    a[hdr_name] = AmArg();
-                    break;
-                }
-
-                a[hdr_name] = ret;
-            } break;
-            case SerializeFirstAsInteger:
-            {
-                if (a.hasMember(hdr_name)) {
-                    break;
-                }
-
-                int ret;
-                if (!str2int(hdr_value, ret)) {
-                    ERROR("header '%s' integer overflow for value '%s'. failover to null", hdr_name.c_str(),
-                          hdr_value.c_str());
-                    a[hdr_name] = AmArg();
-                    break;
-                }
-
-                // https://www.postgresql.org/docs/current/datatype-numeric.html
-                // integer  4 bytes  typical choice for integer  -2147483648 to +2147483647
-
-                if (int2str(ret) != hdr_value) {
-                    ERROR("header '%s' conversion overflow for value '%s'. failover to null", hdr_name.c_str(),
-                          hdr_value.c_str());
-                    a[hdr_name] = AmArg();
-                    break;
-                }
-
-                a[hdr_name] = ret;
-            } break;
-            } // switch
-        }
-        start_pos = hdr_end;
-    }
+            }
+
+            // https://www.postgresql.org/docs/current/datatype-numeric.html
+            // smallint  2 bytes  small-range integer  -32768 to +32767
+            if (ret < std::numeric_limits<signed short>().min() || ret > std::numeric_limits<signed short>().max()) {
+                ERROR("header '%s' smallint overflow for value '%s'. failover to null", hdr_name.c_str(),
+                      hdr_value.c_str());
+                a[hdr_name] = AmArg();
+                break;
+            }
 
-    // add null entries
-    /*for(const auto &hdr : headers) {
-        if(!a.hasMember(hdr.first))
-            a[hdr.first] = AmArg();
-    }*/
+            if (int2str(ret) != hdr_value) {
+                ERROR("header '%s' conversion overflow for value '%s'. failover to null", hdr_name.c_str(),
+                      hdr_value.c_str());
+                a[hdr_name] = AmArg();
+                break;
+            }
+
+            a[hdr_name] = ret;
+        } break;
+        case SerializeFirstAsInteger:
+        {
+            int ret;
+            if (!str2int(hdr_value, ret)) {
+                ERROR("header '%s' integer overflow for value '%s'. failover to null", hdr_name.c_str(),
+                      hdr_value.c_str());
+                a[hdr_name] = AmArg();
+                break;
+            }
+
+            // https://www.postgresql.org/docs/current/datatype-numeric.html
+            // integer  4 bytes  typical choice for integer  -2147483648 to +2147483647
+
+            if (int2str(ret) != hdr_value) {
+                ERROR("header '%s' conversion overflow for value '%s'. failover to null", hdr_name.c_str(),
+                      hdr_value.c_str());
+                a[hdr_name] = AmArg();
+                break;
+            }
+
+            a[hdr_name] = ret;
+        } break;
+        } // switch
+    }
 
     return a;
 }
 
 AmArg cdr_headers_t::serialize_headers_for_snapshot(const string &hdrs) const
 {
-    AmArg a;
+    return serialize_headers_for_snapshot(SipHeadersIndex(hdrs));
+}
 
-    size_t start_pos = 0, name_end, val_begin, val_end, hdr_end;
+AmArg cdr_headers_t::serialize_headers_for_snapshot(const SipHeadersIndex &hdrs_index) const
+{
+    AmArg a;
 
     a.assertStruct();
-    while (start_pos < hdrs.length()) {
-        if (skip_header(hdrs, start_pos, name_end, val_begin, val_end, hdr_end) != 0) {
+    for (const auto &it : snapshot_headers) {
+        switch (it.second.type) {
+        case SnapshotSerializeFirstAsString:
+            if (a.hasMember(it.second.snapshot_key))
+                break;
+            if (auto h = hdrs_index.find_normalized(it.first))
+                a[it.second.snapshot_key] = string(hdrs_index.value(*h));
             break;
-        }
-
-        string hdr_name = hdrs.substr(start_pos, name_end - start_pos);
-        std::transform(hdr_name.begin(), hdr_name.end(), hdr_name.begin(), normalize_aleg_header_name);
-
-        auto it = snapshot_headers.find(hdr_name);
-        if (it != snapshot_headers.end()) {
-            auto hdr_value = hdrs.substr(val_begin, val_end - val_begin);
-            switch (it->second.type) {
-            case SnapshotSerializeFirstAsString:
-                if (!a.hasMember(it->second.snapshot_key)) {
-                    a[it->second.snapshot_key] = hdr_value;
-                }
-            } // switch
-        }
-        start_pos = hdr_end;
+        } // switch
     }
 
     // add null entries
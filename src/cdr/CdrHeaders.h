@@ -4,6 +4,7 @@
 #include <string>
 
 #include "AmSipMsg.h"
+#include "../SipHeadersIndex.h"
 
 class cdr_headers_t {
     enum cdr_header_serialization_type_t {
@@ -12,7 +13,15 @@ class cdr_headers_t {
         SerializeFirstAsSmallint,
         SerializeFirstAsInteger,
     };
-    std::map<std::string, cdr_header_serialization_type_t> headers;
+    struct HeaderData {
+        cdr_header_serialization_type_t type;
+        HeaderData(cdr_header_serialization_type_t type)
+            : type(type)
+        {
+        }
+    };
+    // normalized header name -> data
+    std::map<std::string, HeaderData> headers;
 
     enum cdr_header_snapshot_serialization_type_t {
         SnapshotSerializeFirstAsString,
@@ -34,10 +43,12 @@ class cdr_headers_t {
 
     int   add_header(std::string header_name, const std::string &serialization_type);
     AmArg serialize_headers(const string &hdrs) const;
+    AmArg serialize_headers(const SipHeadersIndex &hdrs_index) const;
 
     int   add_snapshot_header(std::string header_name, const std::string &snapshot_key,
                               const std::string &serialization_type);
     AmArg serialize_headers_for_snapshot(const string &hdrs) const;
+    AmArg serialize_headers_for_snapshot(const SipHeadersIndex &hdrs_index) const;
 
     const SnapshotHeaders &get_snapshot_headers() const { return snapshot_headers; }
 };
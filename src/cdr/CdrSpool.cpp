@@ -0,0 +1,376 @@
+#include "CdrSpool.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SPOOL_SEGMENT_SUFFIX ".cdr_spool"
+#define SPOOL_REJECTED_FILE  "rejected"
+#define SPOOL_DATA_OFFSET    64
+#define SPOOL_MIN_SEGMENT    (1 << 20)
+
+static_assert(SPOOL_DATA_OFFSET >= sizeof(uint32_t) * 2 + sizeof(uint64_t), "spool header does not fit");
+
+CdrSpool::CdrSpool()
+    : segment_size(0)
+    , pending_records(0)
+{
+}
+
+CdrSpool::~CdrSpool()
+{
+    close();
+}
+
+string CdrSpool::segment_path(uint64_t seq) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 SPOOL_SEGMENT_SUFFIX, seq);
+    return dir + "/" + name;
+}
+
+bool CdrSpool::open_segment(segment &s, uint64_t seq, size_t create_size)
+{
+    struct stat st;
+    auto        path = segment_path(seq);
+
+    s.fd = ::open(path.data(), O_RDWR | (create_size ? O_CREAT | O_EXCL : 0), 0644);
+    if (s.fd < 0) {
+        ERROR("failed to open cdr spool segment %s: %s", path.data(), strerror(errno));
+        return false;
+    }
+
+    if (create_size && ftruncate(s.fd, static_cast<off_t>(create_size)) != 0) {
+        ERROR("failed to allocate cdr spool segment %s: %s", path.data(), strerror(errno));
+        ::close(s.fd);
+        s.fd = -1;
+        unlink(path.data());
+        return false;
+    }
+
+    if (fstat(s.fd, &st) != 0 || st.st_size < SPOOL_DATA_OFFSET) {
+        ERROR("invalid cdr spool segment %s", path.data());
+        ::close(s.fd);
+        s.fd = -1;
+        return false;
+    }
+
+    s.size  = static_cast<size_t>(st.st_size);
+    void *p = mmap(nullptr, s.size, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+    if (p == MAP_FAILED) {
+        ERROR("failed to mmap cdr spool segment %s: %s", path.data(), strerror(errno));
+        ::close(s.fd);
+        s = segment();
+        return false;
+    }
+
+    s.data = static_cast<char *>(p);
+    s.seq  = seq;
+
+    if (create_size) {
+        s.header()->magic       = segment_magic;
+        s.header()->version     = segment_version;
+        s.header()->read_offset = SPOOL_DATA_OFFSET;
+    } else if (s.header()->magic != segment_magic || s.header()->version != segment_version) {
+        ERROR("unexpected cdr spool segment %s header", path.data());
+        close_segment(s);
+        return false;
+    }
+
+    s.offset = std::clamp<size_t>(s.header()->read_offset, SPOOL_DATA_OFFSET, s.size);
+
+    return true;
+}
+
+void CdrSpool::close_segment(segment &s)
+{
+    if (s.data) {
+        msync(s.data, s.size, MS_ASYNC);
+        munmap(s.data, s.size);
+    }
+    if (s.fd >= 0)
+        ::close(s.fd);
+    s = segment();
+}
+
+uint32_t CdrSpool::record_length(const segment &s, size_t offset) const
+{
+    uint32_t len;
+    if (offset + sizeof(uint32_t) > s.size)
+        return 0;
+    memcpy(&len, s.data + offset, sizeof(len));
+    if (offset + sizeof(uint32_t) + len > s.size)
+        return 0;
+    return len;
+}
+
+size_t CdrSpool::scan_records(const segment &s, size_t from, uint64_t &records) const
+{
+    size_t offset = from;
+    while (uint32_t len = record_length(s, offset)) {
+        offset += sizeof(uint32_t) + len;
+        records++;
+    }
+    return offset;
+}
+
+int CdrSpool::init(const string &spool_dir, size_t spool_segment_size)
+{
+    AmLock l(mutex);
+
+    dir          = spool_dir;
+    segment_size = std::max<size_t>(spool_segment_size, SPOOL_MIN_SEGMENT);
+
+    if (mkdir(dir.data(), 0755) != 0 && errno != EEXIST) {
+        ERROR("failed to create cdr spool dir %s: %s", dir.data(), strerror(errno));
+        return -1;
+    }
+
+    DIR *d = opendir(dir.data());
+    if (!d) {
+        ERROR("failed to open cdr spool dir %s: %s", dir.data(), strerror(errno));
+        return -1;
+    }
+
+    vector<uint64_t> found;
+    while (struct dirent *e = readdir(d)) {
+        char *end;
+        auto  seq = strtoull(e->d_name, &end, 16);
+        if (end != e->d_name && strcmp(end, SPOOL_SEGMENT_SUFFIX) == 0)
+            found.push_back(seq);
+    }
+    closedir(d);
+
+    std::sort(found.begin(), found.end());
+
+    segments.clear();
+    pending_records = 0;
+    for (auto seq : found) {
+        segment s;
+        if (!open_segment(s, seq, 0)) {
+            ERROR("skip cdr spool segment %s", segment_path(seq).data());
+            continue;
+        }
+
+        auto end = scan_records(s, s.offset, pending_records);
+        segments.push_back(seq);
+
+        if (seq == found.back()) {
+            // continue to write into the last segment
+            s.offset      = end;
+            s.synced      = end;
+            write_segment = s;
+        } else {
+            close_segment(s);
+        }
+    }
+
+    if (pending_records)
+        INFO("cdr spool %s: recovered %" PRIu64 " records in %lu segments", dir.data(), pending_records,
+             segments.size());
+
+    return 0;
+}
+
+void CdrSpool::close()
+{
+    AmLock l(mutex);
+    close_segment(read_segment);
+    sync_write_segment();
+    close_segment(write_segment);
+}
+
+bool CdrSpool::sync_write_segment()
+{
+    if (!write_segment.data || write_segment.synced >= write_segment.offset)
+        return true;
+
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    size_t from = write_segment.synced / page_size * page_size;
+    if (msync(write_segment.data + from, write_segment.offset - from, MS_SYNC) != 0) {
+        ERROR("failed to sync cdr spool segment %s: %s", segment_path(write_segment.seq).data(), strerror(errno));
+        return false;
+    }
+
+    write_segment.synced = write_segment.offset;
+    return true;
+}
+
+void CdrSpool::sync_dir()
+{
+    int fd = ::open(dir.data(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return;
+    if (fsync(fd) != 0)
+        ERROR("failed to sync cdr spool dir %s: %s", dir.data(), strerror(errno));
+    ::close(fd);
+}
+
+bool CdrSpool::append(const string &record)
+{
+    if (record.empty() || record.size() > UINT32_MAX)
+        return false;
+
+    AmLock l(mutex);
+
+    size_t need = sizeof(uint32_t) + record.size();
+    if (!write_segment.data || write_segment.offset + need > write_segment.size) {
+        uint64_t seq = segments.empty() ? 0 : segments.back() + 1;
+        sync_write_segment();
+        close_segment(write_segment);
+        if (!open_segment(write_segment, seq, std::max(segment_size, SPOOL_DATA_OFFSET + need)))
+            return false;
+        // header is persisted with the first records
+        write_segment.offset = SPOOL_DATA_OFFSET;
+        segments.push_back(seq);
+        sync_dir();
+    }
+
+    // store length after the payload. zero length marks the end of data
+    uint32_t len = static_cast<uint32_t>(record.size());
+    memcpy(write_segment.data + write_segment.offset + sizeof(uint32_t), record.data(), record.size());
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(write_segment.data + write_segment.offset, &len, sizeof(len));
+
+    write_segment.offset += need;
+    pending_records++;
+
+    return true;
+}
+
+bool CdrSpool::sync()
+{
+    AmLock l(mutex);
+    return sync_write_segment();
+}
+
+bool CdrSpool::reject(const string &record)
+{
+    AmLock l(mutex);
+
+    auto path = dir + "/" SPOOL_REJECTED_FILE;
+    int  fd   = ::open(path.data(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        ERROR("failed to open %s: %s", path.data(), strerror(errno));
+        return false;
+    }
+
+    string line = record + '\n';
+    bool   ret  = write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()) && fsync(fd) == 0;
+    if (!ret)
+        ERROR("failed to write %s: %s", path.data(), strerror(errno));
+    ::close(fd);
+
+    return ret;
+}
+
+bool CdrSpool::open_read_segment()
+{
+    if (read_segment.data)
+        return true;
+    while (!segments.empty()) {
+        if (open_segment(read_segment, segments.front(), 0))
+            return true;
+        ERROR("skip unreadable cdr spool segment %s", segment_path(segments.front()).data());
+        segments.pop_front();
+    }
+    return false;
+}
+
+void CdrSpool::remove_read_segment()
+{
+    auto path = segment_path(read_segment.seq);
+    close_segment(read_segment);
+    unlink(path.data());
+    segments.pop_front();
+}
+
+size_t CdrSpool::peek(vector<string> &records, size_t max_records)
+{
+    AmLock l(mutex);
+
+    while (open_read_segment()) {
+        size_t n      = 0;
+        size_t offset = read_segment.offset;
+        while (n < max_records) {
+            uint32_t len = record_length(read_segment, offset);
+            if (!len)
+                break;
+            records.emplace_back(read_segment.data + offset + sizeof(uint32_t), len);
+            offset += sizeof(uint32_t) + len;
+            n++;
+        }
+
+        if (n || read_segment.seq == segments.back())
+            return n;
+
+        // fully consumed segment which is not written anymore
+        remove_read_segment();
+    }
+
+    return 0;
+}
+
+void CdrSpool::consume(size_t count)
+{
+    AmLock l(mutex);
+
+    uint64_t consumed = 0;
+    while (open_read_segment()) {
+        size_t end = read_segment.offset;
+        while (consumed < count) {
+            uint32_t len = record_length(read_segment, end);
+            if (!len)
+                break;
+            end += sizeof(uint32_t) + len;
+            consumed++;
+        }
+
+        read_segment.offset                = end;
+        read_segment.header()->read_offset = end;
+
+        if (read_segment.seq == segments.back())
+            break;
+
+        // segment is not written anymore. remove it once it is fully consumed
+        if (record_length(read_segment, end))
+            break;
+
+        remove_read_segment();
+    }
+
+    pending_records -= std::min(pending_records, consumed);
+
+    if (consumed == count)
+        return;
+
+    ERROR("cdr spool: attempt to consume %lu records but only %" PRIu64 " available", count, consumed);
+}
+
+bool CdrSpool::empty()
+{
+    AmLock l(mutex);
+    return pending_records == 0;
+}
+
+uint64_t CdrSpool::get_pending_records()
+{
+    AmLock l(mutex);
+    return pending_records;
+}
+
+size_t CdrSpool::get_segments_count()
+{
+    AmLock l(mutex);
+    return segments.size();
+}
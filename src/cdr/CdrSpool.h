@@ -0,0 +1,101 @@
+#pragma once
+
+#include <AmThread.h>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+using std::deque;
+using std::string;
+using std::vector;
+
+/* append-only durable spool of the serialized CDR records
+ *
+ * records are stored in the memory-mapped segment files <dir>/<seq>.cdr_spool:
+ *   header: magic, version, read offset of the first unconsumed record
+ *   records: [uint32 length][payload], zero length marks the end of data
+ *
+ * the length is stored after the payload so the interrupted append
+ * is ignored on recovery. appended records are persisted by sync(). consumed segments are removed.
+ * read offset is persisted lazily, so records consumed right before
+ * the crash can be replayed once more (at-least-once delivery) */
+class CdrSpool {
+  public:
+    static constexpr uint32_t segment_magic   = 0x50534359; // "YCSP"
+    static constexpr uint32_t segment_version = 1;
+
+  private:
+    struct segment_header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t read_offset;
+    };
+
+    struct segment {
+        uint64_t seq;
+        int      fd;
+        char    *data;
+        size_t   size;
+        size_t   offset; // write position for the write segment, read position for the read segment
+        size_t   synced; // end of the persisted data of the write segment
+
+        segment()
+            : seq(0)
+            , fd(-1)
+            , data(nullptr)
+            , size(0)
+            , offset(0)
+            , synced(0)
+        {
+        }
+
+        segment_header *header() { return reinterpret_cast<segment_header *>(data); }
+    };
+
+    string          dir;
+    size_t          segment_size;
+    deque<uint64_t> segments; // sequence numbers of the not consumed segments
+    segment         write_segment;
+    segment         read_segment;
+    uint64_t        pending_records;
+    AmMutex         mutex;
+
+    string   segment_path(uint64_t seq) const;
+    bool     open_segment(segment &s, uint64_t seq, size_t create_size);
+    void     close_segment(segment &s);
+    bool     open_read_segment();
+    void     remove_read_segment();
+    uint32_t record_length(const segment &s, size_t offset) const; // 0 if there is no record at the offset
+    size_t   scan_records(const segment &s, size_t from, uint64_t &records) const;
+    bool     sync_write_segment();
+    void     sync_dir();
+
+  public:
+    CdrSpool();
+    ~CdrSpool();
+
+    /* opens the spool directory and recovers not consumed records */
+    int  init(const string &dir, size_t segment_size);
+    void close();
+
+    bool append(const string &record);
+    /* flushes appended records to the disk */
+    bool sync();
+
+    /* saves the record rejected by the database to <dir>/rejected */
+    bool reject(const string &record);
+
+    /* fetch up to max_records records starting from the read position
+     * without consuming them. records are fetched from the single segment */
+    size_t peek(vector<string> &records, size_t max_records);
+
+    /* consume count records starting from the read position.
+     * fully consumed segments which are not written anymore are removed */
+    void consume(size_t count);
+
+    bool     empty();
+    uint64_t get_pending_records();
+    size_t   get_segments_count();
+};
@@ -8,8 +8,14 @@
 #include "yeti_version.h"
 #include "AuthCdr.h"
 #include "AmUtils.h"
+#include "AmEventDispatcher.h"
+#include "jsonArg.h"
 
-#define DISABLE_CDRS_WRITING
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <sys/epoll.h>
+#include <unistd.h>
 
 // affect on precision check_interval and batch_timeout handling precision
 #define QUEUE_RUN_TIMEOUT_MSEC      1000
@@ -17,6 +23,14 @@
 #define DEFAULT_BATCH_SIZE          50
 #define DEFAULT_BATCH_TIMEOUT_MSEC  10000
 
+#define DEFAULT_WRITER_BATCH_SIZE         1
+#define DEFAULT_WRITER_BATCH_TIMEOUT_MSEC 1000
+#define MIN_WRITER_BATCH_TIMEOUT_MSEC     10
+
+#define DEFAULT_SPOOL_TIMEOUT_MSEC       10000
+#define DEFAULT_SPOOL_REPLAY_BATCH_SIZE  1000
+#define DEFAULT_SPOOL_SYNC_INTERVAL_MSEC 1000
+
 static_field cdr_static_fields[] = {
     {                      "is_master",  "boolean" },
     {                        "node_id",  "integer" },
@@ -86,8 +100,639 @@ int CdrThreadCfg::cfg2CdrThCfg(cfg_t *cdr_sec, AmConfigReader &cfg)
     failover_to_slave   = cfg.getParameterInt("cdr_failover_to_slave", 1);
     connection_lifetime = cfg_getint(cdr_sec, opt_name_connection_lifetime);
 
+    writer_batch_size    = cfg_getint(cdr_sec, opt_name_cdr_writer_batch_size);
+    writer_batch_timeout = cfg_getint(cdr_sec, opt_name_cdr_writer_batch_timeout);
+
+    spool_dir               = cfg_getstr(cdr_sec, opt_name_cdr_spool_dir);
+    spool_segment_size      = static_cast<size_t>(cfg_getint(cdr_sec, opt_name_cdr_spool_segment_size)) << 20;
+    spool_timeout           = cfg_getint(cdr_sec, opt_name_cdr_spool_timeout);
+    spool_replay_batch_size = cfg_getint(cdr_sec, opt_name_cdr_spool_replay_batch_size);
+    spool_sync_interval     = cfg_getint(cdr_sec, opt_name_cdr_spool_sync_interval);
+
     masterdb.cfg2dbcfg(cfg, "mastercdr");
     slavedb.cfg2dbcfg(cfg, "slavecdr");
 
     return 0;
 }
+
+static const string CDR_WRITER_QUEUE_NAME(MOD_NAME "_cdr_writer");
+
+CdrWriter::CdrWriter()
+    : AmEventFdQueue(this)
+    , batch_size(DEFAULT_WRITER_BATCH_SIZE)
+    , batch_timeout(DEFAULT_WRITER_BATCH_TIMEOUT_MSEC)
+    , next_token(0)
+    , next_journal_id(1)
+    , spool_head(0)
+    , spool_tail(0)
+    , spool_enabled(false)
+    , spooling(false)
+    , spool_timeout(DEFAULT_SPOOL_TIMEOUT_MSEC)
+    , spool_replay_batch_size(DEFAULT_SPOOL_REPLAY_BATCH_SIZE)
+    , spool_sync_interval(DEFAULT_SPOOL_SYNC_INTERVAL_MSEC)
+    , spool_dirty(false)
+    , epoll_fd(-1)
+    , stopped(false)
+    , queue_size(stat_group(Gauge, MOD_NAME, "cdr_writer_queue_size")
+                     .setHelp("CDRs accumulated in the writer batches")
+                     .addAtomicCounter())
+    , flushed_batches(stat_group(Counter, MOD_NAME, "cdr_writer_flushed_batches")
+                          .setHelp("CDR batches posted to the database worker")
+                          .addAtomicCounter())
+    , flushed_cdrs(stat_group(Counter, MOD_NAME, "cdr_writer_flushed_cdrs")
+                       .setHelp("CDRs posted to the database worker")
+                       .addAtomicCounter())
+    , inflight_cdrs(stat_group(Gauge, MOD_NAME, "cdr_writer_inflight_cdrs")
+                        .setHelp("CDRs posted to the database worker and not confirmed yet")
+                        .addAtomicCounter())
+    , resent_cdrs(stat_group(Counter, MOD_NAME, "cdr_writer_resent_cdrs")
+                      .setHelp("CDRs of the failed batches resent one by one")
+                      .addAtomicCounter())
+    , failed_cdrs(stat_group(Counter, MOD_NAME, "cdr_writer_failed_cdrs")
+                      .setHelp("CDRs rejected by the database or not confirmed by it in time")
+                      .addAtomicCounter())
+    , spooled_cdrs(stat_group(Counter, MOD_NAME, "cdr_writer_spooled_cdrs")
+                       .setHelp("CDRs appended to the local spool")
+                       .addAtomicCounter())
+    , replayed_cdrs(stat_group(Counter, MOD_NAME, "cdr_writer_replayed_cdrs")
+                        .setHelp("CDRs replayed from the local spool")
+                        .addAtomicCounter())
+    , spool_mode(stat_group(Gauge, MOD_NAME, "cdr_writer_spool_mode")
+                     .setHelp("1 if CDRs are written to the local spool")
+                     .addAtomicCounter())
+    , flush_delay(LatencyHistograms::instance().add(MOD_NAME "_cdr_writer_flush_delay_usec"))
+    , write_duration(LatencyHistograms::instance().add(MOD_NAME "_cdr_writer_write_duration_usec"))
+{
+    LatencyHistograms::instance().setHelp(MOD_NAME "_cdr_writer_flush_delay_usec",
+                                          "time the oldest CDR of the batch waited before the flush in usec");
+    LatencyHistograms::instance().setHelp(MOD_NAME "_cdr_writer_write_duration_usec",
+                                          "time from the batch posting to the database confirmation in usec");
+}
+
+int CdrWriter::configure(const CdrThreadCfg &cfg)
+{
+    batch_size    = cfg.writer_batch_size;
+    batch_timeout = std::chrono::milliseconds(cfg.writer_batch_timeout);
+
+    batches.clear();
+    for (unsigned int i = 0; i < std::max(cfg.pool_size, 1U); i++)
+        batches.emplace_back(new batch());
+
+    DBG("cdr writer: %lu batches, batch_size: %lu, batch_timeout: %ld msec", batches.size(), batch_size,
+        static_cast<long>(batch_timeout.count()));
+
+    spool_enabled = !cfg.spool_dir.empty();
+    if (spool_enabled) {
+        spool_timeout           = std::chrono::milliseconds(cfg.spool_timeout);
+        spool_replay_batch_size = std::max<size_t>(cfg.spool_replay_batch_size, 1);
+        spool_sync_interval     = std::chrono::milliseconds(std::max(cfg.spool_sync_interval, 0));
+
+        if (spool.init(cfg.spool_dir, cfg.spool_segment_size)) {
+            ERROR("failed to init cdr spool in %s", cfg.spool_dir.data());
+            return -1;
+        }
+        spool_head        = 0;
+        spool_tail        = spool.get_pending_records();
+        spool_synced_time = LatencyHistogram::clock::now();
+
+        // keep order with the CDRs left from the previous run
+        if (!spool.empty()) {
+            spooling = true;
+            spool_mode.set(1);
+        }
+
+        DBG("cdr writer spool: %s, timeout: %ld msec, replay_batch_size: %lu, sync_interval: %ld msec",
+            cfg.spool_dir.data(), static_cast<long>(spool_timeout.count()), spool_replay_batch_size,
+            static_cast<long>(spool_sync_interval.count()));
+    }
+
+    if ((epoll_fd = epoll_create(3)) == -1) {
+        ERROR("epoll_create() call failed");
+        return -1;
+    }
+    timer.link(epoll_fd);
+    flush_event.link(epoll_fd);
+    stop_event.link(epoll_fd);
+    epoll_link(epoll_fd);
+
+    return 0;
+}
+
+std::unique_ptr<PGParamExecute> CdrWriter::take_batch(batch &b)
+{
+    queue_size.dec(b.size);
+    flush_delay.add(b.first_cdr_time);
+
+    b.size = 0;
+    return std::move(b.event);
+}
+
+PGParamExecute *CdrWriter::create_batch_event(string &token)
+{
+    {
+        AmLock l(inflight_mutex);
+        token = std::to_string(next_token++);
+    }
+
+    return new PGParamExecute(PGQueryData(yeti_cdr_pg_worker, /* pg worker name */
+                                          cdr_statement_name, /* prepared stmt name */
+                                          false /*single*/, CDR_WRITER_QUEUE_NAME, token),
+                              PGTransactionData(PGTransactionData::isolation_level::read_committed,
+                                                PGTransactionData::write_policy::read_write),
+                              true /* prepared */);
+}
+
+static string query_params2json(const QueryInfo &q)
+{
+    AmArg params;
+    params.assertArray();
+    for (const auto &p : q.params)
+        params.push(p);
+    return arg2json(params);
+}
+
+size_t CdrWriter::append_to_spool(const vector<QueryInfo> &queries)
+{
+    size_t appended = 0;
+    for (; appended < queries.size(); appended++) {
+        if (!spool.append(query_params2json(queries[appended])))
+            break;
+    }
+
+    spool_tail += appended;
+    if (appended) {
+        spool_dirty = true;
+        sync_spool();
+    }
+
+    return appended;
+}
+
+void CdrWriter::sync_spool()
+{
+    if (!spool_dirty)
+        return;
+
+    auto now = LatencyHistogram::clock::now();
+    if (now - spool_synced_time < spool_sync_interval)
+        return;
+
+    if (!spool.sync())
+        ERROR("cdr writer: failed to sync the spool");
+    spool_dirty       = false;
+    spool_synced_time = now;
+}
+
+void CdrWriter::post_batch(std::unique_ptr<PGParamExecute> event, size_t size, const string &local_tag)
+{
+    uint64_t journal_id = 0;
+
+    if (spool_enabled) {
+        if (spooling.load()) {
+            spool_batch(*event);
+            return;
+        }
+
+        // write ahead. records are consumed once the database confirms them
+        auto &queries  = event->qdata.info;
+        auto  first    = spool_tail;
+        auto  appended = append_to_spool(queries);
+        if (appended)
+            journal_id = add_journal_entry(first, appended);
+        if (appended != queries.size()) {
+            ERROR("cdr writer: failed to append %lu CDRs to the spool. post them without the spooling",
+                  queries.size() - appended);
+        }
+    }
+
+    string                          token;
+    std::unique_ptr<PGParamExecute> batch_event(create_batch_event(token));
+    batch_event->qdata.info = std::move(event->qdata.info);
+    send_batch(std::move(batch_event), token, size, false, journal_id, local_tag);
+}
+
+void CdrWriter::send_batch(std::unique_ptr<PGParamExecute> event, const string &token, size_t size, bool replay,
+                           uint64_t journal_id, const string &local_tag)
+{
+    inflight_batch b{ LatencyHistogram::clock::now(), size, replay, journal_id, {}, {} };
+
+    // single CDR without the spool has nothing to resend one by one. do not copy it
+    if (spool_enabled || size > 1 || local_tag.empty())
+        b.queries = event->qdata.info;
+    else
+        b.local_tag = local_tag;
+
+    {
+        AmLock l(inflight_mutex);
+        inflight.emplace(token, std::move(b));
+    }
+
+    inflight_cdrs.inc(size);
+    flushed_cdrs.inc(size);
+    flushed_batches.inc();
+
+    AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, event.release());
+}
+
+void CdrWriter::spool_batch(PGParamExecute &event)
+{
+    auto &queries = event.qdata.info;
+    auto  spooled = append_to_spool(queries);
+
+    spooled_cdrs.inc(spooled);
+    if (spooled == queries.size())
+        return;
+
+    // do not lose CDRs if the spool is not writable
+    ERROR("failed to append %lu CDRs to the spool. post them to the database worker",
+          queries.size() - spooled);
+
+    queries.erase(queries.begin(), queries.begin() + static_cast<long>(spooled));
+
+    string                          token;
+    std::unique_ptr<PGParamExecute> batch_event(create_batch_event(token));
+    auto                            size = queries.size();
+    batch_event->qdata.info              = std::move(queries);
+    send_batch(std::move(batch_event), token, size, false, 0);
+}
+
+uint64_t CdrWriter::add_journal_entry(uint64_t first, size_t records)
+{
+    uint64_t id = next_journal_id++;
+    journal.emplace(id, journal_entry{ first, records, 1, false });
+    return id;
+}
+
+void CdrWriter::resolve_journal_entry(uint64_t id, bool failed)
+{
+    auto it = journal.find(id);
+    if (it == journal.end())
+        return;
+
+    auto &e = it->second;
+    if (e.pending)
+        e.pending--;
+    if (failed)
+        e.failed = true;
+    if (e.pending)
+        return;
+
+    // records of the failed entry stay at the spool read position to be replayed
+    if (!e.failed)
+        confirmed.emplace(e.first, e.first + e.records);
+    journal.erase(it);
+
+    consume_confirmed();
+}
+
+void CdrWriter::consume_confirmed()
+{
+    // spool is consumed in order. ranges confirmed after the not confirmed records wait for them
+    while (!confirmed.empty() && confirmed.begin()->first <= spool_head) {
+        auto end = confirmed.begin()->second;
+        if (end > spool_head) {
+            spool.consume(end - spool_head);
+            spool_head = end;
+        }
+        confirmed.erase(confirmed.begin());
+    }
+}
+
+bool CdrWriter::is_confirmed(uint64_t seq) const
+{
+    auto it = confirmed.upper_bound(seq);
+    if (it == confirmed.begin())
+        return false;
+    return std::prev(it)->second > seq;
+}
+
+void CdrWriter::post(const string &shard_key, std::unique_ptr<PGParamExecute> cdr_event)
+{
+    // spool is written by the writer thread only
+    if (!spool_enabled && (batch_size <= 1 || batches.empty())) {
+        post_batch(std::move(cdr_event), 1, shard_key);
+        return;
+    }
+
+    std::unique_ptr<PGParamExecute> ready_event;
+    size_t                          ready_size = 0;
+    bool                            ready      = false;
+    auto                           &b          = *batches[std::hash<string>{}(shard_key) % batches.size()];
+    {
+        AmLock l(b.mutex);
+        if (!b.event) {
+            b.event          = std::move(cdr_event);
+            b.first_cdr_time = LatencyHistogram::clock::now();
+        } else {
+            b.event->qdata.info.emplace_back(std::move(cdr_event->qdata.info.front()));
+        }
+        b.size++;
+        queue_size.inc();
+
+        if (b.size >= batch_size) {
+            ready = true;
+            if (!spool_enabled) {
+                ready_size  = b.size;
+                ready_event = take_batch(b);
+            }
+        }
+    }
+
+    if (ready_event)
+        post_batch(std::move(ready_event), ready_size);
+    else if (ready)
+        flush_event.fire();
+}
+
+void CdrWriter::flush_expired(bool force)
+{
+    auto now = LatencyHistogram::clock::now();
+    for (auto &b : batches) {
+        std::unique_ptr<PGParamExecute> ready_event;
+        size_t                          ready_size = 0;
+        {
+            AmLock l(b->mutex);
+            if (!b->event)
+                continue;
+            if (force || b->size >= batch_size || now - b->first_cdr_time >= batch_timeout) {
+                ready_size  = b->size;
+                ready_event = take_batch(*b);
+            }
+        }
+        if (ready_event)
+            post_batch(std::move(ready_event), ready_size);
+    }
+}
+
+void CdrWriter::switch_to_spool()
+{
+    if (spooling.load())
+        return;
+    spooling = true;
+    spool_mode.set(1);
+}
+
+void CdrWriter::check_spooling()
+{
+    bool inflight_empty, inflight_expired = false;
+    auto now = LatencyHistogram::clock::now();
+    {
+        AmLock l(inflight_mutex);
+        inflight_empty = inflight.empty();
+        for (const auto &it : inflight) {
+            if (now - it.second.sent_time >= spool_timeout) {
+                inflight_expired = true;
+                break;
+            }
+        }
+    }
+
+    if (!spooling.load()) {
+        if (inflight_expired) {
+            WARN("cdr writer: database did not confirm CDRs for %ld msec. switch to the spool",
+                 static_cast<long>(spool_timeout.count()));
+            switch_to_spool();
+        }
+        return;
+    }
+
+    // replay only when all previously posted batches are confirmed to keep the order
+    if (inflight_empty)
+        replay_next();
+}
+
+void CdrWriter::replay_next()
+{
+    vector<string> records;
+
+    /* all posted batches are replied. records of the not confirmed ones
+     * are at the spool read position and will be replayed */
+    size_t n = spool.peek(records, spool_replay_batch_size);
+    if (!n) {
+        INFO("cdr writer: spool is drained. switch to the database");
+        spooling = false;
+        spool_mode.set(0);
+        return;
+    }
+
+    string                          token;
+    std::unique_ptr<PGParamExecute> event(create_batch_event(token));
+    auto                           &queries = event->qdata.info;
+    auto                            empty_query(queries.front());
+    queries.clear();
+
+    uint64_t seq = spool_head;
+    for (const auto &r : records) {
+        // already written by the batch confirmed after the failed one
+        if (is_confirmed(seq++))
+            continue;
+        AmArg params;
+        if (!json2arg(r, params) || !isArgArray(params)) {
+            ERROR("cdr writer: malformed spool record is moved to the rejected ones: %s", r.data());
+            spool.reject(r);
+            continue;
+        }
+        auto &q = queries.emplace_back(empty_query);
+        for (size_t i = 0; i < params.size(); i++)
+            q.addParam(params.get(i));
+    }
+
+    auto journal_id = add_journal_entry(spool_head, n);
+
+    if (queries.empty()) {
+        resolve_journal_entry(journal_id, false);
+        return;
+    }
+
+    send_batch(std::move(event), token, queries.size(), true, journal_id);
+}
+
+void CdrWriter::resend(inflight_batch &b)
+{
+    resent_cdrs.inc(b.queries.size());
+
+    // every resent query holds the journal entry until it is replied
+    if (b.journal_id) {
+        auto it = journal.find(b.journal_id);
+        if (it != journal.end())
+            it->second.pending += b.queries.size() - 1;
+    }
+
+    for (auto &q : b.queries) {
+        string                          token;
+        std::unique_ptr<PGParamExecute> event(create_batch_event(token));
+        event->qdata.info.clear();
+        event->qdata.info.emplace_back(std::move(q));
+        send_batch(std::move(event), token, 1, b.replay, b.journal_id);
+    }
+}
+
+void CdrWriter::report_failed(const inflight_batch &b, const char *reason)
+{
+    failed_cdrs.inc(b.size);
+
+    if (b.queries.empty()) {
+        ERROR("cdr writer: CDR %s is not written: %s", b.local_tag.data(), reason);
+        return;
+    }
+
+    for (const auto &q : b.queries) {
+        auto params = query_params2json(q);
+        ERROR("cdr writer: CDR is not written: %s. params: %s", reason, params.data());
+        // keep it for the manual processing
+        if (spool_enabled && !spool.reject(params))
+            ERROR("cdr writer: failed to save rejected CDR");
+    }
+}
+
+void CdrWriter::on_batch_reply(const string &token, AmEvent *ev)
+{
+    inflight_batch b;
+    bool           replay_allowed;
+    {
+        AmLock l(inflight_mutex);
+        auto   it = inflight.find(token);
+        if (it == inflight.end()) {
+            ERROR("cdr writer: reply for unknown batch %s", token.data());
+            return;
+        }
+        b = std::move(it->second);
+        inflight.erase(it);
+        replay_allowed = inflight.empty();
+    }
+
+    inflight_cdrs.dec(b.size);
+    write_duration.add(b.sent_time);
+
+    if (dynamic_cast<PGResponse *>(ev)) {
+        if (b.replay)
+            replayed_cdrs.inc(b.size);
+        if (b.journal_id)
+            resolve_journal_entry(b.journal_id, false);
+    } else if (auto e = dynamic_cast<PGResponseError *>(ev)) {
+        if (b.queries.size() > 1) {
+            // whole transaction is rolled back. isolate the failed CDR
+            ERROR("cdr writer: batch %s error: %s. resend %lu CDRs one by one", token.data(), e->error.data(),
+                  b.queries.size());
+            resend(b);
+            return;
+        }
+        report_failed(b, e->error.data());
+        if (b.journal_id)
+            resolve_journal_entry(b.journal_id, false);
+    } else if (dynamic_cast<PGTimeout *>(ev)) {
+        ERROR("cdr writer: batch %s timeout", token.data());
+        if (b.journal_id) {
+            // records are kept in the spool and replayed
+            resolve_journal_entry(b.journal_id, true);
+            switch_to_spool();
+        } else {
+            // CDR may be written by the database after all. report it for the manual check
+            report_failed(b, "database timeout");
+        }
+    }
+
+    // drain the spool without waiting for the timer
+    if (replay_allowed && spooling.load())
+        replay_next();
+}
+
+void CdrWriter::process(AmEvent *ev)
+{
+    if (auto e = dynamic_cast<PGResponse *>(ev)) {
+        on_batch_reply(e->token, ev);
+    } else if (auto e = dynamic_cast<PGResponseError *>(ev)) {
+        on_batch_reply(e->token, ev);
+    } else if (auto e = dynamic_cast<PGTimeout *>(ev)) {
+        on_batch_reply(e->token, ev);
+    }
+}
+
+void CdrWriter::getStats(AmArg &ret)
+{
+    ret["batch_size"]    = static_cast<long>(batch_size);
+    ret["batch_timeout"] = static_cast<long>(batch_timeout.count());
+    ret["queue_size"]    = static_cast<long>(queue_size.get());
+    ret["inflight_cdrs"] = static_cast<long>(inflight_cdrs.get());
+
+    auto &sizes = ret["batches"];
+    sizes.assertArray();
+    for (auto &b : batches) {
+        AmLock l(b->mutex);
+        sizes.push(static_cast<long>(b->size));
+    }
+
+    if (spool_enabled) {
+        auto &s              = ret["spool"];
+        s["spooling"]        = spooling.load();
+        s["pending_records"] = static_cast<long>(spool.get_pending_records());
+        s["segments"]        = static_cast<long>(spool.get_segments_count());
+    }
+}
+
+void CdrWriter::run()
+{
+    int                f;
+    bool               running;
+    struct epoll_event events[4];
+
+    setThreadName("cdr-writer");
+
+    AmEventDispatcher::instance()->addEventQueue(CDR_WRITER_QUEUE_NAME, this);
+
+    // check batches often enough to flush them in time
+    long timer_msec = std::clamp<long>(batch_timeout.count(), MIN_WRITER_BATCH_TIMEOUT_MSEC, QUEUE_RUN_TIMEOUT_MSEC);
+    timer.set(timer_msec * 1000, timer_msec * 1000);
+
+    running = true;
+    do {
+        int ret = epoll_wait(epoll_fd, events, 4, -1);
+        if (ret == -1 && errno != EINTR) {
+            ERROR("epoll_wait: %s", strerror(errno));
+        }
+        if (ret < 1)
+            continue;
+        for (int n = 0; n < ret; ++n) {
+            f = events[n].data.fd;
+
+            if (f == timer) {
+                timer.read();
+                flush_expired(false);
+                if (spool_enabled) {
+                    sync_spool();
+                    check_spooling();
+                }
+            } else if (f == flush_event) {
+                flush_event.read();
+                flush_expired(false);
+            } else if (f == -queue_fd()) {
+                clear_pending();
+                processEvents();
+            } else if (f == stop_event) {
+                stop_event.read();
+                running = false;
+                break;
+            }
+        }
+    } while (running);
+
+    // replies for CDRs posted now would not be processed. keep them in the spool to replay on start
+    if (spool_enabled)
+        switch_to_spool();
+
+    // do not lose accumulated CDRs on shutdown
+    flush_expired(true);
+
+    AmEventDispatcher::instance()->delEventQueue(CDR_WRITER_QUEUE_NAME);
+
+    epoll_unlink(epoll_fd);
+    close(epoll_fd);
+    spool.close();
+    stopped.set(true);
+}
+
+void CdrWriter::on_stop()
+{
+    stop_event.fire();
+    stopped.wait_for();
+}
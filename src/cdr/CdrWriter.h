@@ -12,13 +12,22 @@
 #include "Cdr.h"
 #include "../db/DbTypes.h"
 #include "AmStatistics.h"
+#include "AmEventFdQueue.h"
+#include "../LatencyHistogram.h"
+#include "CdrSpool.h"
+
+#include "ampi/PostgreSqlAPI.h"
 
 #include <fstream>
 #include <sstream>
 #include <cstdio>
 #include <ctime>
+#include <atomic>
+#include <map>
+#include <memory>
 
 using std::list;
+using std::map;
 using std::string;
 using std::vector;
 
@@ -30,10 +39,153 @@ struct CdrThreadCfg {
     int                     retry_interval;
     int                     batch_timeout;
     size_t                  batch_size;
+    size_t                  writer_batch_size;
+    int                     writer_batch_timeout; // msec
     DbConfig                masterdb, slavedb;
     PreparedQueriesT        prepared_queries;
     DynFieldsT              dyn_fields;
     vector<UsedHeaderField> used_header_fields;
     string                  db_schema;
+    string                  spool_dir;
+    size_t                  spool_segment_size;
+    int                     spool_timeout;
+    size_t                  spool_replay_batch_size;
+    int                     spool_sync_interval; // msec
     int                     cfg2CdrThCfg(cfg_t *cdr_sec, AmConfigReader &cfg);
 };
+
+/* accumulates CDR queries into the per-shard batches and posts each batch
+ * to the CDR PG worker as a single transaction.
+ * batch is flushed when it reaches writer_batch_size or when its oldest CDR
+ * is waiting longer than writer_batch_timeout msec.
+ * CDRs are posted one by one if writer_batch_size is 1 (PG worker batch_size and batch_timeout
+ * apply to the posted transactions in both cases).
+ * CDRs with the same shard key (A-leg local tag) always go to the same batch
+ * so attempts of the same call are written in the order of posting.
+ * queries of the failed batch are resent one by one so the broken CDR does not drop the others.
+ *
+ * if spool_dir is configured, every batch is appended to the local CdrSpool before the posting
+ * and its records are consumed once the database confirms them. journal tracks the spool records
+ * of every posted batch. spool is consumed in order, so records confirmed after the not confirmed ones
+ * wait for them and are skipped on the replay. batches are flushed by the writer thread only in this case.
+ * spool is flushed to the disk at most every spool_sync_interval msec (before every posting if 0).
+ * if the database does not confirm posted batches for spool_timeout or the batch is timed out,
+ * batches are appended to the spool without the posting. spooled CDRs are replayed
+ * by spool_replay_batch_size chunks once all posted batches are replied.
+ * CDRs rejected by the database are saved to the spool rejected file */
+class CdrWriter : public AmThread,
+                  public AmEventFdQueue,
+                  public AmEventHandler {
+    struct batch {
+        AmMutex                             mutex;
+        std::unique_ptr<PGParamExecute>     event;
+        size_t                              size;
+        LatencyHistogram::clock::time_point first_cdr_time;
+
+        batch()
+            : size(0)
+        {
+        }
+    };
+
+    /* queries are kept to resend them one by one on error and to report the failed CDRs.
+     * single CDR posted without the spool keeps its local tag only */
+    struct inflight_batch {
+        LatencyHistogram::clock::time_point sent_time;
+        size_t                              size;
+        bool                                replay;
+        uint64_t                            journal_id; // 0 if the batch is not spooled
+        vector<QueryInfo>                   queries;
+        string                              local_tag;
+    };
+
+    struct journal_entry {
+        uint64_t first;   // spool sequence number of the first record of the batch
+        size_t   records; // spooled records of the batch
+        size_t   pending; // not replied batch parts
+        bool     failed;  // records must be replayed
+    };
+
+    vector<std::unique_ptr<batch>> batches;
+    size_t                         batch_size;
+    std::chrono::milliseconds      batch_timeout;
+
+    map<string, inflight_batch> inflight;
+    AmMutex                     inflight_mutex;
+    unsigned long long          next_token;
+
+    /* accessed by the writer thread only.
+     * spool records are numbered from the read position on start */
+    map<uint64_t, journal_entry> journal;
+    uint64_t                     next_journal_id;
+    map<uint64_t, uint64_t>      confirmed;  // confirmed records ranges [first, end) after spool_head
+    uint64_t                     spool_head; // sequence number of the spool read position
+    uint64_t                     spool_tail; // sequence number of the next appended record
+
+    CdrSpool                            spool;
+    bool                                spool_enabled;
+    std::atomic<bool>                   spooling;
+    std::chrono::milliseconds           spool_timeout;
+    size_t                              spool_replay_batch_size;
+    std::chrono::milliseconds           spool_sync_interval;
+    bool                                spool_dirty;
+    LatencyHistogram::clock::time_point spool_synced_time;
+
+    int               epoll_fd;
+    AmEventFd         stop_event;
+    AmTimerFd         timer;
+    AmEventFd         flush_event;
+    AmCondition<bool> stopped;
+
+    AtomicCounter    &queue_size;
+    AtomicCounter    &flushed_batches;
+    AtomicCounter    &flushed_cdrs;
+    AtomicCounter    &inflight_cdrs;
+    AtomicCounter    &resent_cdrs;
+    AtomicCounter    &failed_cdrs;
+    AtomicCounter    &spooled_cdrs;
+    AtomicCounter    &replayed_cdrs;
+    AtomicCounter    &spool_mode;
+    LatencyHistogram &flush_delay;
+    LatencyHistogram &write_duration;
+
+    /* must be called with b.mutex locked. returns event to post */
+    std::unique_ptr<PGParamExecute> take_batch(batch &b);
+    PGParamExecute                 *create_batch_event(string &token);
+    void                            post_batch(std::unique_ptr<PGParamExecute> event, size_t size,
+                                               const string &local_tag = string());
+    void                            send_batch(std::unique_ptr<PGParamExecute> event, const string &token,
+                                               size_t size, bool replay, uint64_t journal_id,
+                                               const string &local_tag = string());
+    void                            report_failed(const inflight_batch &b, const char *reason);
+    void                            spool_batch(PGParamExecute &event);
+    void                            flush_expired(bool force);
+
+    /* returns count of the appended queries */
+    size_t   append_to_spool(const vector<QueryInfo> &queries);
+    void     sync_spool(); // at most every spool_sync_interval
+    uint64_t add_journal_entry(uint64_t first, size_t records);
+    void     resolve_journal_entry(uint64_t id, bool failed);
+    void     consume_confirmed();
+    bool     is_confirmed(uint64_t seq) const;
+
+    void switch_to_spool();
+    void check_spooling();
+    void replay_next();
+    void resend(inflight_batch &b);
+    void on_batch_reply(const string &token, AmEvent *ev);
+
+  public:
+    CdrWriter();
+
+    int configure(const CdrThreadCfg &cfg);
+
+    /* takes ownership of the single CDR query event */
+    void post(const string &shard_key, std::unique_ptr<PGParamExecute> cdr_event);
+
+    void getStats(AmArg &ret);
+
+    void run() override;
+    void on_stop() override;
+    void process(AmEvent *ev) override;
+};
@@ -0,0 +1,110 @@
+#include "SnapshotSerializer.h"
+
+#include "jsonArg.h"
+
+#include <charconv>
+#include <cstring>
+
+void SnapshotSerializer::escape(string &out, const char *s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+
+    const char *chunk = s;
+    const char *end   = s + len;
+    for (; s != end; s++) {
+        const auto c = static_cast<unsigned char>(*s);
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        out.append(chunk, s);
+        chunk = s + 1;
+
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xf];
+        }
+    }
+    out.append(chunk, end);
+
+    out += '"';
+}
+
+void SnapshotSerializer::add_key(const string &key)
+{
+    if (first_field)
+        first_field = false;
+    else
+        out += ',';
+
+    escape(out, key.data(), key.size());
+    out += ':';
+}
+
+void SnapshotSerializer::begin_row()
+{
+    out += '{';
+    first_field = true;
+}
+
+void SnapshotSerializer::end_row()
+{
+    out += "}\n";
+}
+
+void SnapshotSerializer::add(const string &key, long long value)
+{
+    char buf[24];
+
+    add_key(key);
+    auto r = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, r.ptr);
+}
+
+void SnapshotSerializer::add(const string &key, const string &value)
+{
+    add_key(key);
+    escape(out, value.data(), value.size());
+}
+
+void SnapshotSerializer::add(const string &key, const char *value)
+{
+    add_key(key);
+    escape(out, value, strlen(value));
+}
+
+void SnapshotSerializer::add(const string &key, const AmArg &value)
+{
+    switch (value.getType()) {
+    case AmArg::Undef:    add_null(key); break;
+    case AmArg::Int:      add(key, static_cast<long long>(value.asInt())); break;
+    case AmArg::LongLong: add(key, value.asLongLong()); break;
+    case AmArg::Bool:     add_bool(key, value.asBool()); break;
+    case AmArg::CStr:     add(key, value.asCStr()); break;
+    default:
+        add_key(key);
+        out += arg2json(value);
+    }
+}
+
+void SnapshotSerializer::add_bool(const string &key, bool value)
+{
+    add_key(key);
+    out += value ? "true" : "false";
+}
+
+void SnapshotSerializer::add_null(const string &key)
+{
+    add_key(key);
+    out += "null";
+}
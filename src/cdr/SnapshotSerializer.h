@@ -0,0 +1,36 @@
+#pragma once
+
+#include "AmArg.h"
+
+#include <string>
+
+using std::string;
+
+/* streaming JSONEachRow writer for the active calls snapshots.
+ * rows are appended directly to the caller-owned buffer
+ * so it can be reused between snapshots without reallocations */
+class SnapshotSerializer {
+    string &out;
+    bool    first_field;
+
+    void add_key(const string &key);
+
+  public:
+    SnapshotSerializer(string &out)
+        : out(out)
+        , first_field(true)
+    {
+    }
+
+    void begin_row();
+    void end_row();
+
+    void add(const string &key, long long value);
+    void add(const string &key, const string &value);
+    void add(const string &key, const char *value);
+    void add(const string &key, const AmArg &value);
+    void add_bool(const string &key, bool value);
+    void add_null(const string &key);
+
+    static void escape(string &out, const char *s, size_t len);
+};
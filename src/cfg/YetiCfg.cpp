@@ -101,6 +101,10 @@ int YetiCfg::configure(cfg_t *cfg, AmConfigReader &am_cfg)
     core_options_handling          = cfg_getbool(cfg, opt_name_core_options_handling);
     pcap_memory_logger             = cfg_getbool(cfg, opt_name_pcap_memory_logger);
     db_refresh_interval            = std::chrono::seconds(cfg_getint(cfg, opt_name_db_refresh_interval));
+    db_delta_reloads               = cfg_getbool(cfg, opt_name_db_delta_reloads);
+    config_snapshot_path           = cfg_getstr(cfg, opt_name_config_snapshot);
+    db_listen_channel              = cfg_getstr(cfg, opt_name_db_listen_channel);
+    db_listen_refresh_interval     = std::chrono::seconds(cfg_getint(cfg, opt_name_db_listen_refresh_interval));
     auth_feedback                  = cfg_getbool(cfg, opt_name_auth_feedback);
     ip_auth_reject_if_no_matched   = cfg_getbool(cfg, opt_name_ip_auth_reject_if_no_matched);
     ip_auth_hdr                    = cfg_getstr(cfg, opt_name_ip_auth_header);
@@ -16,6 +16,10 @@ struct YetiCfg {
     DbConfig routing_db_master;
 
     std::chrono::seconds db_refresh_interval;
+    bool                 db_delta_reloads;
+    string               config_snapshot_path;
+    string               db_listen_channel;
+    std::chrono::seconds db_listen_refresh_interval;
 
     string         msg_logger_dir;
     string         audio_recorder_dir;
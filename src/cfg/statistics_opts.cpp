@@ -1,20 +1,31 @@
 #include "statistics_opts.h"
 #include "opts_helpers.h"
 
-#define SNAPSHOTS_PERIOD_DEFAULT 60
+#define SNAPSHOTS_PERIOD_DEFAULT            60
+#define SNAPSHOTS_COMPRESSION_LEVEL_DEFAULT 3
+#define SNAPSHOTS_KEYFRAME_INTERVAL_DEFAULT 12
 
 char section_name_active_calls[] = "active-calls";
 char section_name_clickhouse[]   = "clickhouse";
 
-char opt_name_table[]          = "table";
-char opt_name_destinations[]   = "destinations";
-char opt_name_buffering[]      = "buffering";
-char opt_name_allowed_fields[] = "allowed_fields";
-char opt_name_period[]         = "period";
+char opt_name_table[]             = "table";
+char opt_name_destinations[]      = "destinations";
+char opt_name_buffering[]         = "buffering";
+char opt_name_allowed_fields[]    = "allowed_fields";
+char opt_name_period[]            = "period";
+char opt_name_chunk_size[]        = "chunk_size";
+char opt_name_compression[]       = "compression";
+char opt_name_compression_level[] = "compression_level";
+char opt_name_delta[]             = "delta";
+char opt_name_keyframe_interval[] = "keyframe_interval";
 
 cfg_opt_t sig_yeti_statistics_acive_calls_clickhouse_opts[] = {
     CFG_STR(opt_name_table, "active_calls", CFGF_NONE), CFG_STR(opt_name_destinations, NULL, CFGF_LIST),
-    CFG_BOOL(opt_name_buffering, cfg_false, CFGF_NONE), CFG_STR(opt_name_allowed_fields, NULL, CFGF_LIST), CFG_END()
+    CFG_BOOL(opt_name_buffering, cfg_false, CFGF_NONE), CFG_STR(opt_name_allowed_fields, NULL, CFGF_LIST),
+    CFG_INT(opt_name_chunk_size, 0, CFGF_NONE), CFG_STR(opt_name_compression, "none", CFGF_NONE),
+    CFG_INT(opt_name_compression_level, SNAPSHOTS_COMPRESSION_LEVEL_DEFAULT, CFGF_NONE),
+    CFG_BOOL(opt_name_delta, cfg_false, CFGF_NONE),
+    CFG_INT(opt_name_keyframe_interval, SNAPSHOTS_KEYFRAME_INTERVAL_DEFAULT, CFGF_NONE), CFG_END()
 };
 
 cfg_opt_t sig_yeti_statistics_acive_calls_opts[] = {
@@ -10,6 +10,11 @@ extern char opt_name_destinations[];
 extern char opt_name_buffering[];
 extern char opt_name_allowed_fields[];
 extern char opt_name_period[];
+extern char opt_name_chunk_size[];
+extern char opt_name_compression[];
+extern char opt_name_compression_level[];
+extern char opt_name_delta[];
+extern char opt_name_keyframe_interval[];
 
 extern cfg_opt_t sig_yeti_statistics_acive_calls_clickhouse_opts[];
 extern cfg_opt_t sig_yeti_statistics_acive_calls_opts[];
@@ -10,6 +10,8 @@
 #define YETI_SCTP_DEFAULT_PORT 4444
 
 #define YETI_CFG_RES_INIT_DEFAULT_MAX_DELAY 0
+#define YETI_CFG_RES_LEASE_DEFAULT_MIN_LIMIT 100
+#define YETI_CFG_RES_LEASE_DEFAULT_TTL       60
 
 #define IP_AUTH_DEFAULT_HEADER          "X-ORIG-IP"
 #define YETI_DEFAULT_AUDIO_RECORDER_DIR "/var/spool/sems/record"
@@ -38,12 +40,25 @@ char section_name_headers[]                = "headers";
 char opt_name_core_options_handling[]           = "core_options_handling";
 char opt_name_pcap_memory_logger[]              = "pcap_memory_logger";
 char opt_name_db_refresh_interval[]             = "db_refresh_interval";
+char opt_name_db_delta_reloads[]                = "db_delta_reloads";
+char opt_name_config_snapshot[]                 = "config_snapshot";
+char opt_name_db_listen_channel[]               = "db_listen_channel";
+char opt_name_db_listen_refresh_interval[]      = "db_listen_refresh_interval";
 char opt_name_ip_auth_reject_if_no_matched[]    = "ip_auth_reject_if_no_matched";
 char opt_name_ip_auth_header[]                  = "ip_auth_header";
 char opt_name_postgresql_debug[]                = "postgresql_debug";
 char opt_name_write_internal_disconnect_code[]  = "write_internal_disconnect_code";
 char opt_name_write_auth_error_id[]             = "write_auth_error_id";
 char opt_name_connection_lifetime[]             = "connection_lifetime";
+char opt_name_getprofile_batch_size[]           = "getprofile_batch_size";
+char opt_name_getprofile_batch_window[]         = "getprofile_batch_window";
+char opt_name_cdr_writer_batch_size[]           = "writer_batch_size";
+char opt_name_cdr_writer_batch_timeout[]        = "writer_batch_timeout";
+char opt_name_cdr_spool_dir[]                   = "spool_dir";
+char opt_name_cdr_spool_segment_size[]          = "spool_segment_size";
+char opt_name_cdr_spool_timeout[]               = "spool_timeout";
+char opt_name_cdr_spool_replay_batch_size[]     = "spool_replay_batch_size";
+char opt_name_cdr_spool_sync_interval[]         = "spool_sync_interval";
 char opt_name_pass_input_interface_name[]       = "pass_input_interface_name";
 char opt_name_new_codec_groups[]                = "new_codec_groups";
 char opt_name_pop_id[]                          = "pop_id";
@@ -58,6 +73,8 @@ char opt_name_auth_default_realm_header[]          = "default_realm_header";
 char opt_name_auth_skip_logging_invite_challenge[] = "skip_logging_invite_challenge";
 char opt_name_auth_skip_logging_invite_success[]   = "skip_logging_invite_success";
 char opt_name_auth_jwt_public_key[]                = "jwt_public_key";
+char opt_name_auth_jwt_cache_size[]                = "jwt_cache_size";
+char opt_name_auth_jwt_cache_max_ttl[]             = "jwt_cache_max_ttl";
 
 char opt_func_name_header[]                 = "header";
 char opt_name_cdr_headers_add_sip_reason[]  = "add_sip_reason";
@@ -66,6 +83,14 @@ char opt_name_cdr_headers_add_q850_reason[] = "add_q850_reason";
 char opt_resources_scripts_dir[]              = "scripts_dir";
 char opt_resources_reject_on_error[]          = "reject_on_error";
 char opt_resources_initialization_max_delay[] = "initialization_max_delay";
+char opt_resources_async_check[]              = "async_check";
+char opt_resources_lease_block[]              = "lease_block";
+char opt_resources_lease_min_limit[]          = "lease_min_limit";
+char opt_resources_lease_ttl[]                = "lease_ttl";
+char opt_resources_write_batch_size[]         = "write_batch_size";
+char opt_resources_write_batch_linger[]       = "write_batch_linger";
+char opt_resources_write_max_inflight[]       = "write_max_inflight";
+char opt_resources_handlers_log[]             = "handlers_log";
 
 char opt_redis_hosts[]    = "hosts";
 char opt_redis_timeout[]  = "timeout";
@@ -96,6 +121,8 @@ cfg_opt_t sig_yeti_routing_opts[] = { VCFG_STR(schema, switch22),
                                       CFG_BOOL(opt_name_pass_input_interface_name, cfg_true, CFGF_NONE),
                                       CFG_BOOL(opt_name_new_codec_groups, cfg_true, CFGF_NONE),
                                       CFG_INT(opt_name_connection_lifetime, 0, CFGF_NONE),
+                                      CFG_INT(opt_name_getprofile_batch_size, 0, CFGF_NONE),
+                                      CFG_INT(opt_name_getprofile_batch_window, 2000, CFGF_NONE),
                                       CFG_STR(opt_name_lega_gw_cache_key, "", CFGF_NONE),
                                       CFG_STR(opt_name_legb_gw_cache_key, "", CFGF_NONE),
                                       DCFG_SEC(master_pool, sig_yeti_routing_pool_opts, CFGF_NONE),
@@ -116,6 +143,13 @@ cfg_opt_t sig_yeti_cdr_opts[] = { DCFG_BOOL(failover_to_slave),
                                   DCFG_INT(batch_timeout),
                                   DCFG_INT(auth_batch_timeout),
                                   CFG_INT(opt_name_connection_lifetime, 0, CFGF_NONE),
+                                  CFG_INT(opt_name_cdr_writer_batch_size, 1, CFGF_NONE),
+                                  CFG_INT(opt_name_cdr_writer_batch_timeout, 1000, CFGF_NONE),
+                                  CFG_STR(opt_name_cdr_spool_dir, "", CFGF_NONE),
+                                  CFG_INT(opt_name_cdr_spool_segment_size, 64, CFGF_NONE),
+                                  CFG_INT(opt_name_cdr_spool_timeout, 10000, CFGF_NONE),
+                                  CFG_INT(opt_name_cdr_spool_replay_batch_size, 1000, CFGF_NONE),
+                                  CFG_INT(opt_name_cdr_spool_sync_interval, 1000, CFGF_NONE),
                                   VCFG_STR(schema, switch),
                                   VCFG_STR(function, writecdr),
                                   DCFG_SEC(master, sig_yeti_cdr_db_opts, CFGF_NONE),
@@ -129,9 +163,18 @@ cfg_opt_t sig_yeti_redis_pool_opts[] = { CFG_STR_LIST(opt_redis_hosts, 0, CFGF_N
                                          CFG_STR(opt_redis_password, "", CFGF_NONE), CFG_END() };
 
 cfg_opt_t sig_yeti_resources_opts[] = { CFG_BOOL(opt_resources_reject_on_error, cfg_false, CFGF_NONE),
+                                        CFG_BOOL(opt_resources_async_check, cfg_false, CFGF_NONE),
                                         CFG_INT(opt_resources_initialization_max_delay,
                                                 YETI_CFG_RES_INIT_DEFAULT_MAX_DELAY, CFGF_NONE),
                                         CFG_STR(opt_resources_scripts_dir, YETI_CFG_DEFAULT_SCRIPTS_DIR, CFGF_NONE),
+                                        CFG_INT(opt_resources_lease_block, 0, CFGF_NONE),
+                                        CFG_INT(opt_resources_lease_min_limit, YETI_CFG_RES_LEASE_DEFAULT_MIN_LIMIT,
+                                                CFGF_NONE),
+                                        CFG_INT(opt_resources_lease_ttl, YETI_CFG_RES_LEASE_DEFAULT_TTL, CFGF_NONE),
+                                        CFG_INT(opt_resources_write_batch_size, 0, CFGF_NONE),
+                                        CFG_INT(opt_resources_write_batch_linger, 0, CFGF_NONE),
+                                        CFG_INT(opt_resources_write_max_inflight, 1, CFGF_NONE),
+                                        CFG_STR(opt_resources_handlers_log, "", CFGF_NONE),
                                         DCFG_SEC(write, sig_yeti_redis_pool_opts, CFGF_NONE),
                                         DCFG_SEC(read, sig_yeti_redis_pool_opts, CFGF_NONE),
                                         CFG_END() };
@@ -143,6 +186,8 @@ cfg_opt_t sig_yeti_rpc_opts[] = { DCFG_INT(calls_show_limit), CFG_END() };
 cfg_opt_t sig_yeti_auth_opts[] = { CFG_STR_LIST(opt_name_auth_realm, 0, CFGF_NODEFAULT),
                                    CFG_STR(opt_name_auth_default_realm_header, NULL, CFGF_NODEFAULT),
                                    CFG_STR(opt_name_auth_jwt_public_key, NULL, CFGF_NODEFAULT),
+                                   CFG_INT(opt_name_auth_jwt_cache_size, 65536, CFGF_NONE),
+                                   CFG_INT(opt_name_auth_jwt_cache_max_ttl, 300, CFGF_NONE),
                                    CFG_BOOL(opt_name_auth_skip_logging_invite_challenge, cfg_false, CFGF_NODEFAULT),
                                    CFG_BOOL(opt_name_auth_skip_logging_invite_success, cfg_false, CFGF_NODEFAULT),
                                    CFG_END() };
@@ -161,6 +206,10 @@ cfg_opt_t legb_reply_cdr_headers_opts[] = { CFG_FUNC(opt_func_name_header, add_b
 // yeti
 cfg_opt_t yeti_opts[] = { CFG_INT(opt_name_pop_id, 0, CFGF_NONE),
                           CFG_INT(opt_name_db_refresh_interval, 300 /* 5 min */, CFGF_NONE),
+                          CFG_BOOL(opt_name_db_delta_reloads, cfg_false, CFGF_NONE),
+                          CFG_STR(opt_name_config_snapshot, "", CFGF_NONE),
+                          CFG_STR(opt_name_db_listen_channel, "", CFGF_NONE),
+                          CFG_INT(opt_name_db_listen_refresh_interval, 300, CFGF_NONE),
 
                           CFG_STR(opt_name_msg_logger_dir, YETI_DEFAULT_MSG_LOGGER_DIR, CFGF_NONE),
 
@@ -35,12 +35,25 @@ extern char section_name_headers[];
 extern char opt_name_core_options_handling[];
 extern char opt_name_pcap_memory_logger[];
 extern char opt_name_db_refresh_interval[];
+extern char opt_name_db_delta_reloads[];
+extern char opt_name_config_snapshot[];
+extern char opt_name_db_listen_channel[];
+extern char opt_name_db_listen_refresh_interval[];
 extern char opt_name_ip_auth_reject_if_no_matched[];
 extern char opt_name_ip_auth_header[];
 extern char opt_name_postgresql_debug[];
 extern char opt_name_write_internal_disconnect_code[];
 extern char opt_name_write_auth_error_id[];
 extern char opt_name_connection_lifetime[];
+extern char opt_name_getprofile_batch_size[];
+extern char opt_name_getprofile_batch_window[];
+extern char opt_name_cdr_writer_batch_size[];
+extern char opt_name_cdr_writer_batch_timeout[];
+extern char opt_name_cdr_spool_dir[];
+extern char opt_name_cdr_spool_segment_size[];
+extern char opt_name_cdr_spool_timeout[];
+extern char opt_name_cdr_spool_replay_batch_size[];
+extern char opt_name_cdr_spool_sync_interval[];
 extern char opt_name_pass_input_interface_name[];
 extern char opt_name_new_codec_groups[];
 extern char opt_name_pop_id[];
@@ -55,6 +68,8 @@ extern char opt_name_auth_default_realm_header[];
 extern char opt_name_auth_skip_logging_invite_challenge[];
 extern char opt_name_auth_skip_logging_invite_success[];
 extern char opt_name_auth_jwt_public_key[];
+extern char opt_name_auth_jwt_cache_size[];
+extern char opt_name_auth_jwt_cache_max_ttl[];
 
 extern char opt_func_name_header[];
 extern char opt_name_cdr_headers_add_sip_reason[];
@@ -65,6 +80,14 @@ extern char opt_registrar_keepalive_interval[];
 extern char opt_resources_scripts_dir[];
 extern char opt_resources_reject_on_error[];
 extern char opt_resources_initialization_max_delay[];
+extern char opt_resources_async_check[];
+extern char opt_resources_lease_block[];
+extern char opt_resources_lease_min_limit[];
+extern char opt_resources_lease_ttl[];
+extern char opt_resources_write_batch_size[];
+extern char opt_resources_write_batch_linger[];
+extern char opt_resources_write_max_inflight[];
+extern char opt_resources_handlers_log[];
 
 extern char opt_redis_hosts[];
 extern char opt_redis_timeout[];
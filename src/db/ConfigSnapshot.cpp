@@ -0,0 +1,356 @@
+#include "ConfigSnapshot.h"
+#include "log.h"
+
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// guard against the stack exhaustion on the malformed data
+#define DECODE_MAX_DEPTH 32
+
+enum EncodedType : uint8_t {
+    EncodedUndef = 0,
+    EncodedInt,
+    EncodedLongLong,
+    EncodedBool,
+    EncodedDouble,
+    EncodedCStr,
+    EncodedArray,
+    EncodedStruct
+};
+
+template <typename T> static inline void put(string &out, T v)
+{
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template <typename T> static inline bool get(const char *&p, const char *end, T &v)
+{
+    if (static_cast<size_t>(end - p) < sizeof(v))
+        return false;
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
+}
+
+static inline void put_str(string &out, const char *s, size_t len)
+{
+    put<uint32_t>(out, len);
+    out.append(s, len);
+}
+
+static inline bool get_str(const char *&p, const char *end, string &s)
+{
+    uint32_t len;
+    if (!get(p, end, len) || static_cast<size_t>(end - p) < len)
+        return false;
+    s.assign(p, len);
+    p += len;
+    return true;
+}
+
+ConfigSnapshot::ConfigSnapshot()
+    : node_id(0)
+    , pop_id(0)
+    , dirty(false)
+{
+}
+
+uint32_t ConfigSnapshot::entry_crc(const char *key, size_t key_len, const char *payload, size_t payload_len)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc       = crc32(crc, reinterpret_cast<const Bytef *>(key), key_len);
+    crc       = crc32(crc, reinterpret_cast<const Bytef *>(payload), payload_len);
+    return static_cast<uint32_t>(crc);
+}
+
+void ConfigSnapshot::configure(const string &snapshot_path, int snapshot_node_id, int snapshot_pop_id)
+{
+    path    = snapshot_path;
+    node_id = snapshot_node_id;
+    pop_id  = snapshot_pop_id;
+}
+
+void ConfigSnapshot::encode(const AmArg &a, string &out)
+{
+    switch (a.getType()) {
+    case AmArg::Int:
+        put<uint8_t>(out, EncodedInt);
+        put<int32_t>(out, a.asInt());
+        break;
+    case AmArg::LongLong:
+        put<uint8_t>(out, EncodedLongLong);
+        put<int64_t>(out, a.asLongLong());
+        break;
+    case AmArg::Bool:
+        put<uint8_t>(out, EncodedBool);
+        put<uint8_t>(out, a.asBool());
+        break;
+    case AmArg::Double:
+        put<uint8_t>(out, EncodedDouble);
+        put<double>(out, a.asDouble());
+        break;
+    case AmArg::CStr:
+    {
+        const char *s = a.asCStr();
+        put<uint8_t>(out, EncodedCStr);
+        put_str(out, s, strlen(s));
+    } break;
+    case AmArg::Array:
+        put<uint8_t>(out, EncodedArray);
+        put<uint32_t>(out, a.size());
+        for (size_t i = 0; i < a.size(); i++)
+            encode(a.get(i), out);
+        break;
+    case AmArg::Struct:
+        put<uint8_t>(out, EncodedStruct);
+        put<uint32_t>(out, a.size());
+        for (const auto &[k, v] : *a.asStruct()) {
+            put_str(out, k.data(), k.size());
+            encode(v, out);
+        }
+        break;
+    default:
+        // objects and blobs are not expected in the DB query results
+        put<uint8_t>(out, EncodedUndef);
+    }
+}
+
+bool ConfigSnapshot::decode(const char *&p, const char *end, AmArg &a, int depth)
+{
+    uint8_t type;
+    if (depth > DECODE_MAX_DEPTH || !get(p, end, type))
+        return false;
+
+    switch (type) {
+    case EncodedUndef: a.clear(); return true;
+    case EncodedInt:
+    {
+        int32_t v;
+        if (!get(p, end, v))
+            return false;
+        a = static_cast<int>(v);
+        return true;
+    }
+    case EncodedLongLong:
+    {
+        int64_t v;
+        if (!get(p, end, v))
+            return false;
+        a = static_cast<long long>(v);
+        return true;
+    }
+    case EncodedBool:
+    {
+        uint8_t v;
+        if (!get(p, end, v))
+            return false;
+        a = v != 0;
+        return true;
+    }
+    case EncodedDouble:
+    {
+        double v;
+        if (!get(p, end, v))
+            return false;
+        a = v;
+        return true;
+    }
+    case EncodedCStr:
+    {
+        string v;
+        if (!get_str(p, end, v))
+            return false;
+        a = v;
+        return true;
+    }
+    case EncodedArray:
+    {
+        uint32_t size;
+        if (!get(p, end, size))
+            return false;
+        a.assertArray();
+        for (uint32_t i = 0; i < size; i++) {
+            a.push(AmArg());
+            if (!decode(p, end, a.back(), depth + 1))
+                return false;
+        }
+        return true;
+    }
+    case EncodedStruct:
+    {
+        uint32_t size;
+        if (!get(p, end, size))
+            return false;
+        a.assertStruct();
+        string key;
+        for (uint32_t i = 0; i < size; i++) {
+            if (!get_str(p, end, key) || !decode(p, end, a[key], depth + 1))
+                return false;
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+bool ConfigSnapshot::load(Entries &ret)
+{
+    struct stat st;
+
+    if (!enabled())
+        return false;
+
+    int fd = ::open(path.data(), O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            ERROR("failed to open config snapshot %s: %s", path.data(), strerror(errno));
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(file_header)) {
+        ERROR("invalid config snapshot %s", path.data());
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void  *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ERROR("failed to mmap config snapshot %s: %s", path.data(), strerror(errno));
+        return false;
+    }
+
+    const char *p   = static_cast<const char *>(data);
+    const char *end = p + size;
+
+    file_header h;
+    get(p, end, h);
+
+    uint32_t header_crc = crc32(crc32(0L, Z_NULL, 0), static_cast<const Bytef *>(data), offsetof(file_header, crc));
+    if (h.magic != file_magic || h.version != file_version || h.crc != header_crc) {
+        ERROR("unexpected config snapshot %s header. ignore it", path.data());
+        munmap(data, size);
+        return false;
+    }
+
+    if (h.node_id != node_id || h.pop_id != pop_id) {
+        WARN("config snapshot %s belongs to the node %d pop %d. ignore it", path.data(), h.node_id, h.pop_id);
+        munmap(data, size);
+        return false;
+    }
+
+    entries.clear();
+
+    for (uint32_t i = 0; i < h.entries; i++) {
+        entry_header eh;
+        if (!get(p, end, eh) || static_cast<size_t>(end - p) < static_cast<size_t>(eh.key_len) + eh.payload_len) {
+            ERROR("config snapshot %s is truncated on the entry %u", path.data(), i);
+            break;
+        }
+
+        const char *key     = p;
+        const char *payload = key + eh.key_len;
+        p                   = payload + eh.payload_len;
+
+        string key_str(key, eh.key_len);
+        if (eh.crc != entry_crc(key, eh.key_len, payload, eh.payload_len)) {
+            ERROR("config snapshot %s entry '%s' checksum mismatch. skip it", path.data(), key_str.data());
+            continue;
+        }
+
+        AmArg       a;
+        const char *payload_end = p;
+        if (!decode(payload, payload_end, a) || payload != payload_end) {
+            ERROR("failed to decode config snapshot %s entry '%s'. skip it", path.data(), key_str.data());
+            continue;
+        }
+
+        auto &stored   = entries[key_str];
+        stored.version = eh.version;
+        stored.payload.assign(key + eh.key_len, eh.payload_len);
+
+        ret.try_emplace(key_str, entry{ eh.version, std::move(a) });
+    }
+
+    munmap(data, size);
+    dirty = false;
+
+    INFO("loaded %zd entries from the config snapshot %s", ret.size(), path.data());
+
+    return true;
+}
+
+void ConfigSnapshot::update(const string &key, std::optional<int> version, const AmArg &data)
+{
+    if (!enabled())
+        return;
+
+    auto &stored   = entries[key];
+    stored.version = version.value_or(unknown_version);
+    stored.payload.clear();
+    encode(data, stored.payload);
+    dirty = true;
+}
+
+int ConfigSnapshot::save()
+{
+    if (!enabled() || !dirty)
+        return 0;
+
+    string data;
+
+    file_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic   = file_magic;
+    h.version = file_version;
+    h.node_id = node_id;
+    h.pop_id  = pop_id;
+    h.entries = entries.size();
+    h.crc     = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(&h), offsetof(file_header, crc));
+    put(data, h);
+
+    for (const auto &[key, e] : entries) {
+        entry_header eh;
+        eh.key_len     = key.size();
+        eh.version     = e.version;
+        eh.payload_len = e.payload.size();
+        eh.crc         = entry_crc(key.data(), key.size(), e.payload.data(), e.payload.size());
+        put(data, eh);
+        data.append(key);
+        data.append(e.payload);
+    }
+
+    string tmp_path = path + ".tmp";
+    int    fd       = ::open(tmp_path.data(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        ERROR("failed to create %s: %s", tmp_path.data(), strerror(errno));
+        return -1;
+    }
+    if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()) || fsync(fd) != 0) {
+        ERROR("failed to write %s: %s", tmp_path.data(), strerror(errno));
+        ::close(fd);
+        unlink(tmp_path.data());
+        return -1;
+    }
+    ::close(fd);
+
+    if (rename(tmp_path.data(), path.data()) != 0) {
+        ERROR("failed to rename %s to %s: %s", tmp_path.data(), path.data(), strerror(errno));
+        unlink(tmp_path.data());
+        return -1;
+    }
+
+    dirty = false;
+    DBG("saved %zd entries to the config snapshot %s (%zd bytes)", entries.size(), path.data(), data.size());
+
+    return 0;
+}
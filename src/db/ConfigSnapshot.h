@@ -0,0 +1,83 @@
+#pragma once
+
+#include <AmArg.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+using std::string;
+
+/* local copy of the DB config caches contents to serve calls
+ * right after the start before the config is loaded from the routing DB.
+ *
+ * file layout (native byte order, mapped on load):
+ *   header: magic, version, node_id, pop_id, entries count, header crc32
+ *   entries: [key_len][state_version][payload_len][crc32 of key and payload][key][payload]
+ *
+ * payload is the binary encoded AmArg of the load_*() query result.
+ * types are kept as is because caches distinguish Int and LongLong values.
+ * entries with the checksum mismatch are skipped.
+ * file is rewritten with tmp file and rename so the partial write is never loaded */
+class ConfigSnapshot {
+  public:
+    static constexpr uint32_t file_magic      = 0x53464359; // "YCFS"
+    static constexpr uint32_t file_version    = 1;
+    static constexpr int      unknown_version = -1;
+
+    struct entry {
+        int   version;
+        AmArg data;
+    };
+    using Entries = std::map<string, entry>;
+
+  private:
+    struct file_header {
+        uint32_t magic;
+        uint32_t version;
+        int32_t  node_id;
+        int32_t  pop_id;
+        uint32_t entries;
+        uint32_t crc;
+    };
+
+    struct entry_header {
+        uint32_t key_len;
+        int32_t  version;
+        uint32_t payload_len;
+        uint32_t crc;
+    };
+
+    struct stored_entry {
+        int    version;
+        string payload;
+    };
+
+    string                         path;
+    int                            node_id;
+    int                            pop_id;
+    std::map<string, stored_entry> entries;
+    bool                           dirty;
+
+    static uint32_t entry_crc(const char *key, size_t key_len, const char *payload, size_t payload_len);
+
+  public:
+    ConfigSnapshot();
+
+    void configure(const string &path, int node_id, int pop_id);
+    bool enabled() const { return !path.empty(); }
+
+    /* returns false if file is absent or belongs to the other node/pop */
+    bool load(Entries &ret);
+
+    /* stores the fully loaded cache contents. version is not set for the alias subkeys */
+    void update(const string &key, std::optional<int> version, const AmArg &data);
+
+    /* rewrites file if it was updated since the last save */
+    int save();
+
+    static void encode(const AmArg &a, string &out);
+    /* returns false on the truncated or malformed data */
+    static bool decode(const char *&p, const char *end, AmArg &a, int depth = 0);
+};
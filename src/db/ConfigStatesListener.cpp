@@ -0,0 +1,209 @@
+#include "ConfigStatesListener.h"
+#include "log.h"
+
+#include "AmEventDispatcher.h"
+
+#include <cstring>
+#include <vector>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define RECONNECT_INTERVAL_USEC 5000000
+#define CONNECT_TIMEOUT_SEC     "5"
+
+using std::vector;
+
+ConfigStatesListener::ConfigStatesListener()
+    : epoll_fd(-1)
+    , stopped(false)
+    , conn(nullptr)
+    , conn_fd(-1)
+    , notifications(stat_group(Counter, MOD_NAME, "config_states_notifications")
+                        .setHelp("config states change notifications received from the routing DB")
+                        .addAtomicCounter())
+    , connects(stat_group(Counter, MOD_NAME, "config_states_listener_connects")
+                   .setHelp("config states listener connections to the routing DB")
+                   .addAtomicCounter())
+    , connected(stat_group(Gauge, MOD_NAME, "config_states_listener_connected")
+                    .setHelp("config states listener is connected and subscribed")
+                    .addAtomicCounter())
+{
+}
+
+ConfigStatesListener::~ConfigStatesListener()
+{
+    disconnect();
+}
+
+int ConfigStatesListener::configure(const DbConfig &db_config, const string &states_channel, const string &queue)
+{
+    db         = db_config;
+    channel    = states_channel;
+    queue_name = queue;
+
+    if ((epoll_fd = epoll_create(3)) == -1) {
+        ERROR("epoll_create() call failed");
+        return -1;
+    }
+    stop_event.link(epoll_fd);
+    reconnect_timer.link(epoll_fd);
+
+    return 0;
+}
+
+void ConfigStatesListener::post(ConfigStatesEvent::Type type, const string &payload)
+{
+    if (!AmEventDispatcher::instance()->post(queue_name, new ConfigStatesEvent(type, payload)))
+        ERROR("failed to post config states event to the %s queue", queue_name.data());
+}
+
+bool ConfigStatesListener::connect()
+{
+    string port                = std::to_string(db.port);
+    string keepalives_interval = std::to_string(db.keepalives_interval.value_or(0));
+
+    vector<const char *> keys   = { "host",     "port",           "dbname",          "user",
+                                    "password", "application_name", "connect_timeout", "keepalives" };
+    vector<const char *> values = { db.host.data(), port.data(),           db.name.data(),     db.user.data(),
+                                    db.pass.data(), "yeti-states-listener", CONNECT_TIMEOUT_SEC, "1" };
+    if (db.keepalives_interval) {
+        keys.push_back("keepalives_interval");
+        values.push_back(keepalives_interval.data());
+    }
+    keys.push_back(nullptr);
+    values.push_back(nullptr);
+
+    connects.inc();
+
+    conn = PQconnectdbParams(keys.data(), values.data(), 0);
+    if (PQstatus(conn) != CONNECTION_OK) {
+        ERROR("config states listener failed to connect to %s: %s", db.info_str().data(), PQerrorMessage(conn));
+        disconnect();
+        return false;
+    }
+
+    char *escaped_channel = PQescapeIdentifier(conn, channel.data(), channel.size());
+    if (!escaped_channel) {
+        ERROR("config states listener failed to escape channel '%s': %s", channel.data(), PQerrorMessage(conn));
+        disconnect();
+        return false;
+    }
+    string query = string("LISTEN ") + escaped_channel;
+    PQfreemem(escaped_channel);
+
+    PGresult *res = PQexec(conn, query.data());
+    bool      ok  = PQresultStatus(res) == PGRES_COMMAND_OK;
+    if (!ok)
+        ERROR("config states listener failed to LISTEN '%s': %s", channel.data(), PQerrorMessage(conn));
+    PQclear(res);
+
+    if (!ok || PQsetnonblocking(conn, 1) != 0) {
+        disconnect();
+        return false;
+    }
+
+    conn_fd = PQsocket(conn);
+
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = conn_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn_fd, &ev) != 0) {
+        ERROR("config states listener epoll_ctl: %s", strerror(errno));
+        disconnect();
+        return false;
+    }
+
+    INFO("config states listener is subscribed to '%s' on %s", channel.data(), db.info_str().data());
+    connected.set(1);
+    post(ConfigStatesEvent::Connected);
+
+    return true;
+}
+
+void ConfigStatesListener::disconnect()
+{
+    if (conn_fd != -1) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn_fd, nullptr);
+        conn_fd = -1;
+    }
+    if (conn) {
+        PQfinish(conn);
+        conn = nullptr;
+    }
+    connected.set(0);
+}
+
+void ConfigStatesListener::on_input()
+{
+    if (!PQconsumeInput(conn) || PQstatus(conn) == CONNECTION_BAD) {
+        ERROR("config states listener connection error: %s", PQerrorMessage(conn));
+        disconnect();
+        post(ConfigStatesEvent::Disconnected);
+        reconnect_timer.set(RECONNECT_INTERVAL_USEC, true);
+        return;
+    }
+
+    size_t    received = 0;
+    string    payload;
+    PGnotify *n;
+    while ((n = PQnotifies(conn)) != nullptr) {
+        received++;
+        payload = n->extra;
+        PQfreemem(n);
+    }
+
+    if (!received)
+        return;
+
+    DBG("got %zd config states notifications. last payload: '%s'", received, payload.data());
+    notifications.inc(received);
+    post(ConfigStatesEvent::Changed, payload);
+}
+
+void ConfigStatesListener::run()
+{
+    bool               running;
+    struct epoll_event events[3];
+
+    setThreadName("yeti-cfg-listen");
+
+    if (!connect())
+        reconnect_timer.set(RECONNECT_INTERVAL_USEC, true);
+
+    running = true;
+    do {
+        int ret = epoll_wait(epoll_fd, events, 3, -1);
+        if (ret == -1 && errno != EINTR) {
+            ERROR("epoll_wait: %s", strerror(errno));
+        }
+        if (ret < 1)
+            continue;
+        for (int n = 0; n < ret; ++n) {
+            struct epoll_event &e = events[n];
+
+            if (e.data.fd == stop_event) {
+                stop_event.read();
+                running = false;
+                break;
+            } else if (e.data.fd == reconnect_timer) {
+                reconnect_timer.read();
+                if (!conn && connect()) {
+                    // zero value disarms the timer
+                    reconnect_timer.set(0, false);
+                }
+            } else if (conn && e.data.fd == conn_fd) {
+                on_input();
+            }
+        }
+    } while (running);
+
+    disconnect();
+    close(epoll_fd);
+    stopped.set(true);
+}
+
+void ConfigStatesListener::on_stop()
+{
+    stop_event.fire();
+    stopped.wait_for();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <AmThread.h>
+#include <AmEvent.h>
+#include <AmStatistics.h>
+
+#include "DbConfig.h"
+
+#include <libpq-fe.h>
+
+#include <string>
+
+using std::string;
+
+class ConfigStatesEvent : public AmEvent {
+  public:
+    enum Type { Connected = 0, Disconnected, Changed };
+
+    Type   type;
+    string payload; // of the last notification for the Changed event
+
+    ConfigStatesEvent(Type type, const string &payload = string())
+        : AmEvent(0)
+        , type(type)
+        , payload(payload)
+    {
+    }
+};
+
+/* keeps the dedicated routing DB connection subscribed with LISTEN
+ * to the channel where DB publishes config states changes.
+ * notifications received at once are coalesced into the single Changed event.
+ * Connected/Disconnected events allow the receiver to adjust states polling */
+class ConfigStatesListener : public AmThread {
+    int               epoll_fd;
+    AmEventFd         stop_event;
+    AmTimerFd         reconnect_timer;
+    AmCondition<bool> stopped;
+
+    string   queue_name;
+    string   channel;
+    DbConfig db;
+    PGconn  *conn;
+    int      conn_fd;
+
+    AtomicCounter &notifications;
+    AtomicCounter &connects;
+    AtomicCounter &connected;
+
+    bool connect();
+    void disconnect();
+    void on_input();
+    void post(ConfigStatesEvent::Type type, const string &payload = string());
+
+  public:
+    ConfigStatesListener();
+    ~ConfigStatesListener();
+
+    int configure(const DbConfig &db, const string &channel, const string &queue_name);
+
+    void run() override;
+    void on_stop() override;
+};
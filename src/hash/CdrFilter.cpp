@@ -2,6 +2,7 @@
 
 #include <map>
 #include <algorithm>
+#include <cstring>
 #include <sstream>
 
 const static_call_field static_call_fields[] = {
@@ -49,6 +50,10 @@ typedef map<string, cmp_type_t>::const_iterator field_name2type_iterator;
 static map<string, cmp_cond_t>                  cond_name2type;
 typedef map<string, cmp_cond_t>::const_iterator cond_name2type_iterator;
 
+/* dynamic field name to its slot (position in the router dynamic fields) */
+static map<string, unsigned int> dyn_field_name2slot;
+static vector<string>            dyn_slot_names;
+
 
 // resolve sql types into internal type id
 static cmp_type_t get_type_by_name(const string &type_name)
@@ -102,175 +107,17 @@ static const char *get_cmp_cond_name(cmp_cond_t cond)
     return cmp_cond_names[cond];
 }
 
-/************************
- *		comparators		*
- ************************/
-
-// generic comparators
-
-#define COMPARATOR_NAME(type, field, sop) cmp_##type##_##field##_##sop
-
-#define GENERIC_STATIC_COMPARATOR(field, type, op, sop)                                                                \
-    static bool COMPARATOR_NAME(type, field, sop)(const Cdr *cdr, type value)                                          \
-    {                                                                                                                  \
-        DBG("called %s for Cdr[%p]", FUNC_NAME, cdr);                                                                  \
-        return cdr->field op value;                                                                                    \
-    }
-
-#define TIMESTAMP_STATIC_COMPARATOR(field, type, op, sop)                                                              \
-    static bool COMPARATOR_NAME(type, field, sop)(const Cdr *cdr, const timeval &value)                                \
-    {                                                                                                                  \
-        DBG("called %s for Cdr[%p]", FUNC_NAME, cdr);                                                                  \
-        if (!cdr->field.tv_sec) {                                                                                      \
-            DBG("CDR timestamp field " #field " is not initialized. return false");                                    \
-            return false;                                                                                              \
-        }                                                                                                              \
-        return cdr->field.tv_sec op value.tv_sec;                                                                      \
-    }
-
-#define ACTIVE_COMPARATOR(field, type, op, sop) GENERIC_STATIC_COMPARATOR(field, type, op, sop)
-
-#define EQ_STATIC_COMPARATOR(field, type)  ACTIVE_COMPARATOR(field, type, ==, eq)
-#define NEQ_STATIC_COMPARATOR(field, type) ACTIVE_COMPARATOR(field, type, !=, neq)
-#define GT_STATIC_COMPARATOR(field, type)  ACTIVE_COMPARATOR(field, type, >, gt)
-#define LT_STATIC_COMPARATOR(field, type)  ACTIVE_COMPARATOR(field, type, <, lt)
-#define GTE_STATIC_COMPARATOR(field, type) ACTIVE_COMPARATOR(field, type, >=, gte)
-#define LTE_STATIC_COMPARATOR(field, type) ACTIVE_COMPARATOR(field, type, <=, lte)
-
-#define DEFINE_STATIC_FIELD_COMPARATORS(field, type)                                                                   \
-    EQ_STATIC_COMPARATOR(field, type)                                                                                  \
-    NEQ_STATIC_COMPARATOR(field, type)                                                                                 \
-    GT_STATIC_COMPARATOR(field, type)                                                                                  \
-    LT_STATIC_COMPARATOR(field, type)                                                                                  \
-    GTE_STATIC_COMPARATOR(field, type)                                                                                 \
-    LTE_STATIC_COMPARATOR(field, type)
-
-
-DEFINE_STATIC_FIELD_COMPARATORS(attempt_num, int)
-
-#undef ACTIVE_COMPARATOR
-#define ACTIVE_COMPARATOR(field, type, op, sop) TIMESTAMP_STATIC_COMPARATOR(field, type, op, sop)
-
-DEFINE_STATIC_FIELD_COMPARATORS(connect_time, timestamp)
-
-/* comparators for dynamic fields */
-
-#define DEF_ALL_OPS(MACRO_NAME)                                                                                        \
-    MACRO_NAME(==, eq)                                                                                                 \
-    MACRO_NAME(!=, neq)                                                                                                \
-    MACRO_NAME(>, gt)                                                                                                  \
-    MACRO_NAME(<, lt)                                                                                                  \
-    MACRO_NAME(>=, gte)                                                                                                \
-    MACRO_NAME(<=, lte)
-
-#define DYN_COMPARATOR_NAME(type, op) cmp_dyn_##type##_function_##op
-
-#define DEF_DYN_CMP_INT_FUNC(op, opname)                                                                               \
-    static bool cmp_dyn_int_function_##opname(const Cdr *cdr, const string &field_name, int value)                     \
-    {                                                                                                                  \
-        if (!cdr->dyn_fields.hasMember(field_name)) {                                                                  \
-            ERROR("can't find dynamic field %s in %s", field_name.c_str(), FUNC_NAME);                                 \
-            return false;                                                                                              \
-        }                                                                                                              \
-        AmArg &a = cdr->dyn_fields[field_name];                                                                        \
-        if (a.getType() != AmArg::Int) {                                                                               \
-            ERROR("invalid type for field %s in %s", field_name.c_str(), FUNC_NAME);                                   \
-            return false;                                                                                              \
-        }                                                                                                              \
-        return a.asInt() op value;                                                                                     \
-    }
-DEF_ALL_OPS(DEF_DYN_CMP_INT_FUNC)
-
-#define DEF_DYN_CMP_DOUBLE_FUNC(op, opname)                                                                            \
-    static bool cmp_dyn_double_function_##opname(const Cdr *cdr, const string &field_name, double value)               \
-    {                                                                                                                  \
-        if (!cdr->dyn_fields.hasMember(field_name)) {                                                                  \
-            ERROR("can't find dynamic field %s in %s", field_name.c_str(), FUNC_NAME);                                 \
-            return false;                                                                                              \
-        }                                                                                                              \
-        AmArg &a = cdr->dyn_fields[field_name];                                                                        \
-        if (a.getType() != AmArg::Double) {                                                                            \
-            ERROR("invalid type for field %s in %s", field_name.c_str(), FUNC_NAME);                                   \
-            return false;                                                                                              \
-        }                                                                                                              \
-        return a.asDouble() op value;                                                                                  \
-    }
-DEF_ALL_OPS(DEF_DYN_CMP_DOUBLE_FUNC)
-
-#define DEF_DYN_CMP_LONG_LONG_INT_FUNC(op, opname)                                                                     \
-    static bool cmp_dyn_long_long_int_function_##opname(const Cdr *cdr, const string &field_name, long_long_int value) \
-    {                                                                                                                  \
-        if (!cdr->dyn_fields.hasMember(field_name)) {                                                                  \
-            ERROR("can't find dynamic field %s in %s", field_name.c_str(), FUNC_NAME);                                 \
-            return false;                                                                                              \
-        }                                                                                                              \
-        AmArg &a = cdr->dyn_fields[field_name];                                                                        \
-        if (isArgInt(a)) {                                                                                             \
-            return a.asLong() op value;                                                                                \
-        } else if (isArgLongLong(a)) {                                                                                 \
-            return a.asLongLong() op value;                                                                            \
-        }                                                                                                              \
-        ERROR("invalid type for field %s in %s", field_name.c_str(), FUNC_NAME);                                       \
-        return false;                                                                                                  \
-    }
-DEF_ALL_OPS(DEF_DYN_CMP_LONG_LONG_INT_FUNC)
-
-#define DEF_DYN_CMP_STRING_FUNC(op, opname)                                                                            \
-    static bool cmp_dyn_string_function_##opname(const Cdr *cdr, const string &field_name, const string &value)        \
-    {                                                                                                                  \
-        if (!cdr->dyn_fields.hasMember(field_name)) {                                                                  \
-            ERROR("can't find dynamic field %s in %s", field_name.c_str(), FUNC_NAME);                                 \
-            return false;                                                                                              \
-        }                                                                                                              \
-        AmArg &a = cdr->dyn_fields[field_name];                                                                        \
-        if (a.getType() != AmArg::CStr) {                                                                              \
-            ERROR("invalid type for field '%s' in %s", field_name.c_str(), FUNC_NAME);                                 \
-            return false;                                                                                              \
-        }                                                                                                              \
-        return value op a.asCStr();                                                                                    \
-    }
-
-DEF_DYN_CMP_STRING_FUNC(==, eq)
-DEF_DYN_CMP_STRING_FUNC(!=, neq)
-
-/* macro definitions for static field case declaration in functor constructor */
-
-#define CMP_FIELD_PTR_CASE(type, name, op)                                                                             \
-    case c_cond_##op: fptr_##type = &COMPARATOR_NAME(type, name, op); break;
-
-#define CMP_FIELD_TYPE_CASES(type, name)                                                                               \
-    switch (cmp_cond) {                                                                                                \
-        CMP_FIELD_PTR_CASE(type, name, eq)                                                                             \
-        CMP_FIELD_PTR_CASE(type, name, neq)                                                                            \
-        CMP_FIELD_PTR_CASE(type, name, gt)                                                                             \
-        CMP_FIELD_PTR_CASE(type, name, lt)                                                                             \
-        CMP_FIELD_PTR_CASE(type, name, gte)                                                                            \
-        CMP_FIELD_PTR_CASE(type, name, lte)                                                                            \
-    default:                                                                                                           \
-        throw string(string("condition ") + get_cmp_cond_name(cmp_cond) + " for field " +                              \
-                     get_cmp_field_name(cmp_field) + " is not implemented");                                           \
-    }
+/* validation of the conditions supported by the field type */
 
-#define CMP_FIELD_CASE(type, name)                                                                                     \
-    case c_field_##name: CMP_FIELD_TYPE_CASES(type, name) break
-
-/* macro definitions for dynamic fields case declaration in functor constructor */
-
-#define DYN_FIELD_PTR_CASE(type, op)                                                                                   \
-    case c_cond_##op: fptr_dyn_##type = &DYN_COMPARATOR_NAME(type, op); break;
-
-#define DYN_FIELD_CASE(type)                                                                                           \
-    switch (cmp_cond) {                                                                                                \
-        DYN_FIELD_PTR_CASE(type, eq)                                                                                   \
-        DYN_FIELD_PTR_CASE(type, neq)                                                                                  \
-        DYN_FIELD_PTR_CASE(type, gt)                                                                                   \
-        DYN_FIELD_PTR_CASE(type, lt)                                                                                   \
-        DYN_FIELD_PTR_CASE(type, gte)                                                                                  \
-        DYN_FIELD_PTR_CASE(type, lte)                                                                                  \
-    default:                                                                                                           \
-        throw string(string("condition ") + get_cmp_cond_name(cmp_cond) + " for dynamic field " + dyn_field_name +     \
-                     " is not implemented");                                                                           \
+static void check_condition(cmp_type_t cmp_type, cmp_cond_t cmp_cond, const string &field_name)
+{
+    if (cmp_cond < 0 || cmp_cond >= c_cond_max ||
+        (cmp_type == c_type_string && cmp_cond != c_cond_eq && cmp_cond != c_cond_neq))
+    {
+        throw string(string("condition ") + get_cmp_cond_name(cmp_cond) + " for field " + field_name +
+                     " is not implemented");
     }
+}
 
 /* functor constructors */
 
@@ -282,9 +129,8 @@ cmp_functor::cmp_functor(int value, cmp_field_t cmp_field, cmp_cond_t cmp_cond)
     , v_int(value)
 {
     switch (cmp_field) {
-        // CMP_FIELD_CASE(int,time_limit);
-        CMP_FIELD_CASE(int, attempt_num);
-    default: throw string(string("unknown field: ") + int2str(cmp_field));
+    case c_field_attempt_num: check_condition(cmp_type, cmp_cond, get_cmp_field_name(cmp_field)); break;
+    default:                  throw string(string("unknown field: ") + int2str(cmp_field));
     }
     DBG("created functor %s", info().c_str());
 }
@@ -306,16 +152,15 @@ cmp_functor::cmp_functor(double value, cmp_field_t cmp_field_in, cmp_cond_t cmp_
 {
     switch (cmp_field) {
     case c_field_duration:
-        // DBG("requested functor for pseudo-field 'duration'. replace it with asjusted connect_time comparsion
-        // implicit");
+        check_condition(cmp_type, cmp_cond, get_cmp_field_name(cmp_field));
         timeval now;
         gettimeofday(&now, NULL);
         // adjust parameter, change functor type and condition direction on the fly
-        v_time.tv_sec = now.tv_sec - v_double;
-        cmp_cond      = invert_condition_direction(cmp_cond);
-        cmp_field     = c_field_connect_time;
-        cmp_type      = c_type_timestamp;
-        CMP_FIELD_TYPE_CASES(timestamp, connect_time)
+        v_time.tv_sec  = now.tv_sec - v_double;
+        v_time.tv_usec = 0;
+        cmp_cond       = invert_condition_direction(cmp_cond);
+        cmp_field      = c_field_connect_time;
+        cmp_type       = c_type_timestamp;
         break;
     default: throw string(string("unknown field: ") + int2str(cmp_field));
     }
@@ -330,8 +175,8 @@ cmp_functor::cmp_functor(const timeval &value, cmp_field_t cmp_field, cmp_cond_t
     , v_time(value)
 {
     switch (cmp_field) {
-        CMP_FIELD_CASE(timestamp, connect_time);
-    default: throw string(string("unknown field: ") + int2str(cmp_field));
+    case c_field_connect_time: check_condition(cmp_type, cmp_cond, get_cmp_field_name(cmp_field)); break;
+    default:                   throw string(string("unknown field: ") + int2str(cmp_field));
     }
     DBG("created functor %s", info().c_str());
 }
@@ -344,7 +189,7 @@ cmp_functor::cmp_functor(int value, const string &field_name, cmp_cond_t cmp_con
     , dyn_field_name(field_name)
     , v_int(value)
 {
-    DYN_FIELD_CASE(int)
+    check_condition(cmp_type, cmp_cond, dyn_field_name);
     DBG("created functor %s", info().c_str());
 }
 
@@ -356,7 +201,7 @@ cmp_functor::cmp_functor(double value, const string &field_name, cmp_cond_t cmp_
     , dyn_field_name(field_name)
     , v_double(value)
 {
-    DYN_FIELD_CASE(double)
+    check_condition(cmp_type, cmp_cond, dyn_field_name);
     DBG("created functor %s", info().c_str());
 }
 
@@ -368,11 +213,10 @@ cmp_functor::cmp_functor(long long int value, const string &field_name, cmp_cond
     , dyn_field_name(field_name)
     , v_long_long_int(value)
 {
-    DYN_FIELD_CASE(long_long_int)
+    check_condition(cmp_type, cmp_cond, dyn_field_name);
     DBG("created functor %s", info().c_str());
 }
 
-
 // dynamic fields with type string
 cmp_functor::cmp_functor(const string &value, const string &field_name, cmp_cond_t cmp_cond)
     : cmp_type(c_type_string)
@@ -381,39 +225,10 @@ cmp_functor::cmp_functor(const string &value, const string &field_name, cmp_cond
     , dyn_field_name(field_name)
     , v_string(value)
 {
-    switch (cmp_cond) {
-        DYN_FIELD_PTR_CASE(string, eq)
-        DYN_FIELD_PTR_CASE(string, neq)
-    default:
-        throw string(string("condition ") + get_cmp_cond_name(cmp_cond) + " for dynamic field " + dyn_field_name +
-                     " is not implemented");
-    }
+    check_condition(cmp_type, cmp_cond, dyn_field_name);
     DBG("created functor %s", info().c_str());
 }
 
-// match function
-bool cmp_functor::operator()(const Cdr *cdr) const
-{
-    if (cmp_field == c_field_dynamic) {
-        switch (cmp_type) {
-        case c_type_int:           return (*fptr_dyn_int)(cdr, dyn_field_name, v_int); break;
-        case c_type_double:        return (*fptr_dyn_double)(cdr, dyn_field_name, v_double); break;
-        case c_type_long_long_int: return (*fptr_dyn_long_long_int)(cdr, dyn_field_name, v_long_long_int); break;
-        case c_type_string:        return (*fptr_dyn_string)(cdr, dyn_field_name, v_string); break;
-        default:                   ;
-        }
-    } else {
-        switch (cmp_type) {
-        case c_type_int:       return (*fptr_int)(cdr, v_int); break;
-        case c_type_double:    return (*fptr_double)(cdr, v_double); break;
-        case c_type_timestamp: return (*fptr_timestamp)(cdr, v_time); break;
-        default:               ;
-        }
-    }
-    ERROR("wrong initialized cmp_functor: %s", info().c_str());
-    return false;
-}
-
 string cmp_functor::info() const
 {
     stringstream info;
@@ -438,19 +253,168 @@ string cmp_functor::info() const
     return info.str();
 }
 
-bool apply_filter_rules(const Cdr *cdr, const cmp_rules &rules)
+/************************
+ *    compiled filter   *
+ ************************/
+
+template <typename T> static inline bool cmp_values(cmp_cond_t cond, const T &a, const T &b)
 {
-    bool matched = true;
-    for (cmp_rules_it it = rules.begin(); it != rules.end(); ++it) {
-        if (!(*it)(cdr)) {
-            DBG("[%s] NOT MATCHED against functor: %s", cdr->local_tag.c_str(), it->info().c_str());
-            matched = false;
-            break;
+    switch (cond) {
+    case c_cond_eq:  return a == b;
+    case c_cond_neq: return a != b;
+    case c_cond_gt:  return a > b;
+    case c_cond_lt:  return a < b;
+    case c_cond_gte: return a >= b;
+    case c_cond_lte: return a <= b;
+    default:         return false;
+    }
+}
+
+void cmp_filter::compile(const cmp_rules &rules)
+{
+    ops.clear();
+    ops.reserve(rules.size());
+
+    for (const auto &rule : rules) {
+        cmp_op op;
+        op.cond       = rule.cmp_cond;
+        op.slot       = 0;
+        op.field_name = nullptr;
+        op.v_integer  = 0;
+        op.v_double   = 0;
+        op.info       = rule.info();
+
+        if (rule.cmp_field == c_field_dynamic) {
+            auto slot_it = dyn_field_name2slot.find(rule.dyn_field_name);
+            if (slot_it == dyn_field_name2slot.end())
+                throw string("unknown dynamic field " + rule.dyn_field_name);
+            op.slot       = slot_it->second;
+            op.field_name = &dyn_slot_names[op.slot];
+
+            switch (rule.cmp_type) {
+            case c_type_int:
+                op.code      = op_dyn_int;
+                op.v_integer = rule.v_int;
+                break;
+            case c_type_long_long_int:
+                op.code      = op_dyn_long_long_int;
+                op.v_integer = rule.v_long_long_int;
+                break;
+            case c_type_double:
+                op.code     = op_dyn_double;
+                op.v_double = rule.v_double;
+                break;
+            case c_type_string:
+                op.code     = op_dyn_string;
+                op.v_string = rule.v_string;
+                break;
+            default: throw string(string("not supported dynamic field type: ") + get_cmp_type_name(rule.cmp_type));
+            }
         } else {
-            DBG("[%s] MATCHED against functor: %s", cdr->local_tag.c_str(), it->info().c_str());
+            switch (rule.cmp_field) {
+            case c_field_attempt_num:
+                op.code      = op_attempt_num;
+                op.v_integer = rule.v_int;
+                break;
+            case c_field_connect_time:
+                op.code      = op_connect_time;
+                op.v_integer = rule.v_time.tv_sec;
+                break;
+            default: throw string(string("not supported static field: ") + get_cmp_field_name(rule.cmp_field));
+            }
         }
+
+        ops.emplace_back(std::move(op));
     }
-    return matched;
+
+    // cheap static ops first. dynamic ops are grouped by slot
+    std::stable_sort(ops.begin(), ops.end(), [](const cmp_op &l, const cmp_op &r) {
+        if (l.code < op_dyn_int || r.code < op_dyn_int)
+            return l.code < r.code;
+        return l.slot < r.slot;
+    });
+}
+
+bool cmp_filter::match(const Cdr *cdr) const
+{
+    const AmArg::ValueStruct *dyn_fields = isArgStruct(cdr->dyn_fields) ? cdr->dyn_fields.asStruct() : nullptr;
+    const AmArg              *value      = nullptr;
+    const string             *value_name = nullptr;
+
+    for (const auto &op : ops) {
+        bool matched      = false;
+        bool invalid_type = false;
+
+        if (op.code >= op_dyn_int && op.field_name != value_name) {
+            // read once for all ops of the slot
+            value_name = op.field_name;
+            value      = op.slot < cdr->dyn_fields_slots.size() ? cdr->dyn_fields_slots[op.slot] : nullptr;
+            if (!value && dyn_fields) {
+                auto it = dyn_fields->find(*op.field_name);
+                if (it != dyn_fields->end())
+                    value = &it->second;
+            }
+            if (!value) {
+                ERROR("[%s] can't find dynamic field %s", cdr->local_tag.c_str(), op.field_name->c_str());
+                return false;
+            }
+        }
+
+        switch (op.code) {
+        case op_attempt_num: matched = cmp_values<long long int>(op.cond, cdr->attempt_num, op.v_integer); break;
+        case op_connect_time:
+            if (!cdr->connect_time.tv_sec) {
+                DBG("CDR timestamp field connect_time is not initialized. return false");
+                break;
+            }
+            matched = cmp_values<long long int>(op.cond, cdr->connect_time.tv_sec, op.v_integer);
+            break;
+        case op_dyn_int:
+            if (isArgInt(*value))
+                matched = cmp_values<long long int>(op.cond, value->asInt(), op.v_integer);
+            else
+                invalid_type = true;
+            break;
+        case op_dyn_long_long_int:
+            if (isArgInt(*value))
+                matched = cmp_values<long long int>(op.cond, value->asLong(), op.v_integer);
+            else if (isArgLongLong(*value))
+                matched = cmp_values<long long int>(op.cond, value->asLongLong(), op.v_integer);
+            else
+                invalid_type = true;
+            break;
+        case op_dyn_double:
+            if (isArgDouble(*value))
+                matched = cmp_values<double>(op.cond, value->asDouble(), op.v_double);
+            else
+                invalid_type = true;
+            break;
+        case op_dyn_string:
+            // compare in place without string copy. only eq/neq are allowed for strings
+            if (isArgCStr(*value))
+                matched = (strcmp(value->asCStr(), op.v_string.c_str()) == 0) == (op.cond == c_cond_eq);
+            else
+                invalid_type = true;
+            break;
+        }
+
+        if (invalid_type) {
+            ERROR("[%s] invalid type for field '%s'", cdr->local_tag.c_str(), op.field_name->c_str());
+            return false;
+        }
+
+        if (!matched) {
+            DBG("[%s] NOT MATCHED against functor: %s", cdr->local_tag.c_str(), op.info.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool apply_filter_rules(const Cdr *cdr, const cmp_filter &filter)
+{
+    return filter.match(cdr);
 }
 
 /* helper to parse rule string
@@ -632,9 +596,35 @@ void parse_fields(cmp_rules &rules, const AmArg &params, vector<string> &fields)
     }
 }
 
-int configure_filter(const SqlRouter *router)
+void resolve_dyn_fields_slots(const AmArg &dyn_fields, vector<const AmArg *> &slots)
+{
+    slots.clear();
+    if (!isArgStruct(dyn_fields))
+        return;
+
+    const auto &values = *dyn_fields.asStruct();
+    slots.reserve(dyn_slot_names.size());
+    for (const auto &name : dyn_slot_names) {
+        auto it = values.find(name);
+        slots.push_back(it != values.end() ? &it->second : nullptr);
+    }
+}
+
+void parse_fields(cmp_filter &filter, const AmArg &params, vector<string> &fields)
+{
+    cmp_rules rules;
+    parse_fields(rules, params, fields);
+    filter.compile(rules);
+}
+
+int configure_filter(const DynFieldsT &df)
 {
     field_name2type.clear();
+    field_name2field_type.clear();
+    cond_name2type.clear();
+    dyn_field_name2slot.clear();
+    dyn_slot_names.clear();
+
     // static fields
     for (unsigned int k = 0; k < static_call_fields_count; k++) {
         const static_call_field &f = static_call_fields[k];
@@ -648,7 +638,6 @@ int configure_filter(const SqlRouter *router)
     }
 
     // dynamic fields
-    const DynFieldsT &df = router->getDynFields();
     for (DynFieldsT_const_iterator it = df.begin(); it != df.end(); ++it) {
         try {
             field_name2type.insert(std::pair<string, cmp_type_t>(it->name, get_type_by_name(it->type_name)));
@@ -656,6 +645,8 @@ int configure_filter(const SqlRouter *router)
             ERROR("can't process dynamic field %s: %s", it->name.c_str(), s.c_str());
             return 1;
         }
+        if (dyn_field_name2slot.emplace(it->name, dyn_slot_names.size()).second)
+            dyn_slot_names.push_back(it->name);
     }
 
     /*for(map<string,cmp_type_t>::const_iterator i = field_name2type.begin();
@@ -671,3 +662,8 @@ int configure_filter(const SqlRouter *router)
 
     return 0;
 }
+
+int configure_filter(const SqlRouter *router)
+{
+    return configure_filter(router->getDynFields());
+}
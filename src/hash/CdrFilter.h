@@ -40,30 +40,7 @@ extern const static_call_field static_call_fields[];
 extern const unsigned int      static_call_fields_count;
 
 
-/* types definitions for static fields comparsion functions */
-
-#define STATIC_CMP_FUNCTION_PTR(type) cmp_##type##_function_ptr
-#define DEF_STATIC_CMP_FUNCTION(type, value_type)                                                                      \
-    typedef bool                   cmp_##type##_function(const Cdr *cdr, value_type value);                            \
-    typedef cmp_##type##_function *cmp_##type##_function_ptr;
-
-DEF_STATIC_CMP_FUNCTION(int, int)
-DEF_STATIC_CMP_FUNCTION(double, double)
-DEF_STATIC_CMP_FUNCTION(timestamp, const timeval &)
-
-#define DYNAMIC_CMP_FUNCTION_PTR(type) cmp_dyn_##type##_function_ptr
-#define DEF_DYNAMIC_CMP_FUNCTION(type, val_type)                                                                       \
-    typedef bool cmp_dyn_##type##_function(const Cdr *cdr, const string &field_name, val_type value);                  \
-    typedef cmp_dyn_##type##_function *cmp_dyn_##type##_function_ptr;
-
-DEF_DYNAMIC_CMP_FUNCTION(int, int)
-DEF_DYNAMIC_CMP_FUNCTION(double, double)
-DEF_DYNAMIC_CMP_FUNCTION(string, const string &)
-
-typedef long long int long_long_int;
-DEF_DYNAMIC_CMP_FUNCTION(long_long_int, long_long_int)
-
-/* functor is used to memorize comparsion parameters for further use */
+/* parsed filter rule. see cmp_filter for the evaluation */
 class cmp_functor {
     /* functor parameters */
 
@@ -73,24 +50,15 @@ class cmp_functor {
 
     string dyn_field_name;
 
-    /* pointers to the appropriate comparsion function */
-
-    STATIC_CMP_FUNCTION_PTR(int) fptr_int;
-    STATIC_CMP_FUNCTION_PTR(double) fptr_double;
-    STATIC_CMP_FUNCTION_PTR(timestamp) fptr_timestamp;
-
-    DYNAMIC_CMP_FUNCTION_PTR(int) fptr_dyn_int;
-    DYNAMIC_CMP_FUNCTION_PTR(double) fptr_dyn_double;
-    DYNAMIC_CMP_FUNCTION_PTR(long_long_int) fptr_dyn_long_long_int;
-    DYNAMIC_CMP_FUNCTION_PTR(string) fptr_dyn_string;
-
     /* value holders */
     int           v_int;
-    long_long_int v_long_long_int;
+    long long int v_long_long_int;
     double        v_double;
     timeval       v_time;
     string        v_string;
 
+    friend class cmp_filter;
+
   public:
     /* constructors for static fields */
     cmp_functor(int value, cmp_field_t cmp_field, cmp_cond_t cmp_cond);
@@ -103,10 +71,6 @@ class cmp_functor {
     cmp_functor(long long int value, const string &field_name, cmp_cond_t cmp_cond);
     cmp_functor(const string &value, const string &field_name, cmp_cond_t cmp_cond);
 
-
-    /* check for matching with given Cdr */
-    bool operator()(const Cdr *cdr) const;
-
     /* short self-info */
     string info() const;
 };
@@ -115,14 +79,65 @@ class cmp_functor {
 typedef list<cmp_functor>         cmp_rules;
 typedef cmp_rules::const_iterator cmp_rules_it;
 
-/* walk over functors from list and run each of them for given Cdr
+/* compiled filter rules
+ *
+ * flat vector of the typed predicate ops.
+ * dynamic fields names are resolved to the slots (position in the router dynamic fields)
+ * on compilation. values are taken from Cdr::dyn_fields_slots by the slot
+ * with fallback to the lookup by name for the Cdr without resolved slots.
+ * ops are ordered by the evaluation cost: static fields first,
+ * then dynamic fields grouped by slot to read each field in Cdr once */
+class cmp_filter {
+  public:
+    enum op_code_t {
+        op_attempt_num = 0,
+        op_connect_time,
+        op_dyn_int,
+        op_dyn_long_long_int,
+        op_dyn_double,
+        op_dyn_string,
+    };
+
+  private:
+    struct cmp_op {
+        op_code_t     code;
+        cmp_cond_t    cond;
+        unsigned int  slot;
+        const string *field_name; // dynamic field name owned by the slots table
+        long long int v_integer;  // int, bigint and timestamp seconds
+        double        v_double;
+        string        v_string;
+        string        info;
+    };
+
+    vector<cmp_op> ops;
+
+  public:
+    /* resolve rules to the ops. throws std::string on errors */
+    void compile(const cmp_rules &rules);
+
+    /* return true if all ops matched and false otherwise */
+    bool match(const Cdr *cdr) const;
+
+    bool   empty() const { return ops.empty(); }
+    size_t size() const { return ops.size(); }
+};
+
+/* run compiled filter for given Cdr
  * return true if all rules matched and false otherwise */
-bool apply_filter_rules(const Cdr *cdr, const cmp_rules &rules);
+bool apply_filter_rules(const Cdr *cdr, const cmp_filter &filter);
 
-/* parse one rule and append rules list with created functor */
+/* parse rules, append rules list with created functors */
 void parse_fields(cmp_rules &rules, const AmArg &params, vector<string> &fields);
 
+/* parse and compile rules */
+void parse_fields(cmp_filter &filter, const AmArg &params, vector<string> &fields);
+
+/* fill slots with pointers to the dyn_fields values. must be called after dyn_fields assignment */
+void resolve_dyn_fields_slots(const AmArg &dyn_fields, vector<const AmArg *> &slots);
+
 /* prepare structures for fast parsing */
+int configure_filter(const DynFieldsT &df);
 int configure_filter(const SqlRouter *router);
 
 
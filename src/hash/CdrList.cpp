@@ -10,24 +10,46 @@
 #include "jsonArg.h"
 #include "AmSessionContainer.h"
 #include "AmEventDispatcher.h"
-#include "ampi/HttpClientAPI.h"
 
 #define EPOLL_MAX_EVENTS 2048
 
+// ids reserved by the snapshot shard at once
+#define SNAPSHOT_IDS_BLOCK_SIZE 256
+
 CdrList::CdrList()
     : epoll_fd(0)
     , snapshots_enabled(false)
     , snapshots_buffering(false)
+    , snapshots_delta(false)
     , snapshots_interval(0)
+    , snapshots_keyframe_interval(0)
+    , snapshots_since_keyframe(0)
+    , snapshot_keyframe_required(false)
     , last_snapshot_ts(0)
+    , snapshot_in_progress(false)
     , stopped(false)
     , router(nullptr)
+    , snapshot_id_counter(0)
+    , snapshot_full_rows(stat_group(Counter, MOD_NAME, "active_calls_snapshot_rows")
+                             .setHelp("active calls snapshot rows")
+                             .addAtomicCounter()
+                             .addLabel("type", "full"))
+    , snapshot_heartbeat_rows(stat_group(Counter, MOD_NAME, "active_calls_snapshot_rows")
+                                  .addAtomicCounter()
+                                  .addLabel("type", "heartbeat"))
 {
     snapshot_id.fields.sign    = 0;
     snapshot_id.fields.node_id = AmConfig.node_id;
     snapshot_id.fields.counter = 0;
 }
 
+uint64_t CdrList::get_snapshot_id(uint32_t counter) const
+{
+    auto id           = snapshot_id;
+    id.fields.counter = counter;
+    return id.v;
+}
+
 CdrList::~CdrList() {}
 
 void CdrList::onSessionFinalize(Cdr *cdr)
@@ -75,7 +97,7 @@ bool CdrList::getCall(SBCCallLeg *leg, AmArg &call)
     return true;
 }
 
-bool CdrList::getCallsFields(SBCCallLeg *leg, AmArg &call, const cmp_rules &filter_rules, const vector<string> &fields)
+bool CdrList::getCallsFields(SBCCallLeg *leg, AmArg &call, const cmp_filter &filter, const vector<string> &fields)
 {
     const auto         &gc = Yeti::instance().config;
     const get_calls_ctx ctx(AmConfig.node_id, gc.pop_id, &fields);
@@ -90,7 +112,7 @@ bool CdrList::getCallsFields(SBCCallLeg *leg, AmArg &call, const cmp_rules &filt
         return false;
 
     if (call_ctx->cdr && !call_ctx->profiles.empty()) {
-        if (apply_filter_rules(call_ctx->cdr.get(), filter_rules)) {
+        if (apply_filter_rules(call_ctx->cdr.get(), filter)) {
             cdr2arg_filtered(call, call_ctx->cdr.get(), ctx);
             return true;
         }
@@ -189,11 +211,29 @@ int CdrList::configure(cfg_t *confuse_cfg)
 
     snapshots_table     = cfg_getstr(clickhouse_sec, opt_name_table);
     snapshots_buffering = cfg_getbool(clickhouse_sec, opt_name_buffering);
+    snapshots_delta     = cfg_getbool(clickhouse_sec, opt_name_delta);
+
+    if (snapshots_delta) {
+        int keyframe_interval = cfg_getint(clickhouse_sec, opt_name_keyframe_interval);
+        if (keyframe_interval <= 0) {
+            ERROR("invalid active calls snapshots keyframe_interval: %d", keyframe_interval);
+            return -1;
+        }
+        snapshots_keyframe_interval = keyframe_interval;
+    }
 
     for (unsigned int i = 0; i < cfg_size(clickhouse_sec, opt_name_destinations); i++) {
         snapshots_destinations.emplace_back(cfg_getnstr(clickhouse_sec, opt_name_destinations, i));
     }
 
+    if (sender.configure(snapshots_destinations, cfg_getint(clickhouse_sec, opt_name_chunk_size),
+                         cfg_getstr(clickhouse_sec, opt_name_compression),
+                         cfg_getint(clickhouse_sec, opt_name_compression_level)))
+    {
+        ERROR("failed to configure active calls snapshots sender");
+        return -1;
+    }
+
     for (unsigned int i = 0; i < cfg_size(clickhouse_sec, opt_name_allowed_fields); i++) {
         snapshots_fields_whitelist.emplace(cfg_getnstr(clickhouse_sec, opt_name_allowed_fields, i));
     }
@@ -203,6 +243,9 @@ int CdrList::configure(cfg_t *confuse_cfg)
         "buffering is %sabled",
         snapshots_table.c_str(), snapshots_interval, snapshots_buffering ? "en" : "dis");
 
+    if (snapshots_delta)
+        DBG("delta snapshots with the keyframe every %u snapshots", snapshots_keyframe_interval);
+
     for (const auto &f : snapshots_destinations) {
         DBG("clickhouse destination: %s", f.c_str());
     }
@@ -234,6 +277,8 @@ void CdrList::run()
 
     setThreadName("calls-snapshots");
 
+    sender.start();
+
     u_int64_t    now            = wheeltimer::instance()->unix_clock.get();
     unsigned int first_interval = snapshots_interval - (now % snapshots_interval);
     timer.set(first_interval * 1000000, snapshots_interval * 1000000);
@@ -264,6 +309,8 @@ void CdrList::run()
         }
     } while (running);
 
+    sender.stop(true);
+
     close(epoll_fd);
     stopped.set(true);
 }
@@ -293,19 +340,52 @@ void CdrList::onTimer()
     }
     last_snapshot_ts = snapshot_ts;
 
-    const auto       &gc = Yeti::instance().config;
+    if (snapshot_in_progress.exchange(true)) {
+        ERROR("previous snapshot is not finished yet. skip snapshot %lu", snapshot_ts);
+        return;
+    }
+
     const DynFieldsT &df = router->getDynFields();
 
+    /* rows of the active calls are serialized by the session processors threads.
+     * each processor thread writes into its own shard with own ids block
+     * so no locking is required on the rows serialization */
+    struct SnapshotShard : public AmObject {
+        string  &body;
+        size_t   rows;
+        size_t   heartbeats;
+        uint32_t next_id;
+        uint32_t ids_left;
+        SnapshotShard(string &body)
+            : body(body)
+            , rows(0)
+            , heartbeats(0)
+            , next_id(0)
+            , ids_left(0)
+        {
+            body.clear();
+        }
+    };
+
     struct SnapshotInfo {
-        AmArg    calls;
-        string   snapshot_timestamp_str;
-        string   snapshot_date_str;
-        CdrList *cdr_list;
-        SnapshotInfo(CdrList *cdr_list, time_t tt)
-            : cdr_list(cdr_list)
+        deque<SnapshotShard> shards;
+        AmMutex              shards_mutex;
+        size_t               rows;
+        size_t               heartbeats;
+        time_t               snapshot_ts;
+        bool                 keyframe;
+        string               snapshot_timestamp_str;
+        string               snapshot_date_str;
+        CdrList             *cdr_list;
+        SnapshotInfo(CdrList *cdr_list, time_t tt, bool keyframe)
+            : rows(0)
+            , heartbeats(0)
+            , snapshot_ts(tt)
+            , keyframe(keyframe)
+            , cdr_list(cdr_list)
         {
-            static struct tm t;
-            static char      strftime_buf[64];
+            struct tm t;
+            char      strftime_buf[64];
             gmtime_r(&tt, &t);
 
             auto len               = strftime(strftime_buf, sizeof strftime_buf, "%F %T", &t);
@@ -314,13 +394,98 @@ void CdrList::onTimer()
             len               = strftime(strftime_buf, sizeof strftime_buf, "%F", &t);
             snapshot_date_str = string(strftime_buf, len);
         }
+
+        /* get shard of the current processor thread. shard is stored in the processor iterate result */
+        SnapshotShard &get_shard(AmArg &ret)
+        {
+            if (isArgAObject(ret))
+                return *static_cast<SnapshotShard *>(ret.asObject());
+
+            AmLock l(shards_mutex);
+            // reuse buffers capacity from the previous snapshots
+            if (shards.size() == cdr_list->snapshot_shards_bodies.size())
+                cdr_list->snapshot_shards_bodies.emplace_back();
+            auto &shard = shards.emplace_back(cdr_list->snapshot_shards_bodies[shards.size()]);
+            ret         = static_cast<AmObject *>(&shard);
+            return shard;
+        }
+
+        uint64_t get_id(SnapshotShard &shard)
+        {
+            if (!shard.ids_left) {
+                shard.next_id  = cdr_list->snapshot_id_counter.fetch_add(SNAPSHOT_IDS_BLOCK_SIZE);
+                shard.ids_left = SNAPSHOT_IDS_BLOCK_SIZE;
+            }
+            shard.ids_left--;
+            return cdr_list->get_snapshot_id(shard.next_id++);
+        }
+
+        void begin_row(SnapshotSerializer &s, uint64_t id, bool buffered, bool heartbeat = false)
+        {
+            static const string id_key("id");
+            static const string snapshot_timestamp_key("snapshot_timestamp");
+            static const string snapshot_date_key("snapshot_date");
+            static const string node_id_key("node_id");
+            static const string pop_id_key("pop_id");
+            static const string buffered_key("buffered");
+            static const string heartbeat_key("heartbeat");
+
+            s.begin_row();
+            s.add(id_key, static_cast<long long>(id));
+            s.add(snapshot_timestamp_key, snapshot_timestamp_str);
+            s.add(snapshot_date_key, snapshot_date_str);
+            s.add(node_id_key, AmConfig.node_id);
+            s.add(pop_id_key, Yeti::instance().config.pop_id);
+            if (cdr_list->snapshots_buffering)
+                s.add_bool(buffered_key, buffered);
+            if (cdr_list->snapshots_delta)
+                s.add_bool(heartbeat_key, heartbeat);
+        }
+
+        /* compact row of the call without state changes since the last full row */
+        void heartbeat_row(SnapshotSerializer &s, uint64_t id, const Cdr &cdr,
+                           const unordered_set<string> *wanted_fields)
+        {
+            static const string local_tag_key("local_tag");
+            static const string duration_key("duration");
+
+            auto wanted = [wanted_fields](const string &key) { return !wanted_fields || wanted_fields->count(key); };
+
+            begin_row(s, id, false, true);
+            if (wanted(local_tag_key))
+                s.add(local_tag_key, cdr.local_tag);
+            if (wanted(duration_key)) {
+                s.add(duration_key, timerisset(&cdr.connect_time)
+                                        ? static_cast<long long>(snapshot_ts - cdr.connect_time.tv_sec)
+                                        : 0LL);
+            }
+            if (wanted(end_time_key))
+                s.add(end_time_key, snapshot_timestamp_str);
+            s.end_row();
+        }
     };
-    SnapshotInfo *info  = new SnapshotInfo(this, snapshot_ts);
-    AmArg        &calls = info->calls;
-    calls.assertArray();
+
+    bool keyframe = true;
+    if (snapshots_delta) {
+        // sent states of the calls were updated by the lost snapshot. resend full rows
+        if (snapshot_keyframe_required.exchange(false))
+            snapshots_since_keyframe = 0;
+        keyframe                 = snapshots_since_keyframe == 0;
+        snapshots_since_keyframe = (snapshots_since_keyframe + 1) % snapshots_keyframe_interval;
+    }
+
+    // buffered rows. reuse buffer capacity from the previous snapshots
+    snapshot_body.clear();
+
+    SnapshotInfo      *info = new SnapshotInfo(this, snapshot_ts, keyframe);
+    SnapshotSerializer s(snapshot_body);
 
     snapshot_id.fields.timestamp = snapshot_ts;
 
+    const unordered_set<string> *wanted_fields =
+        snapshots_fields_whitelist.empty() ? nullptr : &snapshots_fields_whitelist;
+    bool add_end_time = !wanted_fields || wanted_fields->count(end_time_key);
+
     if (snapshots_buffering) {
         {
             AmLock l(*this);
@@ -330,26 +495,16 @@ void CdrList::onTimer()
         while (!local_postponed_calls.empty()) {
             const Cdr &cdr = local_postponed_calls.front();
 
-            calls.push(AmArg());
-            AmArg &call = calls.back();
-
-            snapshot_id.fields.counter++;
-            call["id"] = snapshot_id.v;
-
-            call["snapshot_timestamp"] = info->snapshot_timestamp_str;
-            call["snapshot_date"]      = info->snapshot_date_str;
-            call["node_id"]            = AmConfig.node_id;
-            call["pop_id"]             = gc.pop_id;
-            call["buffered"]           = true;
-
-            if (snapshots_fields_whitelist.empty()) {
-                cdr.snapshot_info(call, df);
-                call[end_time_key] = timerisset(&cdr.end_time) ? timeval2str(cdr.end_time) : AmArg();
-            } else {
-                cdr.snapshot_info_filtered(call, df, snapshots_fields_whitelist);
-                if (snapshots_fields_whitelist.count(end_time_key))
-                    call[end_time_key] = timerisset(&cdr.end_time) ? timeval2str(cdr.end_time) : AmArg();
+            info->begin_row(s, get_snapshot_id(snapshot_id_counter++), true);
+            cdr.snapshot_info(s, df, wanted_fields);
+            if (add_end_time) {
+                if (timerisset(&cdr.end_time))
+                    s.add(end_time_key, timeval2str(cdr.end_time));
+                else
+                    s.add_null(end_time_key);
             }
+            s.end_row();
+            info->rows++;
 
             local_postponed_calls.pop();
         }
@@ -371,63 +526,72 @@ void CdrList::onTimer()
             if (!call_ctx->cdr)
                 return;
 
-            info->cdr_list->snapshot_id.fields.counter++;
-            const auto &gc = Yeti::instance().config;
-            ret.push(AmArg());
-            AmArg &call = ret.back();
-            call["id"]  = info->cdr_list->snapshot_id.v;
+            const auto &whitelist     = info->cdr_list->snapshots_fields_whitelist;
+            const auto *wanted_fields = whitelist.empty() ? nullptr : &whitelist;
+
+            auto              &shard = info->get_shard(ret);
+            SnapshotSerializer s(shard.body);
+
+            Cdr &cdr = *call_ctx->cdr;
+            if (info->cdr_list->snapshots_delta) {
+                // snapshot_sent_state is accessed by the session processor thread only
+                auto state = cdr.snapshot_state();
+                if (!info->keyframe && cdr.snapshot_sent_state == state) {
+                    info->heartbeat_row(s, info->get_id(shard), cdr, wanted_fields);
+                    shard.heartbeats++;
+                    shard.rows++;
+                    return;
+                }
+                cdr.snapshot_sent_state = state;
+            }
 
-            call["snapshot_timestamp"] = info->snapshot_timestamp_str;
-            call["snapshot_date"]      = info->snapshot_date_str;
-            call["node_id"]            = AmConfig.node_id;
-            call["pop_id"]             = gc.pop_id;
+            info->begin_row(s, info->get_id(shard), false);
+            cdr.snapshot_info(s, info->cdr_list->router->getDynFields(), wanted_fields);
+            if (!wanted_fields || wanted_fields->count(end_time_key))
+                s.add(end_time_key, info->snapshot_timestamp_str);
+            s.end_row();
+            shard.rows++;
+        },
+        [](const AmArg &, void *user_data) {
+            SnapshotInfo *info     = reinterpret_cast<SnapshotInfo *>(user_data);
+            CdrList      *cdr_list = info->cdr_list;
+
+            auto finish = [info](bool posted) {
+                if (!posted)
+                    info->cdr_list->snapshot_keyframe_required = true;
+                info->cdr_list->snapshot_in_progress = false;
+                delete info;
+            };
+
+            SnapshotSender::job j;
+            j.parts.push_back(&cdr_list->snapshot_body);
+            for (const auto &shard : info->shards) {
+                info->rows += shard.rows;
+                info->heartbeats += shard.heartbeats;
+                j.parts.push_back(&shard.body);
+            }
 
-            if (info->cdr_list->snapshots_buffering)
-                call["buffered"] = false;
+            cdr_list->snapshot_full_rows.inc(info->rows - info->heartbeats);
+            cdr_list->snapshot_heartbeat_rows.inc(info->heartbeats);
 
-            const DynFieldsT &df = info->cdr_list->router->getDynFields();
-            if (info->cdr_list->snapshots_fields_whitelist.empty()) {
-                call_ctx->cdr->snapshot_info(call, df);
-                call[end_time_key] = info->snapshot_timestamp_str;
-            } else {
-                call_ctx->cdr->snapshot_info_filtered(call, df, info->cdr_list->snapshots_fields_whitelist);
-                if (info->cdr_list->snapshots_fields_whitelist.count(end_time_key))
-                    call[end_time_key] = info->snapshot_timestamp_str;
+            if (!info->rows) {
+                finish(true);
+                return;
             }
-        },
-        [](const AmArg &ret, void *user_data) {
-            SnapshotInfo *info = reinterpret_cast<SnapshotInfo *>(user_data);
-            for (auto i = 0u; i < ret.size(); i++) {
-                if (!isArgArray(ret[i]))
-                    continue;
-                for (auto j = 0u; j < ret[i].size(); j++)
-                    info->calls.push(ret[i][j]);
+
+            /* chunking and compression are done by the sender thread
+             * to keep the session processor free. buffers are reused by the next snapshot
+             * so it is not started until the sender finishes with the current one */
+            j.header    = cdr_list->snapshots_body_header;
+            j.on_finish = finish;
+            if (!cdr_list->sender.send(std::move(j))) {
+                ERROR("active calls snapshots sender is busy. drop snapshot");
+                finish(false);
             }
-            if (info->calls.size())
-                info->cdr_list->sendSnapshot(info->calls);
-            delete info;
         },
         info);
 }
 
-void CdrList::sendSnapshot(const AmArg &calls)
-{
-    // serialize to json body for clickhouse
-    string data = snapshots_body_header;
-    for (unsigned int i = 0; i < calls.size(); i++)
-        data += arg2json(calls[i]) + "\n";
-
-    // DBG("data:\n%s",data.c_str());
-
-    for (const auto &destination : snapshots_destinations) {
-        if (!AmSessionContainer::instance()->postEvent(HTTP_EVENT_QUEUE,
-                                                       new HttpPostEvent(destination, data, string())))
-        {
-            ERROR("can't post http event. disable active calls snapshots or add http_client module loading");
-        }
-    }
-}
-
 void CdrList::cdr2arg(AmArg &arg, const Cdr *cdr, const get_calls_ctx &ctx) const noexcept
 {
 #define add_field(val)         arg[#val] = cdr->val;
@@ -5,11 +5,14 @@
 #include <yeti_version.h>
 
 #include "CdrFilter.h"
+#include "SnapshotSender.h"
 #include "../cdr/Cdr.h"
 #include "../SqlRouter.h"
 
 #include <unordered_set>
 #include <unordered_map>
+#include <atomic>
+#include <deque>
 
 class SBCCallLeg;
 
@@ -20,12 +23,20 @@ class CdrList : public AmThread,
     int                   epoll_fd;
     bool                  snapshots_enabled;
     bool                  snapshots_buffering;
+    bool                  snapshots_delta;
     unsigned int          snapshots_interval;
+    unsigned int          snapshots_keyframe_interval;
+    unsigned int          snapshots_since_keyframe;
+    std::atomic<bool>     snapshot_keyframe_required; // previous snapshot is not posted
     vector<string>        snapshots_destinations;
     string                snapshots_table;
     string                snapshots_body_header;
     unordered_set<string> snapshots_fields_whitelist;
     time_t                last_snapshot_ts;
+    string                snapshot_body;
+    deque<string>         snapshot_shards_bodies;
+    std::atomic<bool>     snapshot_in_progress;
+    SnapshotSender        sender;
     AmEventFd             stop_event;
     AmTimerFd             timer;
     AmCondition<bool>     stopped;
@@ -53,7 +64,13 @@ class CdrList : public AmThread,
 #error "Please fix <bits/endian.h>"
 #endif
         } fields;
-    } snapshot_id;
+    } snapshot_id; // node_id and timestamp of the current snapshot. counter is taken from snapshot_id_counter
+    std::atomic<uint32_t> snapshot_id_counter;
+
+    AtomicCounter &snapshot_full_rows;
+    AtomicCounter &snapshot_heartbeat_rows;
+
+    uint64_t get_snapshot_id(uint32_t counter) const;
 
     enum get_calls_type { Unfiltered, Filtered };
 
@@ -81,12 +98,11 @@ class CdrList : public AmThread,
 
     long int getCallsCount();
     bool     getCall(SBCCallLeg *leg, AmArg &call);
-    bool     getCallsFields(SBCCallLeg *leg, AmArg &calls, const cmp_rules &rules, const vector<string> &fields);
+    bool     getCallsFields(SBCCallLeg *leg, AmArg &calls, const cmp_filter &filter, const vector<string> &fields);
 
     void onSessionFinalize(Cdr *cdr);
 
     void validate_fields(const vector<string> &wanted_fields);
-    void sendSnapshot(const AmArg &calls);
 
     int  configure(cfg_t *confuse_cfg);
     void run();
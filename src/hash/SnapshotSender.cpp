@@ -0,0 +1,304 @@
+#include "SnapshotSender.h"
+#include "log.h"
+
+#include "../yeti.h"
+
+#include "AmSessionContainer.h"
+#include "ampi/HttpClientAPI.h"
+
+#include <zlib.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define GZIP_WINDOW_BITS (15 + 16)
+#define GZIP_MEM_LEVEL   8
+
+SnapshotSender::SnapshotSender()
+    : epoll_fd(-1)
+    , stopped(false)
+    , has_pending_job(false)
+    , destinations(nullptr)
+    , chunk_size(0)
+    , compression(CompressionNone)
+    , compression_level(0)
+    , chunks_sent(stat_group(Counter, MOD_NAME, "active_calls_snapshot_chunks")
+                      .setHelp("active calls snapshot chunks posted to the http destinations")
+                      .addAtomicCounter())
+    , raw_bytes(stat_group(Counter, MOD_NAME, "active_calls_snapshot_raw_bytes")
+                    .setHelp("active calls snapshot chunks size before the compression")
+                    .addAtomicCounter())
+    , wire_bytes(stat_group(Counter, MOD_NAME, "active_calls_snapshot_wire_bytes")
+                     .setHelp("active calls snapshot bytes posted to the http destinations")
+                     .addAtomicCounter())
+    , chunk_size_gauge(stat_group(Gauge, MOD_NAME, "active_calls_snapshot_chunk_size")
+                           .setHelp("configured active calls snapshot chunk size. 0 for the whole snapshot")
+                           .addAtomicCounter())
+    , compression_level_gauge(stat_group(Gauge, MOD_NAME, "active_calls_snapshot_compression_level")
+                                  .setHelp("active calls snapshot compression level. 0 if disabled")
+                                  .addAtomicCounter())
+    , send_duration(LatencyHistograms::instance().add(MOD_NAME "_active_calls_snapshot_send_duration_usec"))
+{
+    LatencyHistograms::instance().setHelp(MOD_NAME "_active_calls_snapshot_send_duration_usec",
+                                          "active calls snapshot chunking and compression time in microseconds");
+}
+
+const char *SnapshotSender::compression_name(Compression c)
+{
+    switch (c) {
+    case CompressionNone: return "none";
+    case CompressionGzip: return "gzip";
+    case CompressionZstd: return "zstd";
+    }
+    return "unknown";
+}
+
+int SnapshotSender::configure(const vector<string> &dsts, int chunk_size_bytes, const string &compression_str,
+                              int level)
+{
+    destinations = &dsts;
+    chunk_size   = chunk_size_bytes > 0 ? static_cast<size_t>(chunk_size_bytes) : 0;
+
+    if (compression_str.empty() || compression_str == "none") {
+        compression = CompressionNone;
+    } else if (compression_str == "gzip") {
+        compression = CompressionGzip;
+    } else if (compression_str == "zstd") {
+        compression = CompressionZstd;
+    } else {
+        ERROR("unknown active calls snapshots compression: %s", compression_str.data());
+        return -1;
+    }
+
+    switch (compression) {
+    case CompressionNone: compression_level = 0; break;
+    case CompressionGzip: compression_level = std::clamp(level, 1, Z_BEST_COMPRESSION); break;
+    case CompressionZstd: compression_level = std::clamp(level, 1, ZSTD_maxCLevel()); break;
+    }
+
+    if (compression_level != level && compression != CompressionNone) {
+        WARN("active calls snapshots %s compression level %d is adjusted to %d", compression_name(compression), level,
+             compression_level);
+    }
+
+    chunk_size_gauge.set(chunk_size);
+    compression_level_gauge.set(compression_level);
+
+    if ((epoll_fd = epoll_create(2)) == -1) {
+        ERROR("epoll_create() call failed");
+        return -1;
+    }
+    job_event.link(epoll_fd);
+    stop_event.link(epoll_fd);
+
+    return 0;
+}
+
+bool SnapshotSender::send(job &&j)
+{
+    {
+        AmLock l(job_mutex);
+        if (has_pending_job)
+            return false;
+        pending_job     = std::move(j);
+        has_pending_job = true;
+    }
+    job_event.fire();
+    return true;
+}
+
+void SnapshotSender::run()
+{
+    bool               running;
+    struct epoll_event events[2];
+
+    setThreadName("calls-snap-send");
+
+    running = true;
+    do {
+        int ret = epoll_wait(epoll_fd, events, 2, -1);
+        if (ret == -1 && errno != EINTR) {
+            ERROR("epoll_wait: %s", strerror(errno));
+        }
+        if (ret < 1)
+            continue;
+        for (int n = 0; n < ret; ++n) {
+            struct epoll_event &e = events[n];
+
+            if (e.data.fd == job_event) {
+                job_event.read();
+
+                job j;
+                {
+                    AmLock l(job_mutex);
+                    if (!has_pending_job)
+                        continue;
+                    j               = std::move(pending_job);
+                    has_pending_job = false;
+                }
+                process(j);
+            } else if (e.data.fd == stop_event) {
+                stop_event.read();
+                running = false;
+                break;
+            }
+        }
+    } while (running);
+
+    {
+        // release snapshot buffers of the unprocessed job
+        AmLock l(job_mutex);
+        if (has_pending_job) {
+            if (pending_job.on_finish)
+                pending_job.on_finish(false);
+            has_pending_job = false;
+        }
+    }
+
+    close(epoll_fd);
+    stopped.set(true);
+}
+
+void SnapshotSender::on_stop()
+{
+    stop_event.fire();
+    stopped.wait_for();
+}
+
+void SnapshotSender::process(job &j)
+{
+    auto start_time = LatencyHistogram::clock::now();
+    bool posted     = true;
+
+    chunk.assign(j.header);
+
+    for (const auto *part : j.parts) {
+        const char *p   = part->data();
+        const char *end = p + part->size();
+
+        if (!chunk_size) {
+            chunk.append(p, end);
+            continue;
+        }
+
+        while (p < end) {
+            size_t used = chunk.size() - j.header.size();
+            size_t room = chunk_size > used ? chunk_size - used : 0;
+            size_t left = static_cast<size_t>(end - p);
+
+            if (left <= room) {
+                chunk.append(p, end);
+                break;
+            }
+
+            // last complete row which fits into the chunk
+            const char *row_end = room ? static_cast<const char *>(memrchr(p, '\n', room)) : nullptr;
+            if (!row_end) {
+                if (chunk.size() > j.header.size()) {
+                    posted &= flush_chunk(j.header);
+                    continue;
+                }
+                // row is larger than chunk_size. send it alone
+                row_end = static_cast<const char *>(memchr(p, '\n', left));
+                if (!row_end)
+                    row_end = end - 1;
+            }
+
+            chunk.append(p, row_end + 1);
+            p = row_end + 1;
+            posted &= flush_chunk(j.header);
+        }
+    }
+
+    if (chunk.size() > j.header.size())
+        posted &= flush_chunk(j.header);
+
+    send_duration.add(start_time);
+
+    if (j.on_finish)
+        j.on_finish(posted);
+}
+
+bool SnapshotSender::flush_chunk(const string &header)
+{
+    const string *body   = &chunk;
+    bool          posted = true;
+
+    if (compression != CompressionNone) {
+        if (!compress()) {
+            chunk.assign(header);
+            return false;
+        }
+        body = &compressed;
+    }
+
+    chunks_sent.inc();
+    raw_bytes.inc(chunk.size());
+
+    // HttpPostEvent owns its body. copy it for each destination
+    for (const auto &destination : *destinations) {
+        if (!AmSessionContainer::instance()->postEvent(HTTP_EVENT_QUEUE,
+                                                       new HttpPostEvent(destination, *body, string())))
+        {
+            ERROR("can't post http event. disable active calls snapshots or add http_client module loading");
+            posted = false;
+            continue;
+        }
+        wire_bytes.inc(body->size());
+    }
+
+    chunk.assign(header);
+
+    return posted;
+}
+
+bool SnapshotSender::compress()
+{
+    switch (compression) {
+    case CompressionNone: return false;
+    case CompressionGzip:
+    {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, compression_level, Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEM_LEVEL, Z_DEFAULT_STRATEGY) !=
+            Z_OK)
+        {
+            ERROR("deflateInit2 failed");
+            return false;
+        }
+
+        compressed.resize(deflateBound(&zs, chunk.size()));
+
+        zs.next_in   = reinterpret_cast<Bytef *>(chunk.data());
+        zs.avail_in  = chunk.size();
+        zs.next_out  = reinterpret_cast<Bytef *>(compressed.data());
+        zs.avail_out = compressed.size();
+
+        int ret = deflate(&zs, Z_FINISH);
+        compressed.resize(zs.total_out);
+        deflateEnd(&zs);
+
+        if (ret != Z_STREAM_END) {
+            ERROR("gzip compression of the active calls snapshot failed: %d", ret);
+            return false;
+        }
+        return true;
+    }
+    case CompressionZstd:
+    {
+        compressed.resize(ZSTD_compressBound(chunk.size()));
+        size_t ret =
+            ZSTD_compress(compressed.data(), compressed.size(), chunk.data(), chunk.size(), compression_level);
+        if (ZSTD_isError(ret)) {
+            ERROR("zstd compression of the active calls snapshot failed: %s", ZSTD_getErrorName(ret));
+            return false;
+        }
+        compressed.resize(ret);
+        return true;
+    }
+    }
+    return false;
+}
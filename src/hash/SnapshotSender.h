@@ -0,0 +1,77 @@
+#pragma once
+
+#include <AmThread.h>
+#include <AmStatistics.h>
+
+#include "../LatencyHistogram.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+using std::string;
+using std::vector;
+
+/* posts active calls snapshots to the http destinations from the dedicated thread.
+ *
+ * snapshot rows are split at the rows boundaries into chunks
+ * of up to chunk_size bytes (0 to post whole snapshot at once).
+ * each chunk is a complete INSERT request (prefixed with the body header)
+ * and optionally compressed with gzip or zstd.
+ * http_client destination must send the matching Content-Encoding header
+ * for the compressed chunks */
+class SnapshotSender : public AmThread {
+  public:
+    enum Compression { CompressionNone = 0, CompressionGzip, CompressionZstd };
+
+    struct job {
+        string                    header;
+        vector<const string *>    parts;     // JSONEachRow rows. must stay valid until on_finish
+        std::function<void(bool)> on_finish; // false if any chunk was not posted
+    };
+
+  private:
+    int               epoll_fd;
+    AmEventFd         job_event;
+    AmEventFd         stop_event;
+    AmCondition<bool> stopped;
+
+    AmMutex               job_mutex;
+    job                   pending_job;
+    bool                  has_pending_job;
+    const vector<string> *destinations;
+
+    size_t      chunk_size;
+    Compression compression;
+    int         compression_level;
+
+    // reused between snapshots
+    string chunk;
+    string compressed;
+
+    AtomicCounter    &chunks_sent;
+    AtomicCounter    &raw_bytes;
+    AtomicCounter    &wire_bytes;
+    AtomicCounter    &chunk_size_gauge;
+    AtomicCounter    &compression_level_gauge;
+    LatencyHistogram &send_duration;
+
+    void process(job &j);
+    bool flush_chunk(const string &header);
+    bool compress();
+
+  public:
+    SnapshotSender();
+
+    /* returns -1 on unknown compression */
+    int configure(const vector<string> &destinations, int chunk_size, const string &compression,
+                  int compression_level);
+
+    /* returns false if previous job is not taken by the thread yet */
+    bool send(job &&j);
+
+    void run() override;
+    void on_stop() override;
+
+    static const char *compression_name(Compression c);
+};
@@ -49,5 +49,7 @@ string Resource::print() const
     s << "failover_to_next: " << failover_to_next << ", ";
     s << "active: " << active << ", ";
     s << "taken: " << taken;
+    if (leased)
+        s << ", leased: " << leased;
     return s.str();
 }
@@ -3,6 +3,8 @@
 // #include <vector>
 #include <list>
 #include <string>
+#include <chrono>
+#include <cstdint>
 
 #include <AmThread.h>
 
@@ -33,6 +35,8 @@ struct Resource {
      */
     bool rate_limit; //'takes' will mean sliding window size in seconds
 
+    bool leased; // taken from the node lease (see ResourceLeases)
+
     Resource()
         : id{}
         , type(0)
@@ -42,6 +46,7 @@ struct Resource {
         , active(false)
         , failover_to_next(false)
         , rate_limit(false)
+        , leased(false)
     {
     }
 
@@ -52,21 +57,36 @@ struct ResourceList : public list<Resource> {
     void parse(const string &s);
 };
 
+/* see ResourceHandlers */
+typedef uint64_t ResourceHandler;
+
 struct ResourcesOperation {
   public:
-    ResourceList resources;
-    string       local_tag;
+    ResourceList                          resources;
+    string                                local_tag;
+    ResourceHandler                       handler;   // released by RES_PUT. 0 if not tracked
+    std::chrono::steady_clock::time_point queued_at; // set on the enqueue for the write batching
 
     enum Operation { RES_PUT, RES_GET } op;
 
     ResourcesOperation(Operation op)
-        : op(op)
+        : handler(0)
+        , op(op)
     {
     }
 
     ResourcesOperation(const string &local_tag, const ResourceList &resources, Operation op)
         : resources(resources)
         , local_tag(local_tag)
+        , handler(0)
+        , op(op)
+    {
+    }
+
+    ResourcesOperation(const string &local_tag, ResourceList &&resources, Operation op, ResourceHandler handler = 0)
+        : resources(std::move(resources))
+        , local_tag(local_tag)
+        , handler(handler)
         , op(op)
     {
     }
@@ -5,24 +5,6 @@
 #include "../db/DbHelpers.h"
 #include "../cfg/yeti_opts.h"
 
-void ResourceControl::handler_info(const HandlersIt &i, const struct timeval &now, AmArg &a) const
-{
-    a["handler"] = i->first;
-    i->second.info(a, now);
-}
-
-void ResourceControl::handlers_entry::info(AmArg &a, const struct timeval &now) const
-{
-    a["onwer_tag"] = owner_tag;
-    a["valid"]     = valid;
-    a["lifetime"]  = now.tv_sec - created_at.tv_sec;
-
-    AmArg &r = a["resources"];
-    for (ResourceList::const_iterator j = resources.begin(); j != resources.end(); ++j) {
-        r.push(j->print());
-    }
-}
-
 void ResourceConfig::set_action(int a)
 {
     switch (a) {
@@ -54,7 +36,15 @@ string ResourceConfig::print() const
 
 ResourceControl::ResourceControl()
     : container_ready(false)
+    , reject_on_error(0)
+    , async_check(false)
+    , check_latency_sync(LatencyHistograms::instance().add(MOD_NAME "_resources_check_duration_usec",
+                                                           { { "mode", "sync" } }))
+    , check_latency_async(LatencyHistograms::instance().add(MOD_NAME "_resources_check_duration_usec",
+                                                            { { "mode", "async" } }))
 {
+    LatencyHistograms::instance().setHelp(MOD_NAME "_resources_check_duration_usec",
+                                          "resources check latency in microseconds");
     stat.clear();
 }
 
@@ -67,16 +57,38 @@ int ResourceControl::configure(cfg_t *confuse_cfg, AmConfigReader &cfg)
     }
 
     reject_on_error = cfg_getbool(resources_sec, opt_resources_reject_on_error);
+    async_check     = cfg_getbool(resources_sec, opt_resources_async_check);
+
+    leases.configure(cfg_getint(resources_sec, opt_resources_lease_block),
+                     cfg_getint(resources_sec, opt_resources_lease_min_limit),
+                     cfg_getint(resources_sec, opt_resources_lease_ttl));
 
     if (load_resources_config()) {
         ERROR("can't load resources config");
         return -1;
     }
 
+    string handlers_log_path = cfg_getstr(resources_sec, opt_resources_handlers_log);
+    if (!handlers_log_path.empty()) {
+        std::optional<ResourceHandlersLog::Units> recovered;
+        if (hlog.open(handlers_log_path, AmConfig.node_id, recovered)) {
+            ERROR("can't open resources handlers log: %s", handlers_log_path.data());
+            return -1;
+        }
+        if (recovered)
+            redis_conn.set_initial_compensation(std::move(recovered.value()));
+
+        redis_conn.registerPutsConfirmedCallback(
+            [this](const vector<ResourceHandler> &released) { hlog.released(released); });
+    }
+
     redis_conn.registerResourcesInitializedCallback(std::bind(&ResourceControl::on_resources_initialized, this));
 
     redis_conn.registerDisconnectCallback(std::bind(&ResourceControl::on_resources_disconnected, this));
 
+    if (leases.enabled())
+        redis_conn.registerLeaseTimerCallback(std::bind(&ResourceControl::on_lease_timer, this));
+
     return redis_conn.configure(resources_sec);
 }
 
@@ -84,23 +96,31 @@ void ResourceControl::start()
 {
     redis_conn.init();
     redis_conn.start();
+    if (hlog.enabled())
+        hlog.start();
 }
 
 void ResourceControl::stop()
 {
+    // best effort. leases of the node are reset by the initial invalidation
+    // or compensated from the handlers log on start anyway
+    vector<ResourceLeases::request> returns;
+    leases.release(returns);
+    for (const auto &r : returns)
+        return_lease(r);
+
     redis_conn.stop(true);
+    if (hlog.enabled())
+        hlog.stop(true);
 }
 
 void ResourceControl::invalidate_resources()
 {
-    AmLock lk(handlers_mutex);
-
     container_ready.set(false);
 
-    INFO("invalidate %ld handlers. mark container unready", handlers.size());
+    INFO("invalidate %lu handlers. mark container unready", handlers.invalidate());
 
-    for (auto &h : handlers)
-        h.second.invalidate();
+    leases.clear();
 }
 
 bool ResourceControl::invalidate_resources_rpc()
@@ -154,6 +174,8 @@ int ResourceControl::load_resources_config()
 void ResourceControl::on_resources_initialized()
 {
     INFO("resources reported to be intialized. mark container ready");
+    // node counters are reset or compensated
+    hlog.reset();
     container_ready.set(true);
 }
 
@@ -162,6 +184,60 @@ void ResourceControl::on_resources_disconnected()
     invalidate_resources();
 }
 
+bool ResourceControl::take_leased(ResourceList &rl)
+{
+    if (!leases.enabled() || !container_ready.get())
+        return false;
+
+    vector<ResourceLeases::request> requests;
+    if (leases.take(rl, requests)) {
+        stat.lease_hits++;
+        return true;
+    }
+
+    for (const auto &req : requests)
+        request_lease(req);
+
+    return false;
+}
+
+void ResourceControl::request_lease(const ResourceLeases::request &req)
+{
+    // logged before the request, refused part is subtracted on the reply
+    hlog.add_units(req.resource, req.amount);
+
+    if (!redis_conn.lease(req.resource, req.amount, [this, req](bool is_error, const AmArg &result) {
+            int granted = 0;
+            if (!is_error)
+                granted = isArgLongLong(result) ? static_cast<int>(result.asLongLong()) : result.asInt();
+            hlog.add_units(req.resource, granted - req.amount);
+            leases.on_lease_reply(req, granted);
+        }))
+    {
+        hlog.add_units(req.resource, -req.amount);
+        leases.on_lease_reply(req, 0);
+    }
+}
+
+void ResourceControl::return_lease(const ResourceLeases::request &req)
+{
+    // logged on the reply. lost return is compensated on start
+    redis_conn.lease(req.resource, req.amount, [this, req](bool is_error, const AmArg &result) {
+        if (!is_error)
+            hlog.add_units(req.resource, isArgLongLong(result) ? result.asLongLong() : result.asInt());
+    });
+}
+
+void ResourceControl::on_lease_timer()
+{
+    vector<ResourceLeases::request> returns;
+    leases.collect_expired(time(nullptr), returns);
+    for (const auto &r : returns) {
+        DBG("return %d units of the resource %d:%s lease", -r.amount, r.resource.type, r.resource.id.data());
+        return_lease(r);
+    }
+}
+
 void ResourceControl::eval_resources(ResourceList &rl) const
 {
     for (auto &r : rl) {
@@ -172,7 +248,7 @@ void ResourceControl::eval_resources(ResourceList &rl) const
     }
 }
 
-ResourceCtlResponse ResourceControl::get(ResourceList &rl, string &handler, const string &owner_tag,
+ResourceCtlResponse ResourceControl::get(ResourceList &rl, ResourceHandler &handler, const string &owner_tag,
                                          ResourceConfig &resource_config, ResourceList::iterator &rli)
 {
     if (rl.empty()) {
@@ -181,10 +257,15 @@ ResourceCtlResponse ResourceControl::get(ResourceList &rl, string &handler, cons
     }
     stat.hits++;
 
+    if (take_leased(rl))
+        return process_response(RES_SUCC, rl, handler, owner_tag, resource_config, rli);
+
     ResourceResponse ret;
 
     if (container_ready.get()) {
-        ret = redis_conn.get(owner_tag, rl, rli);
+        auto start_time = LatencyHistogram::clock::now();
+        ret             = redis_conn.get(owner_tag, rl, rli);
+        check_latency_sync.add(start_time);
     } else {
         // DBG("%s: attempt to get resource from the unready container", owner_tag.data());
         ret = RES_ERR;
@@ -193,16 +274,62 @@ ResourceCtlResponse ResourceControl::get(ResourceList &rl, string &handler, cons
     /*for(ResourceList::const_iterator i = rl.begin();i!=rl.end();++i)
         DBG("ResourceControl::get() resource: <%s>",(*i).print().c_str());*/
 
+    return process_response(ret, rl, handler, owner_tag, resource_config, rli);
+}
+
+ResourceCtlResponse ResourceControl::get_async(ResourceList &rl, ResourceHandler &handler, const string &owner_tag,
+                                               ResourceConfig &resource_config, ResourceList::iterator &rli,
+                                               unsigned int check_id)
+{
+    if (rl.empty()) {
+        DBG("empty resources list. do nothing");
+        return RES_CTL_OK;
+    }
+    stat.hits++;
+
+    rli = rl.begin();
+
+    if (take_leased(rl))
+        return process_response(RES_SUCC, rl, handler, owner_tag, resource_config, rli);
+
+    if (!container_ready.get() || !redis_conn.check_async(owner_tag, rl, check_id)) {
+        return process_response(RES_ERR, rl, handler, owner_tag, resource_config, rli);
+    }
+
+    DBG("%s: resources check %u is sent", owner_tag.data(), check_id);
+    return RES_CTL_PENDING;
+}
+
+ResourceCtlResponse ResourceControl::get_async_reply(const ResourceCheckReplyEvent &ev, ResourceList &rl,
+                                                     ResourceHandler &handler, const string &owner_tag,
+                                                     ResourceConfig &resource_config, ResourceList::iterator &rli)
+{
+    check_latency_async.add(ev.start_time);
+
+    rli = rl.begin();
+
+    ResourceResponse ret = RES_ERR;
+    if (ev.is_error) {
+        DBG("%s: resources check %u failed", owner_tag.data(), ev.check_id);
+    } else if (!container_ready.get()) {
+        DBG("%s: container became unready during resources check %u", owner_tag.data(), ev.check_id);
+    } else {
+        ret = redis_conn.eval_check_result(owner_tag, rl, ev.result, rli);
+    }
+
+    return process_response(ret, rl, handler, owner_tag, resource_config, rli);
+}
+
+ResourceCtlResponse ResourceControl::process_response(ResourceResponse ret, ResourceList &rl, ResourceHandler &handler,
+                                                      const string &owner_tag, ResourceConfig &resource_config,
+                                                      ResourceList::iterator &rli)
+{
     switch (ret) {
     case RES_SUCC:
     {
-        handler = AmSession::getNewId();
-        {
-            AmLock lk(handlers_mutex);
-            handlers.emplace(handler, handlers_entry(rl, owner_tag));
-        }
-        DBG("ResourceControl::get() return resources handler '%s' for %p", handler.c_str(), &rl);
-        // TODO: add to internal handlers list
+        handler = handlers.add(rl, owner_tag);
+        hlog.taken(handler, rl);
+        DBG("ResourceControl::get() return resources handler %lu for %p", handler, &rl);
         return RES_CTL_OK;
     } break;
     case RES_BUSY:
@@ -249,43 +376,49 @@ ResourceCtlResponse ResourceControl::get(ResourceList &rl, string &handler, cons
     return RES_CTL_OK;
 }
 
-void ResourceControl::put(const string &handler)
+void ResourceControl::put(ResourceHandler handler)
 {
-    if (handler.empty()) {
+    if (!handler) {
         return;
     }
 
-    DBG3("ResourceControl::put(%s)", handler.c_str());
+    DBG3("ResourceControl::put(%lu)", handler);
 
-    std::optional<handlers_entry> handler_data;
-    {
-        AmLock lk(handlers_mutex);
+    string owner_tag;
+    // swapped with the handler entry storage and reused by the next put() of the thread
+    static thread_local vector<Resource> resources;
 
-        Handlers::iterator h = handlers.find(handler);
-        if (h == handlers.end()) {
-            DBG("ResourceControl::put(%s) attempt to free resources using not existent handler", handler.c_str());
-            return;
-        }
-
-        handlers_entry &e = h->second;
+    switch (handlers.take(handler, owner_tag, resources)) {
+    case ResourceHandlers::HANDLER_NOT_FOUND:
+        DBG("ResourceControl::put(%lu) attempt to free resources using not existent handler", handler);
+        return;
+    case ResourceHandlers::HANDLER_INVALID:
+        DBG("ResourceControl::put(%lu) invalid handler. remove it", handler);
+        hlog.released(handler);
+        return;
+    case ResourceHandlers::HANDLER_TAKEN: break;
+    }
 
-        if (!e.is_valid()) {
-            DBG("ResourceControl::put(%s) invalid handler. remove it", handler.c_str());
-            handlers.erase(h);
-            return;
-        }
+    if (resources.empty()) {
+        DBG3("ResourceControl::put(%lu) empty resources list", handler);
+        return;
+    }
 
-        if (e.resources.empty()) {
-            DBG3("ResourceControl::put(%p) empty resources list", &e.resources);
-            handlers.erase(h);
-            return;
-        }
+    ResourceList rl;
+    for (const auto &r : resources) {
+        if (r.leased)
+            leases.put(r);
+        else
+            rl.push_back(r);
+    }
 
-        handler_data = std::move(e);
-        handlers.erase(h);
+    if (rl.empty()) {
+        hlog.released(handler);
+        return;
     }
 
-    redis_conn.put(handler_data.value().owner_tag, handler_data.value().resources);
+    // released in the handlers log when the operation is confirmed by the redis
+    redis_conn.put(owner_tag, std::move(rl), handler);
 }
 
 void ResourceControl::GetConfig(AmArg &ret, bool types_only)
@@ -321,6 +454,8 @@ void ResourceControl::clearStats()
 void ResourceControl::getStats(AmArg &ret)
 {
     stat.get(ret);
+    if (leases.enabled())
+        leases.info(ret["leases"]);
 }
 
 bool ResourceControl::getResourceState(const string &connection_id, const AmArg &request_id, const AmArg &params)
@@ -352,70 +487,58 @@ bool ResourceControl::getResourceState(const string &connection_id, const AmArg
 void ResourceControl::showResources(AmArg &ret)
 {
     struct timeval now;
-    AmLock         lk(handlers_mutex);
     gettimeofday(&now, NULL);
-    for (HandlersIt i = handlers.begin(); i != handlers.end(); ++i) {
-        // const handlers_entry &e = i->second;
+
+    ret.assertArray();
+    handlers.for_each([&](const ResourceHandlers::entry &e) {
         ret.push(AmArg());
-        handler_info(i, now, ret.back());
-    }
+        e.info(ret.back(), now);
+    });
 }
 
-void ResourceControl::showResourceByHandler(const string &h, AmArg &ret)
+void ResourceControl::showResourceByHandler(ResourceHandler h, AmArg &ret)
 {
-    AmLock     lk(handlers_mutex);
-    HandlersIt i = handlers.find(h);
-    if (i == handlers.end()) {
-        throw AmSession::Exception(500, "no such handler");
-    }
-
     struct timeval now;
     gettimeofday(&now, NULL);
-    handler_info(i, now, ret);
+
+    if (!handlers.find(h, [&](const ResourceHandlers::entry &e) { e.info(ret, now); })) {
+        throw AmSession::Exception(500, "no such handler");
+    }
 }
 
 void ResourceControl::showResourceByLocalTag(const string &tag, AmArg &ret)
 {
-    AmLock lk(handlers_mutex);
-
-    HandlersIt i = handlers.begin();
-    for (; i != handlers.end(); ++i) {
-        const handlers_entry &e = i->second;
-        if (e.owner_tag.empty())
-            continue;
-        if (e.owner_tag == tag)
-            break;
-    }
+    struct timeval now;
+    gettimeofday(&now, NULL);
 
-    if (i == handlers.end()) {
+    bool found = false;
+    handlers.for_each([&](const ResourceHandlers::entry &e) {
+        if (found || e.owner_tag.empty() || e.owner_tag != tag)
+            return;
+        e.info(ret, now);
+        found = true;
+    });
+
+    if (!found) {
         throw AmSession::Exception(500, "no such handler");
     }
-
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    handler_info(i, now, ret);
 }
 
 void ResourceControl::showResourcesById(int id, AmArg &ret)
 {
     struct timeval now;
-
-    AmLock lk(handlers_mutex);
+    gettimeofday(&now, NULL);
 
     ret.assertArray();
-    gettimeofday(&now, NULL);
 
-    HandlersIt i = handlers.begin();
-    for (; i != handlers.end(); ++i) {
-        const handlers_entry        &e = i->second;
-        ResourceList::const_iterator j = e.resources.begin();
-        for (; j != e.resources.end(); --j) {
-            const Resource &r = *j;
-            if (r.id == id) {
+    string id_str = int2str(id);
+    handlers.for_each([&](const ResourceHandlers::entry &e) {
+        for (const auto &r : e.resources) {
+            if (r.id == id_str) {
                 ret.push(AmArg());
-                handler_info(i, now, ret.back());
+                e.info(ret.back(), now);
                 break; // loop over resources
             }
         }
-    }
+    });
 }
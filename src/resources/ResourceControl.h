@@ -3,10 +3,14 @@
 
 #include "AmConfigReader.h"
 #include "ResourceRedisConnection.h"
+#include "ResourceHandlers.h"
+#include "ResourceLeases.h"
+#include "ResourceHandlersLog.h"
 #include "AmArg.h"
 #include <map>
 #include "log.h"
 #include "../db/DbConfig.h"
+#include "../LatencyHistogram.h"
 
 using namespace std;
 
@@ -41,41 +45,33 @@ struct ResourceConfig {
     string print() const;
 };
 
-enum ResourceCtlResponse { RES_CTL_OK, RES_CTL_NEXT, RES_CTL_REJECT, RES_CTL_ERROR };
+enum ResourceCtlResponse { RES_CTL_OK, RES_CTL_NEXT, RES_CTL_REJECT, RES_CTL_ERROR, RES_CTL_PENDING };
 
 class ResourceControl {
     ResourceRedisConnection  redis_conn;
     map<int, ResourceConfig> type2cfg;
 
-    struct handlers_entry {
-        ResourceList   resources;
-        string         owner_tag;
-        struct timeval created_at;
-        bool           valid;
-
-        handlers_entry(const ResourceList &l, const string &tag)
-            : resources(l)
-            , owner_tag(tag)
-            , valid(true)
-        {
-            gettimeofday(&created_at, NULL);
-        }
-        void invalidate() { valid = false; }
-        bool is_valid() { return valid; }
-        void info(AmArg &a, const struct timeval &now) const;
-    };
-    typedef map<string, handlers_entry> Handlers;
-    typedef Handlers::const_iterator    HandlersIt;
-
-    void handler_info(const HandlersIt &i, const struct timeval &now, AmArg &a) const;
-
-    Handlers          handlers;
-    AmMutex           handlers_mutex;
-    AmCondition<bool> container_ready;
+    ResourceHandlers    handlers;
+    ResourceLeases      leases;
+    ResourceHandlersLog hlog;
+    AmCondition<bool>   container_ready;
 
     void replace(string &s, const string &from, const string &to);
     int  load_resources_config();
     int  reject_on_error;
+    bool async_check;
+
+    LatencyHistogram &check_latency_sync;
+    LatencyHistogram &check_latency_async;
+
+    ResourceCtlResponse process_response(ResourceResponse ret, ResourceList &rl, ResourceHandler &handler,
+                                         const string &owner_tag, ResourceConfig &resource_config,
+                                         ResourceList::iterator &rli);
+
+    bool take_leased(ResourceList &rl);
+    void request_lease(const ResourceLeases::request &req);
+    void return_lease(const ResourceLeases::request &req);
+    void on_lease_timer();
 
     struct {
         unsigned int hits;
@@ -83,6 +79,7 @@ class ResourceControl {
         unsigned int rejected;
         unsigned int nextroute;
         unsigned int errors;
+        unsigned int lease_hits;
         void         clear()
         {
             hits       = 0;
@@ -90,6 +87,7 @@ class ResourceControl {
             rejected   = 0;
             nextroute  = 0;
             errors     = 0;
+            lease_hits = 0;
         }
         void get(AmArg &arg)
         {
@@ -98,6 +96,7 @@ class ResourceControl {
             arg["rejected"]   = (long)rejected;
             arg["nextroute"]  = (long)nextroute;
             arg["errors"]     = (long)errors;
+            arg["lease_hits"] = (long)lease_hits;
         }
     } stat;
 
@@ -116,18 +115,29 @@ class ResourceControl {
 
     void replace(string &s, Resource &r, const ResourceConfig &rc);
 
-    ResourceCtlResponse get(ResourceList &rl, string &handler, const string &owner_tag, ResourceConfig &resource_config,
-                            ResourceList::iterator &rli);
+    ResourceCtlResponse get(ResourceList &rl, ResourceHandler &handler, const string &owner_tag,
+                            ResourceConfig &resource_config, ResourceList::iterator &rli);
+
+    /* async mode: returns RES_CTL_PENDING if check request was sent.
+     * final response is returned by get_async_reply() on ResourceCheckReplyEvent
+     * with the same check_id delivered to the owner_tag session */
+    bool                is_async_check_enabled() const { return async_check; }
+    int                 get_async_check_timeout() const { return redis_conn.get_read_timeout(); }
+    ResourceCtlResponse get_async(ResourceList &rl, ResourceHandler &handler, const string &owner_tag,
+                                  ResourceConfig &resource_config, ResourceList::iterator &rli, unsigned int check_id);
+    ResourceCtlResponse get_async_reply(const ResourceCheckReplyEvent &ev, ResourceList &rl, ResourceHandler &handler,
+                                        const string &owner_tag, ResourceConfig &resource_config,
+                                        ResourceList::iterator &rli);
 
     // void put(ResourceList &rl);
-    void put(const string &handler);
+    void put(ResourceHandler handler);
 
     void GetConfig(AmArg &ret, bool types_only = false);
     void clearStats();
     void getStats(AmArg &ret);
     bool getResourceState(const string &connection_id, const AmArg &request_id, const AmArg &params);
     void showResources(AmArg &ret);
-    void showResourceByHandler(const string &h, AmArg &ret);
+    void showResourceByHandler(ResourceHandler h, AmArg &ret);
     void showResourceByLocalTag(const string &tag, AmArg &ret);
     void showResourcesById(int id, AmArg &ret);
     const ResourceRedisConnection &getRedisConn() { return redis_conn; };
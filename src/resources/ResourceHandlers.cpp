@@ -0,0 +1,180 @@
+#include "ResourceHandlers.h"
+
+#define SHARD_INITIAL_SLOTS 64
+
+void ResourceHandlers::entry::info(AmArg &a, const struct timeval &now) const
+{
+    a["handler"]   = static_cast<long long>(handler);
+    a["onwer_tag"] = owner_tag;
+    a["valid"]     = valid;
+    a["lifetime"]  = now.tv_sec - created_at.tv_sec;
+
+    AmArg &r = a["resources"];
+    r.assertArray();
+    for (const auto &res : resources)
+        r.push(res.print());
+}
+
+ResourceHandlers::shard::shard()
+    : slots(SHARD_INITIAL_SLOTS, slot{ 0, 0 })
+    , size(0)
+{
+}
+
+size_t ResourceHandlers::shard::home(ResourceHandler h) const
+{
+    // handlers of the shard are sequential. no collisions until the table wraps
+    return (h / RESOURCE_HANDLERS_SHARDS) & (slots.size() - 1);
+}
+
+ResourceHandlers::slot *ResourceHandlers::shard::find(ResourceHandler h)
+{
+    size_t mask = slots.size() - 1;
+    for (size_t i = home(h);; i = (i + 1) & mask) {
+        auto &s = slots[i];
+        if (s.handler == h)
+            return &s;
+        if (!s.handler)
+            return nullptr;
+    }
+}
+
+void ResourceHandlers::shard::insert(ResourceHandler h, uint32_t idx)
+{
+    if ((size + 1) * 4 > slots.size() * 3)
+        grow();
+
+    size_t mask = slots.size() - 1;
+    size_t i    = home(h);
+    while (slots[i].handler)
+        i = (i + 1) & mask;
+
+    slots[i] = slot{ h, idx };
+    size++;
+}
+
+void ResourceHandlers::shard::erase(slot *s)
+{
+    size_t mask = slots.size() - 1;
+    size_t i    = s - slots.data();
+    size_t j    = i;
+
+    // backward shift: move the following slots of the probe sequence into the hole
+    while (true) {
+        j = (j + 1) & mask;
+        if (!slots[j].handler)
+            break;
+        size_t k = home(slots[j].handler);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        slots[i] = slots[j];
+        i        = j;
+    }
+
+    slots[i].handler = 0;
+    size--;
+}
+
+void ResourceHandlers::shard::grow()
+{
+    vector<slot> old(slots.size() * 2, slot{ 0, 0 });
+    old.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (const auto &s : old) {
+        if (!s.handler)
+            continue;
+        size_t i = home(s.handler);
+        while (slots[i].handler)
+            i = (i + 1) & mask;
+        slots[i] = s;
+    }
+}
+
+ResourceHandlers::ResourceHandlers()
+    : last_handler(0)
+{
+}
+
+ResourceHandler ResourceHandlers::add(const ResourceList &rl, const string &owner_tag)
+{
+    ResourceHandler h = ++last_handler;
+    auto           &s = get_shard(h);
+
+    AmLock   l(s.mutex);
+    uint32_t idx;
+    if (s.free_entries.empty()) {
+        idx = s.pool.size();
+        s.pool.emplace_back();
+    } else {
+        idx = s.free_entries.back();
+        s.free_entries.pop_back();
+    }
+
+    auto &e     = s.pool[idx];
+    e.handler   = h;
+    e.owner_tag = owner_tag;
+    e.valid     = true;
+    gettimeofday(&e.created_at, NULL);
+
+    // keeps capacity of the previous entry user
+    e.resources.clear();
+    for (const auto &r : rl) {
+        if (is_stored(r))
+            e.resources.push_back(r);
+    }
+
+    s.insert(h, idx);
+
+    return h;
+}
+
+ResourceHandlers::TakeResult ResourceHandlers::take(ResourceHandler h, string &owner_tag, vector<Resource> &resources)
+{
+    auto  &s = get_shard(h);
+    AmLock l(s.mutex);
+
+    auto sl = s.find(h);
+    if (!sl)
+        return HANDLER_NOT_FOUND;
+
+    uint32_t idx = sl->idx;
+    s.erase(sl);
+    s.free_entries.push_back(idx);
+
+    auto &e   = s.pool[idx];
+    e.handler = 0;
+    if (!e.valid)
+        return HANDLER_INVALID;
+
+    owner_tag.swap(e.owner_tag);
+    resources.clear();
+    resources.swap(e.resources);
+
+    return HANDLER_TAKEN;
+}
+
+size_t ResourceHandlers::invalidate()
+{
+    size_t ret = 0;
+    for (auto &s : shards) {
+        AmLock l(s.mutex);
+        for (const auto &sl : s.slots) {
+            if (!sl.handler)
+                continue;
+            s.pool[sl.idx].valid = false;
+            ret++;
+        }
+    }
+    return ret;
+}
+
+size_t ResourceHandlers::size()
+{
+    size_t ret = 0;
+    for (auto &s : shards) {
+        AmLock l(s.mutex);
+        ret += s.size;
+    }
+    return ret;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Resource.h"
+#include "AmArg.h"
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <sys/time.h>
+
+#define RESOURCE_HANDLERS_SHARDS 32
+
+/* registry of the resources grabbed by the calls.
+ *
+ * handlers are integers from the monotonic counter, so the stale handler
+ * never refers to the entry of another call. 0 means no handler.
+ *
+ * handlers are distributed over the shards with own mutex,
+ * open addressing table (linear probing, backward shift deletion)
+ * and pool of entries reusing the resources storage between calls.
+ *
+ * entries keep only resources released by put():
+ * taken and rate-limit ones */
+class ResourceHandlers {
+  public:
+    struct entry {
+        ResourceHandler  handler;
+        string           owner_tag;
+        struct timeval   created_at;
+        bool             valid;
+        vector<Resource> resources;
+
+        entry()
+            : handler(0)
+            , created_at{}
+            , valid(false)
+        {
+        }
+        void info(AmArg &a, const struct timeval &now) const;
+    };
+
+    enum TakeResult { HANDLER_NOT_FOUND, HANDLER_INVALID, HANDLER_TAKEN };
+
+  private:
+    struct slot {
+        ResourceHandler handler;
+        uint32_t        idx;
+    };
+
+    struct shard {
+        AmMutex          mutex;
+        vector<slot>     slots;
+        vector<entry>    pool;
+        vector<uint32_t> free_entries;
+        size_t           size;
+
+        shard();
+
+        size_t home(ResourceHandler h) const;
+        slot  *find(ResourceHandler h);
+        void   insert(ResourceHandler h, uint32_t idx);
+        void   erase(slot *s);
+        void   grow();
+    };
+
+    shard                        shards[RESOURCE_HANDLERS_SHARDS];
+    std::atomic<ResourceHandler> last_handler;
+
+    shard &get_shard(ResourceHandler h) { return shards[h % RESOURCE_HANDLERS_SHARDS]; }
+
+  public:
+    ResourceHandlers();
+
+    static bool is_stored(const Resource &r) { return r.taken || r.rate_limit; }
+
+    ResourceHandler add(const ResourceList &rl, const string &owner_tag);
+
+    /* remove handler from the registry.
+     * on HANDLER_TAKEN resources of the handler are swapped into the 'resources' */
+    TakeResult take(ResourceHandler h, string &owner_tag, vector<Resource> &resources);
+
+    /* mark all handlers invalid. returns handlers count */
+    size_t invalidate();
+    size_t size();
+
+    /* f(const entry &) is called under the lock of the single shard,
+     * so concurrent add()/take() wait for one shard at most */
+    template <typename F> void for_each(F f)
+    {
+        for (auto &s : shards) {
+            AmLock l(s.mutex);
+            for (const auto &sl : s.slots)
+                if (sl.handler)
+                    f(s.pool[sl.idx]);
+        }
+    }
+
+    template <typename F> bool find(ResourceHandler h, F f)
+    {
+        auto  &s = get_shard(h);
+        AmLock l(s.mutex);
+        auto   sl = s.find(h);
+        if (!sl)
+            return false;
+        f(s.pool[sl->idx]);
+        return true;
+    }
+};
@@ -0,0 +1,434 @@
+#include "ResourceHandlersLog.h"
+#include "log.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define LOG_FORMAT_VERSION 1
+
+// rewrite log when it has more records than the outstanding state multiplied by the factor
+#define COMPACT_MIN_RECORDS 10000
+#define COMPACT_FACTOR      4
+// records appended during the rewriting are added to the new log under the mutex if they fit
+#define COMPACT_SWAP_TAIL_SIZE 4096
+
+ResourceHandlersLog::ResourceHandlersLog()
+    : fd(-1)
+    , records(0)
+    , compact_requested(false)
+    , compacting(false)
+    , epoll_fd(-1)
+    , stopped(false)
+{
+}
+
+ResourceHandlersLog::~ResourceHandlersLog()
+{
+    if (fd != -1)
+        close(fd);
+    if (epoll_fd != -1)
+        close(epoll_fd);
+}
+
+bool ResourceHandlersLog::apply(const string &line)
+{
+    std::istringstream s(line);
+    char               record;
+
+    if (!(s >> record))
+        return false;
+
+    switch (record) {
+    case 'H':
+    {
+        ResourceHandler h;
+        string          list;
+        if (!(s >> h >> list))
+            return false;
+
+        auto &resources = handlers[h];
+        resources.clear();
+
+        std::istringstream l(list);
+        string             item;
+        while (std::getline(l, item, ',')) {
+            auto first = item.find(':'), last = item.rfind(':');
+            if (first == string::npos || first == last)
+                return false;
+
+            taken_resource r;
+            r.id = item.substr(first + 1, last - first - 1);
+            if (!(std::istringstream(item.substr(0, first)) >> r.type) ||
+                !(std::istringstream(item.substr(last + 1)) >> r.takes))
+                return false;
+            resources.emplace_back(std::move(r));
+        }
+    } break;
+    case 'P':
+    {
+        ResourceHandler h;
+        if (!(s >> h))
+            return false;
+        handlers.erase(h);
+    } break;
+    case 'U':
+    {
+        string k;
+        long   delta;
+        if (!(s >> k >> delta))
+            return false;
+        auto pos = k.find(':');
+        if (pos == string::npos)
+            return false;
+        int type;
+        if (!(std::istringstream(k.substr(0, pos)) >> type))
+            return false;
+        units[key(type, k.substr(pos + 1))] += delta;
+    } break;
+    case 'R':
+        handlers.clear();
+        units.clear();
+        break;
+    default: return false;
+    }
+
+    return true;
+}
+
+void ResourceHandlersLog::append(const string &record)
+{
+    if (fd == -1)
+        return;
+
+    if (write(fd, record.data(), record.size()) != static_cast<ssize_t>(record.size())) {
+        ERROR("failed to write resources handlers log %s: %s", path.data(), strerror(errno));
+    }
+
+    records++;
+    if (compacting) {
+        compact_tail += record;
+    } else if (!compact_requested && records > COMPACT_MIN_RECORDS &&
+               records > COMPACT_FACTOR * (handlers.size() + units.size()))
+    {
+        compact_requested = true;
+        compact_event.fire();
+    }
+}
+
+int ResourceHandlersLog::write_state(const Handlers &h, const Units &u) const
+{
+    string tmp_path = path + ".tmp";
+
+    std::ostringstream s;
+    s << header << '\n';
+    for (const auto &[handler, resources] : h) {
+        s << "H " << handler << ' ';
+        for (size_t i = 0; i < resources.size(); i++) {
+            const auto &r = resources[i];
+            if (i)
+                s << ',';
+            s << r.type << ':' << r.id << ':' << r.takes;
+        }
+        s << '\n';
+    }
+    for (const auto &[k, v] : u) {
+        if (v)
+            s << "U " << k.first << ':' << k.second << ' ' << v << '\n';
+    }
+
+    string data = s.str();
+
+    int tmp_fd = ::open(tmp_path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (tmp_fd == -1) {
+        ERROR("failed to create %s: %s", tmp_path.data(), strerror(errno));
+        return -1;
+    }
+    if (write(tmp_fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()) || fsync(tmp_fd) != 0) {
+        ERROR("failed to write %s: %s", tmp_path.data(), strerror(errno));
+        close(tmp_fd);
+        return -1;
+    }
+
+    return tmp_fd;
+}
+
+bool ResourceHandlersLog::swap_log(int new_fd)
+{
+    string tmp_path = path + ".tmp";
+    if (rename(tmp_path.data(), path.data()) != 0) {
+        ERROR("failed to rename %s to %s: %s", tmp_path.data(), path.data(), strerror(errno));
+        close(new_fd);
+        return false;
+    }
+
+    int old_fd = fd.exchange(new_fd);
+    if (old_fd != -1)
+        close(old_fd);
+    records = 0;
+
+    return true;
+}
+
+void ResourceHandlersLog::compact_sync()
+{
+    int new_fd = write_state(handlers, units);
+    if (new_fd != -1)
+        swap_log(new_fd);
+}
+
+static bool write_tail(int fd, const string &tail, const string &path)
+{
+    if (tail.empty() || write(fd, tail.data(), tail.size()) == static_cast<ssize_t>(tail.size()))
+        return true;
+    ERROR("failed to write %s.tmp: %s", path.data(), strerror(errno));
+    return false;
+}
+
+void ResourceHandlersLog::compact_async()
+{
+    Handlers h;
+    Units    u;
+
+    {
+        AmLock l(mutex);
+        compact_requested = false;
+        if (fd == -1)
+            return;
+        h = handlers;
+        u = units;
+        compact_tail.clear();
+        compacting = true;
+    }
+
+    int new_fd = write_state(h, u);
+
+    // add records appended during the writing. the small rest is added on the swap
+    string tail;
+    while (new_fd != -1) {
+        {
+            AmLock l(mutex);
+            if (compact_tail.size() <= COMPACT_SWAP_TAIL_SIZE) {
+                bool swapped = false;
+                if (write_tail(new_fd, compact_tail, path))
+                    swapped = swap_log(new_fd);
+                else
+                    close(new_fd);
+                compacting = false;
+                compact_tail.clear();
+                if (!swapped)
+                    records = 0; // retry after the next COMPACT_MIN_RECORDS records
+                return;
+            }
+            tail.swap(compact_tail);
+        }
+
+        if (!write_tail(new_fd, tail, path)) {
+            close(new_fd);
+            break;
+        }
+        tail.clear();
+    }
+
+    AmLock l(mutex);
+    compacting = false;
+    compact_tail.clear();
+    records = 0;
+}
+
+void ResourceHandlersLog::outstanding(Units &ret) const
+{
+    ret = units;
+    for (const auto &[h, resources] : handlers) {
+        for (const auto &r : resources)
+            ret[key(r.type, r.id)] += r.takes;
+    }
+    std::erase_if(ret, [](const auto &u) { return u.second <= 0; });
+}
+
+int ResourceHandlersLog::open(const string &log_path, int node_id, std::optional<Units> &recovered)
+{
+    AmLock l(mutex);
+
+    path   = log_path;
+    header = "yeti-resources-log " + std::to_string(LOG_FORMAT_VERSION) + " node " + std::to_string(node_id);
+
+    recovered.reset();
+    handlers.clear();
+    units.clear();
+    compact_requested = false;
+
+    if (epoll_fd == -1) {
+        if ((epoll_fd = epoll_create(2)) == -1) {
+            ERROR("epoll_create() call failed");
+            return -1;
+        }
+        compact_event.link(epoll_fd);
+        stop_event.link(epoll_fd);
+    }
+
+    std::ifstream f(path);
+    string        line;
+    if (f.is_open() && std::getline(f, line)) {
+        if (line != header) {
+            WARN("resources handlers log %s header mismatch: '%s'. ignore it", path.data(), line.data());
+        } else {
+            size_t n = 1;
+            while (std::getline(f, line)) {
+                n++;
+                // unterminated or malformed line is the partially written tail of the crashed instance log
+                if (f.eof() || !apply(line)) {
+                    WARN("resources handlers log %s: stop on the malformed line %lu", path.data(), n);
+                    break;
+                }
+            }
+
+            Units u;
+            outstanding(u);
+            recovered = u;
+        }
+    }
+    f.close();
+
+    // keep recovered leftovers in the log until they are compensated
+    handlers.clear();
+    units.clear();
+    if (recovered)
+        units = recovered.value();
+
+    // log thread is not started yet
+    compact_sync();
+    if (fd == -1) {
+        ERROR("failed to start resources handlers log %s", path.data());
+        return -1;
+    }
+
+    if (recovered)
+        INFO("resources handlers log %s: %lu resources to compensate", path.data(), recovered->size());
+
+    return 0;
+}
+
+void ResourceHandlersLog::taken(ResourceHandler h, const ResourceList &rl)
+{
+    if (!enabled())
+        return;
+
+    vector<taken_resource> resources;
+    std::ostringstream     s;
+    s << "H " << h << ' ';
+    for (const auto &r : rl) {
+        if (!is_logged(r))
+            continue;
+        if (!resources.empty())
+            s << ',';
+        s << r.type << ':' << r.id << ':' << r.takes;
+        resources.push_back({ r.type, r.id, r.takes });
+    }
+    if (resources.empty())
+        return;
+    s << '\n';
+
+    AmLock l(mutex);
+    handlers[h] = std::move(resources);
+    append(s.str());
+}
+
+void ResourceHandlersLog::released(ResourceHandler h)
+{
+    if (!enabled())
+        return;
+
+    AmLock l(mutex);
+    if (!handlers.erase(h))
+        return;
+    append("P " + std::to_string(h) + '\n');
+}
+
+void ResourceHandlersLog::released(const vector<ResourceHandler> &hs)
+{
+    if (!enabled())
+        return;
+
+    string records_data;
+
+    AmLock l(mutex);
+    for (auto h : hs) {
+        if (handlers.erase(h))
+            records_data += "P " + std::to_string(h) + '\n';
+    }
+    if (!records_data.empty())
+        append(records_data);
+}
+
+void ResourceHandlersLog::add_units(const Resource &r, long delta)
+{
+    if (!enabled() || !delta)
+        return;
+
+    std::ostringstream s;
+    s << "U " << r.type << ':' << r.id << ' ' << delta << '\n';
+
+    AmLock l(mutex);
+    units[key(r.type, r.id)] += delta;
+    append(s.str());
+}
+
+void ResourceHandlersLog::reset()
+{
+    if (!enabled())
+        return;
+
+    AmLock l(mutex);
+    handlers.clear();
+    units.clear();
+    append("R\n");
+
+    // truncate the log by the log thread
+    if (!compacting && !compact_requested) {
+        compact_requested = true;
+        compact_event.fire();
+    }
+}
+
+void ResourceHandlersLog::run()
+{
+    bool               running;
+    struct epoll_event events[2];
+
+    setThreadName("res-hlog");
+
+    running = true;
+    do {
+        int ret = epoll_wait(epoll_fd, events, 2, -1);
+        if (ret == -1 && errno != EINTR) {
+            ERROR("epoll_wait: %s", strerror(errno));
+        }
+        if (ret < 1)
+            continue;
+        for (int n = 0; n < ret; ++n) {
+            struct epoll_event &e = events[n];
+
+            if (e.data.fd == compact_event) {
+                compact_event.read();
+                compact_async();
+            } else if (e.data.fd == stop_event) {
+                stop_event.read();
+                running = false;
+                break;
+            }
+        }
+    } while (running);
+
+    stopped.set(true);
+}
+
+void ResourceHandlersLog::on_stop()
+{
+    stop_event.fire();
+    stopped.wait_for();
+}
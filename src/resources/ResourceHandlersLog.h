@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Resource.h"
+
+#include <AmThread.h>
+
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <optional>
+#include <vector>
+
+/* append-only log of the node contributions to the redis resources counters.
+ *
+ * records:
+ *   H <handler> <type>:<id>:<takes>[,...]  resources taken by the handler
+ *   P <handler>                            handler resources are released in redis
+ *   U <type>:<id> <units>                  units not bound to the handler (leases, recovered leftovers)
+ *   R                                      node counters are reset
+ *
+ * log is rewritten with the outstanding state by the own thread when it grows.
+ * records appended during the rewriting are added to the new log
+ * and the log file is replaced under the mutex with them.
+ * outstanding units of the log left by the crashed instance
+ * are compensated on start instead of the full resources invalidation */
+class ResourceHandlersLog : public AmThread {
+  public:
+    typedef std::pair<int, string> key;
+    typedef std::map<key, long>    Units;
+
+  private:
+    struct taken_resource {
+        int    type;
+        string id;
+        int    takes;
+    };
+
+    typedef std::unordered_map<ResourceHandler, vector<taken_resource>> Handlers;
+
+    string           path;
+    string           header;
+    std::atomic<int> fd;
+    AmMutex          mutex;
+
+    Handlers handlers;
+    Units    units;
+    size_t   records;
+
+    bool   compact_requested; // guarded by mutex
+    bool   compacting;        // guarded by mutex. records are collected to compact_tail
+    string compact_tail;      // guarded by mutex
+
+    int               epoll_fd;
+    AmEventFd         compact_event;
+    AmEventFd         stop_event;
+    AmCondition<bool> stopped;
+
+    bool apply(const string &line);
+    void append(const string &record);
+    /* writes and syncs the tmp file with the state. returns its fd or -1 */
+    int  write_state(const Handlers &h, const Units &u) const;
+    /* replaces the log file. must be called under the mutex */
+    bool swap_log(int new_fd);
+    void compact_sync();
+    void compact_async();
+    void outstanding(Units &ret) const;
+
+  public:
+    ResourceHandlersLog();
+    ~ResourceHandlersLog();
+
+    bool enabled() const { return fd.load() != -1; }
+
+    /* loads the log of the previous run and starts the new one.
+     * recovered is not set if the log is absent or belongs to the other node */
+    int open(const string &log_path, int node_id, std::optional<Units> &recovered);
+
+    void run() override;
+    void on_stop() override;
+
+    /* logs taken resources which are not served by the leases */
+    void taken(ResourceHandler h, const ResourceList &rl);
+    void released(ResourceHandler h);
+    void released(const vector<ResourceHandler> &hs);
+    void add_units(const Resource &r, long delta);
+
+    /* node counters are reset */
+    void reset();
+
+    static bool is_logged(const Resource &r) { return r.taken && !r.leased && !r.rate_limit; }
+};
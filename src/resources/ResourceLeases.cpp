@@ -0,0 +1,209 @@
+#include "ResourceLeases.h"
+#include "log.h"
+
+#include <algorithm>
+
+// delay of the next lease request after the refusal
+#define LEASE_RETRY_INTERVAL_SEC 5
+
+ResourceLeases::ResourceLeases()
+    : block(0)
+    , min_limit(0)
+    , ttl(0)
+    , generation(0)
+{
+}
+
+void ResourceLeases::configure(int lease_block, int lease_min_limit, int lease_ttl)
+{
+    block     = std::max(lease_block, 0);
+    min_limit = lease_min_limit;
+    ttl       = lease_ttl;
+}
+
+bool ResourceLeases::is_leasable(const Resource &r) const
+{
+    return !r.rate_limit && r.takes > 0 && r.limit >= min_limit;
+}
+
+void ResourceLeases::get_return(const key &k, int amount, vector<request> &returns) const
+{
+    request req;
+    req.resource.type = k.first;
+    req.resource.id   = k.second;
+    req.amount        = -amount;
+    req.generation    = generation;
+    returns.emplace_back(std::move(req));
+}
+
+bool ResourceLeases::take(ResourceList &rl, vector<request> &requests)
+{
+    if (!enabled())
+        return false;
+
+    time_t now  = time(nullptr);
+    bool   ok   = true;
+    bool   skip = false;
+
+    vector<std::pair<Resource *, lease *>> heads;
+    vector<std::pair<lease *, int>>        demand;
+
+    AmLock l(mutex);
+
+    for (auto &r : rl) {
+        if (skip) {
+            // the rest of the failover group
+            if (!r.failover_to_next)
+                skip = false;
+            continue;
+        }
+        skip = r.failover_to_next;
+
+        if (!is_leasable(r))
+            return false;
+
+        auto [it, inserted] = leases.try_emplace(key(r.type, r.id), lease{});
+        lease &ls           = it->second;
+        if (inserted)
+            ls.last_used = now;
+
+        heads.emplace_back(&r, &ls);
+
+        auto d = std::find_if(demand.begin(), demand.end(), [&ls](const auto &p) { return p.first == &ls; });
+        if (d == demand.end())
+            d = demand.emplace(demand.end(), &ls, 0);
+        d->second += r.takes;
+
+        if (ls.used + d->second > ls.leased) {
+            ok = false;
+            if (!ls.pending && now >= ls.retry_at) {
+                ls.pending = true;
+                requests.push_back({ r, std::max(block, d->second), generation });
+            }
+        }
+    }
+
+    if (!ok)
+        return false;
+
+    for (auto &[r, ls] : heads) {
+        ls->used += r->takes;
+
+        ls->last_used = now;
+        r->active     = true;
+        r->taken      = true;
+        r->leased     = true;
+    }
+
+    return true;
+}
+
+void ResourceLeases::put(const Resource &r)
+{
+    AmLock l(mutex);
+
+    auto it = leases.find(key(r.type, r.id));
+    if (it == leases.end()) {
+        // released on shutdown
+        return;
+    }
+
+    lease &ls    = it->second;
+    ls.used      = std::max(ls.used - r.takes, 0);
+    ls.last_used = time(nullptr);
+}
+
+void ResourceLeases::on_lease_reply(const request &req, int granted)
+{
+    if (req.amount < 0)
+        return;
+
+    AmLock l(mutex);
+
+    if (req.generation != generation) {
+        // node counters were reset by the invalidation in the meantime
+        DBG("ignore lease %d of the resource %d:%s requested before invalidation", granted, req.resource.type,
+            req.resource.id.data());
+        return;
+    }
+
+    auto it = leases.find(key(req.resource.type, req.resource.id));
+    if (it == leases.end())
+        return;
+
+    lease &ls  = it->second;
+    ls.pending = false;
+    time_t now = time(nullptr);
+
+    if (granted > 0) {
+        DBG("leased %d units of the resource %d:%s", granted, req.resource.type, req.resource.id.data());
+        ls.leased += granted;
+
+        ls.last_grant = now;
+    } else {
+        ls.retry_at = now + LEASE_RETRY_INTERVAL_SEC;
+    }
+}
+
+void ResourceLeases::collect_expired(time_t now, vector<request> &returns)
+{
+    AmLock l(mutex);
+
+    for (auto it = leases.begin(); it != leases.end();) {
+        lease &ls = it->second;
+
+        if (ls.pending) {
+            ++it;
+            continue;
+        }
+
+        if (ls.used == 0 && now - ls.last_used >= ttl) {
+            if (ls.leased > 0)
+                get_return(it->first, ls.leased, returns);
+            it = leases.erase(it);
+            continue;
+        }
+
+        // keep one block of the headroom
+        if (ls.leased - ls.used > block && now - ls.last_grant >= ttl) {
+            int surplus = ls.leased - ls.used - block;
+            get_return(it->first, surplus, returns);
+            ls.leased -= surplus;
+        }
+
+        ++it;
+    }
+}
+
+void ResourceLeases::clear()
+{
+    AmLock l(mutex);
+    leases.clear();
+    generation++;
+}
+
+void ResourceLeases::release(vector<request> &returns)
+{
+    AmLock l(mutex);
+    for (const auto &[k, ls] : leases) {
+        if (ls.leased > 0)
+            get_return(k, ls.leased, returns);
+    }
+    leases.clear();
+    generation++;
+}
+
+void ResourceLeases::info(AmArg &ret)
+{
+    long leased = 0, used = 0;
+
+    AmLock l(mutex);
+    for (const auto &[k, ls] : leases) {
+        leased += ls.leased;
+        used   += ls.used;
+    }
+
+    ret["resources"] = static_cast<long>(leases.size());
+    ret["leased"]    = leased;
+    ret["used"]      = used;
+}
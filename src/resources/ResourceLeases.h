@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Resource.h"
+#include "AmArg.h"
+
+#include <map>
+#include <vector>
+#include <ctime>
+
+/* local admission from the capacity reserved for the node in the redis.
+ *
+ * node reserves blocks of resource units (lease_resources.lua adds them to the node counter
+ * if the global limit allows) and serves get()/put() of the resource locally
+ * until the lease is exhausted. other nodes see the whole lease as used,
+ * so the global limit stays exact at the block granularity.
+ *
+ * lease surplus over one block is returned after 'ttl' seconds since the last grant,
+ * the whole lease is returned after 'ttl' seconds without used units */
+class ResourceLeases {
+  public:
+    struct request {
+        Resource     resource;
+        int          amount; // negative to return units
+        unsigned int generation;
+    };
+
+  private:
+    typedef std::pair<int, string> key;
+
+    struct lease {
+        int    leased;
+        int    used;
+        bool   pending;
+        time_t last_used;
+        time_t last_grant;
+        time_t retry_at;
+    };
+
+    std::map<key, lease> leases;
+    AmMutex              mutex;
+
+    int          block;
+    int          min_limit;
+    int          ttl;
+    unsigned int generation;
+
+    bool is_leasable(const Resource &r) const;
+    void get_return(const key &k, int amount, vector<request> &returns) const;
+
+  public:
+    ResourceLeases();
+
+    void configure(int block, int min_limit, int ttl);
+    bool enabled() const { return block > 0; }
+
+    /* takes heads of the failover groups from the leases.
+     * on false rl is untouched and requests contain leases to acquire */
+    bool take(ResourceList &rl, vector<request> &requests);
+    void put(const Resource &r);
+
+    void on_lease_reply(const request &req, int granted);
+
+    void collect_expired(time_t now, vector<request> &returns);
+    /* drop leases without return. node counters are reset by the invalidation */
+    void clear();
+    /* drop leases and get requests to return them */
+    void release(vector<request> &returns);
+
+    void info(AmArg &ret);
+};
@@ -18,6 +18,7 @@ using std::vector;
 #define INVALIDATE_RESOURCES_SCRIPT "invalidate_resources"
 #define GET_ALL_RESOURCES_SCRIPT    "get_all_resources"
 #define CHECK_RESOURCES_SCRIPT      "check_resources"
+#define LEASE_RESOURCES_SCRIPT      "lease_resources"
 
 class ResourceRedisClient {
   protected:
@@ -6,6 +6,7 @@
 #include <AmPlugIn.h>
 #include <format_helper.h>
 #include <random>
+#include <algorithm>
 
 #include "confuse.h"
 
@@ -35,9 +36,12 @@ bool ResourceRedisConnection::InvalidateRequest::make_args(const string &script_
 
 /* OperationRequest */
 
-ResourceRedisConnection::OperationRequest::OperationRequest(ResourcesOperationList &rol, cb_func callback)
+ResourceRedisConnection::OperationRequest::OperationRequest(ResourcesOperationList &rol, cb_func callback,
+                                                            puts_confirmed_cb_func puts_confirmed_cb)
     : Request(callback)
     , operations(std::move(rol))
+    , puts_confirmed_cb(puts_confirmed_cb)
+    , start_time(LatencyHistogram::clock::now())
 {
 }
 
@@ -122,6 +126,28 @@ const ResourcesOperationList &ResourceRedisConnection::OperationRequest::get_res
     return operations;
 }
 
+vector<ResourceHandler> ResourceRedisConnection::OperationRequest::get_put_handlers() const
+{
+    vector<ResourceHandler> handlers;
+    for (const auto &operation : operations) {
+        if (operation.op == ResourcesOperation::RES_PUT && operation.handler)
+            handlers.push_back(operation.handler);
+    }
+    return handlers;
+}
+
+void ResourceRedisConnection::OperationRequest::on_finish()
+{
+    Request::on_finish();
+
+    if (iserror || !puts_confirmed_cb)
+        return;
+
+    auto released = get_put_handlers();
+    if (!released.empty())
+        puts_confirmed_cb(released);
+}
+
 /* GetAllRequest */
 
 ResourceRedisConnection::GetAllRequest::GetAllRequest(const JsonRpcRequestEvent &req)
@@ -184,6 +210,12 @@ ResourceRedisConnection::CheckRequest::CheckRequest(const ResourceList &rl)
     is_persistent = true;
 }
 
+ResourceRedisConnection::CheckRequest::CheckRequest(const ResourceList &rl, cb_func callback)
+    : Request(callback)
+    , rl(rl)
+{
+}
+
 bool ResourceRedisConnection::CheckRequest::make_args(const string &script_hash, vector<AmArg> &args)
 {
     /* keys,args layout:
@@ -227,6 +259,42 @@ const ResourceList &ResourceRedisConnection::CheckRequest::get_resources() const
     return rl;
 }
 
+/* LeaseRequest */
+
+ResourceRedisConnection::LeaseRequest::LeaseRequest(const Resource &r, int amount, cb_func callback)
+    : Request(callback)
+    , type(r.type)
+    , id(r.id)
+    , limit(r.limit)
+    , amount(amount)
+{
+}
+
+bool ResourceRedisConnection::LeaseRequest::make_args(const string &script_hash, vector<AmArg> &args)
+{
+    args = { "EVALSHA", script_hash.c_str(), 1, format("r:{}:{}", type, id), AmConfig.node_id, limit, amount };
+    return true;
+}
+
+/* CompensateRequest */
+
+ResourceRedisConnection::CompensateRequest::CompensateRequest(ResourceHandlersLog::Units &&units)
+    : Request()
+    , units(std::move(units))
+{
+}
+
+bool ResourceRedisConnection::CompensateRequest::make_args(const string &script_hash, vector<AmArg> &args)
+{
+    // zero limit is ignored by lease_resources.lua for the returned units
+    for (const auto &[key, value] : units) {
+        args.emplace_back(AmArg().assign_array("EVALSHA", script_hash.c_str(), 1,
+                                               format("r:{}:{}", key.first, key.second), AmConfig.node_id, 0,
+                                               -value));
+    }
+    return true;
+}
+
 /* ResourceRedisConnection */
 
 ResourceRedisConnection::ResourceRedisConnection(const string &queue_name)
@@ -235,14 +303,28 @@ ResourceRedisConnection::ResourceRedisConnection(const string &queue_name)
     , queue_name(queue_name)
     , writecfg(RedisMaster)
     , readcfg(RedisSlave)
-    , write_async_is_busy(false)
+    , write_inflight(0)
+    , linger_timer_armed(false)
+    , write_batch_size(0)
+    , write_batch_linger(0)
+    , write_max_inflight(1)
     , resources_inited(false)
     , initialization_max_delay(0)
     , initialization_timer(nullptr)
+    , lease_enabled(false)
     , write_queue_size(stat_group(Gauge, "yeti", "resources_write_queue_size").addAtomicCounter())
+    , write_batches(stat_group(Counter, "yeti", "resources_write_batches")
+                        .setHelp("resources operations batches sent to the write connection")
+                        .addAtomicCounter())
+    , write_batched_operations(stat_group(Counter, "yeti", "resources_write_batched_operations")
+                                   .setHelp("resources operations sent within the batches")
+                                   .addAtomicCounter())
+    , write_batch_latency(LatencyHistograms::instance().add("yeti_resources_write_batch_duration_usec"))
     , resources_initialized_cb(nullptr)
     , operation_result_cb(nullptr)
 {
+    LatencyHistograms::instance().setHelp("yeti_resources_write_batch_duration_usec",
+                                          "resources operations batch round trip in microseconds");
     event_dispatcher->addEventQueue(queue_name, this);
 }
 
@@ -304,9 +386,26 @@ void ResourceRedisConnection::run()
                 on_initialization_timer();
                 initialization_timer->read();
             }
+
+            if (e.data.fd == linger_timer) {
+                linger_timer.read();
+                on_linger_timer();
+            }
+
+            if (lease_timer.get() && e.data.fd == *lease_timer.get()) {
+                lease_timer->read();
+                if (lease_timer_cb)
+                    lease_timer_cb();
+            }
         }
     } while (running);
 
+    if (lease_timer.get()) {
+        lease_timer->unlink(epoll_fd);
+        lease_timer.reset(nullptr);
+    }
+    linger_timer.unlink(epoll_fd);
+
     epoll_unlink(epoll_fd);
     close(epoll_fd);
 
@@ -367,6 +466,14 @@ int ResourceRedisConnection::configure(cfg_t *confuse_cfg)
 {
     scripts_dir              = cfg_getstr(confuse_cfg, opt_resources_scripts_dir);
     initialization_max_delay = cfg_getint(confuse_cfg, opt_resources_initialization_max_delay);
+    lease_enabled            = cfg_getint(confuse_cfg, opt_resources_lease_block) > 0;
+
+    int batch_size     = cfg_getint(confuse_cfg, opt_resources_write_batch_size);
+    int batch_linger   = cfg_getint(confuse_cfg, opt_resources_write_batch_linger);
+    int max_inflight   = cfg_getint(confuse_cfg, opt_resources_write_max_inflight);
+    write_batch_size   = batch_size > 0 ? static_cast<size_t>(batch_size) : 0;
+    write_batch_linger = std::chrono::microseconds(batch_linger > 0 ? batch_linger : 0);
+    write_max_inflight = max_inflight > 0 ? static_cast<unsigned int>(max_inflight) : 1;
 
     auto redis_write = cfg_getsec(confuse_cfg, "write");
     if (!redis_write) {
@@ -422,21 +529,51 @@ bool ResourceRedisConnection::is_ready()
 
 void ResourceRedisConnection::process_operations_queue_unsafe()
 {
-    if (!is_ready() || write_async_is_busy)
+    if (!is_ready())
         return;
 
-    if (!resource_operations_queue.empty()) {
-        ResourcesOperationList operations;
-        operations.swap(resource_operations_queue);
+    while (!resource_operations_queue.empty() && write_inflight < write_max_inflight) {
+        size_t queued = resource_operations_queue.size();
+
+        if (write_batch_linger.count() && (!write_batch_size || queued < write_batch_size)) {
+            auto waiting = LatencyHistogram::clock::now() - resource_operations_queue.front().queued_at;
+            if (waiting < write_batch_linger) {
+                // wait for the more operations up to the linger time of the oldest one
+                if (!linger_timer_armed) {
+                    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(write_batch_linger - waiting);
+                    // zero value disarms the timer
+                    linger_timer.set(std::max<long>(usec.count(), 1), false);
+                    linger_timer_armed = true;
+                }
+                return;
+            }
+        }
 
-        if (operation(new OperationRequest(operations, operation_result_cb))) {
-            write_async_is_busy = true;
+        ResourcesOperationList operations;
+        if (!write_batch_size || queued <= write_batch_size) {
+            operations.swap(resource_operations_queue);
+        } else {
+            operations.splice(operations.end(), resource_operations_queue, resource_operations_queue.begin(),
+                              std::next(resource_operations_queue.begin(), write_batch_size));
         }
 
-        write_queue_size.set(0);
+        write_queue_size.set(resource_operations_queue.size());
+        write_batches.inc();
+        write_batched_operations.inc(operations.size());
+
+        if (operation(new OperationRequest(operations, operation_result_cb, puts_confirmed_cb))) {
+            write_inflight++;
+        }
     }
 }
 
+void ResourceRedisConnection::on_linger_timer()
+{
+    AmLock l(queue_and_state_mutex);
+    linger_timer_armed = false;
+    process_operations_queue_unsafe();
+}
+
 void ResourceRedisConnection::process_operations_queue()
 {
     AmLock l(queue_and_state_mutex);
@@ -448,7 +585,19 @@ void ResourceRedisConnection::process_operation(const string &local_tag, const R
 {
     AmLock l(queue_and_state_mutex);
 
-    resource_operations_queue.emplace_back(local_tag, rl, op);
+    resource_operations_queue.emplace_back(local_tag, rl, op).queued_at = LatencyHistogram::clock::now();
+    write_queue_size.inc();
+
+    process_operations_queue_unsafe();
+}
+
+void ResourceRedisConnection::process_operation(const string &local_tag, ResourceList &&rl,
+                                                ResourcesOperation::Operation op, ResourceHandler handler)
+{
+    AmLock l(queue_and_state_mutex);
+
+    resource_operations_queue.emplace_back(local_tag, std::move(rl), op, handler).queued_at =
+        LatencyHistogram::clock::now();
     write_queue_size.inc();
 
     process_operations_queue_unsafe();
@@ -483,7 +632,8 @@ void ResourceRedisConnection::on_disconnect(const string &conn_id, const RedisCo
         resources_inited.set(false);
 
         resource_operations_queue.clear();
-        write_async_is_busy = false;
+        write_queue_size.set(0);
+        write_inflight = 0;
 
         if (disconnect_cb)
             disconnect_cb();
@@ -516,6 +666,10 @@ void ResourceRedisConnection::process_redis_reply_event(RedisReply &ev)
 
     case UserTypeId::Check:             process_check_resources_reply(ev); break;
 
+    case UserTypeId::Lease:             process_lease_resources_reply(ev); break;
+
+    case UserTypeId::CompensateInitial: process_compensate_resources_initial_reply(ev); break;
+
     case UserTypeId::None:
     {
         auto req = dynamic_cast<Request *>(ev.user_data.get());
@@ -535,12 +689,28 @@ void ResourceRedisConnection::process_invalidate_resources_initial_reply(RedisRe
     if (!req)
         return;
     INFO("initial resources invalidation is finished");
-    resources_inited.set(true);
-    Yeti::instance().postEvent(new YetiComponentInited(YetiComponentInited::Resource));
-    process_operations_queue();
+    on_initial_resources_state();
     req->on_finish();
 }
 
+void ResourceRedisConnection::process_compensate_resources_initial_reply(RedisReply &ev)
+{
+    auto req = dynamic_cast<CompensateRequest *>(ev.user_data.get());
+    if (!req)
+        return;
+
+    if (ev.result != RedisReply::SuccessReply) {
+        ERROR("initial resources compensation failed. fallback to the invalidation");
+        invalidate_initial(new InvalidateRequest(resources_initialized_cb));
+        return;
+    }
+
+    INFO("initial resources compensation is finished");
+    on_initial_resources_state();
+    if (resources_initialized_cb)
+        resources_initialized_cb(false, AmArg());
+}
+
 void ResourceRedisConnection::process_invalidate_resources_reply(RedisReply &ev)
 {
     auto req = dynamic_cast<InvalidateRequest *>(ev.user_data.get());
@@ -559,20 +729,24 @@ void ResourceRedisConnection::process_operation_resources_reply(RedisReply &ev)
         return;
     const bool is_error = ev.result != RedisReply::SuccessReply;
 
+    write_batch_latency.add(req->start_time);
+
     if (is_error)
         req->on_error(500, "operation resources reply failed");
     else
         req->on_finish();
 
     AmLock l(queue_and_state_mutex);
-    write_async_is_busy = false;
+    if (write_inflight)
+        write_inflight--;
     if (is_error) {
         // on error have to reset the connection and invalidate resources
         // redis::redisAsyncDisconnect(write_async->get_async_context());//!!!
         // resources_inited.set(false);
     } else if (!resources_inited.get()) {
         // for rpc command of invalidate resources(if connection was busy)
-        invalidate(new InvalidateRequest(resources_initialized_cb));
+        if (!write_inflight)
+            invalidate(new InvalidateRequest(resources_initialized_cb));
     } else {
         // trying the next operation after successful finished previous
         process_operations_queue_unsafe();
@@ -659,6 +833,22 @@ void ResourceRedisConnection::process_check_resources_reply(RedisReply &ev)
     }
 }
 
+void ResourceRedisConnection::process_lease_resources_reply(RedisReply &ev)
+{
+    auto req = dynamic_cast<LeaseRequest *>(ev.user_data.get());
+    if (!req)
+        return;
+
+    if (ev.result != RedisReply::SuccessReply) {
+        req->on_error(500, "reply error in the lease request");
+    } else if (!ev.data.isNumber()) {
+        req->on_error(500, "undesired lease reply from the storage");
+    } else {
+        req->set_result(ev.data);
+        req->on_finish();
+    }
+}
+
 void ResourceRedisConnection::process_jsonrpc_request(const JsonRpcRequestEvent &request)
 {
     switch (request.method_id) {
@@ -675,6 +865,7 @@ int ResourceRedisConnection::init()
 
     epoll_link(epoll_fd, true);
     stop_event.link(epoll_fd, true);
+    linger_timer.link(epoll_fd);
 
     auto cfg_conn_info = [](const RedisConfig &cfg, RedisConnectionInfo &info) {
         info.addrs = cfg.addrs;
@@ -692,6 +883,15 @@ int ResourceRedisConnection::init()
         { INVALIDATE_RESOURCES_SCRIPT, get_script_path(INVALIDATE_RESOURCES_SCRIPT) },
     };
 
+    if (lease_enabled || initial_compensation)
+        write_conn->info.scripts.push_back({ LEASE_RESOURCES_SCRIPT, get_script_path(LEASE_RESOURCES_SCRIPT) });
+
+    if (lease_enabled) {
+        lease_timer.reset(new AmTimerFd());
+        lease_timer->link(epoll_fd);
+        lease_timer->set(1000000, true);
+    }
+
     read_conn->info.scripts = {
         { GET_ALL_RESOURCES_SCRIPT, get_script_path(GET_ALL_RESOURCES_SCRIPT) },
         {   CHECK_RESOURCES_SCRIPT,   get_script_path(CHECK_RESOURCES_SCRIPT) }
@@ -706,7 +906,7 @@ bool ResourceRedisConnection::invalidate_resources_sync()
         INFO("resources will be invalidated after the connect");
     } else if (!resources_inited.get()) {
         INFO("resources are in invalidation process");
-    } else if (write_async_is_busy) {
+    } else if (write_inflight) {
         INFO("resources will be invalidated after the job finished");
     } else {
         invalidate(new InvalidateRequest(resources_initialized_cb));
@@ -730,11 +930,31 @@ void ResourceRedisConnection::registerOperationResultCallback(Request::cb_func f
     operation_result_cb = func;
 }
 
+void ResourceRedisConnection::registerLeaseTimerCallback(std::function<void()> func)
+{
+    lease_timer_cb = func;
+}
+
+void ResourceRedisConnection::registerPutsConfirmedCallback(puts_confirmed_cb_func func)
+{
+    puts_confirmed_cb = func;
+}
+
+void ResourceRedisConnection::set_initial_compensation(ResourceHandlersLog::Units &&units)
+{
+    initial_compensation = std::move(units);
+}
+
 void ResourceRedisConnection::put(const string &local_tag, const ResourceList &rl)
 {
     process_operation(local_tag, rl, ResourcesOperation::RES_PUT);
 }
 
+void ResourceRedisConnection::put(const string &local_tag, ResourceList &&rl, ResourceHandler handler)
+{
+    process_operation(local_tag, std::move(rl), ResourcesOperation::RES_PUT, handler);
+}
+
 void ResourceRedisConnection::get(const string &local_tag, ResourceList &rl)
 {
     for (auto &res : rl) {
@@ -774,9 +994,33 @@ ResourceResponse ResourceRedisConnection::get(const string &local_tag, ResourceL
     if (req->is_error())
         return ret;
 
-    bool  resources_available = true;
-    int   check_state         = CHECK_STATE_NORMAL;
-    AmArg result              = req->get_result();
+    return eval_check_result(local_tag, rl, req->get_result(), resource);
+}
+
+bool ResourceRedisConnection::check_async(const string &local_tag, const ResourceList &rl, unsigned int check_id)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    return check(new CheckRequest(rl, [local_tag, check_id, start_time](bool is_error, const AmArg &result) {
+        if (!session_container->postEvent(local_tag,
+                                          new ResourceCheckReplyEvent(check_id, is_error, result, start_time)))
+        {
+            DBG("%s: failed to post resources check reply. session is gone", local_tag.data());
+        }
+    }));
+}
+
+ResourceResponse ResourceRedisConnection::eval_check_result(const string &local_tag, ResourceList &rl,
+                                                            const AmArg &result, ResourceList::iterator &resource)
+{
+    resource = rl.begin();
+
+    if (!isArgArray(result) || result.size() > rl.size()) {
+        ERROR("%s: unexpected resources check result: %s", local_tag.data(), result.print().data());
+        return RES_ERR;
+    }
+
+    bool resources_available = true;
+    int  check_state         = CHECK_STATE_NORMAL;
     DBG("result: %s", result.print().data());
     for (size_t i = 0; i < result.size(); i++, ++resource) {
         Resource &res = *resource;
@@ -811,12 +1055,11 @@ ResourceResponse ResourceRedisConnection::get(const string &local_tag, ResourceL
 
     if (!resources_available) {
         DBG("resources are unavailable");
-        ret = RES_BUSY;
-    } else {
-        get(local_tag, rl);
-        ret = RES_SUCC;
+        return RES_BUSY;
     }
-    return ret;
+
+    get(local_tag, rl);
+    return RES_SUCC;
 }
 
 inline std::string serialize_redis_addrs(const vector<RedisAddr> addrs)
@@ -859,7 +1102,26 @@ bool ResourceRedisConnection::invalidate(InvalidateRequest *req)
 
 bool ResourceRedisConnection::operation(OperationRequest *req)
 {
-    return post_request(req, write_conn, nullptr, UserTypeId::Operation, false, true);
+    unique_ptr<OperationRequest> req_ptr(req);
+    vector<AmArg>                args;
+    // batch reduced to nothing is finished by the request itself
+    if (prepare_request(req, write_conn, nullptr, args) == false) {
+        return false;
+    }
+
+    auto put_handlers = req->get_put_handlers();
+    auto ev           = new RedisRequest(queue_name, write_conn->id, args, req_ptr.release(), (int)UserTypeId::Operation,
+                                         false, true);
+    if (session_container->postEvent(REDIS_APP_QUEUE, ev))
+        return true;
+
+    /* operations are lost with the event. drop their handlers from the log,
+     * otherwise they are kept until the restart */
+    ERROR("failed to post resources operations. drop %lu put handlers", put_handlers.size());
+    if (puts_confirmed_cb && !put_handlers.empty())
+        puts_confirmed_cb(put_handlers);
+
+    return false;
 }
 
 bool ResourceRedisConnection::get_all(GetAllRequest *req)
@@ -872,6 +1134,24 @@ bool ResourceRedisConnection::check(CheckRequest *req)
     return post_request(req, read_conn, CHECK_RESOURCES_SCRIPT, UserTypeId::Check);
 }
 
+bool ResourceRedisConnection::lease(LeaseRequest *req)
+{
+    return post_request(req, write_conn, LEASE_RESOURCES_SCRIPT, UserTypeId::Lease);
+}
+
+bool ResourceRedisConnection::compensate_initial(CompensateRequest *req)
+{
+    INFO("send initial resources compensation request");
+    return post_request(req, write_conn, LEASE_RESOURCES_SCRIPT, UserTypeId::CompensateInitial, false, true);
+}
+
+bool ResourceRedisConnection::lease(const Resource &r, int amount, Request::cb_func callback)
+{
+    if (!write_conn->is_connected)
+        return false;
+    return lease(new LeaseRequest(r, amount, callback));
+}
+
 /**
  * @brief Generates initialization delay value in seconds.
  * @return Random value between 0 and initialization_max_delay.
@@ -903,9 +1183,35 @@ void ResourceRedisConnection::start_initialization_timer(int seconds)
 
 void ResourceRedisConnection::on_initialization_timer()
 {
+    if (initial_compensation) {
+        // used once. reconnects are followed by the invalidation
+        ResourceHandlersLog::Units units = std::move(initial_compensation.value());
+        initial_compensation.reset();
+
+        if (units.empty()) {
+            INFO("no resources left by the previous run. skip initial invalidation");
+            on_initial_resources_state();
+            if (resources_initialized_cb)
+                resources_initialized_cb(false, AmArg());
+            return;
+        }
+
+        if (compensate_initial(new CompensateRequest(std::move(units))))
+            return;
+
+        ERROR("failed to send initial resources compensation. fallback to the invalidation");
+    }
+
     invalidate_initial(new InvalidateRequest(resources_initialized_cb));
 }
 
+void ResourceRedisConnection::on_initial_resources_state()
+{
+    resources_inited.set(true);
+    Yeti::instance().postEvent(new YetiComponentInited(YetiComponentInited::Resource));
+    process_operations_queue();
+}
+
 void ResourceRedisConnection::stop_initialization_timer()
 {
     if (initialization_timer.get()) {
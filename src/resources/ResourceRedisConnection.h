@@ -2,10 +2,15 @@
 
 #include "ResourceRedisClient.h"
 #include "Resource.h"
+#include "ResourceHandlersLog.h"
+#include "../LatencyHistogram.h"
 
 #include <ampi/JsonRPCEvents.h>
 #include <AmEventFdQueue.h>
 
+#include <chrono>
+#include <optional>
+
 extern const string RESOURCE_QUEUE_NAME;
 
 struct RedisConfig {
@@ -29,12 +34,32 @@ enum ResourceResponse {
     RES_ERR   // error occured on interaction with cache
 };
 
+/* result of the asynchronous resources check posted to the owner session */
+class ResourceCheckReplyEvent : public AmEvent {
+  public:
+    unsigned int                          check_id;
+    bool                                  is_error;
+    AmArg                                 result;
+    std::chrono::steady_clock::time_point start_time;
+
+    ResourceCheckReplyEvent(unsigned int check_id, bool is_error, const AmArg &result,
+                            std::chrono::steady_clock::time_point start_time)
+        : AmEvent(0)
+        , check_id(check_id)
+        , is_error(is_error)
+        , result(result)
+        , start_time(start_time)
+    {
+    }
+};
+
 class ResourceRedisConnection : public AmThread,
                                 public AmEventFdQueue,
                                 public AmEventHandler,
                                 public ResourceRedisClient {
   public:
-    using disconnect_cb_func = std::function<void()>;
+    using disconnect_cb_func     = std::function<void()>;
+    using puts_confirmed_cb_func = std::function<void(const vector<ResourceHandler> &)>;
 
     /* InvalidateRequest */
     class InvalidateRequest : public Request {
@@ -48,6 +73,7 @@ class ResourceRedisConnection : public AmThread,
     class OperationRequest : public Request {
       private:
         ResourcesOperationList operations;
+        puts_confirmed_cb_func puts_confirmed_cb;
 
         bool make_args_reduce(vector<AmArg> &args);
 
@@ -55,8 +81,15 @@ class ResourceRedisConnection : public AmThread,
         bool make_args(const string &script_hash, vector<AmArg> &args) override;
 
       public:
-        OperationRequest(ResourcesOperationList &rol, cb_func callback = nullptr);
+        LatencyHistogram::clock::time_point start_time;
+
+        OperationRequest(ResourcesOperationList &rol, cb_func callback = nullptr,
+                         puts_confirmed_cb_func puts_confirmed_cb = nullptr);
         const ResourcesOperationList &get_resource_operations() const;
+        vector<ResourceHandler>       get_put_handlers() const;
+
+        /* puts_confirmed_cb is called on success. it includes the batch reduced to nothing */
+        void on_finish() override;
     };
 
     /* GetAllRequest */
@@ -90,14 +123,45 @@ class ResourceRedisConnection : public AmThread,
 
       public:
         CheckRequest(const ResourceList &rl);
+        CheckRequest(const ResourceList &rl, cb_func callback);
         const ResourceList &get_resources() const;
     };
 
+    /* LeaseRequest */
+    class LeaseRequest : public Request {
+      private:
+        int    type;
+        string id;
+        int    limit;
+        int    amount;
+
+      protected:
+        bool make_args(const string &script_hash, vector<AmArg> &args) override;
+
+      public:
+        LeaseRequest(const Resource &r, int amount, cb_func callback);
+    };
+
+    /* CompensateRequest
+     * returns units left on the node counters by the previous run */
+    class CompensateRequest : public Request {
+      private:
+        ResourceHandlersLog::Units units;
+
+      protected:
+        bool make_args(const string &script_hash, vector<AmArg> &args) override;
+
+      public:
+        CompensateRequest(ResourceHandlersLog::Units &&units);
+    };
+
     bool invalidate_initial(InvalidateRequest *req);
     bool invalidate(InvalidateRequest *req);
     bool operation(OperationRequest *req);
     bool get_all(GetAllRequest *req);
     bool check(CheckRequest *req);
+    bool lease(LeaseRequest *req);
+    bool compensate_initial(CompensateRequest *req);
 
   private:
     int               epoll_fd;
@@ -109,8 +173,14 @@ class ResourceRedisConnection : public AmThread,
     RedisConfig readcfg;
 
     AmMutex                queue_and_state_mutex;
-    bool                   write_async_is_busy;       // guarded by queue_and_state_mutex
+    unsigned int           write_inflight;            // guarded by queue_and_state_mutex
     ResourcesOperationList resource_operations_queue; // guarded by queue_and_state_mutex
+    bool                   linger_timer_armed;        // guarded by queue_and_state_mutex
+
+    size_t                    write_batch_size;
+    std::chrono::microseconds write_batch_linger;
+    unsigned int              write_max_inflight;
+    AmTimerFd                 linger_timer;
 
     AmCondition<bool>     resources_inited;
     int                   initialization_max_delay;
@@ -119,14 +189,26 @@ class ResourceRedisConnection : public AmThread,
     void                  start_initialization_timer(int seconds);
     void                  on_initialization_timer();
     void                  stop_initialization_timer();
+    void                  on_initial_resources_state();
+
+    std::optional<ResourceHandlersLog::Units> initial_compensation;
+
+    bool                  lease_enabled;
+    unique_ptr<AmTimerFd> lease_timer;
 
-    AtomicCounter &write_queue_size;
+    AtomicCounter    &write_queue_size;
+    AtomicCounter    &write_batches;
+    AtomicCounter    &write_batched_operations;
+    LatencyHistogram &write_batch_latency;
 
-    Request::cb_func   resources_initialized_cb;
-    Request::cb_func   operation_result_cb;
-    disconnect_cb_func disconnect_cb;
+    Request::cb_func      resources_initialized_cb;
+    Request::cb_func       operation_result_cb;
+    disconnect_cb_func     disconnect_cb;
+    std::function<void()>  lease_timer_cb;
+    puts_confirmed_cb_func puts_confirmed_cb;
 
     void process_operations_queue_unsafe();
+    void on_linger_timer();
 
   protected:
     int  cfg2RedisCfg(cfg_t *cfg, RedisConfig &rcfg);
@@ -134,6 +216,8 @@ class ResourceRedisConnection : public AmThread,
 
     void process_operations_queue();
     void process_operation(const string &local_tag, const ResourceList &rl, ResourcesOperation::Operation op);
+    void process_operation(const string &local_tag, ResourceList &&rl, ResourcesOperation::Operation op,
+                           ResourceHandler handler = 0);
     void process_operations_list(ResourcesOperationList &rol);
 
     void connect(const Connection &conn) override;
@@ -151,6 +235,8 @@ class ResourceRedisConnection : public AmThread,
     void process_operation_resources_reply(RedisReply &ev);
     void process_get_all_resources_reply(RedisReply &ev);
     void process_check_resources_reply(RedisReply &ev);
+    void process_lease_resources_reply(RedisReply &ev);
+    void process_compensate_resources_initial_reply(RedisReply &ev);
     void process_jsonrpc_request(const JsonRpcRequestEvent &event);
 
   public:
@@ -167,17 +253,39 @@ class ResourceRedisConnection : public AmThread,
     void registerDisconnectCallback(disconnect_cb_func func);
     void registerResourcesInitializedCallback(Request::cb_func func);
     void registerOperationResultCallback(Request::cb_func func);
+    /* called every second from the connection thread if leases are enabled */
+    void registerLeaseTimerCallback(std::function<void()> func);
+    /* called with handlers of the RES_PUT operations confirmed by the redis */
+    void registerPutsConfirmedCallback(puts_confirmed_cb_func func);
+
+    /* initial invalidation is replaced by the return of units
+     * left by the previous run of the node (see ResourceHandlersLog) */
+    void set_initial_compensation(ResourceHandlersLog::Units &&units);
 
     void             put(const string &local_tag, const ResourceList &rl);
+    void             put(const string &local_tag, ResourceList &&rl, ResourceHandler handler = 0);
     void             get(const string &local_tag, ResourceList &rl);
     ResourceResponse get(const string &local_tag, ResourceList &rl, ResourceList::iterator &resource);
 
+    /* posts check request and returns immediately.
+     * result is delivered to the session local_tag as ResourceCheckReplyEvent */
+    bool check_async(const string &local_tag, const ResourceList &rl, unsigned int check_id);
+    /* evaluates check result and grabs resources on success */
+    ResourceResponse eval_check_result(const string &local_tag, ResourceList &rl, const AmArg &result,
+                                       ResourceList::iterator &resource);
+
+    /* reserves (amount > 0) or returns (amount < 0) units of the resource for the node.
+     * callback gets reserved/returned units count */
+    bool lease(const Resource &r, int amount, Request::cb_func callback);
+
+    int get_read_timeout() const { return readcfg.timeout; }
+
     bool get_resource_state(const string &connection_id, const AmArg &request_id, const AmArg &params);
 
     Connection *get_write_conn() { return write_conn; }
     Connection *get_read_conn() { return read_conn; }
 
-    enum UserTypeId { InvalidateInitial = 1000, Invalidate, Operation, GetAll, Check, None };
+    enum UserTypeId { InvalidateInitial = 1000, Invalidate, Operation, GetAll, Check, Lease, CompensateInitial, None };
 
     bool post_request(Request *req, Connection *conn, const char *script_name = nullptr, UserTypeId user_type_id = None,
                       bool persistent_ctx = false, bool multi = false);
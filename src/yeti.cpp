@@ -17,6 +17,7 @@
 #include "ampi/IdentityValidatorApi.h"
 #include "sip/resolver.h"
 #include "ObjectsCounter.h"
+#include "CallSetupStats.h"
 
 #include "cfg/yeti_opts.h"
 #include "cfg/statistics_opts.h"
@@ -32,6 +33,11 @@
 
 #define LOG_BUF_SIZE 2048
 
+// token suffix of the cfg timer mappings delta reload queries
+#define CFG_DELTA_TOKEN_SUFFIX "/delta"
+// separates the requested db state version in the cfg timer mappings reload tokens
+#define CFG_VERSION_TOKEN_SEPARATOR '@'
+
 string yeti_auth_feedback_header("X-Yeti-Auth-Error: ");
 
 void cfg_reader_error(cfg_t *cfg, const char *fmt, va_list ap)
@@ -68,11 +74,45 @@ void Yeti::cfg_timer_mapping_entry::init_counters(const string &key)
     reload_count_counter =
         &stat_group(Counter, MOD_NAME, "config_reload_count").addAtomicCounter().addLabel("type", key);
     reload_time_counter = &stat_group(Counter, MOD_NAME, "config_reload_time").addAtomicCounter().addLabel("type", key);
+    delta_reload_count_counter =
+        &stat_group(Counter, MOD_NAME, "config_delta_reload_count").addAtomicCounter().addLabel("type", key);
+    delta_fallback_counter =
+        &stat_group(Counter, MOD_NAME, "config_delta_fallback_count").addAtomicCounter().addLabel("type", key);
+}
+
+static string cfg_reload_token(const string &key, std::optional<int> version)
+{
+    if (!version)
+        return key;
+    return key + CFG_VERSION_TOKEN_SEPARATOR + std::to_string(version.value());
 }
 
-void Yeti::cfg_timer_mapping_entry::reload(const string &key)
+void Yeti::cfg_timer_mapping_entry::reload(const string &key, std::optional<int> version)
 {
-    if (on_reload(key) == false)
+    if (delta_enabled && applied_version && version && version.value() > applied_version.value()) {
+        if (on_delta_reload(cfg_reload_token(key, version) + CFG_DELTA_TOKEN_SUFFIX, applied_version.value())) {
+            delta_reload_count_counter->inc();
+            reload_start_time = std::chrono::steady_clock::now();
+            return;
+        }
+    }
+
+    if (on_reload(cfg_reload_token(key, version)) == false)
+        return;
+
+    reload_count_counter->inc();
+    reload_start_time = std::chrono::steady_clock::now();
+}
+
+void Yeti::cfg_timer_mapping_entry::fallback_reload(const string &key, std::optional<int> version)
+{
+    WARN("delta reload failed for '%s'. fallback to the full reload", key.data());
+
+    delta_fallback_counter->inc();
+    // do not trust the cache state until the full reload is applied
+    applied_version.reset();
+
+    if (on_reload(cfg_reload_token(key, version)) == false)
         return;
 
     reload_count_counter->inc();
@@ -88,6 +128,8 @@ void Yeti::cfg_timer_mapping_entry::on_finish_reload()
 
 Yeti::Yeti()
     : AmEventFdQueue(this)
+    , check_states_in_progress(false)
+    , check_states_pending(false)
 {
     initCfgTimerMappings();
 }
@@ -124,6 +166,9 @@ int Yeti::configure(const std::string &config_buf)
     if (config.configure(confuse_cfg, cfg))
         return -1;
 
+    for (auto &[key, mapping] : db_config_timer_mappings)
+        mapping.delta_enabled = config.db_delta_reloads && mapping.on_delta_reload;
+
     return 0;
 }
 
@@ -143,6 +188,9 @@ static void init_counters()
     ObjCounterInit(Cdr);
     ObjCounterInit(AuthCdr);
     ObjCounterInit(SqlCallProfile);
+
+    // register call setup stages histograms before the first call
+    CallSetupStats::instance();
 }
 
 int Yeti::onLoad()
@@ -223,16 +271,31 @@ int Yeti::onLoad()
         return -1;
     }
 
+    // serve calls with the last saved config until it is loaded from the DB.
+    // must be done before the reload timer arming. timer handler saves the snapshot
+    loadConfigSnapshot();
+
     db_cfg_reload_timer.link(epoll_fd);
-    db_cfg_reload_timer.set(std::chrono::duration_cast<std::chrono::microseconds>(config.db_refresh_interval).count(),
-                            true);
+    setDbCfgReloadInterval(config.db_refresh_interval);
+
+    if (!config.db_listen_channel.empty() &&
+        states_listener.configure(config.routing_db_master, config.db_listen_channel, YETI_QUEUE_NAME))
+    {
+        ERROR("config states listener configure failed");
+        return -1;
+    }
 
     http_sequencer.setHttpDestinationName(config.http_events_destination);
 
     // start threads
     rctl.start();
+    router.getCdrWriter().start();
+    if (router.getGetProfileBatcher().enabled())
+        router.getGetProfileBatcher().start();
     if (cdr_list.getSnapshotsEnabled())
         cdr_list.start();
+    if (!config.db_listen_channel.empty())
+        states_listener.start();
 
     configuration_finished = true;
 
@@ -277,6 +340,7 @@ void Yeti::run()
             f                           = e.data.fd;
 
             if (f == db_cfg_reload_timer) {
+                config_snapshot.save();
                 checkStates();
                 db_cfg_reload_timer.read();
             } else if (f == -queue_fd()) {
@@ -286,6 +350,8 @@ void Yeti::run()
         }
     } while (!stopped);
 
+    config_snapshot.save();
+
     AmEventDispatcher::instance()->delEventQueue(YETI_QUEUE_NAME);
 
     DBG3("yeti-worker finished");
@@ -298,7 +364,12 @@ void Yeti::on_stop()
     DBG3("Yeti::on_stop");
 
     cdr_list.stop();
+    if (!config.db_listen_channel.empty())
+        states_listener.stop(true);
     rctl.stop();
+    if (router.getGetProfileBatcher().enabled())
+        router.getGetProfileBatcher().stop();
+    router.getCdrWriter().stop();
 
     stopped = true;
 #pragma GCC diagnostic push
@@ -327,32 +398,30 @@ void Yeti::process(AmEvent *ev)
     }
     else ON_EVENT_TYPE(PGResponse) {
         if (configuration_finished) {
-            auto it_req     = db_requests.find(e->token);
-            auto it_cfg_map = db_config_timer_mappings.find(e->token);
+            auto               it_req = db_requests.find(e->token);
+            string             cfg_key;
+            bool               delta;
+            std::optional<int> version;
+            auto               cfg_entry = findCfgTimerMapping(e->token, cfg_key, delta, version);
             if (it_req != db_requests.end()) {
                 it_req->second.on_db_response(*e);
                 db_requests.erase(it_req);
-            } else if (it_cfg_map != db_config_timer_mappings.end()) {
-                bool exception = true;
-                try {
-                    DBG("call on_db_response() for '%s'", e->token.data());
-                    it_cfg_map->second.on_db_response(*e);
-                    exception = false;
-                } catch (AmArg::OutOfBoundsException &) {
-                    ERROR("AmArg::OutOfBoundsException in cfg timer handler: %s", e->token.data());
-                } catch (AmArg::TypeMismatchException &) {
-                    ERROR("AmArg::TypeMismatchException in cfg timer handler: %s", e->token.data());
-                } catch (std::exception &exc) {
-                    ERROR("std::exception in cfg timer handler '%s': %s", e->token.data(), exc.what());
-                } catch (std::string &s) {
-                    ERROR("cfg timer handler %s exception: %s", e->token.data(), s.data());
-                } catch (...) {
-                    ERROR("exception in cfg timer handler: %s", e->token.data());
-                }
-
-                it_cfg_map->second.on_finish_reload();
+            } else if (cfg_entry && cfg_entry->is_stale(version)) {
+                cfg_entry->on_finish_reload();
+                DBG("skip '%s' response older than the applied version %d", e->token.data(),
+                    cfg_entry->applied_version.value());
+            } else if (cfg_entry) {
+                bool exception = !processCfgTimerMappingResponse(*cfg_entry, *e, delta);
+                cfg_entry->on_finish_reload();
                 if (exception) {
-                    it_cfg_map->second.exceptions_counter->inc();
+                    cfg_entry->exceptions_counter->inc();
+                    // cache may be patched partially. reload it completely
+                    if (delta)
+                        cfg_entry->fallback_reload(cfg_key, version);
+                } else {
+                    cfg_entry->applied_version = version;
+                    if (!delta)
+                        config_snapshot.update(cfg_key, version, e->result);
                 }
             } else {
                 ERROR("unknown db response token: %s", e->token.data());
@@ -366,14 +435,19 @@ void Yeti::process(AmEvent *ev)
     else ON_EVENT_TYPE(PGResponseError) {
         ERROR("got PGResponseError '%s' for token: %s", e->error.data(), e->token.data());
         if (configuration_finished) {
-            auto it_req     = db_requests.find(e->token);
-            auto it_cfg_map = db_config_timer_mappings.find(e->token);
+            auto               it_req = db_requests.find(e->token);
+            string             cfg_key;
+            bool               delta;
+            std::optional<int> version;
+            auto               cfg_entry = findCfgTimerMapping(e->token, cfg_key, delta, version);
             if (it_req != db_requests.end()) {
                 it_req->second.on_db_error(*e);
                 db_requests.erase(it_req);
-            } else if (it_cfg_map != db_config_timer_mappings.end()) {
-                it_cfg_map->second.on_finish_reload();
-                it_cfg_map->second.exceptions_counter->inc();
+            } else if (cfg_entry) {
+                cfg_entry->on_finish_reload();
+                cfg_entry->exceptions_counter->inc();
+                if (delta)
+                    cfg_entry->fallback_reload(cfg_key, version);
             } else {
                 ERROR("unknown db response token: %s", e->token.data());
             }
@@ -385,14 +459,19 @@ void Yeti::process(AmEvent *ev)
     else ON_EVENT_TYPE(PGTimeout) {
         ERROR("got PGTimeout for token: %s", e->token.data());
         if (configuration_finished) {
-            auto it_req     = db_requests.find(e->token);
-            auto it_cfg_map = db_config_timer_mappings.find(e->token);
+            auto               it_req = db_requests.find(e->token);
+            string             cfg_key;
+            bool               delta;
+            std::optional<int> version;
+            auto               cfg_entry = findCfgTimerMapping(e->token, cfg_key, delta, version);
             if (it_req != db_requests.end()) {
                 it_req->second.on_db_timeout(*e);
                 db_requests.erase(it_req);
-            } else if (it_cfg_map != db_config_timer_mappings.end()) {
-                it_cfg_map->second.on_finish_reload();
-                it_cfg_map->second.exceptions_counter->inc();
+            } else if (cfg_entry) {
+                cfg_entry->on_finish_reload();
+                cfg_entry->exceptions_counter->inc();
+                if (delta)
+                    cfg_entry->fallback_reload(cfg_key, version);
             } else {
                 ERROR("unknown db response token: %s", e->token.data());
             }
@@ -417,6 +496,21 @@ void Yeti::process(AmEvent *ev)
                 it_cfg_map->second.exceptions_counter->inc();
         }
     }
+    else ON_EVENT_TYPE(ConfigStatesEvent) {
+        switch (e->type) {
+        case ConfigStatesEvent::Connected:
+            // polling is the safety net while subscribed. check changes missed while disconnected
+            setDbCfgReloadInterval(config.db_listen_refresh_interval);
+            [[fallthrough]];
+        case ConfigStatesEvent::Changed:
+            if (check_states_in_progress)
+                check_states_pending = true;
+            else
+                checkStates();
+            break;
+        case ConfigStatesEvent::Disconnected: setDbCfgReloadInterval(config.db_refresh_interval); break;
+        }
+    }
     else ON_EVENT_TYPE(YetiComponentInited) {
         component_inited[e->type] = true;
     }
@@ -482,6 +576,19 @@ void Yeti::initCfgTimerMappings()
             return AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, query);
         }, [&](const PGResponse &e) {
             orig_pre_auth.reloadLoadIPAuth(e.result);
+        }, [&](const string &token, int version) {
+            // full reload is used if the entries are loaded without ids
+            if (!orig_pre_auth.isIPAuthDeltaSupported())
+                return false;
+            auto query = new PGParamExecute(
+                PGQueryData(yeti_routing_pg_worker, "SELECT * FROM load_ip_auth2_delta($1,$2,$3)",
+                true, /* single */
+                YETI_QUEUE_NAME, token),
+                PGTransactionData(), false);
+            query->addParam(AmConfig.node_id).addParam(config.pop_id).addParam(version);
+            return AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, query);
+        }, [&](const PGResponse &e) {
+            orig_pre_auth.applyIPAuthDelta(e.result);
         } }
     },
     { "trusted_lb",
@@ -612,6 +719,16 @@ void Yeti::initCfgTimerMappings()
             return yeti_routing_db_query("SELECT * FROM load_incoming_auth()", key);
         }, [&](const PGResponse &e) {
             router.reload_credentials(e.result);
+        }, [&](const string &token, int version) {
+            auto query = new PGParamExecute(
+                PGQueryData(yeti_routing_pg_worker, "SELECT * FROM load_incoming_auth_delta($1)",
+                true, /* single */
+                YETI_QUEUE_NAME, token),
+                PGTransactionData(), false);
+            query->addParam(version);
+            return AmEventDispatcher::instance()->post(POSTGRESQL_QUEUE, query);
+        }, [&](const PGResponse &e) {
+            router.apply_credentials_delta(e.result);
         } }
     },
     // OptionsProberManager
@@ -638,6 +755,7 @@ void Yeti::initCfgTimerMappings()
             return false;
         }, [&](const PGResponse &e) {
             gateways_cache_aleg.update(e.result);
+            router.clear_jwt_auth_cache();
         } }
     },
     { "bleg_gateways_cache",
@@ -664,7 +782,8 @@ void Yeti::initCfgTimerMappings()
         { [&](const string &key) {
             return yeti_routing_db_query("SELECT * FROM load_callprofiles()", key);
         }, [&](const PGResponse &e) {
-            callprofiles_cache.load_callprofiles(e);
+            callprofiles_cache.load_callprofiles(e, router.getDynFields(), router.get_lega_gw_cache_key(),
+                                                 router.get_legb_gw_cache_key());
         } }
     },
     }; //db_config_timer_mappings
@@ -673,11 +792,93 @@ void Yeti::initCfgTimerMappings()
 
     stat_group(Counter, MOD_NAME, "config_reload_count").setHelp("db_state reload counter");
     stat_group(Counter, MOD_NAME, "config_reload_time").setHelp("aggregated db_state reload time in msec");
+    stat_group(Counter, MOD_NAME, "config_delta_reload_count").setHelp("db_state delta reload counter");
+    stat_group(Counter, MOD_NAME, "config_delta_fallback_count")
+        .setHelp("db_state delta reloads failed and replaced with the full reload");
 
     for (auto &mapping : db_config_timer_mappings)
         mapping.second.init_counters(mapping.first);
 }
 
+bool Yeti::processCfgTimerMappingResponse(cfg_timer_mapping_entry &entry, const PGResponse &e, bool delta)
+{
+    try {
+        DBG("call on_db_response() for '%s'", e.token.data());
+        if (delta)
+            entry.on_delta_db_response(e);
+        else
+            entry.on_db_response(e);
+        return true;
+    } catch (AmArg::OutOfBoundsException &) {
+        ERROR("AmArg::OutOfBoundsException in cfg timer handler: %s", e.token.data());
+    } catch (AmArg::TypeMismatchException &) {
+        ERROR("AmArg::TypeMismatchException in cfg timer handler: %s", e.token.data());
+    } catch (std::exception &exc) {
+        ERROR("std::exception in cfg timer handler '%s': %s", e.token.data(), exc.what());
+    } catch (std::string &s) {
+        ERROR("cfg timer handler %s exception: %s", e.token.data(), s.data());
+    } catch (...) {
+        ERROR("exception in cfg timer handler: %s", e.token.data());
+    }
+    return false;
+}
+
+void Yeti::loadConfigSnapshot()
+{
+    ConfigSnapshot::Entries entries;
+
+    config_snapshot.configure(config.config_snapshot_path, AmConfig.node_id, config.pop_id);
+    if (!config_snapshot.load(entries))
+        return;
+
+    db_cfg_states.assertStruct();
+
+    for (auto &[key, entry] : entries) {
+        auto it = db_config_timer_mappings.find(key);
+        if (it == db_config_timer_mappings.end())
+            continue;
+
+        if (!processCfgTimerMappingResponse(it->second, PGResponse(entry.data, key), false)) {
+            it->second.exceptions_counter->inc();
+            continue;
+        }
+
+        if (entry.version == ConfigSnapshot::unknown_version)
+            continue;
+
+        // reconcile with the DB states on the first check_states() reply
+        db_cfg_states[key]         = entry.version;
+        it->second.applied_version = entry.version;
+        warm_started_states.emplace(key);
+    }
+
+    INFO("config snapshot: %zd caches are loaded, %zd of them are versioned", entries.size(),
+         warm_started_states.size());
+}
+
+Yeti::cfg_timer_mapping_entry *Yeti::findCfgTimerMapping(const string &token, string &key, bool &delta,
+                                                         std::optional<int> &version)
+{
+    static const string delta_suffix(CFG_DELTA_TOKEN_SUFFIX);
+
+    delta = token.ends_with(delta_suffix);
+    key   = delta ? token.substr(0, token.size() - delta_suffix.size()) : token;
+
+    version.reset();
+    if (auto pos = key.rfind(CFG_VERSION_TOKEN_SEPARATOR); pos != string::npos) {
+        int v;
+        if (str2int(key.substr(pos + 1), v)) {
+            version = v;
+            key.resize(pos);
+        }
+    }
+
+    auto it = db_config_timer_mappings.find(key);
+    if (it == db_config_timer_mappings.end())
+        return nullptr;
+    return &it->second;
+}
+
 void Yeti::onCheckStatesReply(const PGResponse &e)
 {
     const AmArg &r = e.result[0];
@@ -690,26 +891,48 @@ void Yeti::onCheckStatesReply(const PGResponse &e)
 
     for (auto &a : r) {
         // DBG("%s: %d",a.first.data(),a.second.asInt());
-        if (!db_cfg_states.hasMember(a.first) || a.second.asInt() > db_cfg_states[a.first].asInt()) {
+        bool changed = !db_cfg_states.hasMember(a.first) || a.second.asInt() > db_cfg_states[a.first].asInt();
+        // DB state could be rolled back since the config snapshot was saved
+        if (!changed && warm_started_states.contains(a.first))
+            changed = a.second.asInt() != db_cfg_states[a.first].asInt();
+        if (changed) {
             DBG("new or newer db_state %d for: %s", a.second.asInt(), a.first.data());
             if (deprecated_states.contains(a.first)) {
                 DBG("skip deprecated db_state: %s", a.first.data());
                 continue;
             }
             if (auto it = db_config_timer_mappings.find(a.first); it != db_config_timer_mappings.end()) {
-                it->second.reload(it->first);
+                it->second.reload(it->first, a.second.asInt());
             } else {
                 DBG2("unknown db_state: %s", a.first.data());
             }
         }
     }
     db_cfg_states = r;
+    warm_started_states.clear();
+}
+
+void Yeti::onCheckStatesFinished()
+{
+    check_states_in_progress = false;
+    if (check_states_pending) {
+        check_states_pending = false;
+        checkStates();
+    }
+}
+
+void Yeti::setDbCfgReloadInterval(std::chrono::seconds interval)
+{
+    DBG("set db states polling interval to %ld seconds", interval.count());
+    db_cfg_reload_timer.set(std::chrono::duration_cast<std::chrono::microseconds>(interval).count(), true);
 }
 
 void Yeti::checkStates() noexcept
 {
     string token = AmSession::getNewId();
 
+    check_states_in_progress = true;
+
     // clang-format off
     db_requests.emplace(
         token,
@@ -720,9 +943,10 @@ void Yeti::checkStates() noexcept
                 } catch (...) {
                     DBG("exception on check db state response processing");
                 }
+                onCheckStatesFinished();
             },
-            [](const PGResponseError &) {},
-            [](const PGTimeout &) {}
+            [&](const PGResponseError &) { onCheckStatesFinished(); },
+            [&](const PGTimeout &) { onCheckStatesFinished(); }
         )
     );
 
@@ -6,11 +6,15 @@
 #include "HttpSequencer.h"
 #include "SigningKeysCache.h"
 #include "DbConfigStates.h"
+#include "db/ConfigSnapshot.h"
+#include "db/ConfigStatesListener.h"
 
 #include <AmEventFdQueue.h>
 #include "ampi/SipRegistrarApi.h"
 
 #include <chrono>
+#include <optional>
+#include <set>
 
 extern string yeti_auth_feedback_header;
 
@@ -28,23 +32,51 @@ class Yeti : public YetiRpc,
     bool         is_registrar_availbale;
     bool         is_identity_validator_availbale;
 
+    /* entries with on_delta_reload set support the incremental reload.
+     * on_delta_reload(token, version) requests rows changed since the applied version
+     * and on_delta_db_response() patches the cache in place.
+     * full reload is used for the first load and as the fallback on the delta failure.
+     * requested db state version is carried by the request token (see cfg_reload_token()),
+     * so responses of the overlapping reloads are applied with their own versions
+     * and responses older than the applied version are skipped */
     struct cfg_timer_mapping_entry {
-        std::function<bool(const string &key)>   on_reload;
-        std::function<void(const PGResponse &e)> on_db_response;
-        AtomicCounter                           *exceptions_counter   = nullptr;
-        AtomicCounter                           *reload_count_counter = nullptr;
-        AtomicCounter                           *reload_time_counter  = nullptr;
-        std::chrono::steady_clock::time_point    reload_start_time{};
+        std::function<bool(const string &key)>                on_reload;
+        std::function<void(const PGResponse &e)>              on_db_response;
+        std::function<bool(const string &token, int version)> on_delta_reload;
+        std::function<void(const PGResponse &e)>              on_delta_db_response;
+        AtomicCounter                                        *exceptions_counter         = nullptr;
+        AtomicCounter                                        *reload_count_counter       = nullptr;
+        AtomicCounter                                        *reload_time_counter        = nullptr;
+        AtomicCounter                                        *delta_reload_count_counter = nullptr;
+        AtomicCounter                                        *delta_fallback_counter     = nullptr;
+        std::chrono::steady_clock::time_point                 reload_start_time{};
+        bool                                                  delta_enabled = false;
+        std::optional<int>                                    applied_version;
         cfg_timer_mapping_entry(std::function<bool(const string &key)>   on_reload,
                                 std::function<void(const PGResponse &e)> on_db_response)
             : on_reload(on_reload)
             , on_db_response(on_db_response)
         {
         }
+        cfg_timer_mapping_entry(std::function<bool(const string &key)>                on_reload,
+                                std::function<void(const PGResponse &e)>              on_db_response,
+                                std::function<bool(const string &token, int version)> on_delta_reload,
+                                std::function<void(const PGResponse &e)>              on_delta_db_response)
+            : on_reload(on_reload)
+            , on_db_response(on_db_response)
+            , on_delta_reload(on_delta_reload)
+            , on_delta_db_response(on_delta_db_response)
+        {
+        }
 
         void init_counters(const string &key);
-        void reload(const string &key);
+        void reload(const string &key, std::optional<int> version = std::nullopt);
+        void fallback_reload(const string &key, std::optional<int> version);
         void on_finish_reload();
+        bool is_stale(std::optional<int> version) const
+        {
+            return version && applied_version && version.value() < applied_version.value();
+        }
     };
 
     struct db_req_entry {
@@ -63,9 +95,25 @@ class Yeti : public YetiRpc,
     map<string, cfg_timer_mapping_entry> db_config_timer_mappings;
     map<string, db_req_entry>            db_requests;
 
+    ConfigSnapshot   config_snapshot;
+    std::set<string> warm_started_states; // loaded from the config snapshot and not checked against the DB yet
+
+    ConfigStatesListener states_listener;
+    bool                 check_states_in_progress;
+    bool                 check_states_pending; // changes notified while check_states() query is in progress
+
     void initCfgTimerMappings();
+    /* resolves PGResponse token to the mapping entry. delta is set for the delta reload responses.
+     * version is the db state version requested by the reload */
+    cfg_timer_mapping_entry *findCfgTimerMapping(const string &token, string &key, bool &delta,
+                                                 std::optional<int> &version);
+    /* returns false on the handler exception */
+    bool processCfgTimerMappingResponse(cfg_timer_mapping_entry &entry, const PGResponse &e, bool delta);
+    void loadConfigSnapshot();
     void onCheckStatesReply(const PGResponse &e);
+    void onCheckStatesFinished();
     void checkStates() noexcept;
+    void setDbCfgReloadInterval(std::chrono::seconds interval);
     void showStates(const JsonRpcRequestEvent &e);
 
     bool verifyHttpDestinations();
@@ -31,6 +31,7 @@ bool                yeti_routing_db_query(const string &query, const string &tok
 #define YETI_RADIUS_INTERIM_TIMER  (SBC_TIMER_ID_CALL_TIMERS_START + 2)
 #define YETI_FAKE_RINGING_TIMER    (SBC_TIMER_ID_CALL_TIMERS_START + 3)
 #define YETI_REFER_TIMEOUT_TIMER   (SBC_TIMER_ID_CALL_TIMERS_START + 4)
+#define YETI_RESOURCES_CHECK_TIMER (SBC_TIMER_ID_CALL_TIMERS_START + 5)
 
 #if YETI_ENABLE_PROFILING
 
@@ -402,7 +402,7 @@ bool YetiRpc::getCallsFields(const string &connection_id, const AmArg &request_i
     }
 
     struct CallFields {
-        cmp_rules      filter_rules;
+        cmp_filter     filter;
         vector<string> fields;
         string         connection_id;
         AmArg          request_id;
@@ -417,7 +417,7 @@ bool YetiRpc::getCallsFields(const string &connection_id, const AmArg &request_i
     CallFields *call_fields = new CallFields(connection_id, request_id);
 
     try {
-        parse_fields(call_fields->filter_rules, args, call_fields->fields);
+        parse_fields(call_fields->filter, args, call_fields->fields);
         cdr_list.validate_fields(call_fields->fields);
     } catch (std::string &s) {
         throw AmSession::Exception(500, s);
@@ -429,14 +429,12 @@ bool YetiRpc::getCallsFields(const string &connection_id, const AmArg &request_i
             if (!leg)
                 return;
 
-            CallFields      *call_fields  = (CallFields *)user_data;
-            YetiRpc         &rpc          = Yeti::instance();
-            const cmp_rules &filter_rules = call_fields->filter_rules;
-            vector<string>   fields       = call_fields->fields;
+            CallFields *call_fields = (CallFields *)user_data;
+            YetiRpc    &rpc         = Yeti::instance();
 
             ret.assertArray();
             ret.push(AmArg());
-            if (!rpc.cdr_list.getCallsFields(leg, ret.back(), filter_rules, fields)) {
+            if (!rpc.cdr_list.getCallsFields(leg, ret.back(), call_fields->filter, call_fields->fields)) {
                 ret.pop_back();
             }
         },
@@ -623,18 +621,17 @@ void YetiRpc::RemoveCall(SBCCallLeg *leg, AmArg &ret)
         return;
     }
 
-    if (p->resource_handler.empty()) {
+    if (!p->resource_handler) {
         ret.push("empty resource handler");
         return;
     }
 
-    INFO("put resource_handler:'%s' for local_tag:'%s'", p->resource_handler.data(), local_tag.data());
+    INFO("put resource_handler:%lu for local_tag:'%s'", p->resource_handler, local_tag.data());
 
     static const string ret_prefix("put resource handler: ");
-    ret.push(ret_prefix + p->resource_handler);
+    ret.push(ret_prefix + std::to_string(p->resource_handler));
 
-    string resource_handler = p->resource_handler;
-    leg->rctl.put(resource_handler);
+    leg->rctl.put(p->resource_handler);
 
     if (AmSessionContainer::instance()->postEvent(local_tag, new SBCControlEvent("teardown"))) {
         ret.push("found in sessions container. teardown event sent");
@@ -881,13 +878,22 @@ void YetiRpc::showResources(const AmArg &args, AmArg &ret)
     rctl.showResources(ret);
 }
 
+static ResourceHandler parseResourceHandler(const AmArg &a)
+{
+    long long h;
+    if (!str2longlong(a.asCStr(), h) || h <= 0) {
+        throw AmSession::Exception(500, "invalid handler id");
+    }
+    return static_cast<ResourceHandler>(h);
+}
+
 void YetiRpc::showResourceByHandler(const AmArg &args, AmArg &ret)
 {
     handler_log();
     if (!args.size()) {
         throw AmSession::Exception(500, "specify handler id");
     }
-    rctl.showResourceByHandler(args.get(0).asCStr(), ret);
+    rctl.showResourceByHandler(parseResourceHandler(args.get(0)), ret);
 }
 
 void YetiRpc::showResourceByLocalTag(const AmArg &args, AmArg &ret)
@@ -933,7 +939,7 @@ void YetiRpc::requestResourcesHandlerInvalidate(const AmArg &args, AmArg &ret)
 {
     handler_log();
     args.assertArrayFmt("s");
-    rctl.put(args.get(0).asCStr());
+    rctl.put(parseResourceHandler(args.get(0)));
     ret = RPC_CMD_SUCC;
 }
 
@@ -0,0 +1,222 @@
+#include "YetiTest.h"
+#include "../src/Auth.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+TEST_F(YetiTest, AuthCredentialsDelta)
+{
+    GatewaysCacheALeg gateways_cache;
+    Auth              auth(gateways_cache);
+
+    auth.reload_credentials({
+        AmArg{ { "id", 1 }, { "username", "u1" }, { "password", "p1" } },
+        AmArg{ { "id", 2 }, { "username", "shared" }, { "password", "p2" } },
+        AmArg{ { "id", 3 }, { "username", "shared" }, { "password", "p3" } },
+        AmArg{ { "id", 4 }, { "allow_jwt_auth", true }, { "jwt_gid", "g4" } },
+    });
+
+    AmArg ret;
+    auth.auth_info(ret);
+    ASSERT_EQ(ret["users"].size(), 4);
+    ASSERT_EQ(ret["jwt_gid"]["g4"].asInt(), 4);
+
+    auth.apply_credentials_delta({
+        // changed password
+        AmArg{ { "id", 1 }, { "username", "u1" }, { "password", "p1_new" } },
+        // removed. credentials of the id 3 with the same username are kept
+        AmArg{ { "id", 2 }, { "deleted", true } },
+        // jwt auth replaced by the credentials
+        AmArg{ { "id", 4 }, { "username", "u4" }, { "password", "p4" } },
+        // new
+        AmArg{ { "id", 5 }, { "allow_jwt_auth", true }, { "jwt_gid", "g5" } },
+    });
+
+    ret.clear();
+    auth.auth_info_by_user("u1", ret);
+    ASSERT_EQ(ret.size(), 1);
+    ASSERT_EQ(ret[0]["pwd"], AmArg("p1_new"));
+
+    ret.clear();
+    auth.auth_info_by_user("shared", ret);
+    ASSERT_EQ(ret.size(), 1);
+    ASSERT_EQ(ret[0]["id"].asInt(), 3);
+
+    ret.clear();
+    auth.auth_info(ret);
+    ASSERT_EQ(ret["users"].size(), 3);
+    ASSERT_FALSE(ret["jwt_gid"].hasMember("g4"));
+    ASSERT_EQ(ret["jwt_gid"]["g5"].asInt(), 5);
+    ASSERT_EQ(ret["allow_jwt_auth"].size(), 1);
+    ASSERT_EQ(ret["allow_jwt_auth"][0].asInt(), 5);
+}
+
+TEST_F(YetiTest, AuthCredentialsSnapshot)
+{
+    CredentialsContainer c;
+    c.add(AmArg{ { "id", 1 }, { "username", "u1" }, { "password", "p1" } });
+    c.add(AmArg{ { "id", 2 }, { "username", "shared" }, { "password", "p2" } });
+    c.add(AmArg{ { "id", 3 }, { "username", "shared" }, { "password", "p3" } });
+    // password equal to the other username is interned once
+    c.add(AmArg{ { "id", 4 }, { "username", "p1" }, { "password", "u1" } });
+    c.add(AmArg{ { "id", 5 }, { "allow_jwt_auth", true }, { "jwt_gid", "g5" } });
+
+    CredentialsSnapshot s(c);
+
+    auto creds = s.find_user("u1");
+    ASSERT_EQ(creds.size(), 1);
+    ASSERT_EQ(creds[0].id, 1);
+    ASSERT_EQ(creds[0].password, "p1");
+
+    creds = s.find_user("shared");
+    ASSERT_EQ(creds.size(), 2);
+    ASSERT_EQ(creds[0].id + creds[1].id, 5);
+
+    creds = s.find_user("p1");
+    ASSERT_EQ(creds.size(), 1);
+    ASSERT_EQ(creds[0].id, 4);
+
+    ASSERT_TRUE(s.find_user("unknown").empty());
+    ASSERT_EQ(s.get_users_count(), 3);
+
+    ASSERT_EQ(s.find_gid("g5"), 5);
+    ASSERT_FALSE(s.find_gid("g1"));
+    ASSERT_TRUE(s.is_jwt_auth_allowed(5));
+    ASSERT_FALSE(s.is_jwt_auth_allowed(1));
+
+    CredentialsSnapshot empty;
+    ASSERT_TRUE(empty.find_user("u1").empty());
+    ASSERT_FALSE(empty.find_gid("g5"));
+
+    // only the shards changed by the delta are rebuilt
+    c.dirty.reset();
+    c.remove(1);
+    c.add(AmArg{ { "id", 1 }, { "username", "u1" }, { "password", "p1new" } });
+    ASSERT_LE(c.dirty.count(), 2);
+
+    CredentialsSnapshot next(s, c);
+    ASSERT_GE(next.get_shared_shards_count(s), CREDENTIALS_SHARDS_COUNT - 2);
+    creds = next.find_user("u1");
+    ASSERT_EQ(creds.size(), 1);
+    ASSERT_EQ(creds[0].password, "p1new");
+    ASSERT_EQ(next.find_user("shared").size(), 2);
+    ASSERT_EQ(next.find_gid("g5"), 5);
+    ASSERT_EQ(s.find_user("u1")[0].password, "p1");
+
+    // lookups see the consistent snapshot during the concurrent updates
+    const int         credentials_count = 1000;
+    const int         threads_count     = 2;
+    const int         ops_per_thread    = 10000;
+    GatewaysCacheALeg gateways_cache;
+    Auth              auth(gateways_cache);
+
+    AmArg rows;
+    rows.assertArray();
+    for (int i = 0; i < credentials_count; i++) {
+        auto suffix = std::to_string(i);
+        rows.push(AmArg{ { "id", i }, { "username", "user" + suffix }, { "password", "pwd" + suffix } });
+    }
+    auth.reload_credentials(rows);
+
+    std::atomic<bool> stop{ false };
+    std::thread       updater([&auth, &stop]() {
+        for (int i = 0; !stop.load(std::memory_order_relaxed); i++) {
+            int   id     = i % credentials_count;
+            auto  suffix = std::to_string(id);
+            AmArg delta;
+            delta.push(AmArg{ { "id", id }, { "username", "user" + suffix }, { "password", "pwd" + suffix } });
+            auth.apply_credentials_delta(delta);
+        }
+    });
+
+    std::atomic<int>    matched{ 0 };
+    vector<std::thread> threads;
+    for (int n = 0; n < threads_count; n++) {
+        threads.emplace_back([&auth, &matched, n]() {
+            int   thread_matched = 0;
+            AmArg ret;
+            for (int i = 0; i < ops_per_thread; i++) {
+                int  id     = (i * threads_count + n) % credentials_count;
+                auto suffix = std::to_string(id);
+                ret.clear();
+                auth.auth_info_by_user("user" + suffix, ret);
+                if (ret.size() == 1 && ret[0]["id"].asInt() == id && ret[0]["pwd"] == AmArg("pwd" + suffix))
+                    thread_matched++;
+            }
+            matched.fetch_add(thread_matched);
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+
+    stop = true;
+    updater.join();
+
+    ASSERT_EQ(matched, threads_count * ops_per_thread);
+}
+
+// benchmark. run with --gtest_also_run_disabled_tests --gtest_filter=YetiTest.DISABLED_AuthCredentialsBenchmark
+TEST_F(YetiTest, DISABLED_AuthCredentialsBenchmark)
+{
+    const int         credentials_count = 100000;
+    const int         threads_count     = 4;
+    const int         ops_per_thread    = 200000;
+    GatewaysCacheALeg gateways_cache;
+    Auth              auth(gateways_cache);
+
+    AmArg rows;
+    rows.assertArray();
+    for (int i = 0; i < credentials_count; i++) {
+        auto suffix = std::to_string(i);
+        rows.push(AmArg{ { "id", i }, { "username", "user" + suffix }, { "password", "pwd" + suffix } });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auth.reload_credentials(rows);
+    auto usec =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    INFO("Auth: %d credentials reload: %ld usec", credentials_count, usec);
+
+    // lookups must not be blocked by the concurrent updates
+    std::atomic<bool> stop{ false };
+    std::thread       updater([&auth, &stop]() {
+        for (int i = 0; !stop.load(std::memory_order_relaxed); i++) {
+            int   id     = i % credentials_count;
+            auto  suffix = std::to_string(id);
+            AmArg delta;
+            delta.push(AmArg{ { "id", id }, { "username", "user" + suffix }, { "password", "pwd" + suffix } });
+            auth.apply_credentials_delta(delta);
+        }
+    });
+
+    std::atomic<int> matched{ 0 };
+    start = std::chrono::steady_clock::now();
+
+    vector<std::thread> threads;
+    for (int n = 0; n < threads_count; n++) {
+        threads.emplace_back([&auth, &matched, n]() {
+            int   thread_matched = 0;
+            AmArg ret;
+            for (int i = 0; i < ops_per_thread; i++) {
+                int id = (i * threads_count + n) % credentials_count;
+                ret.clear();
+                auth.auth_info_by_user("user" + std::to_string(id), ret);
+                if (ret.size() == 1 && ret[0]["id"].asInt() == id)
+                    thread_matched++;
+            }
+            matched.fetch_add(thread_matched);
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+
+    usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    stop = true;
+    updater.join();
+
+    INFO("Auth: %d credentials, %d threads, %d lookups per thread: %ld usec, %.1f ns/op, %d matched",
+         credentials_count, threads_count, ops_per_thread, usec,
+         static_cast<double>(usec) * 1000 / (threads_count * ops_per_thread), matched.load());
+}
@@ -0,0 +1,73 @@
+#include "YetiTest.h"
+#include "../src/CallProfilesCache.h"
+#include "../src/SqlCallProfile.h"
+
+TEST_F(YetiTest, CallProfilesCacheOverlay)
+{
+    AmArg rows;
+    rows.assertArray();
+
+    AmArg common;
+    common["cache_id"]           = AmArg();
+    common["dead_rtp_time"]      = 10;
+    common["aleg_relay_options"] = true;
+    common["next_hop"]           = "10.0.0.2:5060";
+    rows.push(common);
+
+    AmArg cached;
+    cached["cache_id"]       = "gw1";
+    cached["next_hop"]       = "10.0.0.1:5060";
+    cached["resources"]      = "1:2:3:4";
+    cached["aleg_policy_id"] = 5;
+    rows.push(cached);
+
+    DynFieldsT df;
+    df.emplace_back("customer_id", "integer");
+
+    CallProfilesCache cache;
+    cache.load_callprofiles(PGResponse(rows, "callprofiles"), df, string(), string());
+
+    AmArg per_call;
+    per_call["cache_id"]           = "gw1";
+    per_call["ruri"]               = "sip:100@example.com";
+    per_call["to"]                 = "<sip:100@example.com>";
+    per_call["customer_id"]        = 42;
+    per_call["disconnect_code_id"] = AmArg();
+
+    auto cached_profile = cache.get_profile(per_call);
+    ASSERT_TRUE(cached_profile);
+    ASSERT_TRUE(cached_profile->can_overlay(per_call, string(), string()));
+
+    SqlCallProfile overlaid(*cached_profile);
+    ASSERT_TRUE(overlaid.overlayFromTuple(per_call, "tag", string(), string()));
+
+    // same as the reading of the merged tuple
+    AmArg merged(per_call);
+    ASSERT_TRUE(cache.complete_profile(merged));
+    SqlCallProfile p;
+    ASSERT_TRUE(p.readFromTuple(merged, "tag", df, string(), string()));
+
+    ASSERT_EQ(overlaid.aleg_local_tag, p.aleg_local_tag);
+    ASSERT_EQ(overlaid.ruri, p.ruri);
+    ASSERT_EQ(overlaid.to, p.to);
+    ASSERT_EQ(overlaid.next_hop, "10.0.0.1:5060");
+    ASSERT_EQ(overlaid.next_hop, p.next_hop);
+    ASSERT_EQ(overlaid.resources, p.resources);
+    ASSERT_EQ(overlaid.aleg_override_id, p.aleg_override_id);
+    ASSERT_EQ(overlaid.dead_rtp_time, 10);
+    ASSERT_EQ(overlaid.aleg_relay_options, p.aleg_relay_options);
+    ASSERT_EQ(AmArg::print(overlaid.dyn_fields), AmArg::print(p.dyn_fields));
+
+    // fields with the derived values require the merged tuple reading
+    per_call["enable_session_timer"] = false;
+    ASSERT_FALSE(cached_profile->can_overlay(per_call, string(), string()));
+
+    // refusing profile
+    per_call.asStruct()->erase("enable_session_timer");
+    per_call["disconnect_code_id"] = 113;
+    ASSERT_FALSE(cached_profile->can_overlay(per_call, string(), string()));
+
+    // unknown cache_id
+    per_call["cache_id"] = "gw2";
+    ASSERT_FALSE(cache.get_profile(per_call));
+}
@@ -0,0 +1,70 @@
+#include "YetiTest.h"
+#include "../src/hash/CdrFilter.h"
+
+static bool filter_match(const Cdr &cdr, const vector<string> &rules)
+{
+    AmArg params;
+    params.push("local_tag");
+    params.push("WHERE");
+    for (const auto &r : rules)
+        params.push(r);
+
+    cmp_filter     filter;
+    vector<string> fields;
+    parse_fields(filter, params, fields);
+
+    return apply_filter_rules(&cdr, filter);
+}
+
+TEST_F(YetiTest, CdrFilterCompiled)
+{
+    DynFieldsT df;
+    df.emplace_back("customer_id", "integer");
+    df.emplace_back("customer_name", "varchar");
+    df.emplace_back("vendor_acc_id", "bigint");
+    df.emplace_back("rate", "double precision");
+    ASSERT_EQ(configure_filter(df), 0);
+
+    Cdr cdr;
+    cdr.local_tag   = "filter-test";
+    cdr.attempt_num = 2;
+    gettimeofday(&cdr.connect_time, nullptr);
+    cdr.connect_time.tv_sec -= 100;
+    cdr.dyn_fields["customer_id"]   = 42;
+    cdr.dyn_fields["customer_name"] = "acme";
+    cdr.dyn_fields["vendor_acc_id"] = AmArg(5000000000LL);
+    cdr.dyn_fields["rate"]          = 0.5;
+
+    ASSERT_TRUE(filter_match(cdr, { "attempt_num=2" }));
+    ASSERT_FALSE(filter_match(cdr, { "attempt_num>2" }));
+    ASSERT_TRUE(filter_match(cdr, { "duration>50", "duration<150" }));
+    ASSERT_FALSE(filter_match(cdr, { "duration>150" }));
+
+    ASSERT_TRUE(filter_match(cdr, { "customer_name=acme", "customer_id>=42", "customer_id<43" }));
+    ASSERT_FALSE(filter_match(cdr, { "customer_name!=acme" }));
+    ASSERT_TRUE(filter_match(cdr, { "vendor_acc_id>4000000000", "rate<1" }));
+    ASSERT_FALSE(filter_match(cdr, { "rate>=1", "attempt_num=2" }));
+
+    // not connected call never matches duration filter
+    timerclear(&cdr.connect_time);
+    ASSERT_FALSE(filter_match(cdr, { "duration>0" }));
+
+    // values are read by the resolved slots
+    resolve_dyn_fields_slots(cdr.dyn_fields, cdr.dyn_fields_slots);
+    ASSERT_EQ(cdr.dyn_fields_slots.size(), df.size());
+    ASSERT_EQ(cdr.dyn_fields_slots[0], &cdr.dyn_fields["customer_id"]);
+    ASSERT_TRUE(filter_match(cdr, { "customer_name=acme", "customer_id=42", "rate<1" }));
+    cdr.dyn_fields["customer_id"] = 43;
+    ASSERT_TRUE(filter_match(cdr, { "customer_id=43" }));
+
+    // slots are not copied with Cdr. lookup by name
+    Cdr cdr_copy(cdr);
+    ASSERT_TRUE(cdr_copy.dyn_fields_slots.empty());
+    ASSERT_TRUE(filter_match(cdr_copy, { "customer_id=43", "vendor_acc_id>4000000000" }));
+
+    // type mismatch and unsupported conditions
+    cdr.dyn_fields["customer_id"] = "42";
+    ASSERT_FALSE(filter_match(cdr, { "customer_id=42" }));
+    ASSERT_THROW(filter_match(cdr, { "customer_name>acme" }), std::string);
+    ASSERT_THROW(filter_match(cdr, { "unknown_field=1" }), std::string);
+}
@@ -43,6 +43,32 @@ TEST_F(YetiTest, cdr_headers_parsing)
     ASSERT_EQ(ret["x_integerconversionoverflowtest"], AmArg());
 }
 
+TEST_F(YetiTest, cdr_headers_parsing_normalized_names)
+{
+    cdr_headers_t hdrs;
+    hdrs.add_header("X-Foo", "string");
+    hdrs.add_header("x_bar", "array");
+    hdrs.add_snapshot_header("X_Charge-Info", "charge_key", "String");
+
+    // configured and wire names are compared normalized: case insensitive, '-' equals '_'
+    string          raw_hdrs("x_foo: foo\r\n"
+                             "X-BAR: bar1\r\n"
+                             "X_Bar: bar2\r\n"
+                             "X-Foo: foo2\r\n"
+                             "x-charge_info: charge\r\n");
+    SipHeadersIndex index(raw_hdrs);
+
+    auto ret = hdrs.serialize_headers(index);
+    ASSERT_EQ(ret["x_foo"], AmArg("foo"));
+    ASSERT_EQ(ret["x_bar"], (AmArg{ "bar1", "bar2" }));
+
+    // same result as for the raw headers
+    ASSERT_EQ(ret, hdrs.serialize_headers(raw_hdrs));
+
+    ret = hdrs.serialize_headers_for_snapshot(index);
+    ASSERT_EQ(ret["charge_key"], AmArg("charge"));
+}
+
 TEST_F(YetiTest, cdr_headers_parsing_activecalls)
 {
     cdr_headers_t hdrs;
@@ -0,0 +1,157 @@
+#include "YetiTest.h"
+#include "../src/cdr/CdrSpool.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+static string make_spool_dir()
+{
+    char tmpl[] = "/tmp/yeti_cdr_spool_XXXXXX";
+    return mkdtemp(tmpl);
+}
+
+static string spool_record(int i)
+{
+    return string(700, static_cast<char>('a' + i % 26)) + std::to_string(i);
+}
+
+TEST_F(YetiTest, CdrSpoolAppendConsume)
+{
+    auto     dir = make_spool_dir();
+    CdrSpool spool;
+
+    ASSERT_EQ(spool.init(dir, 0), 0);
+    ASSERT_TRUE(spool.empty());
+
+    // ~2MB of records to get several minimal (1MB) segments
+    for (int i = 0; i < 3000; i++)
+        ASSERT_TRUE(spool.append(spool_record(i)));
+    ASSERT_FALSE(spool.append(string()));
+
+    ASSERT_EQ(spool.get_pending_records(), 3000ULL);
+    ASSERT_GT(spool.get_segments_count(), 1UL);
+
+    int            i = 0;
+    vector<string> records;
+    while (auto n = spool.peek(records, 333)) {
+        for (const auto &r : records)
+            ASSERT_EQ(r, spool_record(i++));
+        records.clear();
+        spool.consume(n);
+    }
+
+    ASSERT_EQ(i, 3000);
+    ASSERT_TRUE(spool.empty());
+    ASSERT_EQ(spool.get_segments_count(), 1UL);
+
+    spool.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(YetiTest, CdrSpoolRecovery)
+{
+    auto dir = make_spool_dir();
+
+    {
+        CdrSpool spool;
+        ASSERT_EQ(spool.init(dir, 0), 0);
+        for (int i = 0; i < 3000; i++)
+            ASSERT_TRUE(spool.append(spool_record(i)));
+
+        vector<string> records;
+        ASSERT_EQ(spool.peek(records, 100), 100UL);
+        spool.consume(100);
+    }
+
+    CdrSpool spool;
+    ASSERT_EQ(spool.init(dir, 0), 0);
+    ASSERT_EQ(spool.get_pending_records(), 2900ULL);
+
+    // appended after the recovered ones
+    ASSERT_TRUE(spool.append("tail"));
+
+    int            i = 100;
+    vector<string> records;
+    while (auto n = spool.peek(records, 1000)) {
+        for (const auto &r : records) {
+            if (i < 3000)
+                ASSERT_EQ(r, spool_record(i));
+            else
+                ASSERT_EQ(r, "tail");
+            i++;
+        }
+        records.clear();
+        spool.consume(n);
+    }
+
+    ASSERT_EQ(i, 3001);
+    ASSERT_TRUE(spool.empty());
+
+    spool.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(YetiTest, CdrSpoolSyncReject)
+{
+    auto     dir = make_spool_dir();
+    CdrSpool spool;
+
+    ASSERT_EQ(spool.init(dir, 0), 0);
+    ASSERT_TRUE(spool.sync());
+
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(spool.append(spool_record(i)));
+        ASSERT_TRUE(spool.sync());
+    }
+
+    ASSERT_TRUE(spool.reject("rejected1"));
+    ASSERT_TRUE(spool.reject("rejected2"));
+
+    std::ifstream  f(dir + "/rejected");
+    vector<string> rejected;
+    for (string line; std::getline(f, line);)
+        rejected.push_back(line);
+    ASSERT_EQ(rejected, vector<string>({ "rejected1", "rejected2" }));
+
+    // rejected file is not treated as a segment
+    spool.close();
+    ASSERT_EQ(spool.init(dir, 0), 0);
+    ASSERT_EQ(spool.get_pending_records(), 10ULL);
+    ASSERT_EQ(spool.get_segments_count(), 1UL);
+
+    spool.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(YetiTest, CdrSpoolConsumeWithoutPeek)
+{
+    auto dir = make_spool_dir();
+
+    {
+        CdrSpool spool;
+        ASSERT_EQ(spool.init(dir, 0), 0);
+        for (int i = 0; i < 3000; i++)
+            ASSERT_TRUE(spool.append(spool_record(i)));
+        auto segments = spool.get_segments_count();
+        ASSERT_GT(segments, 2UL);
+
+        // writer consumes confirmed records without peeking them
+        spool.consume(1000);
+        spool.consume(1500);
+        ASSERT_EQ(spool.get_pending_records(), 500ULL);
+        ASSERT_LT(spool.get_segments_count(), segments);
+
+        spool.consume(500);
+        ASSERT_TRUE(spool.empty());
+        ASSERT_EQ(spool.get_segments_count(), 1UL);
+    }
+
+    CdrSpool spool;
+    ASSERT_EQ(spool.init(dir, 0), 0);
+    ASSERT_TRUE(spool.empty());
+    ASSERT_EQ(spool.get_segments_count(), 1UL);
+
+    spool.close();
+    std::filesystem::remove_all(dir);
+}
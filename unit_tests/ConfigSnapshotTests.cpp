@@ -0,0 +1,87 @@
+#include "YetiTest.h"
+#include "../src/db/ConfigSnapshot.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+static string make_snapshot_path()
+{
+    char tmpl[] = "/tmp/yeti_cfg_snapshot_XXXXXX";
+    return string(mkdtemp(tmpl)) + "/snapshot";
+}
+
+TEST_F(YetiTest, ConfigSnapshotRoundtrip)
+{
+    auto path = make_snapshot_path();
+
+    AmArg rows;
+    rows.assertArray();
+    for (int i = 0; i < 100; i++) {
+        rows.push(AmArg{
+            { "id", static_cast<long long>(i) },
+            { "ip", "10.0.0." + std::to_string(i) },
+            { "flag", i % 2 == 0 },
+            { "rate", i * 0.5 },
+            { "type", i },
+            { "list", AmArg{ "a", "b" } },
+        });
+    }
+
+    {
+        ConfigSnapshot          snapshot;
+        ConfigSnapshot::Entries entries;
+        snapshot.configure(path, 1, 2);
+        ASSERT_FALSE(snapshot.load(entries));
+
+        snapshot.update("ip_auth", 5, rows);
+        snapshot.update("translations.dc_rewrite", std::nullopt, AmArg());
+        ASSERT_EQ(snapshot.save(), 0);
+    }
+
+    {
+        ConfigSnapshot          snapshot;
+        ConfigSnapshot::Entries entries;
+        snapshot.configure(path, 1, 2);
+        ASSERT_TRUE(snapshot.load(entries));
+        ASSERT_EQ(entries.size(), 2);
+        ASSERT_EQ(entries["ip_auth"].version, 5);
+        ASSERT_EQ(entries["translations.dc_rewrite"].version, ConfigSnapshot::unknown_version);
+
+        auto &loaded = entries["ip_auth"].data;
+        ASSERT_EQ(loaded.size(), rows.size());
+        // types are kept as is
+        ASSERT_TRUE(isArgLongLong(loaded[7]["id"]));
+        ASSERT_TRUE(isArgInt(loaded[7]["type"]));
+        ASSERT_EQ(loaded[7]["id"].asLongLong(), 7);
+        ASSERT_EQ(loaded[7]["ip"], AmArg("10.0.0.7"));
+        ASSERT_FALSE(loaded[7]["flag"].asBool());
+        ASSERT_EQ(loaded[7]["rate"].asDouble(), 3.5);
+        ASSERT_EQ(loaded[7]["list"], (AmArg{ "a", "b" }));
+    }
+
+    // other node snapshot is ignored
+    {
+        ConfigSnapshot          snapshot;
+        ConfigSnapshot::Entries entries;
+        snapshot.configure(path, 3, 2);
+        ASSERT_FALSE(snapshot.load(entries));
+    }
+
+    // corrupted entry is skipped. entries are sorted by key, last byte belongs to the translations one
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(-1, std::ios::end);
+        f.put('\xff');
+    }
+    {
+        ConfigSnapshot          snapshot;
+        ConfigSnapshot::Entries entries;
+        snapshot.configure(path, 1, 2);
+        ASSERT_TRUE(snapshot.load(entries));
+        ASSERT_EQ(entries.size(), 1);
+        ASSERT_TRUE(entries.contains("ip_auth"));
+    }
+
+    std::filesystem::remove_all(std::filesystem::path(path).parent_path());
+}
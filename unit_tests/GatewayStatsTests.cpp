@@ -1,13 +1,18 @@
 #include "YetiTest.h"
 #include "../src/GatewayStats.h"
 
+#include <chrono>
+#include <map>
+#include <random>
+#include <thread>
+
 TEST_F(YetiTest, GatewayStatsBasicOperations)
 {
-    GatewayStats s;
-    s.set_window_size(5);
+    GatewayStats s(5);
 
-    ASSERT_EQ(s.global.success_replies, 0);
-    ASSERT_EQ(s.global.failed_replies, 0);
+    ASSERT_EQ(s.get_window_stats().success_replies, 0);
+    ASSERT_EQ(s.get_window_stats().failed_replies, 0);
+    ASSERT_FALSE(s.get_oldest_time_slot());
 
     s.add_failed_reply(10);
     s.add_success_reply(10);
@@ -15,19 +20,126 @@ TEST_F(YetiTest, GatewayStatsBasicOperations)
     s.add_failed_reply(11);
     s.add_success_reply(11);
 
-    ASSERT_EQ(s.global.success_replies, 2);
-    ASSERT_EQ(s.global.failed_replies, 2);
+    ASSERT_EQ(s.get_window_stats().success_replies, 2);
+    ASSERT_EQ(s.get_window_stats().failed_replies, 2);
+    ASSERT_EQ(s.get_oldest_time_slot(), 10);
 
-    ASSERT_EQ(s.getTimeSlots().at(10).success_replies, 1);
-    ASSERT_EQ(s.getTimeSlots().at(10).failed_replies, 1);
-    ASSERT_EQ(s.getTimeSlots().at(11).success_replies, 1);
-    ASSERT_EQ(s.getTimeSlots().at(11).failed_replies, 1);
+    // reply for the second out of the window is ignored
+    s.add_failed_reply(15);
+    s.add_success_reply(10);
+    ASSERT_EQ(s.get_window_stats().success_replies, 1);
+    ASSERT_EQ(s.get_window_stats().failed_replies, 2);
+    ASSERT_EQ(s.get_oldest_time_slot(), 11);
 
     // check obsolete slots cleanup
 
     s.add_failed_reply(20);
     s.add_success_reply(20);
 
-    ASSERT_EQ(s.global.success_replies, 1);
-    ASSERT_EQ(s.global.failed_replies, 1);
+    ASSERT_EQ(s.get_window_stats().success_replies, 1);
+    ASSERT_EQ(s.get_window_stats().failed_replies, 1);
+
+    s.update_time(30);
+    ASSERT_EQ(s.get_window_stats().success_replies, 0);
+    ASSERT_EQ(s.get_window_stats().failed_replies, 0);
+}
+
+TEST_F(YetiTest, GatewayStatsWindowResize)
+{
+    GatewayStats s(10);
+    for (int t = 100; t < 110; t++)
+        s.add_failed_reply(t);
+    s.checked_requests = 7;
+
+    GatewayStats resized(3, s);
+    ASSERT_EQ(resized.get_window_stats().failed_replies, 3);
+    ASSERT_EQ(resized.get_oldest_time_slot(), 107);
+    ASSERT_EQ(resized.checked_requests, 7UL);
+}
+
+TEST_F(YetiTest, GatewayStatsRunningSums)
+{
+    const int    window = 7;
+    GatewayStats s(window);
+    std::mt19937 gen(42);
+
+    // naive model: replies per second
+    std::map<int, GatewayStats::Stats> model;
+
+    int now = 1000, last_time = 0;
+    for (int i = 0; i < 100000; i++) {
+        if (gen() % 100 == 0)
+            now += 1 + gen() % (window + 2);
+
+        // replies are delayed for a few seconds sometimes
+        int  t      = now - static_cast<int>(gen() % 3);
+        bool failed = gen() % 4 == 0;
+        if (failed)
+            s.add_failed_reply(t);
+        else
+            s.add_success_reply(t);
+
+        // window ends at the latest seen second
+        last_time = std::max(last_time, t);
+        if (t > last_time - window) {
+            auto &m = model.try_emplace(t, GatewayStats::Stats{ 0, 0 }).first->second;
+            (failed ? m.failed_replies : m.success_replies)++;
+        }
+
+        GatewayStats::Stats expected{ 0, 0 };
+        for (auto it = model.lower_bound(last_time - window + 1); it != model.end(); ++it) {
+            expected.failed_replies += it->second.failed_replies;
+            expected.success_replies += it->second.success_replies;
+        }
+
+        auto stats = s.get_window_stats();
+        ASSERT_EQ(stats.failed_replies, expected.failed_replies);
+        ASSERT_EQ(stats.success_replies, expected.success_replies);
+    }
+}
+
+// benchmark. run with --gtest_also_run_disabled_tests --gtest_filter=YetiTest.DISABLED_GatewayStatsBenchmark
+TEST_F(YetiTest, DISABLED_GatewayStatsBenchmark)
+{
+    const int    threads_count  = 4;
+    const int    ops_per_thread = 1000000;
+    const int    window         = 60;
+    GatewayStats s(window);
+
+    std::atomic<int> now{ 1000 };
+    auto             start = std::chrono::steady_clock::now();
+
+    vector<std::thread> threads;
+    for (int n = 0; n < threads_count; n++) {
+        threads.emplace_back([&s, &now, n]() {
+            for (int i = 0; i < ops_per_thread; i++) {
+                // every thread moves the time forward sometimes
+                if (i % 10000 == n)
+                    now.fetch_add(1, std::memory_order_relaxed);
+                int t = now.load(std::memory_order_relaxed);
+                if (i % 3)
+                    s.add_success_reply(t);
+                else
+                    s.add_failed_reply(t);
+                s.update_time(t);
+                (void)s.get_window_stats();
+            }
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+
+    auto usec =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    INFO("GatewayStats: %d threads, %d replies+checks per thread: %ld usec, %.1f ns/op", threads_count,
+         ops_per_thread, usec, static_cast<double>(usec) * 1000 / (threads_count * ops_per_thread));
+
+    auto stats = s.get_window_stats();
+    ASSERT_GT(stats.failed_replies + stats.success_replies, 0);
+
+    // running sums are consistent with the slots: nothing left after the window is passed
+    s.update_time(now + window);
+    stats = s.get_window_stats();
+    ASSERT_EQ(stats.failed_replies, 0);
+    ASSERT_EQ(stats.success_replies, 0);
 }
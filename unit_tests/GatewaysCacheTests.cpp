@@ -75,6 +75,19 @@ TEST_F(YetiTest, GatewaysCacheThrottling)
     ASSERT_LE(skip_rate, 31);
     ASSERT_GE(skip_rate, 21);
 
+    // stats are kept across reloads
+    cache.update({ { AmArg{
+        { "id", 1LL },
+        { "throttling_codes", AmArg{ "local408", "408" } },
+        { "throttling_minimum_calls", 2 },
+        { "throttling_window", 5 },
+        { "throttling_threshold_start", 30.0 },
+        { "throttling_threshold_end", 70.0 },
+    } } });
+    cache.info(arg, ret);
+    ASSERT_EQ(ret["gateways"]["1"]["throttling"]["stats"]["failed_replies"].asInt(), 2);
+    ASSERT_EQ(ret["gateways"]["1"]["throttling"]["stats"]["success_replies"].asInt(), 4);
+
     // move time forward to obsolete old counters
     reply.recv_timestamp = { now + 20, 0 };
     cache.update_reply_stats(1, reply);
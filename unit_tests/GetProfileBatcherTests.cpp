@@ -0,0 +1,56 @@
+#include "YetiTest.h"
+#include "../src/GetProfileBatcher.h"
+
+TEST_F(YetiTest, GetProfileBatchSql)
+{
+    PreparedQueryArgs types{ "integer", "varchar" };
+
+    ASSERT_EQ(GetProfileBatcher::build_batch_sql("route_release", types, 1),
+              "SELECT 1 AS batch_idx, p.* FROM route_release($1::integer,$2::varchar) WITH ORDINALITY p"
+              " ORDER BY batch_idx, ordinality");
+
+    ASSERT_EQ(GetProfileBatcher::build_batch_sql("route_release", types, 2),
+              "SELECT 1 AS batch_idx, p.* FROM route_release($1::integer,$2::varchar) WITH ORDINALITY p"
+              " UNION ALL "
+              "SELECT 2 AS batch_idx, p.* FROM route_release($3::integer,$4::varchar) WITH ORDINALITY p"
+              " ORDER BY batch_idx, ordinality");
+}
+
+TEST_F(YetiTest, GetProfileBatchSplit)
+{
+    auto row = [](int batch_idx, int ordinality, const char *value) {
+        AmArg r;
+        r["batch_idx"]  = batch_idx;
+        r["ordinality"] = ordinality;
+        r["value"]      = value;
+        return r;
+    };
+
+    AmArg result;
+    result.assertArray();
+    result.push(row(1, 1, "a1"));
+    result.push(row(1, 2, "a2"));
+    result.push(row(3, 1, "c1"));
+
+    vector<AmArg> rows;
+    ASSERT_TRUE(GetProfileBatcher::split_batch_result(result, 3, rows));
+    ASSERT_EQ(rows.size(), 3UL);
+
+    ASSERT_EQ(rows[0].size(), 2UL);
+    ASSERT_STREQ(rows[0].get(0)["value"].asCStr(), "a1");
+    ASSERT_STREQ(rows[0].get(1)["value"].asCStr(), "a2");
+    ASSERT_FALSE(rows[0].get(0).hasMember("batch_idx"));
+    ASSERT_FALSE(rows[0].get(0).hasMember("ordinality"));
+
+    // request without routes gets the empty result
+    ASSERT_TRUE(isArgArray(rows[1]));
+    ASSERT_EQ(rows[1].size(), 0UL);
+
+    ASSERT_EQ(rows[2].size(), 1UL);
+    ASSERT_STREQ(rows[2].get(0)["value"].asCStr(), "c1");
+
+    // batch_idx out of the batch
+    result.clear();
+    result.push(row(4, 1, "d1"));
+    ASSERT_FALSE(GetProfileBatcher::split_batch_result(result, 3, rows));
+}
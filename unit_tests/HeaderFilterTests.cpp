@@ -72,3 +72,40 @@ TEST_F(YetiTest, inplaceHeaderFilterPattern)
         ASSERT_TRUE(headers.empty());
     }
 }
+
+TEST_F(YetiTest, inplaceHeaderFilterCompiled)
+{
+    vector<FilterEntry> filters;
+    FilterEntry         entry;
+    entry.filter_type = FilterType::Whitelist;
+    for (int i = 0; i < 100; i++)
+        entry.filter_list.emplace("x-header-" + std::to_string(i));
+    entry.filter_list.emplace("p-*");
+    entry.filter_list.emplace("*-id");
+    entry.compile();
+    filters.push_back(entry);
+
+    entry.filter_type = FilterType::Blacklist;
+    entry.filter_list = { "x-header-42", "p-charge-info" };
+    entry.compile();
+    filters.push_back(entry);
+
+    const string headers("Host: domain.invalid\r\n"
+                         "X-HEADER-7: 7\r\n"
+                         "X-Header-42: 42\r\n"
+                         "P-Asserted-Identity: <sip:100@domain.invalid>\r\n"
+                         "P-Charge-Info: <sip:200@domain.invalid>\r\n"
+                         "X-Call-Id: 1\r\n"
+                         "X-Header-100: 100\r\n");
+
+    string filtered(headers);
+    ASSERT_FALSE(inplaceHeaderPatternFilter(filtered, filters));
+    ASSERT_EQ(filtered, string("X-HEADER-7: 7\r\n"
+                               "P-Asserted-Identity: <sip:100@domain.invalid>\r\n"
+                               "X-Call-Id: 1\r\n"));
+
+    // patterns are not applied by the exact filter
+    filtered = headers;
+    ASSERT_FALSE(inplaceHeaderFilter(filtered, filters));
+    ASSERT_EQ(filtered, string("X-HEADER-7: 7\r\n"));
+}
@@ -0,0 +1,48 @@
+#include "YetiTest.h"
+#include "../src/JwtAuthCache.h"
+
+#include <limits>
+
+TEST_F(YetiTest, JwtAuthCache)
+{
+    JwtAuthCache cache;
+
+    auto key = JwtAuthCache::make_key("token1");
+    ASSERT_EQ(key, JwtAuthCache::make_key("token1"));
+    ASSERT_NE(key, JwtAuthCache::make_key("token2"));
+
+    // disabled by default
+    cache.put(key, 1, 100, cache.get_generation());
+    ASSERT_FALSE(cache.get(key, 0));
+
+    cache.configure(32, 60);
+
+    auto generation = cache.get_generation();
+    cache.put(key, 1, 100, generation);
+    ASSERT_EQ(cache.get(key, 100), 1);
+
+    // expired entry is removed
+    ASSERT_FALSE(cache.get(key, 101));
+    ASSERT_EQ(cache.size(), 0);
+
+    cache.put(key, 1, 100, generation);
+    cache.clear();
+    ASSERT_FALSE(cache.get(key, 0));
+
+    // verified before clear()
+    cache.put(key, 1, 100, generation);
+    ASSERT_FALSE(cache.get(key, 0));
+
+    // lifetime is limited by max_ttl
+    generation = cache.get_generation();
+    time_t now = time(nullptr);
+    cache.put(key, 1, std::numeric_limits<time_t>::max(), generation);
+    ASSERT_EQ(cache.get(key, now), 1);
+    ASSERT_FALSE(cache.get(key, now + 120));
+
+    // size is bounded
+    generation = cache.get_generation();
+    for (int i = 0; i < 1000; i++)
+        cache.put(JwtAuthCache::make_key("token" + std::to_string(i)), i, time(nullptr) + 100, generation);
+    ASSERT_LE(cache.size(), 32);
+}
@@ -0,0 +1,33 @@
+#include "YetiTest.h"
+#include "../src/LatencyHistogram.h"
+
+TEST_F(YetiTest, LatencyHistogramBuckets)
+{
+    // every value must fit into the bucket with the nearest upper bound
+    for (unsigned long long v = 0; v < (1ULL << 26); v += (v < 100000 ? 1 : 997)) {
+        int idx = LatencyHistogram::bucket_index(v);
+        ASSERT_LE(v, LatencyHistogram::bucket_upper_bound(idx));
+        if (idx > 0) {
+            ASSERT_GT(v, LatencyHistogram::bucket_upper_bound(idx - 1));
+        }
+    }
+
+    ASSERT_EQ(LatencyHistogram::bucket_index(0), 0);
+    ASSERT_EQ(LatencyHistogram::bucket_index(~0ULL), LatencyHistogram::buckets_count - 1);
+}
+
+TEST_F(YetiTest, LatencyHistogramAdd)
+{
+    LatencyHistogram h;
+
+    for (int i = 0; i < 90; i++)
+        h.add(100ULL);
+    for (int i = 0; i < 10; i++)
+        h.add(100000ULL);
+
+    ASSERT_EQ(h.get_count(), 100ULL);
+    ASSERT_EQ(h.get_sum(), 90 * 100ULL + 10 * 100000ULL);
+
+    ASSERT_EQ(h.get_quantile(0.5), LatencyHistogram::bucket_upper_bound(LatencyHistogram::bucket_index(100)));
+    ASSERT_EQ(h.get_quantile(0.95), LatencyHistogram::bucket_upper_bound(LatencyHistogram::bucket_index(100000)));
+}
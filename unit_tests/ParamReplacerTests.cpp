@@ -0,0 +1,59 @@
+#include "YetiTest.h"
+#include "../src/ParamReplacer.h"
+
+TEST_F(YetiTest, ParamTemplateCompile)
+{
+    ParamTemplate plain("sip:100@example.com");
+    ASSERT_TRUE(plain.is_plain());
+    ASSERT_EQ(plain.get_ops().size(), 1UL);
+
+    // escapes are resolved into the literal spans
+    ParamTemplate t("sip:$rU@\\tx$_u($fU)end");
+    ASSERT_FALSE(t.is_plain());
+
+    const auto &ops = t.get_ops();
+    ASSERT_EQ(ops.size(), 5UL);
+    ASSERT_EQ(ops[0].type, ParamTemplate::op::LITERAL);
+    ASSERT_EQ(ops[0].length, 4UL);
+    ASSERT_EQ(ops[1].type, ParamTemplate::op::EXPRESSION);
+    ASSERT_EQ(t.get_source()[ops[1].offset], 'r');
+    ASSERT_EQ(ops[2].type, ParamTemplate::op::LITERAL);
+    ASSERT_EQ(ops[2].length, 3UL); // "@\tx"
+    ASSERT_EQ(ops[3].type, ParamTemplate::op::EXPRESSION);
+    ASSERT_TRUE(ops[3].nested);
+    ASSERT_EQ(ops[3].nested->get_source(), "$fU");
+    ASSERT_EQ(ops[4].type, ParamTemplate::op::LITERAL);
+    ASSERT_EQ(ops[4].length, 3UL);
+
+    ASSERT_EQ(ParamTemplate::expression_length("$P(param)x", 1), 7UL);
+    ASSERT_EQ(ParamTemplate::expression_length("$H(X-Hdr)", 1), 7UL);
+    ASSERT_EQ(ParamTemplate::expression_length("$fP(tag)", 1), 6UL);
+    ASSERT_EQ(ParamTemplate::expression_length("$ci", 1), 1UL);
+}
+
+TEST_F(YetiTest, ParamTemplateReplace)
+{
+    AmSipRequest req;
+    req.method   = "INVITE";
+    req.r_uri    = "sip:100@192.168.0.1:5070";
+    req.from     = "<sip:200@example.com>";
+    req.from_tag = "from-tag";
+    req.to       = "<sip:100@example.com>";
+    req.callid   = "call-id";
+    req.hdrs     = "X-Hdr: value\r\n";
+
+    ParamReplacerCtx ctx;
+    ctx.app_param = "param=app_value";
+
+    ASSERT_EQ(ctx.replaceParameters("plain", "test", req), "plain");
+    ASSERT_EQ(ctx.replaceParameters("$ci;$ft", "test", req), "call-id;from-tag");
+    ASSERT_EQ(ctx.replaceParameters("sip:$rU@$rh:$rp", "test", req), "sip:100@192.168.0.1:5070");
+    ASSERT_EQ(ctx.replaceParameters("$H(X-Hdr)|$P(param)", "test", req), "value|app_value");
+    ASSERT_EQ(ctx.replaceParameters("\\$fU=$_u(a$fU)\\n", "test", req), "$fU=A200\n");
+    ASSERT_EQ(ctx.replaceParameters("$#(a b)", "test", req), "a+b");
+
+    // compiled once for the same values
+    auto t = ParamTemplatesCache::instance().get("$ci");
+    ASSERT_EQ(t, ParamTemplatesCache::instance().get("$ci"));
+    ASSERT_EQ(ctx.replaceParameters(*t, "test", req), "call-id");
+}
@@ -1,6 +1,13 @@
 #include "YetiTest.h"
 #include "../src/resources/ResourceControl.h"
 #include "../src/resources/ResourceRedisConnection.h"
+#include "../src/resources/ResourceHandlers.h"
+#include "../src/resources/ResourceLeases.h"
+#include "../src/resources/ResourceHandlersLog.h"
+
+#include <fstream>
+#include <thread>
+#include <unistd.h>
 
 static AmCondition<bool> inited(false);
 static void              InitCallback(bool is_error, const AmArg &)
@@ -263,6 +270,253 @@ TEST_F(YetiTest, ResourceOverload)
     conn.stop(true);
 }
 
+TEST_F(YetiTest, ResourceHandlersTakePut)
+{
+    ResourceHandlers handlers;
+
+    ResourceList rl;
+    rl.parse("0:472:1:2;1:473:1:2;1:474:1:2");
+    rl.front().taken                     = true;
+    std::next(rl.begin(), 2)->rate_limit = true;
+
+    vector<ResourceHandler> added;
+    for (int i = 0; i < 1000; i++)
+        added.push_back(handlers.add(rl, "tag" + std::to_string(i)));
+    ASSERT_EQ(handlers.size(), 1000UL);
+
+    // not taken resources are not stored
+    ASSERT_TRUE(handlers.find(added[10], [](const ResourceHandlers::entry &e) {
+        ASSERT_EQ(e.owner_tag, "tag10");
+        ASSERT_EQ(e.resources.size(), 2UL);
+    }));
+
+    string           owner_tag;
+    vector<Resource> resources;
+    for (size_t i = 0; i < added.size(); i += 2) {
+        ASSERT_EQ(handlers.take(added[i], owner_tag, resources), ResourceHandlers::HANDLER_TAKEN);
+        ASSERT_EQ(owner_tag, "tag" + std::to_string(i));
+        ASSERT_EQ(resources.size(), 2UL);
+        // handlers are never reused
+        ASSERT_EQ(handlers.take(added[i], owner_tag, resources), ResourceHandlers::HANDLER_NOT_FOUND);
+    }
+    ASSERT_EQ(handlers.size(), 500UL);
+
+    // remaining handlers are found after the backward shift deletions
+    size_t visited = 0;
+    handlers.for_each([&](const ResourceHandlers::entry &e) {
+        ASSERT_EQ(e.handler % 2, added[1] % 2);
+        visited++;
+    });
+    ASSERT_EQ(visited, 500UL);
+
+    ASSERT_EQ(handlers.invalidate(), 500UL);
+    ASSERT_EQ(handlers.take(added[1], owner_tag, resources), ResourceHandlers::HANDLER_INVALID);
+    ASSERT_EQ(handlers.size(), 499UL);
+}
+
+TEST_F(YetiTest, ResourceLeasesTakePut)
+{
+    ResourceLeases leases;
+    leases.configure(10, 100, 60);
+
+    vector<ResourceLeases::request> requests;
+
+    // failover group is served by the head resource
+    ResourceList rl;
+    rl.parse("0:472:1000:1|0:473:1000:1");
+    ASSERT_FALSE(leases.take(rl, requests));
+    ASSERT_EQ(requests.size(), 1UL);
+    ASSERT_EQ(requests[0].resource.id, "472");
+    ASSERT_EQ(requests[0].amount, 10);
+
+    // lease request is in progress
+    ASSERT_FALSE(leases.take(rl, requests));
+    ASSERT_EQ(requests.size(), 1UL);
+
+    leases.on_lease_reply(requests[0], 10);
+    requests.clear();
+
+    vector<ResourceList> calls;
+    for (int i = 0; i < 10; i++) {
+        calls.emplace_back(rl);
+        ASSERT_TRUE(leases.take(calls.back(), requests));
+        ASSERT_TRUE(calls.back().front().leased);
+        ASSERT_FALSE(calls.back().back().taken);
+    }
+    ASSERT_TRUE(requests.empty());
+
+    // exhausted lease is extended
+    ResourceList next(rl);
+    ASSERT_FALSE(leases.take(next, requests));
+    ASSERT_FALSE(next.front().taken);
+    ASSERT_EQ(requests.size(), 1UL);
+    leases.on_lease_reply(requests[0], 0);
+    requests.clear();
+
+    leases.put(calls[0].front());
+    ASSERT_TRUE(leases.take(next, requests));
+
+    // limit is too low to lease
+    ResourceList low;
+    low.parse("0:474:10:1");
+    ASSERT_FALSE(leases.take(low, requests));
+    ASSERT_TRUE(requests.empty());
+
+    vector<ResourceLeases::request> returns;
+    for (auto &c : calls)
+        leases.put(c.front());
+    leases.put(next.front());
+    leases.collect_expired(time(nullptr) + 60, returns);
+    ASSERT_EQ(returns.size(), 1UL);
+    ASSERT_EQ(returns[0].amount, -10);
+
+    // stale grant after the invalidation
+    ASSERT_FALSE(leases.take(rl, requests));
+    ASSERT_EQ(requests.size(), 1UL);
+    leases.clear();
+    leases.on_lease_reply(requests[0], 10);
+    requests.clear();
+    ASSERT_FALSE(leases.take(rl, requests));
+}
+
+TEST_F(YetiTest, ResourceHandlersLogRecovery)
+{
+    char path[] = "/tmp/yeti_resources_log_XXXXXX";
+    int  fd     = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+
+    std::optional<ResourceHandlersLog::Units> recovered;
+    {
+        ResourceHandlersLog hlog;
+        ASSERT_EQ(hlog.open(path, 1, recovered), 0);
+        // empty file is not a log of the previous run
+        ASSERT_FALSE(recovered);
+
+        ResourceList rl;
+        rl.parse("0:472:10:2|0:473:10:1;1:474:10:1");
+        for (auto &r : rl)
+            r.taken = r.id != "473";
+
+        ResourceList leased;
+        leased.parse("0:475:1000:1");
+        leased.front().taken  = true;
+        leased.front().leased = true;
+
+        hlog.taken(1, rl);
+        hlog.taken(2, rl);
+        hlog.taken(3, leased);
+        hlog.add_units(leased.front(), 100);
+        hlog.released(1);
+        hlog.add_units(leased.front(), -40);
+    }
+
+    // partially written record of the crashed instance
+    std::ofstream(path, std::ios::app) << "P 2";
+
+    ResourceHandlersLog hlog;
+    ASSERT_EQ(hlog.open(path, 1, recovered), 0);
+    ASSERT_TRUE(recovered);
+
+    ResourceHandlersLog::Units expected{
+        { { 0, "472" }, 2 },
+        { { 1, "474" }, 1 },
+        { { 0, "475" }, 60 }
+    };
+    ASSERT_EQ(recovered.value(), expected);
+
+    // leftovers are kept in the compacted log until node counters are reset
+    {
+        ResourceHandlersLog other;
+        ASSERT_EQ(other.open(path, 1, recovered), 0);
+        ASSERT_EQ(recovered.value(), expected);
+    }
+
+    // log file is replaced by the other instance
+    ASSERT_EQ(hlog.open(path, 1, recovered), 0);
+    hlog.reset();
+    ASSERT_EQ(hlog.open(path, 1, recovered), 0);
+    ASSERT_TRUE(recovered->empty());
+
+    // log of the other node is ignored
+    ASSERT_EQ(hlog.open(path, 2, recovered), 0);
+    ASSERT_FALSE(recovered);
+
+    unlink(path);
+}
+
+TEST_F(YetiTest, ResourceHandlersLogCompaction)
+{
+    char path[] = "/tmp/yeti_resources_log_XXXXXX";
+    int  fd     = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+
+    std::optional<ResourceHandlersLog::Units> recovered;
+    {
+        ResourceHandlersLog hlog;
+        ASSERT_EQ(hlog.open(path, 1, recovered), 0);
+        hlog.start();
+
+        ResourceList rl;
+        rl.parse("0:472:10:1");
+        rl.front().taken = true;
+
+        // log is compacted by the log thread while records are appended
+        vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&hlog, &rl, t]() {
+                for (int i = 0; i < 20000; i++) {
+                    ResourceHandler h = t * 100000 + i + 1;
+                    hlog.taken(h, rl);
+                    if (i % 10)
+                        hlog.released(h);
+                    hlog.add_units(rl.front(), 1);
+                }
+            });
+        }
+        for (auto &t : threads)
+            t.join();
+
+        hlog.stop(true);
+    }
+
+    ResourceHandlersLog hlog;
+    ASSERT_EQ(hlog.open(path, 1, recovered), 0);
+    ASSERT_TRUE(recovered);
+
+    ResourceHandlersLog::Units expected{
+        { { 0, "472" }, 4 * 20000 + 4 * 2000 }
+    };
+    ASSERT_EQ(recovered.value(), expected);
+
+    unlink(path);
+}
+
+TEST_F(YetiTest, ResourceOperationsReducedPutsConfirmed)
+{
+    ResourceRedisConnection conn("resourceTestReduce");
+
+    vector<ResourceHandler> confirmed;
+    auto puts_confirmed_cb = [&confirmed](const vector<ResourceHandler> &released) {
+        confirmed.insert(confirmed.end(), released.begin(), released.end());
+    };
+
+    ResourceList get_rl, put_rl;
+    get_rl.parse("0:472:10:1");
+    get_rl.front().active = true;
+    put_rl.parse("0:472:10:1");
+    put_rl.front().taken = true;
+
+    // GET and PUT of the same units cancel out, so the batch is not posted
+    ResourcesOperationList rol;
+    rol.emplace_back("get_tag", std::move(get_rl), ResourcesOperation::RES_GET);
+    rol.emplace_back("put_tag", std::move(put_rl), ResourcesOperation::RES_PUT, 7);
+
+    ASSERT_FALSE(conn.operation(new ResourceRedisConnection::OperationRequest(rol, nullptr, puts_confirmed_cb)));
+    ASSERT_EQ(confirmed, vector<ResourceHandler>({ 7 }));
+}
+
 // this test works only with test_server
 /*
 TEST_F(YetiTest, ResourceTimeout)
@@ -0,0 +1,55 @@
+#include "YetiTest.h"
+#include "../src/SipHeadersIndex.h"
+
+TEST_F(YetiTest, SipHeadersIndexLookup)
+{
+    string hdrs("X-Yeti-Auth: secret\r\n"
+                "P-Asserted-Identity: <sip:100@example.com>\r\n"
+                "Diversion: <sip:200@example.com>\r\n"
+                "x-orig-ip: 192.168.0.1\r\n"
+                "DIVERSION: <sip:300@example.com>\r\n");
+
+    SipHeadersIndex index(hdrs);
+    ASSERT_TRUE(index.is_complete());
+    ASSERT_EQ(index.get_headers().size(), 5UL);
+
+    // case insensitive lookup of the first header
+    auto h = index.find("X-ORIG-IP");
+    ASSERT_TRUE(h);
+    ASSERT_EQ(index.name(*h), "x-orig-ip");
+    ASSERT_EQ(index.value(*h), "192.168.0.1");
+    ASSERT_FALSE(index.find("X-Orig"));
+    ASSERT_FALSE(index.find("Contact"));
+
+    // all values in the original order joined like getHeader() does
+    ASSERT_EQ(index.get("diversion"), "<sip:200@example.com>, <sip:300@example.com>");
+    ASSERT_EQ(index.get("x-yeti-auth"), "secret");
+    ASSERT_EQ(index.get("Contact"), "");
+
+    vector<string> values;
+    index.for_each("Diversion", [&](const auto &h) { values.emplace_back(index.value(h)); });
+    ASSERT_EQ(values, (vector<string>{ "<sip:200@example.com>", "<sip:300@example.com>" }));
+
+    // '-' and '_' are equal for the normalized lookup only
+    ASSERT_FALSE(index.find("x_orig_ip"));
+    h = index.find_normalized("x_orig_ip");
+    ASSERT_TRUE(h);
+    ASSERT_EQ(index.value(*h), "192.168.0.1");
+    ASSERT_FALSE(index.find_normalized("x_orig"));
+
+    // copy of the index for the copy of the headers block
+    string          hdrs_copy(hdrs);
+    SipHeadersIndex index_copy(index);
+    index_copy.rebind(hdrs_copy);
+    hdrs.clear();
+    ASSERT_EQ(index_copy.get("P-Asserted-Identity"), "<sip:100@example.com>");
+
+    // block of the same length with the other header names is reindexed
+    string other_hdrs(hdrs_copy);
+    auto   pos = other_hdrs.find("Diversion");
+    ASSERT_NE(pos, string::npos);
+    other_hdrs.replace(pos, 9, "Xiversion");
+    index_copy.rebind(other_hdrs);
+    ASSERT_EQ(index_copy.get("Diversion"), "<sip:300@example.com>");
+    ASSERT_EQ(index_copy.get("Xiversion"), "<sip:200@example.com>");
+}